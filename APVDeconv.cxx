@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::APVDeconv                                                     //
+//                                                                           //
+// Deconvolution of APV25 sample trains of nsamp samples taken delta_t       //
+// apart, assuming an ideal CR-RC shaper with time constant Tp.              //
+// From Kalyan Allada, NIM A326, 112 (1993)                                  //
+//                                                                           //
+// Each sample is combined with its two predecessors (every sample triplet), //
+// taking the signal as zero before the first sample. This turns a CR-RC     //
+// pulse v(t) = A*(t-t0)/Tp*exp(1-(t-t0)/Tp), t > t0, into at most two       //
+// non-zero deconvoluted samples d[i] = A*u*exp(x*(1-u)) and                 //
+// d[i+1] = A*(1-u)*exp(-x*u), where x = delta_t/Tp and u = i-t0/delta_t is  //
+// the distance of the start of the pulse from sample i, 0 < u <= 1.         //
+// The amplitude A and the peak time t0+Tp follow from the pair of           //
+// consecutive deconvoluted samples with the largest sum.                    //
+//                                                                           //
+// The weights are computed once in Init. Strips are processed in batches    //
+// of sample-major arrays.                                                   //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "APVDeconv.h"
+#include "TMath.h"
+
+#include <cassert>
+
+namespace TreeSearch {
+
+//_____________________________________________________________________________
+void APVDeconv::Init( UInt_t nsamp, Float_t delta_t, Float_t Tp )
+{
+  // Precompute deconvolution weights for nsamp samples with sampling
+  // interval delta_t and shaping time Tp (ns)
+  //
+  // Weight factors calculated based on the response of the silicon microstrip
+  // detector:
+  // v(t) = (delta_t/Tp)*exp(-delta_t/Tp)
+  // Need to update this for GEM detector response(?):
+  // v(t) = A*(1-exp(-(t-t0)/tau1))*exp(-(t-t0)/tau2)
+  // where A is the amplitude, t0 the begin of the rise, tau1 the time
+  // parameter for the rising edge and tau2 the for the falling edge.
+
+  assert( nsamp > 0 and delta_t > 0 and Tp > 0 );
+
+  fNsamp = nsamp;
+  fDt    = delta_t;
+  fTp    = Tp;
+  fX     = delta_t/Tp;
+  fExpX  = TMath::Exp(fX);
+  fW[0]  = TMath::Exp(fX-1)/fX;
+  fW[1]  = -2*TMath::Exp(-1)/fX;
+  fW[2]  = TMath::Exp(-fX-1)/fX;
+}
+
+//_____________________________________________________________________________
+void APVDeconv::Process( UInt_t n, Float_t* const* samp, Float_t* const* dec,
+			 Int_t* ipk, Float_t* integral, Float_t* ampl,
+			 Float_t* peak ) const
+{
+  // Deconvolute the sample trains of n strips. samp[i] and dec[i] point to
+  // the i-th (raw and deconvoluted, respectively) samples of the strips.
+  // Returns, for each strip, the integral of the deconvoluted samples,
+  // the amplitude of the pulse and its peak time (ns) with respect to
+  // the first sample. Amplitude and peak time are zero if no pulse is found.
+  // ipk is a work array of size n.
+
+  const Float_t w0 = fW[0], w1 = fW[1], w2 = fW[2];
+  for( UInt_t i = 0; i < fNsamp; ++i ) {
+    const Float_t* s = samp[i];
+    Float_t* d = dec[i];
+    if( i == 0 ) {
+      for( UInt_t k = 0; k < n; ++k )
+	d[k] = w0*s[k];
+    } else if( i == 1 ) {
+      const Float_t* s1 = samp[0];
+      for( UInt_t k = 0; k < n; ++k )
+	d[k] = w0*s[k] + w1*s1[k];
+    } else {
+      const Float_t* s1 = samp[i-1];
+      const Float_t* s2 = samp[i-2];
+      for( UInt_t k = 0; k < n; ++k )
+	d[k] = w0*s[k] + w1*s1[k] + w2*s2[k];
+    }
+  }
+
+  // Integral, and search for the pair of consecutive deconvoluted samples
+  // with the largest sum. ampl serves as temporary storage for the sums.
+  const Float_t* dn = ( fNsamp > 1 ) ? dec[1] : 0;
+  for( UInt_t k = 0; k < n; ++k ) {
+    integral[k] = dec[0][k];
+    ampl[k] = dec[0][k] + ( dn ? dn[k] : 0 );
+    ipk[k] = 0;
+  }
+  for( UInt_t i = 1; i < fNsamp; ++i ) {
+    const Float_t* d = dec[i];
+    dn = ( i+1 < fNsamp ) ? dec[i+1] : 0;
+    for( UInt_t k = 0; k < n; ++k ) {
+      integral[k] += d[k];
+      Float_t sum = d[k] + ( dn ? dn[k] : 0 );
+      bool better = ( sum > ampl[k] );
+      ampl[k] = better ? sum : ampl[k];
+      ipk[k]  = better ? i : ipk[k];
+    }
+  }
+  for( UInt_t k = 0; k < n; ++k )
+    integral[k] *= fDt;
+
+  // Amplitude and peak time from the best pair
+  for( UInt_t k = 0; k < n; ++k ) {
+    Int_t i = ipk[k];
+    Float_t d0 = dec[i][k];
+    Float_t d1 = ( i+1 < (Int_t)fNsamp ) ? dec[i+1][k] : 0;
+    if( d0 <= 0 and d1 > 0 ) {
+      // Pulse starts right at sample i (u = 1 for sample i+1)
+      ++i;
+      d0 = d1;
+      d1 = ( i+1 < (Int_t)fNsamp ) ? dec[i+1][k] : 0;
+    }
+    if( d0 <= 0 ) {
+      ampl[k] = peak[k] = 0;
+      continue;
+    }
+    Float_t r = ( d1 > 0 ) ? d1/d0 : 0;
+    Float_t u = 1.0/(1.0 + r*fExpX);
+    ampl[k] = d0*TMath::Exp(-fX*(1-u))/u;
+    peak[k] = (i-u)*fDt + fTp;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end namespace TreeSearch
@@ -0,0 +1,43 @@
+#ifndef ROOT_TreeSearch_APVDeconv
+#define ROOT_TreeSearch_APVDeconv
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::APVDeconv                                                     //
+//                                                                           //
+// Deconvolution of APV25 sample trains of nsamp samples taken delta_t       //
+// apart, assuming an ideal CR-RC shaper with time constant Tp.              //
+// From Kalyan Allada, NIM A326, 112 (1993)                                  //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Rtypes.h"
+
+namespace TreeSearch {
+
+  class APVDeconv {
+  public:
+    APVDeconv() : fNsamp(0), fDt(0), fTp(0), fX(0), fExpX(0)
+    { fW[0] = fW[1] = fW[2] = 0; }
+
+    void    Init( UInt_t nsamp, Float_t delta_t, Float_t Tp );
+    void    Process( UInt_t n, Float_t* const* samp, Float_t* const* dec,
+		     Int_t* ipk, Float_t* integral, Float_t* ampl,
+		     Float_t* peak ) const;
+
+    UInt_t  GetNsamp() const { return fNsamp; }
+    Float_t GetDt()    const { return fDt; }
+    Float_t GetTp()    const { return fTp; }
+
+  private:
+    UInt_t  fNsamp;  // Number of samples
+    Float_t fDt;     // Time interval between samples (ns)
+    Float_t fTp;     // Shaping time constant (ns)
+    Float_t fX;      // fDt/fTp
+    Float_t fExpX;   // exp(fX)
+    Float_t fW[3];   // Deconvolution weights
+  };
+
+} // end namespace TreeSearch
+
+#endif
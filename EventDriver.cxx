@@ -0,0 +1,325 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::EventDriver                                                   //
+//                                                                           //
+// Event-level parallel tracking. The driver owns nworkers-1 clones of a     //
+// prototype Tracker (see Tracker::MakeClone), which share the prototype's   //
+// pattern trees but have their own per-event state. Queued events are       //
+// processed in rounds of up to nworkers events, one per tracker, as tasks   //
+// in the shared ThreadPool. Since events finish in arbitrary order, the     //
+// results of each round are delivered to the Consumer only after the whole  //
+// round is done, in the order in which the events were queued.              //
+//                                                                           //
+// In pipelined mode (SetPipelined), the trackers form a ring buffer of      //
+// per-event decoded hit data. Events are decoded one at a time, in order,   //
+// into the next free tracker, while the previously decoded events are       //
+// being tracked concurrently. Decoding blocks when all trackers hold events //
+// not yet delivered (backpressure). Results are still delivered in input    //
+// order. The depth of the ring buffer is the number of workers, unless set  //
+// with SetPipelineDepth. A greater depth lets decoding run further ahead    //
+// of tracking, at the cost of one more tracker clone per additional slot.   //
+//                                                                           //
+// The event data objects must remain valid until their results have been    //
+// delivered. Each queued event must have its own THaEvData object.          //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "EventDriver.h"
+#include "Tracker.h"
+#include "ThreadPool.h"
+#include "THaEvData.h"
+#include "TClonesArray.h"
+#include "TSystem.h"
+#include "TMath.h"
+#include "TError.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <cassert>
+
+using namespace std;
+
+namespace TreeSearch {
+
+//_____________________________________________________________________________
+class EventDriver::EventTask : public ThreadPool::Task {
+  // Decode and/or track one event with one tracker
+public:
+  enum EStage { kAll, kDecode, kTrack };
+  EventTask( Tracker* tracker, TClonesArray* tracks )
+    : fTracker(tracker), fTracks(tracks), fEvdata(0), fStage(kAll),
+      fStatus(0) {}
+  void  SetEvent( const THaEvData* evdata ) { fEvdata = evdata; }
+  void  SetStage( EStage stage ) { fStage = stage; }
+  Int_t GetStatus() const { return fStatus; }
+  virtual Int_t Run()
+  {
+    assert( fEvdata );
+    try {
+      if( fStage != kTrack ) {
+	fTracker->Clear();
+	fTracks->Clear("C");
+	fStatus = fTracker->Decode( *fEvdata );
+      }
+      if( fStage != kDecode and fStatus >= 0 ) {
+	fStatus = fTracker->CoarseTrack( *fTracks );
+	if( fStatus >= 0 )
+	  fStatus = fTracker->FineTrack( *fTracks );
+      }
+    }
+    // Exceptions must not escape into the thread pool
+    catch( exception& e ) {
+      ::Error( "EventDriver", "Caught %s while tracking event with \"%s\"",
+	       e.what(), fTracker->GetName() );
+      fStatus = -1;
+    }
+    return fStatus;
+  }
+private:
+  Tracker*          fTracker;
+  TClonesArray*     fTracks;
+  const THaEvData*  fEvdata;
+  EStage            fStage;
+  Int_t             fStatus;
+};
+
+//_____________________________________________________________________________
+EventDriver::EventDriver( Tracker* prototype, UInt_t nworkers )
+  : fPrototype(prototype), fNworkers(nworkers > 0 ? nworkers : 1),
+    fDepth(0), fNdone(0), fPool(0), fPipelined(false)
+{
+  // Constructor. Events will be processed by the (initialized) prototype
+  // tracker plus nworkers-1 clones of it, created in Init().
+
+  assert( prototype );
+}
+
+//_____________________________________________________________________________
+EventDriver::~EventDriver()
+{
+  // Destructor
+
+  Clear();
+}
+
+//_____________________________________________________________________________
+void EventDriver::Clear()
+{
+  // Delete clones, track arrays and tasks. Release the thread pool.
+  // The timing statistics of the clones are added to the prototype's.
+
+  for( vector<EventTask*>::size_type i = 0; i < fTasks.size(); ++i )
+    delete fTasks[i];
+  for( vector<TClonesArray*>::size_type i = 0; i < fTracks.size(); ++i )
+    delete fTracks[i];
+  // The first tracker is the prototype, which we do not own
+  for( vector<Tracker*>::size_type i = 1; i < fTrackers.size(); ++i ) {
+    if( fTrackers[i]->IsInit() )
+      fPrototype->AddStageStats( *fTrackers[i] );
+    delete fTrackers[i];
+  }
+  fTasks.clear();
+  fTracks.clear();
+  fTrackers.clear();
+  if( fPool ) {
+    ThreadPool::Release();
+    fPool = 0;
+  }
+}
+
+//_____________________________________________________________________________
+Int_t EventDriver::Init( const TDatime& date )
+{
+  // Create and initialize the tracker clones, one per worker, or as many
+  // as the pipeline depth requires, if greater. The prototype must already
+  // be initialized. Returns 0 on success.
+
+  static const char* const here = "EventDriver::Init";
+
+  Clear();
+  if( !fPrototype->IsInit() ) {
+    ::Error( here, "Prototype tracker \"%s\" not initialized",
+	     fPrototype->GetName() );
+    return -1;
+  }
+  UInt_t ntrackers = TMath::Max( fNworkers, GetPipelineDepth() );
+  fTrackers.push_back( fPrototype );
+  for( UInt_t i = 1; i < ntrackers; ++i ) {
+    Tracker* clone = fPrototype->MakeClone();
+    if( !clone ) {
+      Clear();
+      return -1;
+    }
+    fTrackers.push_back( clone );
+    if( clone->Init(date) != THaAnalysisObject::kOK ) {
+      ::Error( here, "Error initializing clone %u of tracker \"%s\"",
+	       i, fPrototype->GetName() );
+      Clear();
+      return -1;
+    }
+  }
+  for( UInt_t i = 0; i < ntrackers; ++i ) {
+    TClonesArray* tracks = new TClonesArray( "THaTrack", 10 );
+    fTracks.push_back( tracks );
+    fTasks.push_back( new EventTask(fTrackers[i], tracks) );
+  }
+  if( fNworkers > 1 ) {
+    if( gSystem->Load("libThread") >= 0 )
+      fPool = ThreadPool::Acquire( fNworkers );
+    else
+      ::Warning( here, "Error loading thread library. Events will be "
+		 "processed sequentially." );
+  }
+  return 0;
+}
+
+//_____________________________________________________________________________
+void EventDriver::Push( const THaEvData* evdata )
+{
+  // Queue an event for processing
+
+  assert( evdata );
+  fQueue.push_back( evdata );
+}
+
+//_____________________________________________________________________________
+UInt_t EventDriver::Process( Consumer& consumer )
+{
+  // Track all queued events and deliver the results to 'consumer' in
+  // queue order. Returns the number of events processed.
+
+  if( fTasks.empty() ) {
+    ::Error( "EventDriver::Process", "Not initialized" );
+    return 0;
+  }
+  if( fPipelined and fPool )
+    return ProcessPipelined( consumer );
+
+  return ProcessRounds( consumer );
+}
+
+//_____________________________________________________________________________
+UInt_t EventDriver::ProcessRounds( Consumer& consumer )
+{
+  // Process queued events in rounds of up to GetNworkers() events each
+
+  UInt_t nproc = 0;
+  while( !fQueue.empty() ) {
+    UInt_t n = TMath::Min( (UInt_t)fQueue.size(), fNworkers );
+    if( fPool ) {
+      ThreadPool::TaskGroup group;
+      for( UInt_t k = 0; k < n; ++k ) {
+	fTasks[k]->SetEvent( fQueue[k] );
+	fTasks[k]->SetStage( EventTask::kAll );
+	fPool->Submit( fTasks[k], group );
+      }
+      fPool->Wait( group );
+    } else {
+      for( UInt_t k = 0; k < n; ++k ) {
+	fTasks[k]->SetEvent( fQueue[k] );
+	fTasks[k]->SetStage( EventTask::kAll );
+	fTasks[k]->Run();
+      }
+    }
+    // Deliver the results of this round in input order
+    for( UInt_t k = 0; k < n; ++k ) {
+      consumer.Deliver( fNdone, fQueue.front(), fTrackers[k], fTracks[k],
+			fTasks[k]->GetStatus() );
+      fQueue.pop_front();
+      ++fNdone;
+    }
+    nproc += n;
+  }
+  return nproc;
+}
+
+//_____________________________________________________________________________
+UInt_t EventDriver::ProcessPipelined( Consumer& consumer )
+{
+  // Process queued events in a decode -> track pipeline. The trackers are
+  // used round-robin as a ring buffer: slot 'head' holds the oldest event
+  // not yet delivered, 'nused' slots are in use, holding the events
+  // fQueue[0...nused-1].
+  //
+  // The calling thread is the decode stage: it decodes the events in order,
+  // each into the slot following the newest event, while the pool threads
+  // track the events decoded earlier. If the ring is full, it waits for
+  // the tracking of the oldest event, which is then delivered to free
+  // its slot.
+
+  // The depth may have been raised after Init(), so limit it to the
+  // number of trackers
+  const UInt_t nslots = TMath::Min( GetPipelineDepth(),
+				    (UInt_t)fTasks.size() );
+  vector<ThreadPool::TaskGroup> track_group( nslots );
+  UInt_t head = 0, nused = 0, nqueued = fQueue.size(), nproc = 0;
+
+  while( nproc < nqueued ) {
+    if( nproc+nused < nqueued ) {
+      if( nused < nslots ) {
+	// Sample the occupancies of the tracking and delivery stages
+	UInt_t ntrk = 0, nwait = 0;
+	for( UInt_t i = 0; i < nused; ++i ) {
+	  if( track_group[(head+i) % nslots].IsDone() )
+	    ++nwait;
+	  else
+	    ++ntrk;
+	}
+	++fStats.nsteps;
+	fStats.sum_tracking += ntrk;
+	fStats.sum_waiting  += nwait;
+	if( ntrk == 0 )
+	  ++fStats.nstarved;  // Tracking stage idle during this decode
+
+	// Decode the next event into the next free slot
+	UInt_t slot = (head+nused) % nslots;
+	fTasks[slot]->SetEvent( fQueue[nused] );
+	fTasks[slot]->SetStage( EventTask::kDecode );
+	fTasks[slot]->Run();
+	++nused;
+
+	// Hand the event over to the tracking stage
+	if( fTasks[slot]->GetStatus() >= 0 ) {
+	  fTasks[slot]->SetStage( EventTask::kTrack );
+	  fPool->Submit( fTasks[slot], track_group[slot] );
+	}
+	// Deliver finished events right away, if possible, else keep
+	// feeding the pipeline
+	if( !track_group[head].IsDone() )
+	  continue;
+      } else
+	++fStats.nstalls;   // Ring buffer full, decoding must wait
+    }
+    // Deliver the oldest event once its tracking is done
+    fPool->Wait( track_group[head] );
+    consumer.Deliver( fNdone, fQueue.front(), fTrackers[head], fTracks[head],
+		      fTasks[head]->GetStatus() );
+    fQueue.pop_front();
+    ++fNdone;
+    ++nproc;
+    ++fStats.nevents;
+    head = (head+1) % nslots;
+    --nused;
+  }
+  return nproc;
+}
+
+//_____________________________________________________________________________
+void EventDriver::PrintPipelineStats() const
+{
+  // Print pipeline statistics
+
+  cout << "EventDriver pipeline: " << fStats.nevents << " events, "
+       << TMath::Min(GetPipelineDepth(), (UInt_t)fTasks.size())
+       << " slots, " << GetNworkers() << " workers" << endl
+       << "  avg events being tracked         = "
+       << fStats.GetAvgTracking() << endl
+       << "  avg events awaiting delivery     = "
+       << fStats.GetAvgWaiting() << endl
+       << "  decode stalls (ring buffer full) = " << fStats.nstalls << endl
+       << "  decodes with idle tracking stage = " << fStats.nstarved << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end namespace TreeSearch
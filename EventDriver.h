@@ -0,0 +1,105 @@
+#ifndef ROOT_TreeSearch_EventDriver
+#define ROOT_TreeSearch_EventDriver
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::EventDriver                                                   //
+//                                                                           //
+// Tracks a queue of events concurrently with a set of Tracker clones and    //
+// delivers the results in input order. Optionally pipelined, overlapping    //
+// the decoding of the next event with the tracking of previous ones.        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Rtypes.h"
+#include <vector>
+#include <deque>
+
+class THaEvData;
+class TClonesArray;
+class TDatime;
+
+namespace TreeSearch {
+
+  class Tracker;
+  class ThreadPool;
+
+  class EventDriver {
+  public:
+    // Receiver of tracking results. Deliver() is called from the thread
+    // calling Process(), once per event, in the order the events were queued.
+    // 'tracks' and the state of 'tracker' are valid only during the call.
+    class Consumer {
+    public:
+      virtual ~Consumer() {}
+      virtual void Deliver( ULong64_t seq, const THaEvData* evdata,
+			    Tracker* tracker, TClonesArray* tracks,
+			    Int_t status ) = 0;
+    };
+
+    // Pipeline statistics. Occupancies are averaged over all pipeline
+    // steps (decode launches and deliveries).
+    struct PipelineStats_t {
+      ULong64_t nevents;       // Events processed in pipelined mode
+      ULong64_t nsteps;        // Number of samples of occupancies
+      ULong64_t nstalls;       // Decoding blocked by full ring buffer
+      ULong64_t nstarved;      // Tracking stage waited for decoding
+      Double_t  sum_tracking;  // Sum of # events being tracked
+      Double_t  sum_waiting;   // Sum of # tracked events awaiting delivery
+      PipelineStats_t() : nevents(0), nsteps(0), nstalls(0), nstarved(0),
+			  sum_tracking(0), sum_waiting(0) {}
+      Double_t  GetAvgTracking() const
+      { return nsteps ? sum_tracking/nsteps : 0; }
+      Double_t  GetAvgWaiting()  const
+      { return nsteps ? sum_waiting/nsteps : 0; }
+    };
+
+    EventDriver( Tracker* prototype, UInt_t nworkers );
+    virtual ~EventDriver();
+
+    Int_t     Init( const TDatime& date );
+    void      Push( const THaEvData* evdata );
+    UInt_t    Process( Consumer& consumer );
+
+    void      SetPipelined( Bool_t enable = true ) { fPipelined = enable; }
+    // Number of events in flight in pipelined mode (decoded, being tracked
+    // or awaiting delivery), i.e. the number of trackers in the ring
+    // buffer. 0 = number of workers (default). Must be set before Init().
+    void      SetPipelineDepth( UInt_t depth ) { fDepth = depth; }
+    Bool_t    IsPipelined() const { return fPipelined; }
+    UInt_t    GetNworkers() const { return fNworkers; }
+    UInt_t    GetPipelineDepth() const { return fDepth ? fDepth : fNworkers; }
+    UInt_t    GetNqueued()  const { return fQueue.size(); }
+    ULong64_t GetNdone()    const { return fNdone; }
+    const PipelineStats_t& GetPipelineStats() const { return fStats; }
+    void      PrintPipelineStats() const;
+
+  protected:
+    class EventTask;  // Defined in implementation
+
+    Tracker*                      fPrototype; // Tracker to clone (not owned)
+    UInt_t                        fNworkers;  // Requested number of workers
+    UInt_t                        fDepth;     // Pipeline depth (0 = fNworkers)
+    std::vector<Tracker*>         fTrackers;  // Prototype+clones, at least
+                                              // fNworkers and the depth
+    std::vector<TClonesArray*>    fTracks;    // Track arrays, per tracker
+    std::vector<EventTask*>       fTasks;     // Event tasks, per tracker
+    std::deque<const THaEvData*>  fQueue;     // Events waiting to be tracked
+    ULong64_t                     fNdone;     // Number of events delivered
+    ThreadPool*                   fPool;      // Thread pool (shared)
+    Bool_t                        fPipelined; // Use pipelined processing
+    PipelineStats_t               fStats;     // Pipeline statistics
+
+    void      Clear();
+    UInt_t    ProcessRounds( Consumer& consumer );
+    UInt_t    ProcessPipelined( Consumer& consumer );
+
+  private:
+    // Copying is not supported
+    EventDriver( const EventDriver& );
+    EventDriver& operator=( const EventDriver& );
+  };
+
+} // end namespace TreeSearch
+
+#endif
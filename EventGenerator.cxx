@@ -0,0 +1,254 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::EventGenerator                                                //
+//                                                                           //
+// Generates synthetic events for an initialized Tracker, without raw data   //
+// or decoders. The geometry, resolutions, drift time-to-distance            //
+// conversion and thresholds come from the Tracker's database.               //
+//                                                                           //
+// Each event consists of                                                    //
+//  - SetNtracks() straight tracks, uniformly distributed over the first     //
+//    plane and in slope, within the acceptance (all planes) and the         //
+//    maxslope of each projection,                                           //
+//  - on average SetNoise() hits per plane, uniformly distributed,           //
+//  - optionally a burst of hits (SetBursts), spread about a common line     //
+//    through all planes, as from a shower or a discharge.                   //
+//                                                                           //
+// Hits are made by each plane's detector response model (AddSimHit), e.g.   //
+// the inverse drift time-to-distance conversion for wire planes and a       //
+// cluster charge model for GEM planes. Init() switches all planes to        //
+// external hit input, so they ignore the raw event data when decoding.      //
+//                                                                           //
+// Usage:                                                                    //
+//                                                                           //
+//   EventGenerator gen( tracker );  // tracker must be initialized          //
+//   gen.SetNoise( 4 );                                                      //
+//   gen.Init();                                                             //
+//   for( ... ) {                                                            //
+//     tracker->Clear();                                                     //
+//     gen.Generate();                                                       //
+//     tracker->DecodeHits( ievt );  // finalizes hits, fills hitpatterns    //
+//     tracker->CoarseTrack( tracks );                                       //
+//     ...                                                                   //
+//   }                                                                       //
+//                                                                           //
+// Alternatively, Decode() can be called with any THaEvData object, whose    //
+// raw data are ignored. The tracker must outlive the generator. Monte       //
+// Carlo mode is not supported.                                              //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "EventGenerator.h"
+#include "Tracker.h"
+#include "Projection.h"
+#include "Plane.h"
+#include "TMath.h"
+#include "TError.h"
+
+#include <cassert>
+
+using namespace std;
+
+namespace TreeSearch {
+
+// Maximum number of attempts to draw a track within the acceptance
+static const UInt_t kMaxTries = 1000;
+
+typedef vector<Plane*>::size_type vplsiz_t;
+
+//_____________________________________________________________________________
+EventGenerator::EventGenerator( Tracker* tracker, UInt_t seed )
+  : fTracker(tracker), fRandom(seed), fIsInit(false), fNtracks(1),
+    fEfficiency(1.0), fNoise(0), fBurstProb(0), fBurstHits(0),
+    fBurstWidth(0), fNhits(0)
+{
+  // Constructor
+
+  assert( tracker );
+}
+
+//_____________________________________________________________________________
+EventGenerator::~EventGenerator()
+{
+  // Destructor. Returns the planes to normal decoding.
+
+  for( vplsiz_t i = 0; i < fPlanes.size(); ++i )
+    fPlanes[i]->SetExtInput( false );
+}
+
+//_____________________________________________________________________________
+Int_t EventGenerator::Init()
+{
+  // Set up generation for the current configuration of the tracker, which
+  // must be initialized. Returns 0 on success.
+
+  static const char* const here = "EventGenerator::Init";
+
+  fIsInit = false;
+  fPlanes.clear();
+  if( !fTracker->IsInit() ) {
+    ::Error( here, "Tracker \"%s\" not initialized", fTracker->GetName() );
+    return -1;
+  }
+#ifdef MCDATA
+  if( fTracker->TestBit(Tracker::kMCdata) ) {
+    ::Error( here, "Tracker \"%s\" is set up for Monte Carlo data, which "
+	     "is not supported", fTracker->GetName() );
+    return -2;
+  }
+#endif
+  // The Tracker keeps its planes sorted by z
+  for( UInt_t i = 0; i < fTracker->GetNplanes(); ++i ) {
+    Plane* pl = fTracker->GetPlane(i);
+    assert( pl->GetProjection() );
+    pl->SetExtInput();
+    fPlanes.push_back( pl );
+  }
+  if( fPlanes.size() < 2 ) {
+    ::Error( here, "Tracker \"%s\" has too few planes", fTracker->GetName() );
+    return -3;
+  }
+  fIsInit = true;
+  return 0;
+}
+
+//_____________________________________________________________________________
+Int_t EventGenerator::Generate()
+{
+  // Generate the hits of one event in the tracker's planes, which must
+  // have been cleared. Returns the number of hits, or -1 if not initialized.
+
+  if( !fIsInit ) {
+    ::Error( "EventGenerator::Generate", "Not initialized" );
+    return -1;
+  }
+  fTracks.clear();
+  fNhits = 0;
+  for( UInt_t i = 0; i < fNtracks; ++i ) {
+    Track_t track;
+    if( MakeTrack(track) ) {
+      fTracks.push_back( track );
+      fNhits += AddTrackHits( track, fEfficiency );
+    }
+  }
+  if( fNoise > 0 )
+    fNhits += AddNoiseHits();
+  if( fBurstProb > 0 and fRandom.Rndm() < fBurstProb )
+    fNhits += AddBurstHits();
+
+  return fNhits;
+}
+
+//_____________________________________________________________________________
+Bool_t EventGenerator::MakeTrack( Track_t& track )
+{
+  // Draw a random track that crosses all planes within their active area
+  // and whose slope in each projection is within the projection's maxslope.
+  // Returns false if no such track was found after kMaxTries attempts.
+
+  Plane* front = fPlanes.front();
+  Double_t zf = front->GetZ(), zb = fPlanes.back()->GetZ();
+  Double_t xf = front->GetOrigin().X(), dx = 0.5*front->GetXSize();
+  Double_t yf = front->GetOrigin().Y(), dy = 0.5*front->GetYSize();
+  Double_t smax = 0;
+  for( vplsiz_t i = 0; i < fPlanes.size(); ++i )
+    smax = TMath::Max( smax, fPlanes[i]->GetProjection()->GetMaxSlope() );
+  // No point in slopes leading out of the acceptance of the last plane
+  if( zb > zf )
+    smax = TMath::Min( smax, 2.*TMath::Max(dx,dy)/(zb-zf) );
+
+  for( UInt_t itry = 0; itry < kMaxTries; ++itry ) {
+    track.xp = fRandom.Uniform( -smax, smax );
+    track.yp = fRandom.Uniform( -smax, smax );
+    track.x  = fRandom.Uniform( xf-dx, xf+dx ) - track.xp*zf;
+    track.y  = fRandom.Uniform( yf-dy, yf+dy ) - track.yp*zf;
+    bool good = true;
+    for( vplsiz_t i = 0; good and i < fPlanes.size(); ++i ) {
+      Plane* pl = fPlanes[i];
+      Projection* proj = pl->GetProjection();
+      Double_t z = pl->GetZ();
+      Double_t slope = track.xp*proj->GetCosAngle() +
+	track.yp*proj->GetSinAngle();
+      good = ( TMath::Abs(slope) <= proj->GetMaxSlope() and
+	       pl->Contains( track.x + track.xp*z, track.y + track.yp*z ) );
+    }
+    if( good )
+      return true;
+  }
+  return false;
+}
+
+//_____________________________________________________________________________
+UInt_t EventGenerator::AddTrackHits( const Track_t& track, Double_t eff )
+{
+  // Add the hits of the given track in all planes, each with probability
+  // eff. Returns the number of hits made.
+
+  UInt_t nhits = 0;
+  for( vplsiz_t i = 0; i < fPlanes.size(); ++i ) {
+    if( eff < 1.0 and fRandom.Rndm() >= eff )
+      continue;
+    Plane* pl = fPlanes[i];
+    Projection* proj = pl->GetProjection();
+    Double_t z = pl->GetZ();
+    Double_t pos = (track.x + track.xp*z) * proj->GetCosAngle() +
+      (track.y + track.yp*z) * proj->GetSinAngle();
+    Double_t slope = track.xp*proj->GetCosAngle() +
+      track.yp*proj->GetSinAngle();
+    if( pl->AddSimHit(pos, slope, fRandom) )
+      ++nhits;
+  }
+  return nhits;
+}
+
+//_____________________________________________________________________________
+UInt_t EventGenerator::AddNoiseHits()
+{
+  // Add on average fNoise uniformly distributed hits to each plane.
+  // Returns the number of hits made.
+
+  UInt_t nhits = 0;
+  for( vplsiz_t i = 0; i < fPlanes.size(); ++i ) {
+    Plane* pl = fPlanes[i];
+    Double_t lo = pl->GetStart() - 0.5*pl->GetPitch();
+    Double_t hi = lo + pl->GetNelem()*pl->GetPitch();
+    Int_t n = fRandom.Poisson( fNoise );
+    for( Int_t k = 0; k < n; ++k ) {
+      if( pl->AddSimHit(fRandom.Uniform(lo, hi), 0.0, fRandom) )
+	++nhits;
+    }
+  }
+  return nhits;
+}
+
+//_____________________________________________________________________________
+UInt_t EventGenerator::AddBurstHits()
+{
+  // Add on average fBurstHits hits to each plane, spread by fBurstWidth
+  // about a random line through the detector. Returns the number of hits
+  // made.
+
+  Track_t center;
+  if( !MakeTrack(center) )
+    return 0;
+  UInt_t nhits = 0;
+  for( vplsiz_t i = 0; i < fPlanes.size(); ++i ) {
+    Plane* pl = fPlanes[i];
+    Projection* proj = pl->GetProjection();
+    Double_t z = pl->GetZ();
+    Double_t pos = (center.x + center.xp*z) * proj->GetCosAngle() +
+      (center.y + center.yp*z) * proj->GetSinAngle();
+    Double_t slope = center.xp*proj->GetCosAngle() +
+      center.yp*proj->GetSinAngle();
+    Int_t n = fRandom.Poisson( fBurstHits );
+    for( Int_t k = 0; k < n; ++k ) {
+      if( pl->AddSimHit(pos + fRandom.Gaus(0, fBurstWidth), slope, fRandom) )
+	++nhits;
+    }
+  }
+  return nhits;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end namespace TreeSearch
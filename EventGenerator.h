@@ -0,0 +1,79 @@
+#ifndef ROOT_TreeSearch_EventGenerator
+#define ROOT_TreeSearch_EventGenerator
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::EventGenerator                                                //
+//                                                                           //
+// Synthetic events for benchmarks and tests: straight tracks plus noise     //
+// and correlated bursts of hits, generated directly into the planes of an   //
+// initialized Tracker.                                                      //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Rtypes.h"
+#include "TRandom3.h"
+#include <vector>
+
+namespace TreeSearch {
+
+  class Tracker;
+  class Plane;
+
+  class EventGenerator {
+  public:
+    // Parameters of a generated track in the Tracker frame at z = 0
+    struct Track_t {
+      Double_t x, y;    // Position (m)
+      Double_t xp, yp;  // Slopes dx/dz, dy/dz
+    };
+
+    EventGenerator( Tracker* tracker, UInt_t seed = 4357 );
+    virtual ~EventGenerator();
+
+    Int_t     Init();
+    Int_t     Generate();
+
+    // Mean number of noise hits per plane and event
+    void      SetNoise( Double_t nhits ) { fNoise = nhits; }
+    // Bursts of hits around a common line, with probability 'prob' per
+    // event, 'nhits' mean hits per plane and a spread of 'width' (m)
+    void      SetBursts( Double_t prob, Double_t nhits, Double_t width )
+    { fBurstProb = prob; fBurstHits = nhits; fBurstWidth = width; }
+    void      SetEfficiency( Double_t eff ) { fEfficiency = eff; }
+    void      SetNtracks( UInt_t n ) { fNtracks = n; }
+    void      SetSeed( UInt_t seed ) { fRandom.SetSeed(seed); }
+
+    Tracker*  GetTracker()  const { return fTracker; }
+    TRandom&  GetRandom()         { return fRandom; }
+    UInt_t    GetNhits()    const { return fNhits; }
+    const std::vector<Track_t>& GetTracks() const { return fTracks; }
+
+  private:
+    Tracker*  fTracker;     // Tracker whose planes receive the hits
+    TRandom3  fRandom;      // Random number generator
+    Bool_t    fIsInit;      // Init() succeeded
+    UInt_t    fNtracks;     // Number of tracks per event
+    Double_t  fEfficiency;  // Probability of a track to make a hit in a plane
+    Double_t  fNoise;       // Mean number of noise hits per plane
+    Double_t  fBurstProb;   // Probability of a burst per event
+    Double_t  fBurstHits;   // Mean number of hits per plane in a burst
+    Double_t  fBurstWidth;  // Spread of burst hits about their center (m)
+
+    std::vector<Plane*>   fPlanes;  // Planes of fTracker, sorted by z
+    std::vector<Track_t>  fTracks;  // Tracks of the last event
+    UInt_t    fNhits;       // Number of hits made in the last event
+
+    Bool_t    MakeTrack( Track_t& track );
+    UInt_t    AddTrackHits( const Track_t& track, Double_t eff );
+    UInt_t    AddNoiseHits();
+    UInt_t    AddBurstHits();
+
+    // Prevent copying
+    EventGenerator( const EventGenerator& );
+    EventGenerator& operator=( const EventGenerator& );
+  };
+
+} // end namespace TreeSearch
+
+#endif
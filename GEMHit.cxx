@@ -26,7 +26,8 @@ void GEMHit::Print( Option_t* opt ) const
 
   Hit::Print("C");
   cout << " size="  << GetSize()
-       << " type="  << GetType();
+       << " type="  << GetType()
+       << " time="  << GetTime();
   if( *opt != 'C' )
     cout << endl;
 }
@@ -22,23 +22,26 @@ namespace TreeSearch {
   public:
     GEMHit() {}
     GEMHit( Double_t pos, Double_t adc_sum, UInt_t num_strips, Int_t type,
-	    Double_t res, GEMPlane* pl ) :
+	    Double_t res, GEMPlane* pl, Double_t time = 0.0 ) :
       Hit(pos, res, static_cast<Plane*>(pl)), fADCsum(adc_sum),
-      fSize(num_strips), fType(type) {}
+      fSize(num_strips), fType(type), fTime(time) {}
     virtual ~GEMHit() {}
 
     virtual void Print( Option_t* opt="" ) const;
+    virtual Double_t GetInputData() const { return fADCsum; }
 
     Double_t GetADCsum()     const { return fADCsum; }
     UInt_t   GetSize()       const { return fSize; }
     Int_t    GetType()       const { return fType; }
+    Double_t GetTime()       const { return fTime; }
 
   protected:
     Double_t fADCsum;      // Sum of ADC values of active strips
     UInt_t   fSize;        // Number of active strips
     Int_t    fType;        // Result code of cluster analysis
+    Double_t fTime;        // Amplitude-weighted leading-edge time (ns)
 
-    ClassDef(GEMHit,1)     // Hit on an ADC-based readout plane, e.g. GEMs
+    ClassDef(GEMHit,2)     // Hit on an ADC-based readout plane, e.g. GEMs
   };
 
 #ifdef MCDATA
@@ -51,14 +54,14 @@ namespace TreeSearch {
     MCGEMHit() {}
     MCGEMHit( Double_t pos, Double_t adc_sum, UInt_t num_strips, Int_t type,
 	      Double_t res, GEMPlane* pl, Int_t mctrk, Double_t mcpos,
-	      Double_t mctime, Int_t num_bg_strips )
-      : GEMHit(pos, adc_sum, num_strips, type, res, pl),
+	      Double_t mctime, Int_t num_bg_strips, Double_t time = 0.0 )
+      : GEMHit(pos, adc_sum, num_strips, type, res, pl, time),
 	MCHitInfo(mctrk, mcpos, mctime, num_bg_strips) {}
     virtual ~MCGEMHit() {}
 
     virtual void Print( Option_t* opt="" ) const;
 
-    ClassDef(MCGEMHit,2)   // Monte Carlo hit in ADC-based readout plane
+    ClassDef(MCGEMHit,3)   // Monte Carlo hit in ADC-based readout plane
   };
 #endif // MCDATA
 
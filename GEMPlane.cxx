@@ -13,12 +13,14 @@
 #include "GEMHit.h"
 #include "GEMTracker.h"
 #include "Projection.h"
+#include "APVDeconv.h"
 
 #include "THaDetMap.h"
 #include "TClonesArray.h"
 #include "TH1.h"
 #include "TError.h"
 #include "TString.h"
+#include "TRandom.h"
 
 #ifndef MCDATA
 #include "THaEvData.h"
@@ -38,27 +40,115 @@ using namespace Podd;
 
 namespace TreeSearch {
 
-struct StripData_t {
-  Float_t adcraw;
-  Float_t adc;
-  Float_t time;
-  Bool_t  pass;
-  StripData_t() {}
-  StripData_t( Float_t _raw, Float_t _adc, Float_t _time, Bool_t _pass )
-    : adcraw(_raw), adc(_adc), time(_time), pass(_pass) {}
+//_____________________________________________________________________________
+// Per-event strip data of a GEMPlane, stored as a structure of arrays. The
+// per-strip computations in GEMDecode (integration, deconvolution, pulse
+// shape test, pedestal subtraction) are simple loops over contiguous
+// arrays that the compiler can vectorize. The arrays are allocated once,
+// for the maximum number of strips, and reused for every event.
+class StripBatch {
+public:
+  StripBatch( UInt_t nstrips, UInt_t napv, UInt_t nsamp );
+
+  UInt_t          n;       // Number of strips with data in this event
+  UInt_t          cap;     // Maximum number of strips
+  UInt_t          nsamp;   // Number of samples analyzed per strip
+  UInt_t          nsingle; // Number of strips with only one sample
+  APVDeconv       deconv;  // Deconvolution engine
+  vector<Float_t> samp;    // [nsamp][cap] ADC samples, sample-major
+  vector<Float_t> dec;     // [nsamp][cap] Deconvoluted samples
+  vector<Float_t*> row;    // [nsamp] Pointers to sample rows
+  vector<Float_t*> drow;   // [nsamp] Pointers to deconvoluted sample rows
+  vector<Int_t>   strip;   // [cap] Strip number
+  vector<Int_t>   apv;     // [cap] APV number
+  vector<Int_t>   nhit;    // [cap] Number of samples read
+  vector<Int_t>   imod;    // [cap] Index of detector map module
+  vector<Int_t>   chan;    // [cap] Hardware channel
+  vector<Int_t>   ipk;     // [cap] Work space for deconvolution
+  vector<Float_t> ped;     // [cap] Pedestal
+  vector<Float_t> adcraw;  // [cap] Integral of raw samples
+  vector<Float_t> adc;     // [cap] Integral of deconvoluted samples
+  vector<Float_t> ampl;    // [cap] Amplitude of deconvoluted pulse
+  vector<Float_t> time;    // [cap] Peak time of deconvoluted pulse (ns)
+  vector<Float_t> adccor;  // [cap] adc corrected for pedestal & noise
+  vector<Byte_t>  pass;    // [cap] Pulse shape test result
+  vector<Double_t> cm_sum; // [napv] Sum of ADCs below threshold
+  vector<UInt_t>  cm_n;    // [napv] Number of ADCs below threshold
+  vector<Float_t> cm;      // [napv] Common-mode correction
 };
 
+//_____________________________________________________________________________
+StripBatch::StripBatch( UInt_t nstrips, UInt_t napv, UInt_t ns )
+  : n(0), cap(nstrips), nsamp(ns), nsingle(0), samp(ns*nstrips),
+    dec(ns*nstrips), row(ns), drow(ns), strip(nstrips), apv(nstrips),
+    nhit(nstrips), imod(nstrips), chan(nstrips), ipk(nstrips),
+    ped(nstrips), adcraw(nstrips), adc(nstrips), ampl(nstrips),
+    time(nstrips), adccor(nstrips), pass(nstrips), cm_sum(napv),
+    cm_n(napv), cm(napv)
+{
+  // Constructor
+
+  assert( ns > 0 );
+  for( UInt_t i = 0; i < ns; ++i ) {
+    row[i]  = &samp[i*cap];
+    drow[i] = &dec[i*cap];
+  }
+}
+
+//_____________________________________________________________________________
+static void IntegrateSamples( UInt_t n, UInt_t nsamp, Float_t dt,
+			      const Float_t* const* samp, Float_t* adcraw )
+{
+  // Integral of the raw samples of n strips
+
+  for( UInt_t k = 0; k < n; ++k )
+    adcraw[k] = 0;
+  for( UInt_t i = 0; i < nsamp; ++i ) {
+    const Float_t* s = samp[i];
+    for( UInt_t k = 0; k < n; ++k )
+      adcraw[k] += s[k];
+  }
+  for( UInt_t k = 0; k < n; ++k )
+    adcraw[k] *= dt;
+}
+
+//_____________________________________________________________________________
+static void CheckPulseShape( UInt_t n, const Float_t* s0, const Float_t* s1,
+			     const Float_t* s2, Byte_t* pass )
+{
+  // Check for bad signals: the first three samples must be positive and
+  // rising. Same as requiring ratios s0/s2 < s1/s2 < 1.
+
+  for( UInt_t k = 0; k < n; ++k )
+    pass[k] = (s2[k] > 0) & (s0[k] < s1[k]) & (s1[k] < s2[k]);
+}
+
+//_____________________________________________________________________________
+static void SubtractPedestal( UInt_t n, const Float_t* adc,
+			      const Float_t* ped, Float_t* adccor )
+{
+  // Strip-by-strip pedestal subtraction
+
+  for( UInt_t k = 0; k < n; ++k )
+    adccor[k] = adc[k] - ped[k];
+}
+
 // Sanity limit on number of channels (strips)
 static const Int_t kMaxNChan = 20000;
+// Sanity limit on number of ADC samples per channel
+static const UInt_t kMaxNsamp = 32;
 
 //_____________________________________________________________________________
 GEMPlane::GEMPlane( const char* name, const char* description,
 		    THaDetectorBase* parent )
   : Plane(name,description,parent),
     fMapType(kOneToOne), fMaxClusterSize(0), fMinAmpl(0), fSplitFrac(0),
-    fMaxSamp(1), fAmplSigma(0), fADCraw(0), fADC(0), fHitTime(0), fADCcor(0),
-    fGoodHit(0), fDnoise(0), fNrawStrips(0), fNhitStrips(0), fHitOcc(0),
-    fOccupancy(0), fADCMap(0)
+    fMaxSamp(1), fAPVnchan(128), fDeconvNsamp(3), fDeconvDt(25.0),
+    fDeconvTp(50.0), fMinTime(-kBig), fMaxTime(kBig), fAmplSigma(0),
+    fADCraw(0), fADC(0), fAmpl(0), fHitTime(0), fADCcor(0), fGoodHit(0),
+    fTimed(0), fDnoise(0), fBatch(0), fNrawStrips(0), fNhitStrips(0),
+    fHitOcc(0), fOccupancy(0), fNtimeRej(0), fNclustTot(0), fNclustRej(0),
+    fADCMap(0)
 {
   // Constructor
 
@@ -94,9 +184,12 @@ GEMPlane::~GEMPlane()
     RemoveVariables();
 
   // fHits deleted in base class
+  delete fBatch;
+  delete fTimed;
   delete fGoodHit;
   delete fADCcor;
   delete fHitTime;
+  delete fAmpl;
   delete fADC;
   delete fADCraw;
 }
@@ -127,20 +220,44 @@ void GEMPlane::Clear( Option_t* opt )
   Plane::Clear(opt);
 
   if( !IsDummy() ) {
-    assert( fADCraw and fADC and fHitTime and fADCcor and fGoodHit );
-    memset( fADCraw, 0, fNelem*sizeof(Float_t) );
-    memset( fADC, 0, fNelem*sizeof(Float_t) );
-    memset( fHitTime, 0, fNelem*sizeof(Float_t) );
-    memset( fADCcor, 0, fNelem*sizeof(Float_t) );
-    memset( fGoodHit, 0, fNelem*sizeof(Byte_t) );
+    assert( fADCraw and fADC and fAmpl and fHitTime and fADCcor and
+	    fGoodHit and fTimed );
+    if( TestBit(kSparseClear) ) {
+      // Reset only the strips that the last Decode() may have written to,
+      // i.e. the strips with decoder data. The others are still zero.
+      assert( fBatch );
+      for( UInt_t k = 0; k < fBatch->n; ++k ) {
+	Int_t istrip = fBatch->strip[k];
+	fADCraw[istrip] = fADC[istrip] = fAmpl[istrip] = 0;
+	fHitTime[istrip] = fADCcor[istrip] = 0;
+	fGoodHit[istrip] = fTimed[istrip] = 0;
+	fStripsSeen[istrip] = false;
+      }
+      fBatch->n = 0;
+    } else
+      ClearStrips();
     fSigStrips.clear();
-    fStripsSeen.assign( fNelem, false );
   }
 
-  fNhitStrips = fNrawStrips = 0;
+  fNhitStrips = fNrawStrips = fNtimeRej = 0;
   fHitOcc = fOccupancy = fDnoise = 0.0;
 }
 
+//_____________________________________________________________________________
+void GEMPlane::ClearStrips()
+{
+  // Reset the data of all strips
+
+  memset( fADCraw, 0, fNelem*sizeof(Float_t) );
+  memset( fADC, 0, fNelem*sizeof(Float_t) );
+  memset( fAmpl, 0, fNelem*sizeof(Float_t) );
+  memset( fHitTime, 0, fNelem*sizeof(Float_t) );
+  memset( fADCcor, 0, fNelem*sizeof(Float_t) );
+  memset( fGoodHit, 0, fNelem*sizeof(Byte_t) );
+  memset( fTimed, 0, fNelem*sizeof(Byte_t) );
+  fStripsSeen.assign( fNelem, false );
+}
+
 //_____________________________________________________________________________
 Int_t GEMPlane::MapChannel( Int_t idx ) const
 {
@@ -189,57 +306,6 @@ Int_t GEMPlane::MapChannel( Int_t idx ) const
   return ret;
 }
 
-//_____________________________________________________________________________
-static StripData_t ChargeDep( const vector<Float_t>& amp )
-{
-  // Deconvolute signal given by samples in 'amp', return approximate integral.
-  // Currently analyzes exactly 3 samples.
-  // From Kalyan Allada
-  // NIM A326, 112 (1993)
-
-  //FIXME: from database, proper value for Tp
-  const Float_t delta_t = 25.0; // time interval between samples (ns)
-  const Float_t Tp      = 50.0; // RC filter time constant (ns)
-
-  assert( amp.size() >= 3 );
-
-  Float_t adcraw = delta_t*(amp[0]+amp[1]+amp[2]);
-
-  // Weight factors calculated based on the response of the silicon microstrip
-  // detector:
-  // v(t) = (delta_t/Tp)*exp(-delta_t/Tp)
-  // Need to update this for GEM detector response(?):
-  // v(t) = A*(1-exp(-(t-t0)/tau1))*exp(-(t-t0)/tau2)
-  // where A is the amplitude, t0 the begin of the rise, tau1 the time
-  // parameter for the rising edge and tau2 the for the falling edge.
-
-  Float_t x = delta_t/Tp;
-
-  Float_t w1 = TMath::Exp(x-1)/x;
-  Float_t w2 = -2*TMath::Exp(-1)/x;
-  Float_t w3 = TMath::Exp(-x-1)/x;
-
-  // Deconvoluted signal samples, assuming measurements of zero before the
-  // leading edge
-  Float_t sig[3] = { amp[0]*w1,
-		     amp[1]*w1+amp[0]*w2,
-		     amp[2]*w1+amp[1]*w2+amp[0]*w3 };
-
-  Float_t adc    = delta_t*(sig[0]+sig[1]+sig[2]);
-  Float_t time   = 0;     // TODO
-
-  Bool_t pass;
-  // Calculate ratios for 3 samples and check for bad signals
-  if( amp[2] > 0 ) {
-    Float_t r1 = amp[0]/amp[2];
-    Float_t r2 = amp[1]/amp[2];
-    pass = (r1 < 1.0 and r2 < 1.0 and r1 < r2);
-  } else
-    pass = false;
-
-  return StripData_t(adcraw,adc,time,pass);
-}
-
 //_____________________________________________________________________________
 void GEMPlane::AddStrip( Int_t istrip )
 {
@@ -260,14 +326,49 @@ void GEMPlane::AddStrip( Int_t istrip )
 #endif
 }
 
+//_____________________________________________________________________________
+void GEMPlane::AddStripData( Int_t istrip, Int_t idx, Int_t imod, Int_t chan,
+			     UInt_t nsamp, const Float_t* samp )
+{
+  // Add the nsamp ADC samples of the given strip to the batch of strips to
+  // be analyzed by AnalyzeStrips. Samples beyond the number analyzed are
+  // ignored. idx is the hardware channel index within the plane, used for
+  // the common-mode correction per APV. imod and chan identify the
+  // detector map module and channel (for Monte Carlo truth).
+
+  assert( fBatch and nsamp > 0 );
+  assert( istrip >= 0 and istrip < fNelem );
+  StripBatch& b = *fBatch;
+  const UInt_t nread = b.nsamp;
+  if( nsamp > nread )
+    nsamp = nread;
+  ++fNrawStrips;
+
+  UInt_t k = b.n++;
+  assert( k < b.cap );
+  b.strip[k] = istrip;
+  b.apv[k]   = ( fAPVnchan > 0 ) ? idx / fAPVnchan : 0;
+  b.nhit[k]  = nsamp;
+  b.imod[k]  = imod;
+  b.chan[k]  = chan;
+  b.ped[k]   = fPed.empty() ? 0.0 : fPed[istrip];
+  UInt_t isamp = 0;
+  for( ; isamp < nsamp; ++isamp )
+    b.row[isamp][k] = samp[isamp];
+  for( ; isamp < nread; ++isamp )
+    b.row[isamp][k] = 0.0;
+  if( nsamp == 1 )
+    ++b.nsingle;
+}
+
 //_____________________________________________________________________________
 Int_t GEMPlane::GEMDecode( const THaEvData& evData )
 {
   // Extract this plane's hit data from the raw evData.
   //
-  // This routine decodes the front-end readout data.
-  // Finds clusters of active strips (=above software threshold) and
-  // computes weighted average of position. Each such cluster makes one "Hit".
+  // This routine decodes the front-end readout data. The ADC samples of
+  // all strips with data are collected in a batch, which AnalyzeStrips
+  // then processes into hits.
 
   const char* const here = "GEMPlane::Decode";
 
@@ -275,38 +376,12 @@ Int_t GEMPlane::GEMDecode( const THaEvData& evData )
   bool mc_data = fTracker->TestBit(Tracker::kMCdata);
   assert( !mc_data || dynamic_cast<const SimDecoder*>(&evData) != 0 );
 #endif
-  assert( fADCraw and fADC and fADCcor and fHitTime );
-
-#ifdef TESTCODE
-  if( TestBit(kDoHistos) )
-    assert( fHitMap != 0 and fADCMap != 0 );
-#endif
-  assert( fPed.empty() or
-	  fPed.size() == static_cast<Vflt_t::size_type>(fNelem) );
-  assert( fSigStrips.empty() );
   assert( fStripsSeen.size() == static_cast<Vbool_t::size_type>(fNelem) );
+  assert( fBatch );
+  fBatch->n = fBatch->nsingle = 0;
 
-  UInt_t nHits = 0;
-
-  // Set up pedestal and noise corrections
-  Double_t noisesum = 0.0;
-  UInt_t   n_noise = 0;
-
-  bool do_pedestal_subtraction = !fPed.empty();
-  bool do_noise_subtraction    = TestBit(kDoNoise);
-
-#ifdef MCDATA
-  const SimDecoder* simdata = 0;
-  if( mc_data ) {
-    assert( dynamic_cast<const SimDecoder*>(&evData) );
-    simdata = static_cast<const SimDecoder*>(&evData);
-  }
-#endif
-  Vflt_t samples;
-  if( fMaxSamp > 1 )
-    samples.reserve(fMaxSamp);
-
-  // Decode data
+  // Gather the data of all strips into the batch arrays
+  Float_t samp[kMaxNsamp];
   for( Int_t imod = 0; imod < fDetMap->GetSize(); ++imod ) {
     THaDetMap::Module * d = fDetMap->GetModule(imod);
 
@@ -317,8 +392,8 @@ Int_t GEMPlane::GEMDecode( const THaEvData& evData )
       if( chan < d->lo or chan > d->hi ) continue; // not part of this detector
 
       // Map channel number to strip number
-      Int_t istrip =
-	MapChannel( d->first + ((d->reverse) ? d->hi - chan : chan - d->lo) );
+      Int_t idx = d->first + ((d->reverse) ? d->hi - chan : chan - d->lo);
+      Int_t istrip = MapChannel( idx );
       // Test for duplicate istrip, if found, warn and skip
       assert( istrip >= 0 and istrip < fNelem );
       if( fStripsSeen[istrip] ) {
@@ -338,80 +413,131 @@ Int_t GEMPlane::GEMDecode( const THaEvData& evData )
       // correspond to time samples 25 ns apart
       Int_t nsamp = evData.GetNumHits( d->crate, d->slot, chan );
       assert( nsamp > 0 );
-      ++fNrawStrips;
-      nsamp = TMath::Min( nsamp, static_cast<Int_t>(fMaxSamp) );
-
-      // Integrate the signal over time and analyze pulse shape
-      StripData_t stripdata;
-      if( nsamp > 1 ) {
-	samples.clear();
-	for( Int_t isamp = 0; isamp < nsamp; ++isamp ) {
-	  Float_t fsamp = static_cast<Float_t>
-	    ( evData.GetData(d->crate, d->slot, chan, isamp) );
-	  samples.push_back( fsamp );
-	}
-	// Analyze the pulse shape
-	stripdata = ChargeDep(samples);
-      }
-      else {
-	stripdata.adcraw = stripdata.adc =
-	  static_cast<Float_t>( evData.GetData(d->crate, d->slot, chan, 0) );
-	stripdata.time = 0;
-	stripdata.pass = true;
-      }
-      // Skip null data
-      if( stripdata.adcraw == 0 )
-	continue;
+      nsamp = TMath::Min( nsamp, static_cast<Int_t>(fBatch->nsamp) );
+      for( Int_t isamp = 0; isamp < nsamp; ++isamp )
+	samp[isamp] = static_cast<Float_t>
+	  ( evData.GetData(d->crate, d->slot, chan, isamp) );
+      AddStripData( istrip, idx, imod, chan, nsamp, samp );
+    }  // chans
+  }    // modules
 
-      // Save results for cluster finding later
-      fADCraw[istrip]  = stripdata.adcraw;
-      fADC[istrip]     = stripdata.adc;
-      fHitTime[istrip] = stripdata.time;
+  return AnalyzeStrips( &evData );
+}
 
-      // Strip-by-strip pedestal subtraction
-      Float_t adc = stripdata.adc;
-      if( do_pedestal_subtraction )
-	adc -= fPed[istrip];
+//_____________________________________________________________________________
+Int_t GEMPlane::AnalyzeStrips( const THaEvData* evData )
+{
+  // Analyze the strips in the batch (see AddStripData): integrate and
+  // deconvolute the samples, subtract pedestals and common-mode noise,
+  // then find clusters of active strips (=above software threshold) and
+  // compute the weighted average of their positions. Each such cluster
+  // that is within the time window makes one "Hit". evData is only used
+  // for the Monte Carlo truth information of the strips.
 
-      fADCcor[istrip] = adc;
-      fGoodHit[istrip] = not TestBit(kCheckPulseShape) or stripdata.pass;
+#ifdef MCDATA
+  bool mc_data = fTracker->TestBit(Tracker::kMCdata);
+  assert( !mc_data || dynamic_cast<const SimDecoder*>(evData) != 0 );
+#endif
+  assert( fADCraw and fADC and fADCcor and fHitTime and fTimed );
 
-      if( do_noise_subtraction ) {
-	// Sum up ADCs that are likely not a hit
-	if( adc < fMinAmpl ) {
-	  noisesum += adc;
-	  n_noise++;
-	}
-      }
-      else {
-	// If no noise subtraction is done, then we can finish up with this
-	// strip number right here. Otherwise we need a second iteration below
-	AddStrip( istrip );
-      }
+#ifdef TESTCODE
+  if( TestBit(kDoHistos) )
+    assert( fHitMap != 0 and fADCMap != 0 );
+#endif
+  assert( fPed.empty() or
+	  fPed.size() == static_cast<Vflt_t::size_type>(fNelem) );
+  assert( fSigStrips.empty() );
+
+  UInt_t nHits = 0;
+
+  bool do_noise_subtraction = TestBit(kDoNoise);
 
 #ifdef MCDATA
-      // If doing MC data, save the truth information for each strip
-      if( mc_data ) {
-	fMCHitList.push_back(istrip);
-	fMCHitInfo[istrip] = simdata->GetMCHitInfo(d->crate,d->slot,chan);
-      }
+  const SimDecoder* simdata = 0;
+  if( mc_data )
+    simdata = static_cast<const SimDecoder*>(evData);
 #endif
-    }  // chans
-  }    // modules
+  assert( fBatch );
+  StripBatch& b = *fBatch;
+  const UInt_t nread = b.nsamp;
+  Float_t* const* row = &b.row[0];
+
+  // Integrate the signals and analyze the pulse shapes
+  const UInt_t n = b.n;
+  if( b.nsingle < n ) {
+    const APVDeconv& deconv = b.deconv;
+    IntegrateSamples( n, nread, deconv.GetDt(), row, &b.adcraw[0] );
+    deconv.Process( n, row, &b.drow[0], &b.ipk[0], &b.adc[0], &b.ampl[0],
+		    &b.time[0] );
+    if( nread >= 3 )
+      CheckPulseShape( n, row[0], row[1], row[2], &b.pass[0] );
+  }
+  if( b.nsingle > 0 ) {
+    // Single-sample data are taken as they are
+    for( UInt_t k = 0; k < n; ++k ) {
+      if( b.nhit[k] == 1 ) {
+	b.adcraw[k] = b.adc[k] = b.ampl[k] = row[0][k];
+	b.time[k] = 0;
+	b.pass[k] = true;
+      }
+    }
+  }
+  SubtractPedestal( n, &b.adc[0], &b.ped[0], &b.adccor[0] );
 
-  // Calculate average common-mode noise and subtract it from corrected
-  // ADC values, if requested
+  // Calculate the average common-mode noise per APV from the ADC values
+  // that are likely not a hit, and subtract it from the corrected ADC
+  // values, if requested. Null data are skipped.
   if( do_noise_subtraction ) {
-    if ( n_noise > 0 ) {
-      fDnoise = noisesum/n_noise;
-      assert( fDnoise < fMinAmpl );
+    UInt_t napv = b.cm.size();
+    Double_t noisesum = 0.0;
+    UInt_t   n_noise = 0;
+    b.cm_sum.assign( napv, 0.0 );
+    b.cm_n.assign( napv, 0 );
+    for( UInt_t k = 0; k < n; ++k ) {
+      if( b.adcraw[k] != 0 and b.adccor[k] < fMinAmpl ) {
+	b.cm_sum[b.apv[k]] += b.adccor[k];
+	++b.cm_n[b.apv[k]];
+      }
     }
-    // Save strip numbers of corrected ADC data above threshold. Fill histograms.
-    assert( fSigStrips.empty() );
-    for( Int_t i = 0; i < fNelem; i++ ) {
-      fADCcor[i] -= fDnoise;
-      AddStrip( i );
+    for( UInt_t i = 0; i < napv; ++i ) {
+      b.cm[i] = ( b.cm_n[i] > 0 ) ? b.cm_sum[i]/b.cm_n[i] : 0.0;
+      assert( b.cm_n[i] == 0 or b.cm[i] < fMinAmpl );
+      noisesum += b.cm_sum[i];
+      n_noise  += b.cm_n[i];
     }
+    if( n_noise > 0 )
+      fDnoise = noisesum/n_noise;
+    for( UInt_t k = 0; k < n; ++k )
+      b.adccor[k] -= b.cm[b.apv[k]];
+  }
+
+  // Save results for cluster finding later
+  bool check_pulse_shape = TestBit(kCheckPulseShape);
+  for( UInt_t k = 0; k < n; ++k ) {
+    // Skip null data
+    if( b.adcraw[k] == 0 )
+      continue;
+
+    Int_t istrip = b.strip[k];
+    fADCraw[istrip]  = b.adcraw[k];
+    fADC[istrip]     = b.adc[k];
+    fAmpl[istrip]    = b.ampl[k];
+    // Leading edge = peak time - shaping time. This may be exactly zero,
+    // so keep track of which strips have a time separately
+    fTimed[istrip]   = ( b.nhit[k] > 1 and b.ampl[k] > 0 );
+    fHitTime[istrip] = fTimed[istrip] ? b.time[k] - fDeconvTp : 0;
+    fADCcor[istrip]  = b.adccor[k];
+    fGoodHit[istrip] = not check_pulse_shape or b.pass[k];
+    AddStrip( istrip );
+
+#ifdef MCDATA
+    // If doing MC data, save the truth information for each strip
+    if( mc_data ) {
+      THaDetMap::Module* d = fDetMap->GetModule( b.imod[k] );
+      fMCHitList.push_back(istrip);
+      fMCHitInfo[istrip] = simdata->GetMCHitInfo(d->crate,d->slot,b.chan[k]);
+    }
+#endif
   }
 
   fHitOcc    = static_cast<Double_t>(fNhitStrips) / fNelem;
@@ -530,6 +656,9 @@ Int_t GEMPlane::GEMDecode( const THaEvData& evData )
     // Compute weighted position average. Again, a crude (but fast) substitute
     // for fitting the centroid of the peak.
     Double_t xsum = 0.0, adcsum = 0.0;
+    // Likewise, the cluster time is the amplitude-weighted average of the
+    // leading-edge times of the strips with timing information
+    Double_t tsum = 0.0, amplsum = 0.0;
 #ifdef MCDATA
     Double_t mcpos = 0.0, mctime = kBig;
     Int_t mctrack = 0, num_bg = 0;
@@ -540,6 +669,11 @@ Int_t GEMPlane::GEMDecode( const THaEvData& evData )
       Double_t adc = fADCcor[istrip];
       xsum   += pos * adc;
       adcsum += adc;
+      if( fTimed[istrip] ) {
+	assert( fAmpl[istrip] > 0 );
+	tsum    += fHitTime[istrip] * fAmpl[istrip];
+	amplsum += fAmpl[istrip];
+      }
 #ifdef MCDATA
       // If doing MC data, analyze the strip truth information
       if( mc_data ) {
@@ -568,6 +702,17 @@ Int_t GEMPlane::GEMDecode( const THaEvData& evData )
     }
     assert( adcsum > 0.0 );
     Double_t pos = xsum/adcsum;
+    Double_t time = ( amplsum > 0.0 ) ? tsum/amplsum : 0.0;
+
+    // Drop clusters outside of the time window, i.e. out-of-time pileup,
+    // before they can enter the hitpattern. Clusters without timing
+    // information (single samples) are always kept.
+    ++fNclustTot;
+    if( amplsum > 0.0 and (time < fMinTime or time > fMaxTime) ) {
+      ++fNtimeRej;
+      ++fNclustRej;
+      continue;
+    }
 
 #ifdef MCDATA
     if( mc_data && mctrack == 0 ) {
@@ -606,7 +751,8 @@ Int_t GEMPlane::GEMDecode( const THaEvData& evData )
 					 size,
 					 type,
 					 resolution,
-					 this
+					 this,
+					 time
 					 );
 #ifdef MCDATA
     } else {
@@ -623,7 +769,8 @@ Int_t GEMPlane::GEMDecode( const THaEvData& evData )
 					   mctrack,
 					   mcpos,
 					   mctime,
-					   num_bg
+					   num_bg,
+					   time
 					   );
     }
 #endif // MCDATA
@@ -689,13 +836,122 @@ Hit* GEMPlane::AddHitImpl( Double_t pos )
   return theHit;
 }
 
+//_____________________________________________________________________________
+Hit* GEMPlane::AddExtHit( Double_t pos, Double_t res, Double_t charge,
+			  const MCHitTruth_t* mc )
+{
+  // Add a hit at cluster centroid pos with the given resolution and
+  // cluster charge, given via AddHits. The cluster is assumed to be clean.
+  // Returns 0 if there is no strip at pos.
+
+  if( IsDummy() )
+    return Plane::AddExtHit( pos, res, charge, mc );
+
+  Int_t istrip = TMath::Nint( (pos-GetStart()) / GetPitch() );
+  if( istrip < 0 or istrip >= fNelem )
+    return 0;
+
+  const UInt_t size = 1, type = 0;
+  GEMHit* theHit = 0;
+#ifdef MCDATA
+  if( fTracker->TestBit(Tracker::kMCdata) ) {
+    const Int_t num_bg = 0;
+    Int_t mctrack = mc ? mc->track : 0;
+    Double_t mcpos = mc ? mc->pos : 0.0, mctime = mc ? mc->time : 0.0;
+    theHit = new( (*fHits)[GetNhits()] ) MCGEMHit( pos,
+						   charge,
+						   size,
+						   type,
+						   res,
+						   this,
+						   mctrack,
+						   mcpos,
+						   mctime,
+						   num_bg
+						   );
+  } else
+#endif
+    theHit = new( (*fHits)[GetNhits()] ) GEMHit( pos,
+						 charge,
+						 size,
+						 type,
+						 res,
+						 this
+						 );
+  return theHit;
+}
+
+//_____________________________________________________________________________
+Hit* GEMPlane::AddSimHit( Double_t pos, Double_t slope, TRandom& rnd )
+{
+  // Add a simulated hit for a track crossing this plane at projection
+  // coordinate pos with the given slope. The cluster charge follows a
+  // Landau distribution with most probable value 10*adc.min (as for dummy
+  // hits) and relative width fAmplSigma. It is spread over the strips
+  // with a Gaussian profile, widened by the track's inclination. Strips
+  // above adc.min make up the cluster. Returns 0 if the track misses the
+  // strips or the cluster is below threshold.
+
+  // Most probable cluster charge if adc.min is not set (ADC counts)
+  static const Double_t kSimAmpl = 1000.0;
+  // Width of the charge spread at normal incidence (m)
+  static const Double_t kSimSpread = 2e-4;
+  // Thickness of the drift gap, for the spread of inclined tracks (m)
+  static const Double_t kSimGap = 3e-3;
+
+  if( IsDummy() )
+    return Plane::AddSimHit( pos, slope, rnd );
+
+  assert( HasExtInput() );
+#ifdef MCDATA
+  assert( !fTracker->TestBit(Tracker::kMCdata) ); // see EventGenerator::Init
+#endif
+
+  Int_t istrip = TMath::Nint( (pos-GetStart()) / GetPitch() );
+  if( istrip < 0 or istrip >= fNelem )
+    return 0;
+
+  Double_t mpv = ( fMinAmpl > 0 ) ? 10.*fMinAmpl : kSimAmpl;
+  Double_t charge = rnd.Landau( mpv, fAmplSigma*mpv );
+  if( charge <= 0 )
+    return 0;
+  Double_t sigma = TMath::Sqrt( kSimSpread*kSimSpread +
+				slope*slope*kSimGap*kSimGap/12. );
+  Int_t kmax = TMath::CeilNint( 3.*sigma/GetPitch() );
+  Double_t adcsum = 0;
+  UInt_t size = 0;
+  for( Int_t k = TMath::Max(istrip-kmax,0);
+       k <= TMath::Min(istrip+kmax,fNelem-1); ++k ) {
+    Double_t x = GetStart() + k*GetPitch() - pos;
+    Double_t ampl = 0.5*charge *
+      ( TMath::Erf( (x+0.5*GetPitch())/(TMath::Sqrt2()*sigma) ) -
+	TMath::Erf( (x-0.5*GetPitch())/(TMath::Sqrt2()*sigma) ) );
+    if( ampl > fMinAmpl ) {
+      adcsum += ampl;
+      ++size;
+    }
+  }
+  if( size == 0 )
+    return 0;
+  // Oversize clusters from a single track have a well-defined peak
+  Int_t type = ( size > fMaxClusterSize ) ? 3 : 0;
+
+  return new( (*fHits)[GetNhits()] ) GEMHit( pos + rnd.Gaus(0, fResolution),
+					     adcsum,
+					     size,
+					     type,
+					     fResolution,
+					     this
+					     );
+}
+
 //_____________________________________________________________________________
 Int_t GEMPlane::Decode( const THaEvData& evData )
 {
   // Convert evData to hits
 
-  if( IsDummy() )
-    // Special "decoding" for dummy planes
+  if( IsDummy() or HasExtInput() )
+    // Special "decoding" for dummy planes and hits added directly
     return DummyDecode( evData );
 
   return GEMDecode( evData );
@@ -706,6 +962,9 @@ Int_t GEMPlane::DefineVariables( EMode mode )
 {
   // initialize global variables
 
+  // No variables for clones (see Tracker::MakeClone)
+  if( fTracker->IsClone() ) return kOK;
+
   if( mode == kDefine && fIsSetup ) return kOK;
   fIsSetup = ( mode == kDefine );
 
@@ -720,9 +979,11 @@ Int_t GEMPlane::DefineVariables( EMode mode )
     { "strip.adcraw",   "Raw strip ADC sum",                "fADCraw" },
     { "strip.adc",      "Deconvoluted strip ADC sum",       "fADC" },
     { "strip.adc_c",    "Pedestal-sub strip ADC sum",       "fADCcor" },
+    { "strip.ampl",     "Deconvoluted strip pulse amplitude","fAmpl" },
     { "strip.time",     "Leading time of strip signal (ns)","fHitTime" },
     { "strip.good",     "Good pulse shape on strip",        "fGoodHit" },
     { "nhits",          "Num hits (clusters of strips)",    "GetNhits()" },
+    { "ntimerej",       "Num clusters outside time window", "fNtimeRej" },
     { "noise",          "Noise level (avg below adc.min)",  "fDnoise" },
     { "ncoords",        "Num fit coords",                   "GetNcoords()" },
     { "coord.pos",      "Position used in fit (m)",         "fFitCoords.TreeSearch::FitCoord.fPos" },
@@ -748,6 +1009,7 @@ Int_t GEMPlane::DefineVariables( EMode mode )
       { "hit.adc",  "Hit ADC sum",           "fHits.TreeSearch::GEMHit.fADCsum" },
       { "hit.size", "Num strips ",           "fHits.TreeSearch::GEMHit.fSize" },
       { "hit.type", "Hit analysis result",   "fHits.TreeSearch::GEMHit.fType" },
+      { "hit.time", "Hit leading time (ns)", "fHits.TreeSearch::GEMHit.fTime" },
       { 0 }
     };
     ret = DefineVarsFromList( nonmcvars, mode );
@@ -762,6 +1024,7 @@ Int_t GEMPlane::DefineVariables( EMode mode )
       { "hit.adc",   "Hit ADC sum",           "fHits.TreeSearch::MCGEMHit.fADCsum" },
       { "hit.size",  "Num strips ",           "fHits.TreeSearch::MCGEMHit.fSize" },
       { "hit.type",  "Hit analysis result",   "fHits.TreeSearch::MCGEMHit.fType" },
+      { "hit.time",  "Hit leading time (ns)", "fHits.TreeSearch::MCGEMHit.fTime" },
       { "hit.mctrk", "MC track number",       "fHits.TreeSearch::MCGEMHit.fMCTrack" },
       { "hit.mcpos", "MC track position (m)", "fHits.TreeSearch::MCGEMHit.fMCPos" },
       { "hit.mctime","MC track time (s)",     "fHits.TreeSearch::MCGEMHit.fMCTime" },
@@ -790,6 +1053,39 @@ Int_t GEMPlane::End( THaRunBase* run )
   return 0;
 }
 
+//_____________________________________________________________________________
+void GEMPlane::AddHitStats( const Plane& rhs )
+{
+  // Add the time window statistics of rhs, a clone of this plane, to ours
+
+  const GEMPlane* gp = dynamic_cast<const GEMPlane*>(&rhs);
+  assert( gp );
+  if( gp ) {
+    fNclustTot += gp->fNclustTot;
+    fNclustRej += gp->fNclustRej;
+  }
+}
+
+//_____________________________________________________________________________
+void GEMPlane::ResetHitStats()
+{
+  // Clear the time window statistics
+
+  fNclustTot = fNclustRej = 0;
+}
+
+//_____________________________________________________________________________
+void GEMPlane::PrintHitStats() const
+{
+  // Print the rate of clusters rejected by the time window, if enabled
+
+  if( !HasTimeWindow() or fNclustTot == 0 )
+    return;
+  cout << GetPrefix() << "time window [" << fMinTime << "," << fMaxTime
+       << "] ns: rejected " << fNclustRej << " of " << fNclustTot
+       << " clusters (" << 100.0*fNclustRej/fNclustTot << "%)" << endl;
+}
+
 //_____________________________________________________________________________
 Int_t GEMPlane::ReadDatabase( const TDatime& date )
 {
@@ -808,12 +1104,18 @@ Int_t GEMPlane::ReadDatabase( const TDatime& date )
 
   // Set defaults
   TString mapping;
-  Int_t do_noise = 1, check_pulse_shape = 1;
+  Int_t do_noise = 1, check_pulse_shape = 1, sparse_clear = 1;
   fMaxClusterSize = kMaxUInt;
   fMinAmpl   = 0.0;
   fSplitFrac = 0.0;
   fMapType   = kOneToOne;
   fMaxSamp   = 1;
+  fDeconvNsamp = 3;
+  fDeconvDt  = 25.0;
+  fDeconvTp  = 50.0;
+  fMinTime   = -kBig;
+  fMaxTime   = kBig;
+  fAPVnchan  = 128;
   fChanMap.clear();
   fPed.clear();
   fAmplSigma = 0.36; // default, an educated guess
@@ -826,6 +1128,11 @@ Int_t GEMPlane::ReadDatabase( const TDatime& date )
       { "strip.pitch",    &fPitch,          kDouble,  0, 0, gbl },
       { "maxclustsiz",    &fMaxClusterSize, kUInt,    0, 1, gbl },
       { "maxsamp",        &fMaxSamp,        kUInt,    0, 1, gbl },
+      { "deconv.nsamp",   &fDeconvNsamp,    kUInt,    0, 1, gbl },
+      { "deconv.dt",      &fDeconvDt,       kDouble,  0, 1, gbl },
+      { "deconv.tau",     &fDeconvTp,       kDouble,  0, 1, gbl },
+      { "time.min",       &fMinTime,        kDouble,  0, 1, gbl },
+      { "time.max",       &fMaxTime,        kDouble,  0, 1, gbl },
       { "adc.min",        &fMinAmpl,        kDouble,  0, 1, gbl },
       { "split.frac",     &fSplitFrac,      kDouble,  0, 1, gbl },
       { "mapping",        &mapping,         kTString, 0, 1, gbl },
@@ -833,7 +1140,9 @@ Int_t GEMPlane::ReadDatabase( const TDatime& date )
       { "pedestal",       &fPed,            kFloatV,  0, 1 },
       { "do_noise",       &do_noise,        kInt,     0, 1, gbl },
       { "adc.sigma",      &fAmplSigma,      kDouble,  0, 1, gbl },
+      { "apv.nchan",      &fAPVnchan,       kUInt,    0, 1, gbl },
       { "check_pulse_shape",&check_pulse_shape, kInt, 0, 1, gbl },
+      { "sparse_clear",   &sparse_clear,    kInt,     0, 1, gbl },
       { 0 }
     };
     status = LoadDB( file, date, request, fPrefix );
@@ -873,12 +1182,16 @@ Int_t GEMPlane::ReadDatabase( const TDatime& date )
 
   SetBit( kDoNoise, do_noise );
   SetBit( kCheckPulseShape, check_pulse_shape );
+  SetBit( kSparseClear, sparse_clear );
 
   SafeDelete(fADCraw);
   SafeDelete(fADC);
+  SafeDelete(fAmpl);
   SafeDelete(fHitTime);
   SafeDelete(fADCcor);
   SafeDelete(fGoodHit);
+  SafeDelete(fTimed);
+  SafeDelete(fBatch);
 #ifdef MCDATA
   delete [] fMCHitInfo; fMCHitInfo = 0;
 #endif
@@ -889,11 +1202,16 @@ Int_t GEMPlane::ReadDatabase( const TDatime& date )
   // Out of memory exceptions from here are caught in Tracker.cxx.
   fADCraw = new Float_t[fNelem];
   fADC = new Float_t[fNelem];
+  fAmpl = new Float_t[fNelem];
   fHitTime = new Float_t[fNelem];
   fADCcor = new Float_t[fNelem];
   fGoodHit = new Byte_t[fNelem];
+  fTimed = new Byte_t[fNelem];
   fSigStrips.reserve(fNelem);
   fStripsSeen.resize(fNelem);
+  // Start out with all strips cleared. With sparse clearing, Clear() only
+  // resets strips that have been filled since.
+  ClearStrips();
 
 #ifdef MCDATA
   if( fTracker->TestBit(Tracker::kMCdata) ) {
@@ -967,16 +1285,43 @@ Int_t GEMPlane::ReadDatabase( const TDatime& date )
   }
 
   // Sanity checks on fMaxSamp
-  static const UInt_t max_maxsamp = 32; // arbitrary sanity limit
   if( fMaxSamp == 0 )
     fMaxSamp = 1;
-  else if( fMaxSamp > max_maxsamp ) {
+  else if( fMaxSamp > kMaxNsamp ) {
     Warning( Here(here), "Illegal maximum number of samples: %u. "
-	     "Adjusted to maximum allowed = %u.", fMaxSamp, max_maxsamp );
-    fMaxSamp = max_maxsamp;
+	     "Adjusted to maximum allowed = %u.", fMaxSamp, kMaxNsamp );
+    fMaxSamp = kMaxNsamp;
+  }
+  // Deconvolution parameters. The number of samples analyzed is limited
+  // by the number of samples read.
+  if( fDeconvNsamp == 0 )
+    fDeconvNsamp = 1;
+  if( fDeconvNsamp > fMaxSamp )
+    fDeconvNsamp = fMaxSamp;
+  if( fDeconvNsamp > 1 and (fDeconvDt <= 0.0 or fDeconvTp <= 0.0) ) {
+    Error( Here(here), "Deconvolution sampling interval (%lf) and shaping "
+	   "time (%lf) must be > 0. Fix database.", fDeconvDt, fDeconvTp );
+    return kInitError;
   }
-  if( fMaxSamp == 1 )
+  // The pulse shape test requires at least three samples
+  if( fDeconvNsamp < 3 )
     ResetBit( kCheckPulseShape );
+  // Cluster time window. Timing requires at least two samples.
+  if( HasTimeWindow() ) {
+    if( fMinTime >= fMaxTime ) {
+      Error( Here(here), "Time window min (%lf) must be less than max (%lf). "
+	     "Fix database.", fMinTime, fMaxTime );
+      return kInitError;
+    }
+    if( fDeconvNsamp < 2 )
+      Warning( Here(here), "Time window set, but no timing information "
+	       "without multiple samples (maxsamp, deconv.nsamp). Ignored." );
+  }
+
+  UInt_t napv = ( fAPVnchan > 0 ) ? (fNelem-1)/fAPVnchan + 1 : 1;
+  fBatch = new StripBatch( fNelem, napv, fDeconvNsamp );
+  if( fDeconvNsamp > 1 )
+    fBatch->deconv.Init( fDeconvNsamp, fDeconvDt, fDeconvTp );
 
   if( fAmplSigma < 0.0 ) {
     Warning( Here(here), "Negative adc.sigma = %lf makes no sense. Adjusted "
@@ -14,12 +14,15 @@
 
 namespace TreeSearch {
 
+  class StripBatch;  // Defined in implementation
+
   class GEMPlane : public Plane {
   public:
     GEMPlane( const char* name, const char* description = "",
 	      THaDetectorBase* parent = 0 );
     // For ROOT RTTI
-    GEMPlane() : fADCraw(0), fADC(0), fHitTime(0), fADCcor(0), fGoodHit(0) {}
+    GEMPlane() : fADCraw(0), fADC(0), fAmpl(0), fHitTime(0), fADCcor(0),
+		 fGoodHit(0), fTimed(0), fBatch(0) {}
     virtual ~GEMPlane();
 
     virtual void    Clear( Option_t* opt="" );
@@ -29,12 +32,21 @@ namespace TreeSearch {
     virtual Int_t   Begin( THaRunBase* r=0 );
     virtual Int_t   End( THaRunBase* r=0 );
 
+    virtual Hit*    AddSimHit( Double_t pos, Double_t slope, TRandom& rnd );
+    virtual void    AddHitStats( const Plane& rhs );
+    virtual void    ResetHitStats();
+    virtual void    PrintHitStats() const;
+
     Double_t        GetAmplSigma( Double_t ampl ) const;
     Double_t        GetHitOcc()      const { return fHitOcc; }
     Double_t        GetOccupancy()   const { return fOccupancy; }
+    Bool_t          HasTimeWindow()  const
+    { return fMinTime > -kBig or fMaxTime < kBig; }
     Int_t           GetNsigStrips()  const { return fSigStrips.size(); }
 
   protected:
+    friend class BenchAccess;  // Benchmarks (tsbench)
+
     typedef std::vector<bool>  Vbool_t;
 
     // Hardware channel mapping
@@ -51,6 +63,13 @@ namespace TreeSearch {
     Double_t      fSplitFrac;   // Percentage of amplitude swing necessary
                                 // for detecting cluster maximum/minimum
     UInt_t        fMaxSamp;     // Maximum # ADC samples per channel
+    UInt_t        fAPVnchan;    // Channels per APV for common-mode correction
+                                // (0 = one common mode for whole plane)
+    UInt_t        fDeconvNsamp; // Number of samples to deconvolute
+    Double_t      fDeconvDt;    // Time interval between samples (ns)
+    Double_t      fDeconvTp;    // Shaping time constant of front-end (ns)
+    Double_t      fMinTime;     // Time window for clusters, min leading-edge
+    Double_t      fMaxTime;     // and max leading-edge time (ns)
 
     Vflt_t        fPed;         // [fNelem] Per-channel pedestal values
     TBits         fBadChan;     // Bad channel map
@@ -59,26 +78,38 @@ namespace TreeSearch {
     // Event data, hits etc.
     Float_t*      fADCraw;      // [fNelem] Integral of raw ADC samples
     Float_t*      fADC;         // [fNelem] Integral of deconvoluted ADC samples
+    Float_t*      fAmpl;        // [fNelem] Amplitude of deconv signal
     Float_t*      fHitTime;     // [fNelem] Leading-edge time of deconv signal (ns)
     Float_t*      fADCcor;      // [fNelem] fADC corrected for pedestal & noise
     Byte_t*       fGoodHit;     // [fNelem] Strip data passed pulse shape test
+    Byte_t*       fTimed;       // [fNelem] fHitTime valid (multiple samples)
     Double_t      fDnoise;      // Event-by-event noise (avg below fMinAmpl)
     Vint_t        fSigStrips;   // Ordered strip numbers with signal (adccor > minampl)
     Vbool_t       fStripsSeen;  // Flags for duplicate strip number detection
+    StripBatch*   fBatch;       //! Working arrays for strip data processing
 
     UInt_t        fNrawStrips;  // Statistics: strips with any data
     UInt_t        fNhitStrips;  // Statistics: strips > 0
     Double_t      fHitOcc;      // Statistics: hit occupancy fNhitStrips/fNelem
     Double_t      fOccupancy;   // Statistics: occupancy GetNsigStrips/fNelem
+    UInt_t        fNtimeRej;    // Statistics: clusters outside time window
+    ULong64_t     fNclustTot;   // Run statistics: clusters found
+    ULong64_t     fNclustRej;   // Run statistics: clusters outside time window
 
     // Optional diagnostics for TESTCODE, keep for binary compatibility
     TH1*          fADCMap;      // Histogram of strip numbers weighted by ADC
 
     void          AddStrip( Int_t istrip );
+    void          ClearStrips();
 
     // Support functions for dummy planes
     virtual Hit*  AddHitImpl( Double_t x );
+    virtual Hit*  AddExtHit( Double_t pos, Double_t res, Double_t charge,
+			     const MCHitTruth_t* mc );
     virtual Int_t GEMDecode( const THaEvData& );
+    void          AddStripData( Int_t istrip, Int_t idx, Int_t imod,
+				Int_t chan, UInt_t nsamp, const Float_t* samp );
+    Int_t         AnalyzeStrips( const THaEvData* evData );
 
     // Podd interface
     virtual Int_t ReadDatabase( const TDatime& date );
@@ -87,7 +118,8 @@ namespace TreeSearch {
     // Bits for GEMPlanes
     enum {
       kDoNoise         = BIT(16), // Correct data for common-mode noise
-      kCheckPulseShape = BIT(17)  // Reject malformed ADC pulse shapes
+      kCheckPulseShape = BIT(17), // Reject malformed ADC pulse shapes
+      kSparseClear     = BIT(18)  // Clear only strips with data in Clear()
     };
 
     ClassDef(GEMPlane,0)  // ADC-based readout plane coordinate direction
@@ -18,7 +18,6 @@
 
 #include "TString.h"
 #include "TMath.h"
-#include "TBits.h"
 
 #include <iostream>
 #include <algorithm>
@@ -244,6 +243,14 @@ Int_t GEMTracker::ReadDatabase( const TDatime& date )
   return kOK;
 }
 
+//_____________________________________________________________________________
+Tracker* GEMTracker::NewClone() const
+{
+  // Create a new, uninitialized GEMTracker with our name and apparatus
+
+  return new GEMTracker( GetName(), GetTitle(), GetApparatus() );
+}
+
 //_____________________________________________________________________________
 Plane* GEMTracker::MakePlane( const char* name, const char* description,
 			      THaDetectorBase* parent ) const
@@ -263,6 +270,16 @@ UInt_t GEMTracker::GetCrateMapDBcols() const
   return 5;
 }
 
+//_____________________________________________________________________________
+// Functor for ordering roads by plane pattern
+
+struct PlanePatternIsLess
+  : public std::binary_function< Road*, Road*, bool >
+{
+  bool operator() ( const Road* a, const Road* b ) const
+  { return ( a->GetPlanePattern() < b->GetPlanePattern() ); }
+};
+
 //_____________________________________________________________________________
 UInt_t GEMTracker::MatchRoadsCorrAmpl( vector<Rvec_t>& roads,
 		       UInt_t /* ncombos */,
@@ -299,7 +316,19 @@ UInt_t GEMTracker::MatchRoadsCorrAmpl( vector<Rvec_t>& roads,
   assert( xplanes.front()->GetType() != yplanes.front()->GetType() );
 
   UInt_t nplanes = xplanes.size();
-  TBits xybits(nplanes), ybits(nplanes);
+
+  // Group the y-roads by plane pattern. The test for a sufficient number of
+  // common active planes then needs to be done only once per group instead
+  // of once per x/y road pair.
+  Rvec_t& yroads = roads[1];
+  sort( ALL(yroads), PlanePatternIsLess() );
+  vector<Rvec_t::size_type> ygroup( 1, 0 );
+  for( Rvec_t::size_type i = 1; i < yroads.size(); ++i ) {
+    if( yroads[i]->GetPlanePattern() != yroads[i-1]->GetPlanePattern() )
+      ygroup.push_back(i);
+  }
+  ygroup.push_back( yroads.size() );
+
   // Look at all possible combinations of x-roads and y-roads.
   // Try to match them via the ADC amplitudes of the hits in the shared
   // readout planes. Amplitudes should correlate well in the absence
@@ -309,110 +338,111 @@ UInt_t GEMTracker::MatchRoadsCorrAmpl( vector<Rvec_t>& roads,
     Road* xroad = *itx;
     const Road::Pvec_t& xpoints = xroad->GetPoints();
     UInt_t xpat = xroad->GetPlanePattern();
-    for( Rvec_t::iterator ity = roads[1].begin(); ity != roads[1].end();
-	 ++ity ) {
-      Road* yroad = *ity;
-
+    for( vector<Rvec_t::size_type>::size_type ig = 0; ig+1 < ygroup.size();
+	 ++ig ) {
       // xpat and ypat are bitpatterns of the plane numbers that have hits.
       // The AND of these patters is the pattern of planes where both read-
       // out directions have hits (matching or not). Check here if there
       // are enough such common active planes, else all following work can
-      // be skipped.
-      UInt_t ypat = yroad->GetPlanePattern();
-      xybits.Set( nplanes, &xpat );
-      ybits.Set( nplanes, &ypat );
-      xybits &= ybits;
-      assert( xybits.CountBits() <= nplanes );
-      if( xybits.CountBits() + fMaxCorrMismatches < nplanes )
+      // be skipped for the entire group of y-roads with this pattern.
+      UInt_t ypat = yroads[ygroup[ig]]->GetPlanePattern();
+      UInt_t ncommon = NumberOfSetBits( xpat & ypat );
+      assert( ncommon <= nplanes );
+      if( ncommon + fMaxCorrMismatches < nplanes )
 	continue;
 
-      // For all points (=hits that yield the best fit) of this xroad,
-      // get the yroad point in the same plane (if available), then check
-      // if their ADC amplitudes approximately match (within a hard cut)
-      const Road::Pvec_t& ypoints = yroad->GetPoints();
-      Road::Pvec_t::const_iterator ityp = ypoints.begin();
-      UInt_t nmatches = 0;
-      Double_t matchval = 0.0;
-      for( Road::Pvec_t::const_iterator itxp = xpoints.begin();
-	   itxp != xpoints.end(); ++itxp ) {
-	const Road::Point* xp = *itxp;
-	assert( xp and xp->hit );
-	const Plane* xplane = xp->hit->GetPlane();
-	assert( xplane );
-	UInt_t xnum = xplane->GetPlaneNum();
-	assert( xnum < xplanes.size() );
-	// No hit in the other readout direction of this plane?
-	if( not ybits.TestBitNumber(xnum) )
-	  continue;
-	// Move y-iterator forward until it gets to the same plane
-	assert( ityp == ypoints.end() or
-		(*ityp)->hit->GetPlaneNum() != kMaxUInt );
-	while( ityp != ypoints.end() and
-	       (*ityp)->hit->GetPlaneNum() != xnum ) {
-	  ++ityp;
-	}
-	// Must find a corresponding hit here, else bug in ybits test
-	assert( ityp != ypoints.end() );
-	if( ityp == ypoints.end() ) break;
-	const Road::Point* yp = *ityp;
-	assert( yp and yp->hit );
-	const Plane* yplane = yp->hit->GetPlane();
-	assert( yplane );
-	assert( yplane->GetPartner() == xplane );
-
-	// Get ratio of hit amplitudes
-	assert( dynamic_cast<GEMHit*>(xp->hit) );
-	assert( dynamic_cast<GEMHit*>(yp->hit) );
-	Double_t xampl = static_cast<GEMHit*>(xp->hit)->GetADCsum();
-	Double_t yampl = static_cast<GEMHit*>(yp->hit)->GetADCsum();
-	assert( xampl > 0.0 and yampl > 0.0 ); // ensured in Decoder
-	if( xampl < 1.0 or yampl < 1.0 )
-	  continue;
-	Double_t ratio = xampl/yampl;
-	Double_t asym = (xampl - yampl)/(xampl + yampl);
-	// Compute the cutoff. In general, the sigma of the distribution can
-	// be amplitude-dependent, so we get it via a calibration function
-	// that is a property of each readout plane
-	// 	  Double_t xsigma = xplane->GetAmplSigma( xampl );
-	// 	  Double_t ysigma = yplane->GetAmplSigma( yampl );
-	// Apply overall scale factor ("number of sigmas") from the database
-	// 	  Double_t cutoff = fMaxCorrNsigma / yampl *
-	// 	    TMath::Sqrt( xsigma*xsigma + ysigma*ysigma*ratio*ratio );
-	Double_t cutoff = fMaxCorrNsigma;
+      for( Rvec_t::size_type iy = ygroup[ig]; iy < ygroup[ig+1]; ++iy ) {
+	Road* yroad = yroads[iy];
+	assert( yroad->GetPlanePattern() == ypat );
+
+	// For all points (=hits that yield the best fit) of this xroad,
+	// get the yroad point in the same plane (if available), then check
+	// if their ADC amplitudes approximately match (within a hard cut)
+	const Road::Pvec_t& ypoints = yroad->GetPoints();
+	Road::Pvec_t::const_iterator ityp = ypoints.begin();
+	UInt_t nmatches = 0;
+	Double_t matchval = 0.0;
+	for( Road::Pvec_t::const_iterator itxp = xpoints.begin();
+	     itxp != xpoints.end(); ++itxp ) {
+	  const Road::Point* xp = *itxp;
+	  assert( xp and xp->hit );
+	  const Plane* xplane = xp->hit->GetPlane();
+	  assert( xplane );
+	  UInt_t xnum = xplane->GetPlaneNum();
+	  assert( xnum < xplanes.size() );
+	  // No hit in the other readout direction of this plane?
+	  if( (ypat & (1U<<xnum)) == 0 )
+	    continue;
+	  // Move y-iterator forward until it gets to the same plane
+	  assert( ityp == ypoints.end() or
+		  (*ityp)->hit->GetPlaneNum() != kMaxUInt );
+	  while( ityp != ypoints.end() and
+		 (*ityp)->hit->GetPlaneNum() != xnum ) {
+	    ++ityp;
+	  }
+	  // Must find a corresponding hit here, else bug in ypat test
+	  assert( ityp != ypoints.end() );
+	  if( ityp == ypoints.end() ) break;
+	  const Road::Point* yp = *ityp;
+	  assert( yp and yp->hit );
+	  const Plane* yplane = yp->hit->GetPlane();
+	  assert( yplane );
+	  assert( yplane->GetPartner() == xplane );
+
+	  // Get ratio of hit amplitudes
+	  assert( dynamic_cast<GEMHit*>(xp->hit) );
+	  assert( dynamic_cast<GEMHit*>(yp->hit) );
+	  Double_t xampl = static_cast<GEMHit*>(xp->hit)->GetADCsum();
+	  Double_t yampl = static_cast<GEMHit*>(yp->hit)->GetADCsum();
+	  assert( xampl > 0.0 and yampl > 0.0 ); // ensured in Decoder
+	  if( xampl < 1.0 or yampl < 1.0 )
+	    continue;
+	  Double_t ratio = xampl/yampl;
+	  Double_t asym = (xampl - yampl)/(xampl + yampl);
+	  // Compute the cutoff. In general, the sigma of the distribution can
+	  // be amplitude-dependent, so we get it via a calibration function
+	  // that is a property of each readout plane
+	  //        Double_t xsigma = xplane->GetAmplSigma( xampl );
+	  //        Double_t ysigma = yplane->GetAmplSigma( yampl );
+	  // Apply overall scale factor ("number of sigmas") from the database
+	  //        Double_t cutoff = fMaxCorrNsigma / yampl *
+	  //          TMath::Sqrt( xsigma*xsigma + ysigma*ysigma*ratio*ratio );
+	  Double_t cutoff = fMaxCorrNsigma;
 #ifdef VERBOSE
-	if( fDebug > 3 ) {
-	  cout << xplane->GetName() << yplane->GetName()
-	       << " ampl = (" << xampl << ", " << yampl << ")"
-	       << ",\tratio = " << ratio
-	       << ", asym = " << asym << endl;
-	}
+	  if( fDebug > 3 ) {
+	    cout << xplane->GetName() << yplane->GetName()
+		 << " ampl = (" << xampl << ", " << yampl << ")"
+		 << ",\tratio = " << ratio
+		 << ", asym = " << asym << endl;
+	  }
 #endif
-	// Count readout planes whose x/y-hit amplitudes match
-	if( TMath::Abs(asym) < cutoff ) {
-	  matchval += TMath::Abs(asym);  // not really used later (yet)
-	  ++nmatches;
-	}
-      } //xpoints
+	  // Count readout planes whose x/y-hit amplitudes match
+	  if( TMath::Abs(asym) < cutoff ) {
+	    matchval += TMath::Abs(asym);  // not really used later (yet)
+	    ++nmatches;
+	  }
+	} //xpoints
 
 #ifdef VERBOSE
-      if( fDebug > 3 ) {
-	cout <<   "nmatches = " << nmatches
-	     << ", matchval = " << matchval << "   ";
-      }
+	if( fDebug > 3 ) {
+	  cout <<   "nmatches = " << nmatches
+	       << ", matchval = " << matchval << "   ";
+	}
 #endif
-      // If enough planes have correlated x/y hit amplitudes, save this
-      // x/y road pair as a possible 3D track candidate. The 3D track fit
-      // will separate the wheat from the chaff later
-      if( nmatches + fMaxCorrMismatches >= nplanes ) {
-	selected[0] = xroad;
-	selected[1] = yroad;
-	Add3dMatch( selected, matchval, combos_found, unique_found );
-	++nfound;
-      }
+	// If enough planes have correlated x/y hit amplitudes, save this
+	// x/y road pair as a possible 3D track candidate. The 3D track fit
+	// will separate the wheat from the chaff later
+	if( nmatches + fMaxCorrMismatches >= nplanes ) {
+	  selected[0] = xroad;
+	  selected[1] = yroad;
+	  Add3dMatch( selected, matchval, combos_found, unique_found );
+	  ++nfound;
+	}
 #ifdef VERBOSE
-      else if( fDebug > 3 ) { cout << endl; }
+	else if( fDebug > 3 ) { cout << endl; }
 #endif
-    } //yroads
+      } //yroads
+    } //ygroups
   }   //xroads
 
   return nfound;
@@ -40,6 +40,7 @@ namespace TreeSearch {
 
     virtual UInt_t GetCrateMapDBcols() const;
 
+    virtual Tracker* NewClone() const;
     virtual Plane* MakePlane( const char* name, const char* description = "",
 			      THaDetectorBase* parent = 0 ) const;
     virtual UInt_t MatchRoadsImpl( vector<Rvec_t>& roads, UInt_t ncombos,
@@ -14,6 +14,8 @@
 #include <cassert>
 #include <functional>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 
 namespace TreeSearch {
 
@@ -148,6 +150,137 @@ namespace TreeSearch {
     return (((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
   }
 
+  //___________________________________________________________________________
+  // Normal equations (At W A) b = (At W) y of a linear least-squares fit
+  // with exactly four parameters, such as the straight-line 3D track fit.
+  // All data are kept in fixed-size arrays, and the system is solved via
+  // Cholesky decomposition (At W A = L Lt), so no heap allocation occurs.
+  // Use this instead of TMatrixDSym/TDecompChol in time-critical code.
+
+  class NormalEq4 {
+  public:
+    NormalEq4() { Clear(); }
+
+    void Clear() {
+      memset( fAtA, 0, sizeof(fAtA) );
+      memset( fAty, 0, sizeof(fAty) );
+      fNpoints = 0;
+      fSolved = false;
+    }
+    void Add( const Double_t* Ai, Double_t y, Double_t w = 1.0 ) {
+      // Add measurement y with weight w (=1/sigma^2) and model row Ai[4].
+      // Only the upper triangle of At W A is accumulated.
+      for( int j = 0; j<4; ++j ) {
+	Double_t wa = w * Ai[j];
+	for( int k = j; k<4; ++k )
+	  fAtA[j][k] += wa * Ai[k];
+	fAty[j] += wa * y;
+      }
+      ++fNpoints;
+    }
+    void Update( const Double_t* Ai, Double_t dy, Double_t w = 1.0 ) {
+      // Change the value of a previously added measurement with model row
+      // Ai[4] and weight w by dy. Since only At W y changes, the Cholesky
+      // factor from a prior Solve() stays valid, and Resolve() can be used.
+      for( int j = 0; j<4; ++j )
+	fAty[j] += w * Ai[j] * dy;
+    }
+    Int_t  GetNpoints() const { return fNpoints; }
+    Bool_t Solve( Double_t* coef );
+    Bool_t Resolve( Double_t* coef ) const;
+    Bool_t GetCovariance( Double_t covar[4][4] ) const;
+
+  private:
+    Double_t fAtA[4][4];  // At W A (upper triangle)
+    Double_t fAty[4];     // At W y
+    Double_t fL[4][4];    // Cholesky factor L (lower triangle), set by Solve
+    Int_t    fNpoints;    // Number of measurements added
+    Bool_t   fSolved;     // fL is valid
+  };
+
+  //___________________________________________________________________________
+  inline Bool_t NormalEq4::Solve( Double_t* coef )
+  {
+    // Solve the normal equations. Results (4 values) are put in 'coef'.
+    // Returns false if the matrix is not positive-definite.
+
+    // Decompose At W A = L Lt
+    for( int j = 0; j<4; ++j ) {
+      Double_t d = fAtA[j][j];
+      for( int k = 0; k<j; ++k )
+	d -= fL[j][k] * fL[j][k];
+      if( d <= 0.0 )
+	return (fSolved = false);
+      fL[j][j] = std::sqrt(d);
+      Double_t inv = 1.0/fL[j][j];
+      for( int i = j+1; i<4; ++i ) {
+	Double_t s = fAtA[j][i];
+	for( int k = 0; k<j; ++k )
+	  s -= fL[i][k] * fL[j][k];
+	fL[i][j] = s * inv;
+      }
+    }
+    fSolved = true;
+    return Resolve( coef );
+  }
+
+  //___________________________________________________________________________
+  inline Bool_t NormalEq4::Resolve( Double_t* coef ) const
+  {
+    // Solve the normal equations with the decomposition from the last call
+    // to Solve(), after updating measurements with Update().
+    // Results (4 values) are put in 'coef'.
+
+    if( !fSolved )
+      return false;
+    // Forward substitution L z = At W y, then back substitution Lt b = z
+    Double_t z[4];
+    for( int i = 0; i<4; ++i ) {
+      Double_t s = fAty[i];
+      for( int k = 0; k<i; ++k )
+	s -= fL[i][k] * z[k];
+      z[i] = s / fL[i][i];
+    }
+    for( int i = 3; i>=0; --i ) {
+      Double_t s = z[i];
+      for( int k = i+1; k<4; ++k )
+	s -= fL[k][i] * coef[k];
+      coef[i] = s / fL[i][i];
+    }
+    return true;
+  }
+
+  //___________________________________________________________________________
+  inline Bool_t NormalEq4::GetCovariance( Double_t covar[4][4] ) const
+  {
+    // Get covariance matrix of the fit parameters, (At W A)^-1 = Lt^-1 L^-1.
+    // Requires a successful call to Solve().
+
+    if( !fSolved )
+      return false;
+    // Invert L (lower triangular)
+    Double_t Li[4][4];
+    memset( Li, 0, sizeof(Li) );
+    for( int j = 0; j<4; ++j ) {
+      Li[j][j] = 1.0/fL[j][j];
+      for( int i = j+1; i<4; ++i ) {
+	Double_t s = 0.0;
+	for( int k = j; k<i; ++k )
+	  s -= fL[i][k] * Li[k][j];
+	Li[i][j] = s / fL[i][i];
+      }
+    }
+    for( int j = 0; j<4; ++j ) {
+      for( int k = j; k<4; ++k ) {
+	Double_t s = 0.0;
+	for( int i = k; i<4; ++i )
+	  s += Li[i][j] * Li[i][k];
+	covar[j][k] = covar[k][j] = s;
+      }
+    }
+    return true;
+  }
+
 ///////////////////////////////////////////////////////////////////////////////
 
 } // end namespace TreeSearch
@@ -19,9 +19,6 @@
 #include <functional>
 #include <iostream>
 
-class TSeqCollection;
-class TIterator;
-
 namespace TreeSearch {
 
   class Road;
@@ -47,6 +44,11 @@ namespace TreeSearch {
     // only used in Roads::CollectCoordinates
     virtual UInt_t   GetNumPos()         const;
     virtual Double_t GetPosI( UInt_t i ) const;
+    // Correct the hit position(s) for the slope of the track crossing the
+    // plane, where applicable. Used in fine tracking.
+    virtual void     ApplyTrackSlope( Double_t /* slope */ ) {}
+    // The 'data' value to pass to Plane::AddHits to recreate this hit
+    virtual Double_t GetInputData()      const { return 0; }
 
     Double_t GetPos()        const { return fPos; }
     Double_t GetResolution() const { return fResolution; }
@@ -56,6 +58,13 @@ namespace TreeSearch {
     UInt_t   GetPlaneNum()   const { return fPlane->GetPlaneNum(); }
     UInt_t   GetAltPlaneNum() const { return fPlane->GetAltPlaneNum(); }
 
+    // Hit rejected as isolated noise by Projection::FilterHits. Filtered
+    // hits are not entered into the hitpattern.
+    Bool_t   IsFiltered()    const { return TestBit(kFiltered); }
+    void     SetFiltered( Bool_t enable = true ) { SetBit(kFiltered,enable); }
+
+    enum { kFiltered = BIT(14) };
+
     // Functor for ordering hits in sets
     struct PosIsLess : public std::binary_function< Hit*, Hit*, bool >
     {
@@ -80,62 +89,46 @@ namespace TreeSearch {
   };
 
   //___________________________________________________________________________
-  // Utility class for iterating over one or two collections of hits.
-  // Used for generating hit patterns. If two collections are given, they
-  // are assumed to contain hits from adjacent planes with parallel
-  // (and usually staggered) wires, and hit pairs are returned for hits
-  // whose positions are within 'maxdist' of each other.
-
-  typedef std::pair<TObject*,TObject*> ObjPair_t;
+  // Utility class for pairing the hits of two partner planes, i.e. adjacent
+  // planes with parallel (and usually staggered) wires. Used for generating
+  // hit patterns. The hits of each plane are given as contiguous arrays of
+  // the low and high ends of their position ranges, sorted by position, as
+  // the hits in the planes' hit arrays are. Next() returns the indices of
+  // hit pairs whose ranges are within 'maxdist' of each other, or of
+  // unpaired hits in either plane, with the other index set to -1.
+  // This is a two-pointer merge of the two arrays. It does not allocate
+  // memory and does not require virtual function calls.
 
   class HitPairIter {
 
   public:
-    HitPairIter( const TSeqCollection* collA, const TSeqCollection* collB,
-		 Double_t maxdist );
-    HitPairIter( const HitPairIter& rhs );
-    HitPairIter& operator=( const HitPairIter& rhs );
-    virtual ~HitPairIter();
-
-    const TSeqCollection* GetCollection( Int_t n=0 ) const
-    { return (n==0) ? fCollA : fCollB; }
-    void Reset();
-
-    // Iterator functions.
-    HitPairIter& Next();
-    HitPairIter& operator++() { return Next(); }
-    const HitPairIter operator++(int) {
-      HitPairIter clone(*this);  Next();  return clone;
-    }
-    // Current value.
-    ObjPair_t  operator()() const  { return fCurrent; }
-    ObjPair_t& operator* ()        { return fCurrent; }
-    // Comparisons
-    bool operator==( const HitPairIter& rhs ) const {
-      return( fCollA == rhs.fCollA && fCollB == rhs.fCollB &&
-	      fCurrent == rhs.fCurrent );
-    }
-    bool operator!=( const HitPairIter& rhs ) const { return !(*this==rhs); }
-    operator bool() const
-    { return (fCurrent.first != 0 || fCurrent.second != 0); }
-    bool operator!() const { return !((bool)*this); }
+    HitPairIter( UInt_t nA, const Double_t* loA, const Double_t* hiA,
+		 UInt_t nB, const Double_t* loB, const Double_t* hiB,
+		 Double_t maxdist )
+      : fNA(nA), fLoA(loA), fHiA(hiA), fNB(nB), fLoB(loB), fHiB(hiB),
+	fMaxDist(maxdist) { Reset(); }
+
+    void Reset() { fA = fB = fSaveB = 0; fScanning = false; }
+    bool Next( Int_t& ia, Int_t& ib );
 
   private:
-    const TSeqCollection* fCollA;
-    const TSeqCollection* fCollB;
-    TIterator* fIterA;
-    TIterator* fIterB;
-    TIterator* fSaveIter;
-    Hit* fSaveHit;
-    Double_t fMaxDist;
-    Bool_t fStarted;
-    Bool_t fScanning;
-    ObjPair_t fCurrent;
-    ObjPair_t fNext;
-
-    HitPairIter();
-
-    ClassDef(HitPairIter,0)  // Iterator over two lists of hits
+    UInt_t          fNA;       // Number of hits in plane A
+    const Double_t* fLoA;      // [fNA] Low ends of hit ranges in plane A
+    const Double_t* fHiA;      // [fNA] High ends of hit ranges in plane A
+    UInt_t          fNB;       // Number of hits in plane B
+    const Double_t* fLoB;      // [fNB] Low ends of hit ranges in plane B
+    const Double_t* fHiB;      // [fNB] High ends of hit ranges in plane B
+    Double_t        fMaxDist;  // Maximum distance of paired hits
+    UInt_t          fA;        // Next hit to consider in A
+    UInt_t          fB;        // Next hit to consider in B
+    UInt_t          fSaveB;    // Hit in B where the current scan started
+    bool            fScanning; // Scanning B for matches of a fixed A
+
+    // Hit i in A is to the left of hit j in B, or vice versa
+    bool ALessB( UInt_t i, UInt_t j ) const
+    { return fHiA[i]+fMaxDist < fLoB[j]; }
+    bool BLessA( UInt_t j, UInt_t i ) const
+    { return fHiB[j]+fMaxDist < fLoA[i]; }
   };
 
   //___________________________________________________________________________
@@ -169,6 +162,9 @@ namespace TreeSearch {
     Double_t  Get3DTrkDist()  const
     { return fHit ? f3DTrkPos-fHit->GetPos() : kBig; }
     Double_t  Get3DTrkResid() const { return fHit ? f3DTrkPos-fPos : kBig; }
+
+    void      Set3DTrack( Double_t pos, Double_t trkpos, Double_t trkslope )
+    { fPos = pos; f3DTrkPos = trkpos; f3DTrkSlope = trkslope; }
     // Int_t     GetWireNum()    const { return fHit ? fHit->GetWireNum() : -1; }
 
   private:
@@ -299,6 +295,75 @@ namespace TreeSearch {
   }
 #endif
 
+  //___________________________________________________________________________
+  inline
+  bool HitPairIter::Next( Int_t& ia, Int_t& ib )
+  {
+    // Get the next pair of hits along the wire plane. If a hit in either
+    // plane is unpaired (no matching hit on the other plane within maxdist)
+    // then the index of the other hit is -1. Returns false if there are
+    // no more hits in either plane.
+
+    UInt_t a = fA, b = fB;
+    bool haveA = (a < fNA), haveB = (b < fNB);
+    ia = haveA ? Int_t(a) : -1;
+    ib = haveB ? Int_t(b) : -1;
+
+    if( haveA && haveB ) {
+      if( ALessB(a,b) ) {
+	++fA;
+	ib = -1;
+      } else if( BLessA(b,a) ) {
+	++fB;
+	ia = -1;
+      } else {
+	// Found a pair
+	UInt_t nextB = b+1;
+	if( nextB == fNB || ALessB(a,nextB) ) {
+	  if( fScanning ) {
+	    // End of a scan of plane B with fixed A. Advance to the next A.
+	    // Rewind B to where the scan started, then advance B until either
+	    // B >= A or B == nextB (the hit in B that ended the prior scan),
+	    // whichever comes first. The Bs for which saveB <= B < nextB have
+	    // been paired with the prior A in the prior scan and so can't be
+	    // considered unpaired, but they might pair with the new A, still.
+	    fScanning = false;
+	    b = fSaveB;
+	    if( ++a < fNA ) {
+	      while( b != nextB && BLessA(b,a) )
+		++b;
+	    } else
+	      b = nextB;
+	    fA = a;
+	    fB = b;
+	  } else {
+	    // This is the normal case: nextB > A (usually true for small
+	    // maxdist). The next hits to consider are the next ones in each
+	    // plane.
+	    fA = a+1;
+	    fB = nextB;
+	  }
+	} else {
+	  // A==B and A==nextB, so more than one B matches this A.
+	  // Keep A fixed and walk along B as long as B==A.
+	  if( !fScanning ) {
+	    fScanning = true;
+	    fSaveB = b;
+	  }
+	  fB = nextB;
+	}
+      }
+    }
+    else if( haveA )
+      ++fA;
+    else if( haveB )
+      ++fB;
+    else
+      return false;
+
+    return true;
+  }
+
 ///////////////////////////////////////////////////////////////////////////////
 
 } // end namespace TreeSearch
@@ -0,0 +1,348 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::HitSnapshot                                                   //
+//                                                                           //
+// Snapshots of decoded hits, for re-running the tracking with different     //
+// parameters without the cost of raw decoding.                              //
+//                                                                           //
+// In write mode, WriteEvent() appends the hits of all planes of the         //
+// tracker, as decoded by Tracker::Decode (i.e. after reference time,        //
+// offset and pedestal corrections), to the file. In read mode, ReadEvent()  //
+// adds the hits of the next recorded event to the planes via the in-memory  //
+// hit input (Plane::AddHits), after which Tracker::DecodeHits() completes   //
+// the decoding, e.g. the drift time-to-distance conversion with the current //
+// database parameters. The Tracker uses snapshots automatically if the      //
+// database keys snapshot_write or snapshot_read are set.                    //
+//                                                                           //
+// File format (native byte order), optionally gzip-compressed:              //
+//                                                                           //
+//  header:  char[8] "TSSNAPv1", UInt_t nplanes, UInt_t geometry checksum,   //
+//           UInt_t hit record size                                          //
+//  events:  Int_t evnum, UInt_t nhits[nplanes],                             //
+//           { Double_t pos, Double_t data }[sum of nhits],                  //
+//           UInt_t CRC-32 of the preceding bytes of the event               //
+//                                                                           //
+// 'data' is the drift time for wire planes and the cluster charge for GEM   //
+// planes (see Hit::GetInputData). Other hit details, such as GEM cluster    //
+// sizes and Monte Carlo truth, are not recorded.                            //
+//                                                                           //
+// The geometry checksum covers the names, types, number of elements,        //
+// positions, pitches and angles of all planes. A snapshot can only be       //
+// replayed by a tracker with the same geometry. Parameters not affecting    //
+// the recorded hits (resolutions, drift time-to-distance conversion,        //
+// tracking cuts etc.) may differ.                                           //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "HitSnapshot.h"
+#include "Tracker.h"
+#include "Projection.h"
+#include "Plane.h"
+#include "Hit.h"
+#include "TError.h"
+
+#include <zlib.h>
+#include <cstring>
+#include <cassert>
+
+using namespace std;
+
+namespace TreeSearch {
+
+static const char     kMagic[8] = { 'T','S','S','N','A','P','v','1' };
+static const UInt_t   kHitSize  = 2*sizeof(Double_t);
+// Sanity limit on the number of hits per event in a snapshot
+static const UInt_t   kMaxHits  = 10000000;
+// Size of the file buffer for gzip (de)compression
+static const unsigned kGzBufSize = 1U<<20;
+
+//_____________________________________________________________________________
+template< typename T >
+static inline void Append( vector<char>& buf, const T& val )
+{
+  // Append the bytes of val to buf
+
+  const char* p = reinterpret_cast<const char*>(&val);
+  buf.insert( buf.end(), p, p+sizeof(T) );
+}
+
+//_____________________________________________________________________________
+template< typename T >
+static inline const char* Extract( const char* p, T& val )
+{
+  // Copy val from the bytes at p. Returns the position following val.
+
+  memcpy( &val, p, sizeof(T) );
+  return p+sizeof(T);
+}
+
+//_____________________________________________________________________________
+HitSnapshot::HitSnapshot( Tracker* tracker )
+  : fTracker(tracker), fMode(kClosed), fFile(0), fAtEnd(false),
+    fError(false), fEvNum(0), fNevents(0)
+{
+  // Constructor. The tracker must be initialized before a file is opened.
+
+  assert( tracker );
+}
+
+//_____________________________________________________________________________
+HitSnapshot::~HitSnapshot()
+{
+  // Destructor
+
+  Close();
+}
+
+//_____________________________________________________________________________
+UInt_t HitSnapshot::GetGeometryChecksum() const
+{
+  // CRC-32 of the geometry parameters of the tracker's planes that
+  // determine the recorded hit positions
+
+  vector<char> buf;
+  for( UInt_t i = 0; i < fTracker->GetNplanes(); ++i ) {
+    const Plane* pl = fTracker->GetPlane(i);
+    const char* name = pl->GetName();
+    buf.insert( buf.end(), name, name+strlen(name)+1 );
+    Append( buf, static_cast<Int_t>(pl->GetType()) );
+    Append( buf, static_cast<Int_t>(pl->GetNelem()) );
+    Append( buf, static_cast<Int_t>(pl->IsDummy()) );
+    Append( buf, pl->GetStart() );
+    Append( buf, pl->GetPitch() );
+    Append( buf, pl->GetZ() );
+    Append( buf, pl->GetProjection() ? pl->GetProjection()->GetAngle() : 0.0 );
+  }
+  uLong crc = crc32( 0L, Z_NULL, 0 );
+  if( !buf.empty() )
+    crc = crc32( crc, reinterpret_cast<const Bytef*>(&buf[0]), buf.size() );
+  return static_cast<UInt_t>(crc);
+}
+
+//_____________________________________________________________________________
+Int_t HitSnapshot::OpenWrite( const char* filename, Int_t compression )
+{
+  // Create the snapshot file 'filename' for recording. compression is the
+  // gzip compression level, 0 (none, fastest) to 9. Returns 0 on success.
+
+  static const char* const here = "HitSnapshot::OpenWrite";
+
+  Close();
+  if( compression < 0 or compression > 9 ) {
+    ::Error( here, "Illegal compression level %d. Must be 0-9.",
+	     compression );
+    return -1;
+  }
+  char mode[] = "wb0";
+  mode[2] = static_cast<char>( '0' + compression );
+  gzFile f = gzopen( filename, mode );
+  if( !f ) {
+    ::Error( here, "Cannot create snapshot file %s", filename );
+    return -2;
+  }
+  gzbuffer( f, kGzBufSize );
+
+  vector<char> head( kMagic, kMagic+sizeof(kMagic) );
+  Append( head, fTracker->GetNplanes() );
+  Append( head, GetGeometryChecksum() );
+  Append( head, kHitSize );
+  if( gzwrite( f, &head[0], head.size() ) != static_cast<int>(head.size()) ) {
+    ::Error( here, "Error writing snapshot file %s", filename );
+    gzclose( f );
+    return -3;
+  }
+  fFile = f;
+  fFileName = filename;
+  fMode = kWrite;
+  fNevents = 0;
+  return 0;
+}
+
+//_____________________________________________________________________________
+Int_t HitSnapshot::OpenRead( const char* filename )
+{
+  // Open the snapshot file 'filename' for replay and check that it matches
+  // the tracker's geometry. Enables external hit input in all planes.
+  // Returns 0 on success.
+
+  static const char* const here = "HitSnapshot::OpenRead";
+
+  Close();
+  gzFile f = gzopen( filename, "rb" );
+  if( !f ) {
+    ::Error( here, "Cannot open snapshot file %s", filename );
+    return -1;
+  }
+  gzbuffer( f, kGzBufSize );
+
+  char head[ sizeof(kMagic) + 3*sizeof(UInt_t) ];
+  UInt_t nplanes = 0, checksum = 0, hitsize = 0;
+  if( gzread( f, head, sizeof(head) ) != static_cast<int>(sizeof(head)) or
+      memcmp( head, kMagic, sizeof(kMagic) ) != 0 ) {
+    ::Error( here, "%s is not a TreeSearch hit snapshot file", filename );
+    gzclose( f );
+    return -2;
+  }
+  const char* p = head + sizeof(kMagic);
+  p = Extract( p, nplanes );
+  p = Extract( p, checksum );
+  p = Extract( p, hitsize );
+  if( nplanes != fTracker->GetNplanes() or hitsize != kHitSize or
+      checksum != GetGeometryChecksum() ) {
+    ::Error( here, "Snapshot file %s does not match the geometry of "
+	     "tracker \"%s\" (planes %u/%u, checksum %08x/%08x). "
+	     "Check database.", filename, nplanes, fTracker->GetNplanes(),
+	     checksum, GetGeometryChecksum() );
+    gzclose( f );
+    return -3;
+  }
+  for( UInt_t i = 0; i < nplanes; ++i )
+    fTracker->GetPlane(i)->SetExtInput();
+
+  fFile = f;
+  fFileName = filename;
+  fMode = kRead;
+  fAtEnd = fError = false;
+  fNevents = 0;
+  return 0;
+}
+
+//_____________________________________________________________________________
+void HitSnapshot::Close()
+{
+  // Close the file. After replay, return the planes to normal decoding.
+
+  if( fFile )
+    gzclose( static_cast<gzFile>(fFile) );
+  if( fMode == kRead ) {
+    for( UInt_t i = 0; i < fTracker->GetNplanes(); ++i )
+      fTracker->GetPlane(i)->SetExtInput( false );
+  }
+  fFile = 0;
+  fFileName.clear();
+  fMode = kClosed;
+}
+
+//_____________________________________________________________________________
+Int_t HitSnapshot::WriteEvent( Int_t evnum )
+{
+  // Append the hits currently in the tracker's planes, as event 'evnum'.
+  // Returns 0 on success.
+
+  if( fMode != kWrite ) {
+    ::Error( "HitSnapshot::WriteEvent", "No snapshot file open for writing" );
+    return -1;
+  }
+  UInt_t np = fTracker->GetNplanes();
+  fBuf.clear();
+  Append( fBuf, evnum );
+  for( UInt_t i = 0; i < np; ++i )
+    Append( fBuf, static_cast<UInt_t>(fTracker->GetPlane(i)->GetNhits()) );
+  for( UInt_t i = 0; i < np; ++i ) {
+    const Plane* pl = fTracker->GetPlane(i);
+    for( Int_t k = 0; k < pl->GetNhits(); ++k ) {
+      const Hit* hit = pl->GetHit(k);
+      Append( fBuf, hit->GetPos() );
+      Append( fBuf, hit->GetInputData() );
+    }
+  }
+  UInt_t crc = crc32( 0L, reinterpret_cast<const Bytef*>(&fBuf[0]),
+		      fBuf.size() );
+  Append( fBuf, crc );
+
+  if( gzwrite( static_cast<gzFile>(fFile), &fBuf[0], fBuf.size() ) !=
+      static_cast<int>(fBuf.size()) ) {
+    ::Error( "HitSnapshot::WriteEvent", "Error writing snapshot file %s",
+	     fFileName.c_str() );
+    return -2;
+  }
+  fEvNum = evnum;
+  ++fNevents;
+  return 0;
+}
+
+//_____________________________________________________________________________
+Int_t HitSnapshot::ReadEvent()
+{
+  // Read the next event and add its hits to the tracker's planes, which
+  // must have been cleared. Then call Tracker::DecodeHits. Returns 1 on
+  // success, 0 at the end of the file, negative on error. After an error,
+  // the file position is undefined, and no further records are read.
+
+  static const char* const here = "HitSnapshot::ReadEvent";
+
+  if( fMode != kRead ) {
+    ::Error( here, "No snapshot file open for reading" );
+    return -1;
+  }
+  if( fError )
+    return -5;
+  gzFile f = static_cast<gzFile>(fFile);
+  UInt_t np = fTracker->GetNplanes();
+  UInt_t headsz = sizeof(Int_t) + np*sizeof(UInt_t);
+  fBuf.resize( headsz );
+  int n = gzread( f, &fBuf[0], headsz );
+  if( n == 0 ) {
+    fAtEnd = true;
+    return 0;
+  }
+  if( n != static_cast<int>(headsz) ) {
+    ::Error( here, "Truncated record %llu in snapshot file %s",
+	     fNevents, fFileName.c_str() );
+    fError = true;
+    return -2;
+  }
+  Int_t evnum;
+  const char* p = Extract( &fBuf[0], evnum );
+  fNhits.resize( np );
+  UInt_t ntot = 0;
+  for( UInt_t i = 0; i < np; ++i ) {
+    p = Extract( p, fNhits[i] );
+    ntot += fNhits[i];
+  }
+  if( ntot > kMaxHits ) {
+    ::Error( here, "Corrupt record %llu in snapshot file %s",
+	     fNevents, fFileName.c_str() );
+    fError = true;
+    return -3;
+  }
+  UInt_t bodysz = ntot*kHitSize;
+  fBuf.resize( headsz + bodysz + sizeof(UInt_t) );
+  n = gzread( f, &fBuf[headsz], bodysz + sizeof(UInt_t) );
+  if( n != static_cast<int>(bodysz + sizeof(UInt_t)) ) {
+    ::Error( here, "Truncated record %llu in snapshot file %s",
+	     fNevents, fFileName.c_str() );
+    fError = true;
+    return -2;
+  }
+  UInt_t crc;
+  Extract( &fBuf[headsz+bodysz], crc );
+  if( crc != crc32( 0L, reinterpret_cast<const Bytef*>(&fBuf[0]),
+		    headsz+bodysz ) ) {
+    ::Error( here, "Checksum error in record %llu of snapshot file %s",
+	     fNevents, fFileName.c_str() );
+    fError = true;
+    return -4;
+  }
+
+  p = &fBuf[headsz];
+  for( UInt_t i = 0; i < np; ++i ) {
+    UInt_t nh = fNhits[i];
+    if( nh == 0 )
+      continue;
+    fPos.resize( nh );
+    fData.resize( nh );
+    for( UInt_t k = 0; k < nh; ++k ) {
+      p = Extract( p, fPos[k] );
+      p = Extract( p, fData[k] );
+    }
+    fTracker->GetPlane(i)->AddHits( nh, &fPos[0], 0, &fData[0] );
+  }
+  fEvNum = evnum;
+  ++fNevents;
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end namespace TreeSearch
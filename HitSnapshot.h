@@ -0,0 +1,66 @@
+#ifndef ROOT_TreeSearch_HitSnapshot
+#define ROOT_TreeSearch_HitSnapshot
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::HitSnapshot                                                   //
+//                                                                           //
+// Recording of the decoded hits of a Tracker to a binary file, and replay   //
+// of the recorded hits into the tracker's planes, bypassing raw decoding.   //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Rtypes.h"
+#include <vector>
+#include <string>
+
+namespace TreeSearch {
+
+  class Tracker;
+
+  class HitSnapshot {
+  public:
+    enum EMode { kClosed, kWrite, kRead };
+
+    HitSnapshot( Tracker* tracker );
+    virtual ~HitSnapshot();
+
+    Int_t     OpenWrite( const char* filename, Int_t compression = 0 );
+    Int_t     OpenRead( const char* filename );
+    void      Close();
+
+    Int_t     WriteEvent( Int_t evnum );
+    Int_t     ReadEvent();
+
+    EMode     GetMode()      const { return fMode; }
+    Bool_t    IsReading()    const { return fMode == kRead; }
+    Bool_t    IsWriting()    const { return fMode == kWrite; }
+    const char* GetFileName() const { return fFileName.c_str(); }
+    Bool_t    AtEnd()        const { return fAtEnd; }
+    Bool_t    HasError()     const { return fError; }
+    Int_t     GetEvNum()     const { return fEvNum; }
+    ULong64_t GetNevents()   const { return fNevents; }
+    UInt_t    GetGeometryChecksum() const;
+
+  private:
+    Tracker*  fTracker;     // Tracker whose planes are recorded/replayed
+    EMode     fMode;        // Current mode
+    void*     fFile;        // Open file (gzFile)
+    std::string fFileName;  // Name of open file
+    Bool_t    fAtEnd;       // End of file reached in read mode
+    Bool_t    fError;       // Read error occurred, no more records read
+    Int_t     fEvNum;       // Event number of last record read or written
+    ULong64_t fNevents;     // Number of records read or written
+    std::vector<char>     fBuf;    // Record buffer
+    std::vector<UInt_t>   fNhits;  // Number of hits per plane in record
+    std::vector<Double_t> fPos;    // Hit positions of one plane, for replay
+    std::vector<Double_t> fData;   // Hit data of one plane, for replay
+
+    // Prevent copying
+    HitSnapshot( const HitSnapshot& );
+    HitSnapshot& operator=( const HitSnapshot& );
+  };
+
+} // end namespace TreeSearch
+
+#endif
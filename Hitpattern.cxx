@@ -272,30 +272,24 @@ Int_t Hitpattern::ScanHits( Plane* pl, Plane* )
   // the points at all depths of the hit pattern that correspond to
   // the hits in the given plane.
   //
-  // Returns number of hits found in the plane
+  // Returns number of hits found in the plane, excluding filtered hits
 
   if( !pl ) return 0;
   UInt_t plane = pl->GetAltPlaneNum();
   assert( plane < fNplanes );
 
+  // Don't record the pseudo-hits in dummy planes
+  bool record = !pl->IsDummy();
   Int_t nhits = 0;
-
-  TIterator* it = pl->GetHits()->MakeIterator();
-  Hit* phit = 0;
-#ifndef NDEBUG
-  Hit* prevHit = 0;
-#endif
-  while( (phit = static_cast<Hit*>(it->Next())) ) {
-    ++nhits;
+  for( Int_t i = 0; i < pl->GetNhits(); ++i ) {
+    Hit* phit = pl->GetHit(i);
+    assert( phit );
+    if( phit->IsFiltered() )
+      continue;
     SetPosition( phit->GetPos()+fOffset, phit->GetResolution(), plane,
-		 // Don't record the pseudo-hits in dummy planes
-		 pl->IsDummy() ? 0 : phit );
-#ifndef NDEBUG
-    assert( phit != prevHit );
-    prevHit = phit;
-#endif
+		 record ? phit : 0 );
+    ++nhits;
   }
-  delete it;
   return nhits;
 }
 
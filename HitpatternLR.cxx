@@ -103,6 +103,34 @@ Int_t HitpatternLR::Fill( const vector<Plane*>& planes )
   return ntot;
 }
 
+//_____________________________________________________________________________
+static UInt_t GetHitRanges( const Plane* pl, vector<Double_t>& range,
+			     vector<WireHit*>& hits )
+{
+  // Copy the positions of the L/R ambiguous hits in plane pl to 'range',
+  // the lower ends (left positions) first, followed by the upper ends (right
+  // positions), and the hits themselves to 'hits'. Filtered hits are
+  // skipped. Returns the number of hits copied.
+
+  hits.clear();
+  if( !pl )
+    return 0;
+  for( Int_t i = 0; i < pl->GetNhits(); ++i ) {
+    assert( dynamic_cast<WireHit*>(pl->GetHit(i)) );
+    WireHit* hit = static_cast<WireHit*>(pl->GetHit(i));
+    if( !hit->IsFiltered() )
+      hits.push_back( hit );
+  }
+  UInt_t n = hits.size();
+  if( range.size() < 2*n )
+    range.resize( 2*n );
+  for( UInt_t i = 0; i < n; ++i ) {
+    range[i]   = hits[i]->GetPosL();
+    range[n+i] = hits[i]->GetPosR();
+  }
+  return n;
+}
+
 //_____________________________________________________________________________
 Int_t HitpatternLR::ScanHits( Plane* A, Plane* B )
 {
@@ -131,18 +159,22 @@ Int_t HitpatternLR::ScanHits( Plane* A, Plane* B )
 
   Int_t nhits = 0;
 
-  HitPairIter it( A->GetHits(), B ? B->GetHits() : 0, maxdist );
-  while( it ) {
+  // Pair the hits of the two planes by merging their position ranges
+  UInt_t nA = GetHitRanges( A, fRangeA, fHitsA );
+  UInt_t nB = GetHitRanges( B, fRangeB, fHitsB );
+  const Double_t* rA = nA ? &fRangeA[0] : 0;
+  const Double_t* rB = nB ? &fRangeB[0] : 0;
+  HitPairIter it( nA, rA, rA+nA, nB, rB, rB+nB, maxdist );
+  Int_t ia, ib;
+  while( it.Next(ia,ib) ) {
     // At least one hit found
     nhits++;
-    assert( !(*it).first  || dynamic_cast<WireHit*>((*it).first)  );
-    assert( !(*it).second || dynamic_cast<WireHit*>((*it).second) );
-    WireHit* hitA = static_cast<WireHit*>((*it).first);
-    WireHit* hitB = static_cast<WireHit*>((*it).second);
-    assert( hitA || hitB );
+    assert( ia >= 0 || ib >= 0 );
+    WireHit* hitA = (ia >= 0) ? fHitsA[ia] : 0;
+    WireHit* hitB = (ib >= 0) ? fHitsB[ib] : 0;
     // Don't record the pseudo-hits in dummy planes
     WireHit* recA = A->IsDummy() ? 0 : hitA;
-    WireHit* recB = B->IsDummy() ? 0 : hitB;
+    WireHit* recB = (!hitB || B->IsDummy()) ? 0 : hitB;
     if( hitA && hitB ) {
       // A pair of hits registered in partner planes. One or more combinations
       // of hit positions may be within maxdist of each other.
@@ -188,7 +220,6 @@ Int_t HitpatternLR::ScanHits( Plane* A, Plane* B )
 		     planeB, recB );
       }
     }
-    ++it;
   }
   return nhits;
 }
@@ -13,6 +13,8 @@
 
 namespace TreeSearch {
 
+  class WireHit;
+
   class HitpatternLR : public Hitpattern {
 
   public:
@@ -25,6 +27,13 @@ namespace TreeSearch {
     virtual Int_t Fill( const std::vector<TreeSearch::Plane*>& planes );
     virtual Int_t ScanHits( Plane* A, Plane* B = 0 );
 
+  protected:
+    // Scratch arrays for the hit position ranges of partner planes
+    std::vector<Double_t> fRangeA;  //! Low ends, followed by high ends
+    std::vector<Double_t> fRangeB;  //! Same for partner plane
+    std::vector<WireHit*> fHitsA;   //! Unfiltered hits of fRangeA
+    std::vector<WireHit*> fHitsB;   //! Same for partner plane
+
     ClassDef(HitpatternLR,0)  // Hitpattern filled by L/R-ambiguous wire hits
   };
 
@@ -0,0 +1,380 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::Instrument                                                    //
+//                                                                           //
+// Stage timing for production running. ReadClock() reads the CPU's time     //
+// stamp counter (a few ns per call) where available, else the monotonic     //
+// system clock. The tick rate is calibrated once at library load time       //
+// against the system clock.                                                 //
+//                                                                           //
+// Durations are collected in LatencyHist histograms, whose bin width grows  //
+// with the value (8 sub-bins per power of two), so that a fixed 4 kB        //
+// histogram covers all latencies with a relative precision of about 6%.     //
+// Filling is a handful of integer operations. Quantiles are computed on     //
+// demand and are estimated at the bin centers.                              //
+//                                                                           //
+// When enabled, Trace collects the start and stop times of the stages       //
+// marked with TraceScope objects from all threads into a ring buffer and    //
+// writes them as "complete" events of the Chrome trace event format.        //
+// Each thread gets a small index when it makes its first record. Stage      //
+// names are copied into a set of interned strings on recording, since the   //
+// names of e.g. cloned planes may be gone by the time the trace is written. //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Instrument.h"
+#include "ThreadPool.h"   // for TS_ATOMIC_ADD
+#include "TMath.h"
+#include "TError.h"
+#include "TMutex.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <set>
+#include <cstring>
+#include <ctime>
+#include <cassert>
+
+using namespace std;
+
+namespace TreeSearch {
+
+// Duration of the tick rate calibration (ns)
+static const ULong64_t kCalibTime = 2000000;
+
+//_____________________________________________________________________________
+ULong64_t ReadMonotonicClock()
+{
+  // Current time of the monotonic system clock, in ns
+
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return static_cast<ULong64_t>(ts.tv_sec)*1000000000ULL + ts.tv_nsec;
+}
+
+//_____________________________________________________________________________
+static Double_t CalibrateClock()
+{
+  // Measure the number of ReadClock() ticks per us by comparing with
+  // the monotonic system clock over a short busy-wait interval
+
+  ULong64_t t0 = ReadMonotonicClock(), c0 = ReadClock();
+  ULong64_t t1, c1;
+  do {
+    t1 = ReadMonotonicClock();
+    c1 = ReadClock();
+  } while( t1-t0 < kCalibTime );
+  if( c1 <= c0 )
+    return 1e3;
+  return 1e3*static_cast<Double_t>(c1-c0)/static_cast<Double_t>(t1-t0);
+}
+
+static const Double_t gTicksPerUs = CalibrateClock();
+
+//_____________________________________________________________________________
+Double_t ClockToUs( Double_t ticks )
+{
+  // Convert a difference of ReadClock() values to microseconds
+
+  return ticks/gTicksPerUs;
+}
+
+//_____________________________________________________________________________
+ULong64_t LatencyHist::GetBinLowEdge( UInt_t bin )
+{
+  // Smallest tick count falling into the given bin
+
+  if( bin < kNsub )
+    return bin;
+  UInt_t shift = bin/kNsub - 1;
+  return static_cast<ULong64_t>(kNsub + bin%kNsub) << shift;
+}
+
+//_____________________________________________________________________________
+ULong64_t LatencyHist::GetBinWidth( UInt_t bin )
+{
+  // Number of distinct tick counts in the given bin
+
+  if( bin < kNsub )
+    return 1;
+  return 1ULL << (bin/kNsub - 1);
+}
+
+//_____________________________________________________________________________
+void LatencyHist::Add( const LatencyHist& rhs )
+{
+  // Add contents of rhs to this histogram
+
+  for( UInt_t i = 0; i < kNbins; ++i )
+    fCount[i] += rhs.fCount[i];
+  fNentries += rhs.fNentries;
+  fSum += rhs.fSum;
+  if( rhs.fMax > fMax )
+    fMax = rhs.fMax;
+}
+
+//_____________________________________________________________________________
+void LatencyHist::Reset()
+{
+  // Clear the histogram
+
+  memset( fCount, 0, sizeof(fCount) );
+  fNentries = 0;
+  fSum = 0;
+  fMax = 0;
+}
+
+//_____________________________________________________________________________
+Double_t LatencyHist::GetQuantile( Double_t q ) const
+{
+  // Estimate of the q-quantile (0 <= q <= 1) of the entries, in ticks.
+  // Returns the center of the bin containing the quantile, but at most
+  // the largest entry.
+
+  if( fNentries == 0 )
+    return 0;
+  ULong64_t rank = static_cast<ULong64_t>( TMath::Ceil(q*fNentries) );
+  if( rank < 1 )
+    rank = 1;
+  ULong64_t sum = 0;
+  for( UInt_t i = 0; i < kNbins; ++i ) {
+    sum += fCount[i];
+    if( sum >= rank ) {
+      Double_t x = GetBinLowEdge(i) + 0.5*(GetBinWidth(i)-1);
+      return TMath::Min( x, static_cast<Double_t>(fMax) );
+    }
+  }
+  return fMax;
+}
+
+//_____________________________________________________________________________
+StageStats::StageStats( const char* const* names )
+{
+  // Construct with the stages given in the null-terminated list of names
+
+  assert( names );
+  while( *names )
+    AddStage( *names++ );
+}
+
+//_____________________________________________________________________________
+UInt_t StageStats::AddStage( const char* name )
+{
+  // Add a stage with the given name. Returns its index for Record().
+
+  fNames.push_back( name );
+  fHist.push_back( LatencyHist() );
+  return fHist.size()-1;
+}
+
+//_____________________________________________________________________________
+void StageStats::Add( const StageStats& rhs )
+{
+  // Add the statistics of rhs, which must have the same stages
+
+  assert( rhs.GetNstages() == GetNstages() );
+  for( UInt_t i = 0; i < fHist.size() and i < rhs.fHist.size(); ++i )
+    fHist[i].Add( rhs.fHist[i] );
+}
+
+//_____________________________________________________________________________
+void StageStats::Reset()
+{
+  // Clear the histograms of all stages
+
+  for( UInt_t i = 0; i < fHist.size(); ++i )
+    fHist[i].Reset();
+}
+
+//_____________________________________________________________________________
+Double_t StageStats::GetQuantile( UInt_t stage, Double_t q ) const
+{
+  // q-quantile of the duration of the given stage, in us
+
+  return ClockToUs( fHist[stage].GetQuantile(q) );
+}
+
+//_____________________________________________________________________________
+void StageStats::GetPercentiles( UInt_t stage, Double_t* pct ) const
+{
+  // Put the 50th, 99th and 99.9th percentiles of the duration of the
+  // given stage, in us, into pct[0..2]
+
+  static const Double_t q[3] = { 0.5, 0.99, 0.999 };
+  for( UInt_t i = 0; i < 3; ++i )
+    pct[i] = GetQuantile( stage, q[i] );
+}
+
+//_____________________________________________________________________________
+void StageStats::Print( const char* title ) const
+{
+  // Print a table of the latency statistics of all stages
+
+  cout << title << " timing (us):" << endl
+       << "  " << left << setw(12) << "stage" << right
+       << setw(10) << "calls" << setw(10) << "mean"
+       << setw(10) << "p50" << setw(10) << "p99" << setw(10) << "p99.9"
+       << setw(10) << "max" << endl;
+  for( UInt_t i = 0; i < fHist.size(); ++i ) {
+    const LatencyHist& h = fHist[i];
+    Double_t pct[3];
+    GetPercentiles( i, pct );
+    cout << "  " << left << setw(12) << fNames[i] << right
+	 << setw(10) << h.GetEntries()
+	 << fixed << setprecision(1)
+	 << setw(10) << ClockToUs(h.GetMean())
+	 << setw(10) << pct[0] << setw(10) << pct[1] << setw(10) << pct[2]
+	 << setw(10) << ClockToUs(static_cast<Double_t>(h.GetMax()))
+	 << endl;
+    cout.unsetf( ios::floatfield );
+    cout << setprecision(6);
+  }
+}
+
+//_____________________________________________________________________________
+Bool_t    Trace::fgEnabled  = false;
+UInt_t    Trace::fgNusers   = 0;
+ULong64_t Trace::fgNrec     = 0;
+Int_t     Trace::fgNthreads = 0;
+vector<Trace::Record_t> Trace::fgBuf;
+
+// Index of the current thread in the trace, 0 if not yet assigned
+static __thread Int_t gTraceTid = 0;
+
+// Interned copies of the stage names in the trace records
+static set<string> gTraceNames;
+static TMutex*     gTraceNamesLock = 0;  // Protects gTraceNames
+
+//_____________________________________________________________________________
+void Trace::Enable( UInt_t maxrec )
+{
+  // Start recording, keeping at least the most recent 'maxrec' records.
+  // Each call must be balanced by a call to Disable().
+
+  if( !gTraceNamesLock )
+    gTraceNamesLock = new TMutex;
+  if( maxrec == 0 )
+    maxrec = 1;
+  if( maxrec > fgBuf.size() ) {
+    fgBuf.resize( maxrec );
+    Clear();
+  }
+  ++fgNusers;
+  fgEnabled = true;
+}
+
+//_____________________________________________________________________________
+void Trace::Disable()
+{
+  // Stop recording when the last user disables the trace. Any records
+  // are discarded, along with the interned stage names.
+
+  if( fgNusers > 0 and --fgNusers == 0 ) {
+    fgEnabled = false;
+    vector<Record_t>().swap( fgBuf );
+    Clear();
+    gTraceNames.clear();
+  }
+}
+
+//_____________________________________________________________________________
+void Trace::Clear()
+{
+  // Discard all records
+
+  fgNrec = 0;
+}
+
+//_____________________________________________________________________________
+void Trace::Record( const char* name, Int_t evnum,
+		    ULong64_t start, ULong64_t stop )
+{
+  // Add a record to the ring buffer, overwriting the oldest one if full.
+  // The record refers to an interned copy of 'name', so the caller's
+  // string need only be valid during the call.
+
+  if( fgBuf.empty() )
+    return;
+  if( !name )
+    name = "";
+  gTraceNamesLock->Lock();
+  name = gTraceNames.insert( string(name) ).first->c_str();
+  gTraceNamesLock->UnLock();
+  if( gTraceTid == 0 )
+    gTraceTid = TS_ATOMIC_ADD( &fgNthreads, 1 );
+  ULong64_t n = TS_ATOMIC_ADD( &fgNrec, 1 ) - 1;
+  Record_t& rec = fgBuf[ n % fgBuf.size() ];
+  rec.name  = name;
+  rec.evnum = evnum;
+  rec.tid   = gTraceTid;
+  rec.start = start;
+  rec.stop  = stop;
+}
+
+//_____________________________________________________________________________
+static void WriteJSONString( ostream& os, const char* str )
+{
+  // Write str as a quoted JSON string
+
+  os << '"';
+  for( const char* c = str; c and *c; ++c ) {
+    if( *c == '"' or *c == '\\' )
+      os << '\\';
+    if( (unsigned char)*c >= 0x20 )
+      os << *c;
+  }
+  os << '"';
+}
+
+//_____________________________________________________________________________
+Int_t Trace::Write( const char* filename )
+{
+  // Write the buffered records to 'filename' in Chrome trace event (JSON)
+  // format. Times are in us relative to the earliest record. Returns the
+  // number of records written, or -1 on error.
+
+  static const char* const here = "Trace::Write";
+
+  ofstream ofs( filename );
+  if( !ofs ) {
+    ::Error( here, "Cannot open trace file %s", filename );
+    return -1;
+  }
+  ULong64_t nrec = fgNrec, nbuf = fgBuf.size();
+  ULong64_t first = ( nrec > nbuf ) ? nrec-nbuf : 0;
+  ULong64_t t0 = 0;
+  for( ULong64_t i = first; i < nrec; ++i ) {
+    const Record_t& rec = fgBuf[ i % nbuf ];
+    if( i == first or rec.start < t0 )
+      t0 = rec.start;
+  }
+  ofs << "{\"traceEvents\":[" << endl;
+  ofs << fixed << setprecision(3);
+  for( ULong64_t i = first; i < nrec; ++i ) {
+    const Record_t& rec = fgBuf[ i % nbuf ];
+    ofs << "{\"name\":";
+    WriteJSONString( ofs, rec.name );
+    ofs << ",\"cat\":\"TreeSearch\",\"ph\":\"X\",\"pid\":1"
+	<< ",\"tid\":" << rec.tid
+	<< ",\"ts\":"  << ClockToUs( static_cast<Double_t>(rec.start-t0) )
+	<< ",\"dur\":" << ClockToUs( static_cast<Double_t>(rec.stop-rec.start) );
+    if( rec.evnum >= 0 )
+      ofs << ",\"args\":{\"event\":" << rec.evnum << "}";
+    ofs << "}";
+    if( i+1 < nrec )
+      ofs << ",";
+    ofs << endl;
+  }
+  ofs << "],\"displayTimeUnit\":\"ns\","
+      << "\"otherData\":{\"dropped\":" << first << "}}" << endl;
+  if( !ofs ) {
+    ::Error( here, "Error writing trace file %s", filename );
+    return -1;
+  }
+  return static_cast<Int_t>( nrec-first );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end namespace TreeSearch
@@ -0,0 +1,187 @@
+#ifndef ROOT_TreeSearch_Instrument
+#define ROOT_TreeSearch_Instrument
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::Instrument                                                    //
+//                                                                           //
+// Low-overhead timing of processing stages: a cycle-counter clock,          //
+// log-scale latency histograms with percentile queries, and an optional     //
+// recorder of per-thread stage timelines in Chrome trace format.            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Rtypes.h"
+#include <vector>
+#include <string>
+
+namespace TreeSearch {
+
+  // Monotonic system clock in ns (clock_gettime)
+  ULong64_t ReadMonotonicClock();
+
+#ifndef __CINT__
+  //___________________________________________________________________________
+  inline ULong64_t ReadClock()
+  {
+    // Read the time stamp counter. Not serializing, so a few instructions
+    // may be attributed to the wrong side of a stage boundary, which is
+    // irrelevant at the time scales of interest (>= 1 us).
+
+#if defined(__x86_64__) || defined(__i386__)
+    UInt_t lo, hi;
+    __asm__ __volatile__ ( "rdtsc" : "=a" (lo), "=d" (hi) );
+    return (static_cast<ULong64_t>(hi) << 32) | lo;
+#else
+    return ReadMonotonicClock();
+#endif
+  }
+#endif
+
+  // Conversion of ReadClock() tick differences to microseconds
+  Double_t ClockToUs( Double_t ticks );
+
+  //___________________________________________________________________________
+  class LatencyHist {
+    // Histogram of clock tick counts with logarithmically spaced bins.
+    // Each power of two is divided into kNsub linear sub-bins, so the
+    // relative resolution is better than 1/kNsub over the full 64-bit range.
+  public:
+    enum { kSubBits = 3, kNsub = 1<<kSubBits, kNbins = (64-kSubBits+1)*kNsub };
+
+    LatencyHist() { Reset(); }
+
+#ifndef __CINT__
+    void      Fill( ULong64_t ticks )
+    {
+      ++fCount[ GetBin(ticks) ];
+      ++fNentries;
+      fSum += ticks;
+      if( ticks > fMax )
+	fMax = ticks;
+    }
+#endif
+    void      Add( const LatencyHist& rhs );
+    void      Reset();
+
+    ULong64_t GetEntries() const { return fNentries; }
+    Double_t  GetMean()    const { return fNentries ? fSum/fNentries : 0; }
+    ULong64_t GetMax()     const { return fMax; }
+    Double_t  GetQuantile( Double_t q ) const;
+
+#ifndef __CINT__
+    // Inline for speed. Hidden from CINT, which cannot parse the builtin.
+    static UInt_t GetBin( ULong64_t ticks )
+    {
+      if( ticks < kNsub )
+	return static_cast<UInt_t>(ticks);
+      UInt_t shift = 63 - __builtin_clzll(ticks) - kSubBits;
+      return (shift+1)*kNsub + static_cast<UInt_t>((ticks>>shift)&(kNsub-1));
+    }
+#endif
+    static ULong64_t GetBinLowEdge( UInt_t bin );
+    static ULong64_t GetBinWidth( UInt_t bin );
+
+  private:
+    ULong64_t fCount[kNbins];  // Bin contents
+    ULong64_t fNentries;       // Number of entries
+    Double_t  fSum;            // Sum of entries, for the mean
+    ULong64_t fMax;            // Largest entry
+  };
+
+  //___________________________________________________________________________
+  class StageStats {
+    // Latency histograms for a set of named processing stages. Not
+    // thread-safe: each instance is to be filled by one thread at a time.
+    // Statistics of several instances can be combined with Add().
+  public:
+    StageStats() {}
+    StageStats( const char* const* names );
+
+    UInt_t    AddStage( const char* name );
+#ifndef __CINT__
+    Double_t  Record( UInt_t stage, ULong64_t ticks )
+    {
+      // Record the duration of one execution of 'stage'. Returns the
+      // duration in us.
+      fHist[stage].Fill( ticks );
+      return ClockToUs( static_cast<Double_t>(ticks) );
+    }
+#endif
+    void      Add( const StageStats& rhs );
+    void      Reset();
+
+    UInt_t    GetNstages() const { return fHist.size(); }
+    const char* GetStageName( UInt_t stage ) const
+    { return fNames[stage].c_str(); }
+    const LatencyHist& GetHist( UInt_t stage ) const { return fHist[stage]; }
+    ULong64_t GetEntries( UInt_t stage ) const
+    { return fHist[stage].GetEntries(); }
+    Double_t  GetQuantile( UInt_t stage, Double_t q ) const;
+    void      GetPercentiles( UInt_t stage, Double_t* pct ) const;
+    void      Print( const char* title ) const;
+
+  private:
+    std::vector<std::string>  fNames;  // Stage names
+    std::vector<LatencyHist>  fHist;   // Latency histogram of each stage
+  };
+
+  //___________________________________________________________________________
+  class Trace {
+    // Process-wide recorder of the start and stop times of processing
+    // stages, tagged with event number and thread, for viewing as a
+    // timeline in chrome://tracing or Perfetto. Disabled by default.
+    // Records are kept in a ring buffer of fixed size, so only the most
+    // recent ones are written. Record() is thread-safe; the other functions
+    // must not be called while events are being processed.
+  public:
+    static void   Enable( UInt_t maxrec );
+    static void   Disable();
+    static void   Clear();
+    static Int_t  Write( const char* filename );
+
+    static Bool_t IsEnabled() { return fgEnabled; }
+    static void   Record( const char* name, Int_t evnum,
+			  ULong64_t start, ULong64_t stop );
+
+  private:
+    struct Record_t {
+      const char* name;    // Stage name (interned copy, see Record())
+      Int_t       evnum;   // Event number, -1 if unknown
+      Int_t       tid;     // Thread index
+      ULong64_t   start;   // ReadClock() at start of stage
+      ULong64_t   stop;    // ReadClock() at end of stage
+    };
+
+    static Bool_t             fgEnabled; // Recording enabled
+    static UInt_t             fgNusers;  // Number of Enable() calls outstanding
+    static std::vector<Record_t> fgBuf;  // Ring buffer of records
+    static ULong64_t          fgNrec;    // Number of records ever made
+    static Int_t              fgNthreads;// Number of threads seen
+  };
+
+#ifndef __CINT__
+  //___________________________________________________________________________
+  class TraceScope {
+    // Record the lifetime of this object as a stage in the Trace, if
+    // tracing is enabled. 'name' must remain valid for the lifetime of
+    // this object.
+  public:
+    TraceScope( const char* name, Int_t evnum = -1 )
+      : fName(name), fEvNum(evnum),
+	fStart( Trace::IsEnabled() ? ReadClock() : 0 ) {}
+    ~TraceScope()
+    {
+      if( fStart )
+	Trace::Record( fName, fEvNum, fStart, ReadClock() );
+    }
+  private:
+    const char* fName;
+    Int_t       fEvNum;
+    ULong64_t   fStart;
+  };
+#endif
+
+} // end namespace TreeSearch
+
+#endif
@@ -301,6 +301,14 @@ Int_t MWDC::ReadDatabase( const TDatime& date )
   return kOK;
 }
 
+//_____________________________________________________________________________
+Tracker* MWDC::NewClone() const
+{
+  // Create a new, uninitialized MWDC with our name and apparatus
+
+  return new MWDC( GetName(), GetTitle(), GetApparatus() );
+}
+
 //_____________________________________________________________________________
 Plane* MWDC::MakePlane( const char* name, const char* description,
 			THaDetectorBase* parent ) const
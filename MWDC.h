@@ -37,6 +37,7 @@ namespace TreeSearch {
 
     virtual UInt_t GetCrateMapDBcols() const;
 
+    virtual Tracker* NewClone() const;
     virtual Plane* MakePlane( const char* name, const char* description = "",
 			      THaDetectorBase* parent = 0 ) const;
     virtual Projection* MakeProjection( EProjType type, const char* name,
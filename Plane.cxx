@@ -21,6 +21,7 @@
 #include "TH1.h"
 #include "TClass.h"
 #include "TString.h"
+#include "TRandom.h"
 
 #ifdef MCDATA
 #include "SimDecoder.h"      // for Podd::MCHitInfo
@@ -41,7 +42,8 @@ Plane::Plane( const char* name, const char* description,
   : THaSubDetector(name,description,parent), fPlaneNum(kMaxUInt),
     fAltPlaneNum(kMaxUInt), fDefinedNum(kMaxUInt), fType(kUndefinedType),
     fStart(0), fPitch(0), fCoordOffset(0), fPartner(0), fProjection(0),
-    fResolution(0), fMaxHits(kMaxUInt), fHits(0), fFitCoords(0)
+    fResolution(0), fMaxHits(kMaxUInt), fHits(0), fFitCoords(0),
+    fUseDispatch(false)
 #ifdef MCDATA
   , fHitMap(0), fMCHitInfo(0)
 #endif
@@ -107,6 +109,63 @@ Hit* Plane::AddHit( Double_t x, Double_t y )
   return AddHitImpl( pos );
 }
 
+//_____________________________________________________________________________
+Hit* Plane::AddSimHit( Double_t pos, Double_t /* slope */, TRandom& rnd )
+{
+  // Add a simulated hit for a track crossing this plane at the given
+  // projection coordinate and slope (see EventGenerator). Returns 0 if the
+  // track produces no hit. Derived classes should override this with a
+  // model of their detector response. This version smears the position
+  // with the plane's resolution and adds a dummy hit.
+
+  assert( IsDummy() or HasExtInput() );
+
+  return AddHitImpl( pos + rnd.Gaus(0, fResolution) );
+}
+
+//_____________________________________________________________________________
+Int_t Plane::AddHits( UInt_t n, const Double_t* pos, const Double_t* res,
+		      const Double_t* data, const MCHitTruth_t* mc )
+{
+  // Add n hits to this plane, bypassing the raw data decoder. The plane
+  // must have external input enabled (SetExtInput). The hits are given as
+  // arrays of length n:
+  //
+  //  pos:  hit position in the projection coordinate of the Tracker frame
+  //        (m), i.e. the wire position for wire planes, the cluster
+  //        centroid for GEM planes
+  //  res:  position resolution (m). If null, the plane's resolution is used
+  //  data: drift time (s) for wire planes, cluster charge (ADC) for GEM
+  //        planes. If null, zero is assumed
+  //  mc:   Monte Carlo truth. Only used in MCDATA builds for trackers set up
+  //        for Monte Carlo data. If null, the truth is left empty
+  //
+  // The hits need not be sorted. Call Tracker::DecodeHits() after adding
+  // the hits of all planes. Returns the number of hits added, which may be
+  // less than n if some positions are outside of the plane.
+
+  assert( HasExtInput() );
+  assert( pos );
+
+  Int_t nadded = 0;
+  for( UInt_t i = 0; i < n; ++i ) {
+    if( AddExtHit( pos[i], res ? res[i] : fResolution,
+		   data ? data[i] : 0.0, mc ? mc+i : 0 ) )
+      ++nadded;
+  }
+  return nadded;
+}
+
+//_____________________________________________________________________________
+Hit* Plane::AddExtHit( Double_t pos, Double_t, Double_t, const MCHitTruth_t* )
+{
+  // Add one hit given via AddHits. This version adds a dummy hit at pos.
+  // Derived classes should override it to make hits of their type from
+  // all the given data.
+
+  return AddHitImpl( pos );
+}
+
 //_____________________________________________________________________________
 Hit* Plane::AddHitImpl( Double_t )
 {
@@ -189,12 +248,15 @@ Int_t Plane::DummyDecode( const THaEvData& evData )
   // simply sort the hit array. If there are no hits yet, attempt to decode
   // the given event data. evData is assumed to contain hit x and y coordinates
   // (in the lab system) at the z-position of this plane.
+  //
+  // Also used for planes with external hit input (SetExtInput), whose hits
+  // are never decoded from evData.
 
   //const char* const here = "GEMPlane::DummyDecode";
 
-  assert( IsDummy() );
+  assert( IsDummy() or HasExtInput() );
 
-  if( GetNhits() == 0 ) {
+  if( GetNhits() == 0 and not HasExtInput() ) {
 #ifndef NDEBUG
     Bool_t did_decode = false;
 #endif
@@ -233,8 +295,24 @@ Int_t Plane::DummyDecode( const THaEvData& evData )
     }
   }
 
-  // Sort hits according to their Compare method
-  fHits->Sort();
+  return DecodeHits();
+}
+
+//_____________________________________________________________________________
+Int_t Plane::DecodeHits()
+{
+  // Finish decoding of hits that have been added directly with AddHit,
+  // AddHits or AddSimHit. Returns the number of hits, negative if there
+  // are more than fMaxHits.
+
+  // Sort hits according to their Compare method, unless they are already
+  // in order. There is usually only one hit in a dummy plane.
+  for( Int_t i = 1; i < GetNhits(); ++i ) {
+    if( GetHit(i)->Compare(GetHit(i-1)) < 0 ) {
+      fHits->Sort();
+      break;
+    }
+  }
 
   // Negative return value indicates potential problem
   UInt_t nHits = GetNhits();
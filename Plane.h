@@ -22,6 +22,7 @@
 
 class TH1;
 class THaTrack;
+class TRandom;
 namespace Podd {
   class MCHitInfo;
 }
@@ -35,16 +36,31 @@ namespace TreeSearch {
   class Road;
   extern const Double_t kBig;
 
+  // Optional Monte Carlo truth of hits given to Plane::AddHits
+  struct MCHitTruth_t {
+    Int_t    track;  // MC track number, 0 for noise
+    Double_t pos;    // True position in the projection coordinate (m)
+    Double_t time;   // True hit time (s)
+  };
+
   class Plane : public THaSubDetector {
   public:
     typedef std::vector<Int_t>  Vint_t;
     typedef std::vector<Float_t> Vflt_t;
 
+    // Raw data word staged by the Tracker's crate/slot dispatcher
+    struct RawHit_t {
+      Int_t elem;  // Logical channel (e.g. wire number)
+      Int_t imod;  // Index of source module in fDetMap
+      Int_t data;  // Raw data
+    };
+    typedef std::vector<RawHit_t> Vraw_t;
+
     Plane( const char* name, const char* description = "",
 	   THaDetectorBase* parent = 0 );
     // For ROOT RTTI
     Plane() : fPartner(0), fProjection(0), fHits(0), fFitCoords(0),
-	      fHitMap(0) {}
+	      fUseDispatch(false), fHitMap(0) {}
     virtual ~Plane();
 
     virtual void    Clear( Option_t* opt="" );
@@ -55,6 +71,8 @@ namespace TreeSearch {
     virtual Int_t   End( THaRunBase* r=0 );
 
     virtual Hit*    AddHit( Double_t x, Double_t y );
+    virtual Hit*    AddSimHit( Double_t pos, Double_t slope, TRandom& rnd );
+    virtual Int_t   DecodeHits();
     virtual Bool_t  Contains( Double_t x, Double_t y ) const;
     virtual Double_t GetMaxLRdist() const { return 0; }
     virtual Hit*    FindNearestHitAndPos( Double_t x, Double_t& pos ) const;
@@ -62,13 +80,34 @@ namespace TreeSearch {
 				       const std::vector<TreeSearch::Road*>& roads );
     virtual std::pair<Int_t,Int_t>
                     FindHitsInRange( Double_t xmin, Double_t xmax ) const;
+    // Run statistics of the hit selection, if any (see Tracker::End)
+    virtual void    AddHitStats( const Plane& /* rhs */ ) {}
+    virtual void    ResetHitStats() {}
+    virtual void    PrintHitStats() const {}
 #ifdef MCDATA
     virtual Hit*    FindNearestMCHitAndPos( Double_t x, Int_t mctrack,
 					    Double_t& pos ) const;
+    // Hits of this plane carry MC truth (track number etc.)
+    Bool_t          HasMCTruth() const { return fMCHitInfo != 0; }
 #endif
 //     virtual Int_t   Compare ( const TObject* obj ) const;
 //     virtual Bool_t  IsSortable () const { return kTRUE; }
 
+    // Support for decoding via Tracker dispatch table. Planes that can
+    // decode from staged raw hits override CanUseDispatch.
+    virtual Bool_t  CanUseDispatch() const { return false; }
+    Bool_t          UsesDispatch()   const { return fUseDispatch; }
+    void            SetUseDispatch( Bool_t enable = true )
+    { fUseDispatch = enable; }
+    void            ClearRawHits() { fRawHits.clear(); }
+    void            StageRawHit( Int_t elem, Int_t imod, Int_t data )
+    { RawHit_t h = { elem, imod, data }; fRawHits.push_back(h); }
+
+    // In-memory hit input, bypassing the raw data decoders (see AddHits)
+    Int_t           AddHits( UInt_t n, const Double_t* pos,
+			     const Double_t* res = 0, const Double_t* data = 0,
+			     const MCHitTruth_t* mc = 0 );
+
     FitCoord*       AddFitCoord( const FitCoord& coord );
     Bool_t          Contains( const TVector2& point ) const;
     void            EnableCalibration( Bool_t enable = true );
@@ -96,6 +135,7 @@ namespace TreeSearch {
     UInt_t          GetDefinedNum()  const { return fDefinedNum; }
     Bool_t          IsCalibrating()  const { return TestBit(kCalibrating); }
     Bool_t          IsDummy()        const { return TestBit(kIsDummy); }
+    Bool_t          HasExtInput()    const { return TestBit(kExtInput); }
     Bool_t          IsRequired()     const;
 
     void            SetPlaneNum( UInt_t n )    { fPlaneNum = n; }
@@ -104,6 +144,7 @@ namespace TreeSearch {
     void            SetProjection( Projection* p )
     { fProjection = p; UpdateOffset(); }
     void            SetDummy( Bool_t enable = true );
+    void            SetExtInput( Bool_t enable = true );
     void            SetRequired( Bool_t enable = true );
     void            UpdateOffset();
 
@@ -160,6 +201,8 @@ namespace TreeSearch {
     // Event data, hits etc.
     TClonesArray* fHits;        // Cluster data (groups of hits)
     TClonesArray* fFitCoords;   // Cluster coordinates used by good road fits
+    Vraw_t        fRawHits;     //! Raw hits staged by Tracker dispatcher
+    Bool_t        fUseDispatch; //! Decode from fRawHits instead of evdata
 
     Int_t ReadDatabaseCommon( const TDatime& date );
 
@@ -179,10 +222,15 @@ namespace TreeSearch {
     virtual Hit*  AddHitImpl( Double_t x );
     virtual Int_t DummyDecode( const THaEvData& );
 
+    // Support function for in-memory hit input
+    virtual Hit*  AddExtHit( Double_t pos, Double_t res, Double_t data,
+			     const MCHitTruth_t* mc );
+
     // Bits for Planes
     enum {
       kIsRequired  = BIT(14), // Tracks must have a hit in this plane
       kCalibrating = BIT(15), // Plane in calibration mode (implies !required)
+      kExtInput    = BIT(19), // Hits are added directly, not decoded
       kIsDummy     = BIT(20), // Plane is a dummy = used for TreeSearch only
       kTDCReadout  = BIT(21), // Readout is TDC-based
       kHaveRefChans= BIT(22)  // Hardware modules have reference channels
@@ -255,6 +303,17 @@ namespace TreeSearch {
     SetBit( kIsDummy, enable );
   }
 
+  //___________________________________________________________________________
+  inline
+  void Plane::SetExtInput( Bool_t enable )
+  {
+    // Enable/disable external hit input. If enabled, Decode() ignores the
+    // raw event data and only finalizes the hits that have been added with
+    // AddHits or AddSimHit since the last Clear().
+
+    SetBit( kExtInput, enable );
+  }
+
 ///////////////////////////////////////////////////////////////////////////////
 
 } // end namespace TreeSearch
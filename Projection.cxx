@@ -16,6 +16,7 @@
 #include "Road.h"
 #include "Helper.h"
 #include "Hit.h"
+#include "ThreadPool.h"
 #include "Tracker.h"   // for Tracker bits
 
 #include "TMath.h"
@@ -23,14 +24,15 @@
 #include "TBits.h"
 #include "TError.h"
 
+#ifdef MCDATA
+#include "SimDecoder.h"      // for Podd::MCHitInfo
+#endif
+
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <utility>
-#ifdef TESTCODE
-#include "TStopwatch.h"
 #include <cstring>
-#endif
 
 using namespace std;
 
@@ -44,6 +46,14 @@ static const UInt_t kMinFitPlanes = 3;
 // Parameter for angle consistency check in SetAngle (rad)
 static const Double_t kAngleTolerance = 1.0 * TMath::DegToRad();
 
+// Number of roads fitted per thread pool task
+static const UInt_t kRoadsPerFitTask = 8;
+
+// Timed stages of Track()
+enum { kStageSearch, kStageRoads, kStageFit, kStageTrack };
+static const char* const kStageNames[] =
+  { "treesearch", "roads", "fit", "track", 0 };
+
 //_____________________________________________________________________________
 Projection::Projection( EProjType type, const char* name, Double_t angle,
 			THaDetectorBase* parent )
@@ -51,10 +61,15 @@ Projection::Projection( EProjType type, const char* name, Double_t angle,
     fMaxSlope(0.0), fWidth(0.0), fDetector(parent), fPatternTree(0),
     fDummyPlanePattern(0), fFirstPlaneNum(kMaxUInt), fLastPlaneNum(0),
     fMinFitPlanes(kMinFitPlanes), fMaxMiss(0), fRequire1of2(false),
-    fPlaneCombos(0), fAltPlaneCombos(0), fMaxPat(kMaxUInt),
+    fPlaneCombos(0), fAltPlaneCombos(0), fLevel(0), fMaxPat(kMaxUInt),
     fFrontMaxBinDist(kMaxUInt), fBackMaxBinDist(kMaxUInt), fHitMaxDist(0),
+    fFilterMinPlanes(0), fNfiltHits(0), fNfiltRej(0),
+#ifdef MCDATA
+    fNfiltMCsig(0), fNfiltMCsigRej(0), fNfiltMCnoise(0), fNfiltMCnoiseRej(0),
+#endif
     fConfLevel(1e-3), fHitpattern(0), fRoads(0), fNgoodRoads(0),
-    fRoadCorners(0), fTrkStat(kTrackOK)
+    fRoadCorners(0), fTrkStat(kTrackOK), fThreadPool(0), fSharedTree(false),
+    fStats(kStageNames)
 {
   // Constructor
 
@@ -67,10 +82,8 @@ Projection::Projection( EProjType type, const char* name, Double_t angle,
   fRoads = new TClonesArray("TreeSearch::Road", 3);
   R__ASSERT(fRoads);
 
-#ifdef TESTCODE
-  size_t nbytes = (char*)&t_track - (char*)&n_hits + sizeof(t_track);
+  size_t nbytes = (char*)&p_track[3] - (char*)&n_hits;
   memset( &n_hits, 0, nbytes );
-#endif
 
   ResetBit( kHaveDummies );
 }
@@ -84,8 +97,9 @@ Projection::~Projection()
     RemoveVariables();
   delete fRoads;
   delete fRoadCorners;
-  delete fPatternTree;
-  delete fHitpattern;
+  if( !fSharedTree )
+    delete fPatternTree;
+  DeleteSearchLevels();
   if( fAltPlaneCombos != fPlaneCombos )
     delete fAltPlaneCombos;
   delete fPlaneCombos;
@@ -156,8 +170,15 @@ void Projection::Clear( Option_t* )
 {
   // Clear event-by-event data
 
-  if( fHitpattern )
-    fHitpattern->Clear();
+  for( vector<SearchLevel_t>::size_type i = 0; i < fLevels.size(); ++i ) {
+    SearchLevel_t& lvl = fLevels[i];
+    if( lvl.filled ) {
+      lvl.hitpattern->Clear();
+      lvl.filled = false;
+    }
+  }
+  if( !fLevels.empty() )
+    SelectSearchLevel( 0 );
 
   fRoads->Delete();
   DeleteContainer( fPatternsFound );
@@ -167,10 +188,8 @@ void Projection::Clear( Option_t* )
   if( TestBit(kEventDisplay) )
     fRoadCorners->Clear();
 
-#ifdef TESTCODE
   size_t nbytes = (char*)&t_track - (char*)&n_hits + sizeof(t_track);
   memset( &n_hits, 0, nbytes );
-#endif
 }
 
 //_____________________________________________________________________________
@@ -182,6 +201,7 @@ Int_t Projection::Decode( const THaEvData& evdata )
   bool err = false;
   for( vplsiz_t i = 0; i < GetNallPlanes(); ++i ) {
     Plane* pl = fAllPlanes[i];
+    TraceScope trace( pl->GetName(), GetEvNum() );
     Int_t nhits = pl->Decode( evdata );
     if( nhits < 0 ) {
       err = true;
@@ -195,6 +215,31 @@ Int_t Projection::Decode( const THaEvData& evdata )
   return sum;
 }
 
+//_____________________________________________________________________________
+Int_t Projection::DecodeHits()
+{
+  // Finish decoding of the hits added directly to the planes of this
+  // projection (see Plane::AddHits). Returns the total number of hits,
+  // negative if any plane has too many hits.
+
+  Int_t sum = 0;
+  bool err = false;
+  for( vplsiz_t i = 0; i < GetNallPlanes(); ++i ) {
+    Plane* pl = fAllPlanes[i];
+    assert( pl->HasExtInput() );
+    Int_t nhits = pl->DecodeHits();
+    if( nhits < 0 ) {
+      err = true;
+      sum -= nhits;
+    } else
+      sum += nhits;
+  }
+  if( err )
+    return -sum;
+
+  return sum;
+}
+
 //_____________________________________________________________________________
 Double_t Projection::GetPlaneZ( UInt_t i ) const
 {
@@ -204,6 +249,55 @@ Double_t Projection::GetPlaneZ( UInt_t i ) const
   return fPlanes[i]->GetZ();
 }
 
+//_____________________________________________________________________________
+Int_t Projection::GetEvNum() const
+{
+  // Number of the event being processed, for diagnostics
+
+  return static_cast<const Tracker*>(fDetector)->GetEvNum();
+}
+
+//_____________________________________________________________________________
+void Projection::AddStageStats( const Projection& rhs )
+{
+  // Add the stage timing and hit filter statistics of rhs (e.g. a clone)
+  // to ours
+
+  fStats.Add( rhs.fStats );
+  fNfiltHits += rhs.fNfiltHits;
+  fNfiltRej  += rhs.fNfiltRej;
+#ifdef MCDATA
+  fNfiltMCsig      += rhs.fNfiltMCsig;
+  fNfiltMCsigRej   += rhs.fNfiltMCsigRej;
+  fNfiltMCnoise    += rhs.fNfiltMCnoise;
+  fNfiltMCnoiseRej += rhs.fNfiltMCnoiseRej;
+#endif
+}
+
+//_____________________________________________________________________________
+void Projection::ResetStageStats()
+{
+  // Clear the stage timing and hit filter statistics
+
+  fStats.Reset();
+  UpdatePercentiles();
+  fNfiltHits = fNfiltRej = 0;
+#ifdef MCDATA
+  fNfiltMCsig = fNfiltMCsigRej = fNfiltMCnoise = fNfiltMCnoiseRej = 0;
+#endif
+}
+
+//_____________________________________________________________________________
+void Projection::UpdatePercentiles()
+{
+  // Update the percentile global variables from the stage timing statistics
+
+  fStats.GetPercentiles( kStageSearch, p_treesearch );
+  fStats.GetPercentiles( kStageRoads,  p_roads );
+  fStats.GetPercentiles( kStageFit,    p_fit );
+  fStats.GetPercentiles( kStageTrack,  p_track );
+}
+
 //_____________________________________________________________________________
 void Projection::Reset( Option_t* opt )
 {
@@ -212,8 +306,10 @@ void Projection::Reset( Option_t* opt )
 
   fIsInit = kFALSE;
   fMaxSlope = fWidth = 0.0;
-  delete fHitpattern; fHitpattern = 0;
-  delete fPatternTree; fPatternTree = 0;
+  DeleteSearchLevels();
+  if( !fSharedTree )
+    delete fPatternTree;
+  fPatternTree = 0; fSharedTree = false;
   if( fAltPlaneCombos != fPlaneCombos ) {
     delete fAltPlaneCombos; fAltPlaneCombos = 0;
   }
@@ -400,6 +496,13 @@ THaAnalysisObject::EStatus Projection::Init( const TDatime& date )
     return kInitError;
   }
 
+  if( fFilterMinPlanes >= GetNplanes() ) {
+    Error( Here(here), "noise_filter = %u for projection \"%s\" must be less "
+	   "than the number of planes (%u). Fix database.",
+	   fFilterMinPlanes, GetName(), GetNplanes() );
+    return kInitError;
+  }
+
   // No need to set up pattern tree and hitpattern if no tracking requested
   bool doing_tracking = fDetector->TestBit(Tracker::kDoCoarse);
   if( doing_tracking ) {
@@ -412,15 +515,31 @@ THaAnalysisObject::EStatus Projection::Init( const TDatime& date )
     if( tp.Normalize() != 0 )
       return fStatus = kInitError;
 
-    // Attempt to read the pattern database from file
+    // A clone of a tracker shares the pattern tree of the corresponding
+    // projection of the prototype tracker (the tree is read-only)
     assert( fPatternTree == 0 );
+    const Tracker* proto = static_cast<Tracker*>(fDetector)->GetPrototype();
+    if( proto ) {
+      Projection* orig = proto->GetProjection( fType );
+      if( orig and orig->fPatternTree and
+	  orig->fPatternTree->GetNlevels() == fNlevels and
+	  orig->fPatternTree->GetNplanes() == GetNallPlanes() ) {
+	fPatternTree = orig->fPatternTree;
+	fSharedTree = true;
+      } else {
+	Warning( Here(here), "Cannot share pattern tree of projection \"%s\" "
+		 "with prototype tracker. Generating new tree.", GetName() );
+      }
+    }
+
+    // Attempt to read the pattern database from file
     //TODO: Make the file name
     // const char* filename = "test.tree";
     // fPatternTree = PatternTree::Read( filename, tp );
 
     // If the tree cannot not be read (or the parameters mismatch), then
     // create it from scratch (takes a few seconds)
-    // if( !fPatternTree ) {
+    if( !fPatternTree ) {
       PatternGenerator pg;
       fPatternTree = pg.Generate( tp );
       if( fPatternTree ) {
@@ -429,27 +548,35 @@ THaAnalysisObject::EStatus Projection::Init( const TDatime& date )
 	//       fPatternTree->Write( filename );
       } else
 	return fStatus = kInitError;
-    // }
+    }
 
     // Set up a hitpattern object with the parameters of this projection
-    assert( fHitpattern == 0 );
-    try { fHitpattern = MakeHitpattern( *fPatternTree ); }
-    catch( bad_alloc ) { fHitpattern = 0; }
-    if( !fHitpattern || fHitpattern->IsError() )
-      return fStatus = kInitError;
-    assert( GetNallPlanes() == fHitpattern->GetNplanes() );
-
-    // Determine maximum search distance (in bins) for combining patterns,
-    // separately for front and back planes since they can have different
-    // parameters.
-    // This is the max distance of bins that can belong to the same hit
-    // plus an allowance for extra slope of a pattern if a front/back hit
-    // is missing
+    // for each search resolution. The coarser levels search the top levels
+    // of the same pattern tree.
     Plane *front_plane = fPlanes.front(), *back_plane = fPlanes.back();
     Double_t dxf= front_plane->GetMaxLRdist() + 2.0*front_plane->GetResolution();
     Double_t dxb= back_plane->GetMaxLRdist()  + 2.0*back_plane->GetResolution();
-    fFrontMaxBinDist = TMath::CeilNint( dxf * fHitpattern->GetBinScale() ) + 2;
-    fBackMaxBinDist  = TMath::CeilNint( dxb * fHitpattern->GetBinScale() ) + 2;
+    assert( !fLevels.empty() and fLevels[0].nlevels == fNlevels );
+    for( vector<SearchLevel_t>::size_type i = 0; i < fLevels.size(); ++i ) {
+      SearchLevel_t& lvl = fLevels[i];
+      assert( lvl.hitpattern == 0 );
+      try { lvl.hitpattern = MakeHitpattern( *fPatternTree, lvl.nlevels ); }
+      catch( bad_alloc ) { lvl.hitpattern = 0; }
+      if( !lvl.hitpattern || lvl.hitpattern->IsError() )
+	return fStatus = kInitError;
+      assert( GetNallPlanes() == lvl.hitpattern->GetNplanes() );
+
+      // Determine maximum search distance (in bins) for combining patterns,
+      // separately for front and back planes since they can have different
+      // parameters.
+      // This is the max distance of bins that can belong to the same hit
+      // plus an allowance for extra slope of a pattern if a front/back hit
+      // is missing
+      Double_t scale = lvl.hitpattern->GetBinScale();
+      lvl.front_maxbindist = TMath::CeilNint( dxf * scale ) + 2;
+      lvl.back_maxbindist  = TMath::CeilNint( dxb * scale ) + 2;
+    }
+    SelectSearchLevel( 0 );
 
   } // doing_tracking
 
@@ -549,7 +676,10 @@ Int_t Projection::ReadDatabase( const TDatime& date )
   fMaxMiss = 0;
   fMaxPat  = kMaxUInt;
   fConfLevel = 1e-3;
+  fFilterMinPlanes = 0;
   Int_t req1of2 = 0, disable_chi2 = 0;
+  vector<Int_t> fb_depth, fb_maxpat;
+  vector<Double_t> fb_occ;
 
   Int_t gbl = Plane::GetDBSearchLevel(fPrefix);
   const DBRequest request[] = {
@@ -562,6 +692,10 @@ Int_t Projection::ReadDatabase( const TDatime& date )
     { "req1of2",         &req1of2,       kInt,    0, 1, gbl },
     { "maxpat",          &fMaxPat,       kUInt,   0, 1, gbl },
     { "disable_chi2",    &disable_chi2,  kInt,    0, 1, gbl },
+    { "fallback_depth",  &fb_depth,      kIntV,   0, 1, gbl },
+    { "fallback_maxpat", &fb_maxpat,     kIntV,   0, 1, gbl },
+    { "fallback_occupancy", &fb_occ,     kDoubleV, 0, 1, gbl },
+    { "noise_filter",    &fFilterMinPlanes, kUInt, 0, 1, gbl },
     { 0 }
   };
 
@@ -577,6 +711,39 @@ Int_t Projection::ReadDatabase( const TDatime& date )
   }
   ++fNlevels; // The number of levels is maxdepth+1
 
+  // Coarser search depths to fall back to if a search finds more than
+  // maxpat patterns. Default pattern cap: maxpat halved per level
+  DeleteSearchLevels();
+  fLevels.push_back( SearchLevel_t(fNlevels, fMaxPat, 0.0) );
+  if( (!fb_maxpat.empty() and fb_maxpat.size() != fb_depth.size()) or
+      (!fb_occ.empty() and fb_occ.size() != fb_depth.size()) ) {
+    Error( Here(here), "fallback_maxpat and fallback_occupancy must have "
+	   "as many elements as fallback_depth (%u). Fix database.",
+	   static_cast<UInt_t>(fb_depth.size()) );
+    return kInitError;
+  }
+  for( vector<Int_t>::size_type i = 0; i < fb_depth.size(); ++i ) {
+    Int_t depth = fb_depth[i];
+    UInt_t prev = fLevels.back().nlevels-1;
+    if( depth < 1 or static_cast<UInt_t>(depth) >= prev ) {
+      Error( Here(here), "Illegal fallback_depth = %d. Must be >= 1 and "
+	     "less than the preceding search depth %u. Fix database.",
+	     depth, prev );
+      return kInitError;
+    }
+    UInt_t maxpat = fMaxPat >> (fNlevels-1-depth);
+    if( !fb_maxpat.empty() ) {
+      if( fb_maxpat[i] <= 0 ) {
+	Error( Here(here), "Illegal fallback_maxpat = %d. Must be > 0. "
+	       "Fix database.", fb_maxpat[i] );
+	return kInitError;
+      }
+      maxpat = fb_maxpat[i];
+    }
+    Double_t minocc = fb_occ.empty() ? 0.0 : fb_occ[i];
+    fLevels.push_back( SearchLevel_t(depth+1, TMath::Max(maxpat,1U), minocc) );
+  }
+
   // If angle read, set it, otherwise keep default from call to constructor
   if( angle < kBig )
     SetAngle( angle*TMath::DegToRad() );
@@ -614,6 +781,9 @@ Int_t Projection::DefineVariables( EMode mode )
 {
   // Initialize global variables and lookup table for decoder
 
+  // No variables for clones (see Tracker::MakeClone)
+  if( static_cast<Tracker*>(fDetector)->IsClone() ) return kOK;
+
   if( mode == kDefine && fIsSetup ) return kOK;
   fIsSetup = ( mode == kDefine );
 
@@ -628,18 +798,24 @@ Int_t Projection::DefineVariables( EMode mode )
     { "n_bins", "Number of bins set in hitpattern", "n_bins" },
     { "n_binhits", "Number of references from bins to hits","n_binhits" },
     { "n_maxhits_bin", "Max number of hits per bin", "maxhits_bin" },
-    { "n_test", "Number of pattern comparisons", "n_test"  },
-    { "n_pat", "Number of patterns found",   "n_pat"    },
     { "n_roads", "Number of roads before filter",   "n_roads"    },
     { "n_dupl",  "Number of duplicate roads removed",   "n_dupl"    },
     { "n_badfits", "Number of roads found",   "n_badfits"    },
+    { "rd.nfits", "Number of acceptable fits in road",
+                                         "fRoads.TreeSearch::Road.fNfits" },
+#endif
+    { "n_test", "Number of pattern comparisons", "n_test"  },
+    { "n_pat", "Number of patterns found",   "n_pat"    },
+    { "depth", "Tree search depth used",     "GetSearchDepth()" },
+    { "n_filt", "Number of hits rejected by noise filter", "n_filt" },
     { "t_treesearch", "Time in TreeSearch (us)", "t_treesearch" },
     { "t_roads", "Time in MakeRoads (us)", "t_roads" },
     { "t_fit", "Time for fitting Roads (us)", "t_fit" },
     { "t_track", "Total time in Track (us)", "t_track" },
-    { "rd.nfits", "Number of acceptable fits in road",
-                                         "fRoads.TreeSearch::Road.fNfits" },
-#endif
+    { "p_treesearch", "p50/p99/p99.9 of t_treesearch (us)", "p_treesearch" },
+    { "p_roads", "p50/p99/p99.9 of t_roads (us)", "p_roads" },
+    { "p_fit", "p50/p99/p99.9 of t_fit (us)", "p_fit" },
+    { "p_track", "p50/p99/p99.9 of t_track (us)", "p_track" },
     { "nroads","Number of roads (good or bad)",        "GetNroads()"      },
     { "ngood", "Number of good roads",                 "fNgoodRoads"      },
     { "rd.pos",   "Origin of best track (m)",
@@ -708,8 +884,27 @@ Int_t Projection::FillHitpattern()
 {
   // Fill this projection's hitpattern from hits in the planes.
   // Returns the total number of hits processed.
-
-  Int_t ntot = fHitpattern->Fill( fAllPlanes );
+  //
+  // If fallback search depths with a fallback_occupancy are configured,
+  // the search starts at the coarsest of them whose occupancy threshold
+  // is reached by the mean number of hits per active plane.
+
+  TraceScope trace( "FillHitpattern", GetEvNum() );
+  n_filt = ( fFilterMinPlanes > 0 ) ? FilterHits() : 0;
+
+  UInt_t level = 0;
+  if( fLevels.size() > 1 ) {
+    UInt_t nhits = 0;
+    for( vplsiz_t i = 0; i < fPlanes.size(); ++i )
+      nhits += fPlanes[i]->GetNhits();
+    nhits -= n_filt;
+    Double_t occ = static_cast<Double_t>(nhits)/GetNplanes();
+    for( vector<SearchLevel_t>::size_type i = 1; i < fLevels.size(); ++i ) {
+      if( fLevels[i].minocc > 0.0 and occ >= fLevels[i].minocc )
+	level = i;
+    }
+  }
+  Int_t ntot = SetSearchLevel( level );
 
 #ifdef TESTCODE
   n_hits = ntot;
@@ -720,6 +915,130 @@ Int_t Projection::FillHitpattern()
   return ntot;
 }
 
+//_____________________________________________________________________________
+UInt_t Projection::FilterHits()
+{
+  // Reject isolated noise hits before the tree search. A hit is kept only
+  // if at least fFilterMinPlanes other active planes of this projection
+  // have a compatible hit, i.e. one within the distance that a track with
+  // |slope| <= maxslope can cover between the planes, plus the planes'
+  // maximum L/R drift distances and twice their resolutions. The hits of
+  // each plane pair are compared with a sliding window over the sorted
+  // hit positions. Rejected hits are flagged (Hit::SetFiltered) and
+  // ignored by Hitpattern::Fill. Returns the number of rejected hits.
+
+  UInt_t np = GetNplanes();
+  fFiltHits.resize( np );
+  for( UInt_t i = 0; i < np; ++i ) {
+    Plane* pl = fPlanes[i];
+    vector<FiltHit_t>& fh = fFiltHits[i];
+    fh.resize( pl->GetNhits() );
+    bool sorted = true;
+    for( Int_t k = 0; k < pl->GetNhits(); ++k ) {
+      FiltHit_t& h = fh[k];
+      h.hit = pl->GetHit(k);
+      h.pos = h.hit->GetPos();
+      h.nplanes = 0;
+      if( k > 0 and h.pos < fh[k-1].pos )
+	sorted = false;
+    }
+    // Hits are usually sorted already, but not necessarily by position
+    if( !sorted )
+      sort( ALL(fh) );
+  }
+
+  for( UInt_t i = 0; i < np; ++i ) {
+    vector<FiltHit_t>& fhA = fFiltHits[i];
+    Plane* A = fPlanes[i];
+    Double_t tolA = A->GetMaxLRdist() + 2.0*A->GetResolution();
+    for( UInt_t j = 0; j < np; ++j ) {
+      const vector<FiltHit_t>& fhB = fFiltHits[j];
+      if( j == i or fhB.empty() )
+	continue;
+      Plane* B = fPlanes[j];
+      Double_t win = fMaxSlope * TMath::Abs(B->GetZ() - A->GetZ()) + tolA
+	+ B->GetMaxLRdist() + 2.0*B->GetResolution();
+      vector<FiltHit_t>::size_type lo = 0;
+      for( vector<FiltHit_t>::iterator it = fhA.begin(); it != fhA.end();
+	   ++it ) {
+	if( it->nplanes >= fFilterMinPlanes )
+	  continue;
+	while( lo < fhB.size() and fhB[lo].pos < it->pos - win )
+	  ++lo;
+	if( lo == fhB.size() )
+	  break;
+	if( fhB[lo].pos <= it->pos + win )
+	  ++it->nplanes;
+      }
+    }
+  }
+
+  UInt_t nrej = 0, ntot = 0;
+#ifdef MCDATA
+  Bool_t mcdata = TestBit(kMCdata);
+#endif
+  for( UInt_t i = 0; i < np; ++i ) {
+    vector<FiltHit_t>& fh = fFiltHits[i];
+    ntot += fh.size();
+#ifdef MCDATA
+    // Wire hits have no MC truth yet (see WirePlane::MakeHit); counting
+    // them would make all of them noise
+    Bool_t mctruth = mcdata and fPlanes[i]->HasMCTruth();
+#endif
+    for( vector<FiltHit_t>::iterator it = fh.begin(); it != fh.end(); ++it ) {
+      Bool_t reject = ( it->nplanes < fFilterMinPlanes );
+      it->hit->SetFiltered( reject );
+      if( reject )
+	++nrej;
+#ifdef MCDATA
+      if( mctruth ) {
+	Podd::MCHitInfo* mc = dynamic_cast<Podd::MCHitInfo*>(it->hit);
+	if( mc and mc->fMCTrack > 0 ) {
+	  ++fNfiltMCsig;
+	  if( reject ) ++fNfiltMCsigRej;
+	} else {
+	  ++fNfiltMCnoise;
+	  if( reject ) ++fNfiltMCnoiseRej;
+	}
+      }
+#endif
+    }
+  }
+  fNfiltHits += ntot;
+  fNfiltRej  += nrej;
+  return nrej;
+}
+
+//_____________________________________________________________________________
+void Projection::PrintFilterStats() const
+{
+  // Print the statistics of the isolated-hit filter, if enabled. For Monte
+  // Carlo data, also print the fraction of track hits kept (efficiency)
+  // and of noise hits rejected, counting only the hits of planes with MC
+  // truth (GEM planes).
+
+  if( fFilterMinPlanes == 0 or fNfiltHits == 0 )
+    return;
+  cout << GetPrefix() << "noise_filter: rejected " << fNfiltRej << " of "
+       << fNfiltHits << " hits ("
+       << 100.0*fNfiltRej/fNfiltHits << "%)" << endl;
+#ifdef MCDATA
+  if( fNfiltMCsig + fNfiltMCnoise > 0 ) {
+    cout << GetPrefix() << "noise_filter: MC track hits kept ";
+    if( fNfiltMCsig > 0 )
+      cout << 100.0*(fNfiltMCsig-fNfiltMCsigRej)/fNfiltMCsig << "%";
+    else
+      cout << "n/a";
+    cout << " of " << fNfiltMCsig << ", noise hits rejected ";
+    if( fNfiltMCnoise > 0 )
+      cout << 100.0*fNfiltMCnoiseRej/fNfiltMCnoise << "%";
+    else
+      cout << "n/a";
+    cout << " of " << fNfiltMCnoise << endl;
+  }
+#endif
+}
+
 //_____________________________________________________________________________
 Int_t Projection::Track()
 {
@@ -741,40 +1060,50 @@ Int_t Projection::Track()
   assert( fPatternsFound.empty() );
   assert( GetTrackingStatus() == kTrackOK );
 
-#ifdef TESTCODE
-  TStopwatch timer, timer_tot;
-#endif
-
-  ComparePattern compare( fHitpattern, fAltPlaneCombos, &fPatternsFound,
-			  fDummyPlanePattern );
-  TreeWalk walk( fNlevels );
-  walk( fPatternTree->GetRoot(), compare );
+  ULong64_t t_start = ReadClock(), t_stage = t_start, t_now;
+
+  // The search stops as soon as more than maxpat patterns are found. If
+  // that happens, retry at the next coarser search depth, if any.
+  n_test = 0;
+  for( ;; ) {
+    const SearchLevel_t& lvl = fLevels[fLevel];
+    ComparePattern compare( fHitpattern, fAltPlaneCombos, &fPatternsFound,
+			    fDummyPlanePattern, lvl.maxpat );
+    {
+      TraceScope trace( "TreeWalk", GetEvNum() );
+      TreeWalk walk( lvl.nlevels );
+      walk( fPatternTree->GetRoot(), compare );
+    }
+    n_test += compare.GetNtest();
 
 #ifdef VERBOSE
-  if( fDebug > 0 ) {
-    UInt_t npat = fPatternsFound.size();
-    cout << npat << " pattern";
-    if( npat!=1 ) cout << "s";
-    if( npat > fMaxPat )
-      cout << " >>> exceeding limit of " << fMaxPat << ", terminating";
-    cout << endl;
-  }
+    if( fDebug > 0 ) {
+      UInt_t npat = fPatternsFound.size();
+      cout << "depth " << lvl.nlevels-1 << ": " << npat << " pattern";
+      if( npat!=1 ) cout << "s";
+      if( npat > lvl.maxpat )
+	cout << " >>> exceeding limit of " << lvl.maxpat << ", terminating";
+      cout << endl;
+    }
 #endif
-#ifdef TESTCODE
-  t_treesearch = 1e6*timer.RealTime();
+    if( (UInt_t)fPatternsFound.size() <= lvl.maxpat or
+	fLevel+1 >= fLevels.size() )
+      break;
+    DeleteContainer( fPatternsFound );
+    SetSearchLevel( fLevel+1 );
+  }
+  t_now = ReadClock();
+  t_treesearch = fStats.Record( kStageSearch, t_now-t_stage );
+  t_stage = t_now;
 
-  n_test = compare.GetNtest();
   n_pat  = fPatternsFound.size();
 
-  timer.Start();
-#endif
-
   if( fPatternsFound.empty() ) {
     fTrkStat = kNoPatterns;
     goto quit;
   }
   // Die if too many patterns - noisy event
-  if( (UInt_t)fPatternsFound.size() > fMaxPat ) {
+  if( (UInt_t)fPatternsFound.size() > fLevels[fLevel].maxpat ) {
     // TODO: keep statistics
     fTrkStat = kTooManyPatterns;
     ret = -1;
@@ -817,18 +1146,14 @@ Int_t Projection::Track()
 //     }
 //   }
 // #endif
-#ifdef TESTCODE
-  t_roads = 1e6*timer.RealTime();
-  timer.Start();
-#endif
+  t_now = ReadClock();
+  t_roads = fStats.Record( kStageRoads, t_now-t_stage );
+  t_stage = t_now;
 
   // Fit hit positions in the roads to straight lines
   FitRoads();
 
-#ifdef TESTCODE
-  t_fit   = 1e6*timer.RealTime();
-  t_track = 1e6*timer_tot.RealTime();
-#endif
+  t_fit   = fStats.Record( kStageFit, ReadClock()-t_stage );
 
 #ifdef VERBOSE
   if( fDebug > 0 ) {
@@ -844,6 +1169,8 @@ Int_t Projection::Track()
   ret = GetNgoodRoads();
 
  quit:
+  t_track = fStats.Record( kStageTrack, ReadClock()-t_start );
+
 #ifdef VERBOSE
   if( fDebug > 0 ) {
     cout << "------------ end of projection  " << GetName()
@@ -926,6 +1253,8 @@ Int_t Projection::MakeRoads()
   // This is the primary de-cloning algorithm. It finds clusters of patterns
   // that share active wires (hits).
 
+  TraceScope trace( "MakeRoads", GetEvNum() );
+
   // Sort patterns according to MostPlanes (see above)
   sort( ALL(fPatternsFound), MostPlanes() );
 
@@ -1080,13 +1409,66 @@ Bool_t Projection::RemoveDuplicateRoads()
   return changed;
 }
 
+//_____________________________________________________________________________
+class RoadFitTask : public ThreadPool::Task {
+  // Fit a contiguous range of roads
+public:
+  RoadFitTask() : fRoads(0), fBegin(0), fEnd(0), fNgood(0) {}
+  void Set( TClonesArray* roads, UInt_t begin, UInt_t end )
+  { fRoads = roads; fBegin = begin; fEnd = end; fNgood = 0; }
+  virtual Int_t Run()
+  {
+    for( UInt_t i = fBegin; i < fEnd; ++i ) {
+      Road* rd = static_cast<Road*>(fRoads->UncheckedAt(i));
+      assert(rd);
+      if( rd->Fit() )
+	++fNgood;
+    }
+    return 0;
+  }
+  UInt_t GetNgood() const { return fNgood; }
+private:
+  TClonesArray* fRoads;
+  UInt_t        fBegin, fEnd;
+  UInt_t        fNgood;
+};
+
 //_____________________________________________________________________________
 Bool_t Projection::FitRoads()
 {
   // Fit hits within each road. Store fit parameters with Road.
   // Also, store the hits & positions used by the best fit with Road.
+
+  TraceScope trace( "FitRoads", GetEvNum() );
   bool changed = false;
 
+  UInt_t nroads = GetNroads();
+  if( fThreadPool and nroads > kRoadsPerFitTask and fDebug <= 1 ) {
+    // Many roads: fit them in batches in the thread pool. Roads are
+    // independent, so this is safe. The calling thread may itself be a
+    // pool thread (running Track()); it helps with the fits while waiting.
+    UInt_t ntasks = (nroads+kRoadsPerFitTask-1)/kRoadsPerFitTask;
+    vector<RoadFitTask> tasks(ntasks);
+    ThreadPool::TaskGroup group;
+    for( UInt_t k = 0; k < ntasks; ++k ) {
+      UInt_t begin = k*kRoadsPerFitTask;
+      tasks[k].Set( fRoads, begin, TMath::Min(begin+kRoadsPerFitTask,nroads) );
+      fThreadPool->Submit( &tasks[k], group );
+    }
+    fThreadPool->Wait( group );
+    UInt_t ngood = 0;
+    for( UInt_t k = 0; k < ntasks; ++k )
+      ngood += tasks[k].GetNgood();
+    fNgoodRoads += ngood;
+    changed = ( ngood < nroads );
+#ifdef TESTCODE
+    n_badfits += nroads-ngood;
+#endif
+    if( nroads > 0 && fNgoodRoads == 0 )
+      fTrkStat = kFailed2DFits;
+    return changed;
+  }
+
   for( UInt_t i = 0; i < GetNroads(); ++i ) {
     Road* rd = static_cast<Road*>(fRoads->UncheckedAt(i));
     assert(rd);
@@ -1195,6 +1577,8 @@ void Projection::Print( Option_t* opt ) const
        << " maxsl=" << GetMaxSlope()
        << " width=" << GetWidth()
        << " angle=" << GetAngle()*TMath::RadToDeg();
+  for( vector<SearchLevel_t>::size_type i = 1; i < fLevels.size(); ++i )
+    cout << (i == 1 ? " fallback=" : ",") << fLevels[i].nlevels-1;
   cout << endl;
 
   if( verbose > 0 ) {
@@ -1206,13 +1590,56 @@ void Projection::Print( Option_t* opt ) const
 }
 
 //_____________________________________________________________________________
-Hitpattern* Projection::MakeHitpattern( const PatternTree& pt ) const
+Hitpattern* Projection::MakeHitpattern( const PatternTree& pt,
+					UInt_t nlevels ) const
 {
-  // Instantiate Hitpattern to be used for this type of projection.
+  // Instantiate Hitpattern to be used for this type of projection, with
+  // nlevels resolutions (<= the number of levels of the pattern tree).
   // The Hitpattern determines how hit information it processed,
   // either as single position measurements or L/R-ambiguous wire hits.
 
-  return new Hitpattern( pt );
+  return new Hitpattern( nlevels, pt.GetNplanes(), pt.GetWidth() );
+}
+
+//_____________________________________________________________________________
+Int_t Projection::SetSearchLevel( UInt_t level )
+{
+  // Make fLevels[level] the current search resolution and fill its
+  // hitpattern, if not yet done in this event. Returns the number of hits
+  // processed by the fill, or 0 if it was already filled.
+
+  SelectSearchLevel( level );
+  SearchLevel_t& lvl = fLevels[level];
+  if( lvl.filled or !fHitpattern )
+    return 0;
+  lvl.filled = true;
+  return fHitpattern->Fill( fAllPlanes );
+}
+
+//_____________________________________________________________________________
+void Projection::SelectSearchLevel( UInt_t level )
+{
+  // Make fLevels[level] the current search resolution without filling
+  // its hitpattern
+
+  assert( level < fLevels.size() );
+  const SearchLevel_t& lvl = fLevels[level];
+  fLevel = level;
+  fHitpattern = lvl.hitpattern;
+  fFrontMaxBinDist = lvl.front_maxbindist;
+  fBackMaxBinDist  = lvl.back_maxbindist;
+}
+
+//_____________________________________________________________________________
+void Projection::DeleteSearchLevels()
+{
+  // Delete the hitpatterns of all search levels and the levels themselves
+
+  for( vector<SearchLevel_t>::size_type i = 0; i < fLevels.size(); ++i )
+    delete fLevels[i].hitpattern;
+  fLevels.clear();
+  fLevel = 0;
+  fHitpattern = 0;
 }
 
 //_____________________________________________________________________________
@@ -1242,9 +1669,8 @@ Projection::ComparePattern::operator() ( const NodeDescriptor& nd )
   // Test if the pattern from the database that is given by NodeDescriptor
   // is present in the current event's hitpattern
 
-#ifdef TESTCODE
   ++fNtest;
-#endif
+
   // Compute the match pattern and see if it is allowed
   pair<UInt_t,UInt_t> match = fHitpattern->ContainsPattern(nd);
   if( fPlaneCombos->TestBitNumber(match.first)  ) {
@@ -1278,8 +1704,10 @@ Projection::ComparePattern::operator() ( const NodeDescriptor& nd )
     }
 
     // Add the pointer to the new node to the vector of results
-    //TODO: stop if max num of patterns reached
     fMatches->push_back( node );
+    // Stop the search if the maximum number of patterns is exceeded
+    if( fMatches->size() > fMaxPat )
+      return kError;
   }
   return kSkipChildNodes;
 }
@@ -11,6 +11,7 @@
 #include "TreeWalk.h"   // for NodeVisitor
 #include "Hit.h"        // for Node_t
 #include "Types.h"
+#include "Instrument.h"
 #include "TMath.h"
 #include "TClonesArray.h"
 #include "TVector2.h"
@@ -31,6 +32,7 @@ namespace TreeSearch {
   class PatternTree;
   class Road;
   class Plane;
+  class ThreadPool;
 
   typedef std::vector<Plane*>            vpl_t;
   typedef std::vector<Plane*>::size_type vplsiz_t;
@@ -43,19 +45,22 @@ namespace TreeSearch {
 		THaDetectorBase* parent );
     Projection() : fType(kUndefinedType), fDetector(0), fPatternTree(0),
 		   fPlaneCombos(0), fAltPlaneCombos(0), fHitpattern(0),
-		   fRoads(0), fRoadCorners(0) {} // ROOT RTTI
+		   fRoads(0), fRoadCorners(0), fThreadPool(0),
+		   fSharedTree(false) {} // ROOT RTTI
     virtual ~Projection();
 
     void            AddPlane( Plane* pl, Plane* partner = 0 );
     void            AddDummyPlane( Plane* pl, Plane* partner = 0 );
     virtual void    Clear( Option_t* opt="" );
     virtual Int_t   Decode( const THaEvData& );
+    Int_t           DecodeHits();
     virtual EStatus Init( const TDatime& date );
     // EStatus         InitLevel2( const TDatime& date );
     virtual void    Print( Option_t* opt="" ) const;
     void            Reset( Option_t* opt="" );
 
     Int_t           FillHitpattern();
+    UInt_t          FilterHits();
     Int_t           Track();
     Int_t           MakeRoads();
 
@@ -74,6 +79,7 @@ namespace TreeSearch {
     UInt_t          GetMinFitPlanes() const { return fMinFitPlanes; }
     UInt_t          GetNgoodRoads()   const { return fNgoodRoads; }
     UInt_t          GetNlevels()      const { return fNlevels; }
+    UInt_t          GetSearchDepth()  const;
     UInt_t          GetNpatterns()    const;
     UInt_t          GetNplanes()      const { return (UInt_t)fPlanes.size(); }
     UInt_t          GetNroads()       const;
@@ -93,7 +99,16 @@ namespace TreeSearch {
 
     void            SetPatternTree( PatternTree* pt ) { fPatternTree = pt; }
 
+    // Stage timing statistics
+    const StageStats& GetStageStats() const { return fStats; }
+    void            AddStageStats( const Projection& rhs );
+    void            ResetStageStats();
+    void            UpdatePercentiles();
+    void            PrintFilterStats() const;
+    void            SetThreadPool( ThreadPool* pool ) { fThreadPool = pool; }
+
     const vpl_t&    GetListOfPlanes() const { return fPlanes; }
+    const vpl_t&    GetListOfAllPlanes() const { return fAllPlanes; }
 
     Bool_t          DoingChisqTest() const  { return TestBit(kDoChi2); }
 
@@ -144,6 +159,7 @@ namespace TreeSearch {
     ETrackingStatus GetTrackingStatus() const { return fTrkStat; }
 
   protected:
+    friend class BenchAccess;  // Benchmarks (tsbench)
     typedef std::vector<Node_t*> NodeVec_t;
 
     // Configuration
@@ -168,6 +184,23 @@ namespace TreeSearch {
     TBits*           fPlaneCombos;   // Allowed plane occupancy patterns
     TBits*           fAltPlaneCombos;// Allowed plane patterns including dummies
 
+    // Tree search resolutions. fLevels[0] is the full search_depth, followed
+    // by coarser fallback depths for noisy events (see Track)
+    struct SearchLevel_t {
+      UInt_t      nlevels;     // Number of tree levels searched (depth+1)
+      UInt_t      maxpat;      // Sanity cut on number of patterns
+      Double_t    minocc;      // Start here if mean hits/plane >= minocc
+      UInt_t      front_maxbindist; // Max pattern dist in front plane
+      UInt_t      back_maxbindist;  // Max pattern dist in back plane
+      Hitpattern* hitpattern;  // Hitpattern at this resolution
+      Bool_t      filled;      // hitpattern filled in current event
+      SearchLevel_t( UInt_t nlev, UInt_t maxp, Double_t occ )
+	: nlevels(nlev), maxpat(maxp), minocc(occ), front_maxbindist(kMaxUInt),
+	  back_maxbindist(kMaxUInt), hitpattern(0), filled(false) {}
+    };
+    std::vector<SearchLevel_t> fLevels; // Search levels, finest first
+    UInt_t           fLevel;         // Index of fLevels used in current event
+
     // Road construction control
     UInt_t           fMaxPat;        // Sanity cut on number of patterns
     UInt_t           fFrontMaxBinDist; // Max pattern dist in front plane
@@ -175,29 +208,62 @@ namespace TreeSearch {
     UInt_t           fHitMaxDist;    // Max allowed distance between hits for
                                      // clustering patterns into roads
 
+    // Isolated-hit filter (see FilterHits)
+    UInt_t           fFilterMinPlanes; // Min # of other planes with compatible
+                                       // hits to keep a hit (0=no filter)
+    struct FiltHit_t {
+      Double_t pos;     // Hit position (m)
+      Hit*     hit;     // The hit
+      UInt_t   nplanes; // Number of other planes with compatible hits
+      bool operator<( const FiltHit_t& rhs ) const { return pos < rhs.pos; }
+    };
+    std::vector< std::vector<FiltHit_t> > fFiltHits; //! Scratch, per plane
+    ULong64_t        fNfiltHits;     // Hits seen by filter in run
+    ULong64_t        fNfiltRej;      // Hits rejected by filter in run
+#ifdef MCDATA
+    ULong64_t        fNfiltMCsig;    // MC track hits seen by filter in run
+    ULong64_t        fNfiltMCsigRej; // MC track hits rejected by filter
+    ULong64_t        fNfiltMCnoise;  // MC noise hits seen by filter in run
+    ULong64_t        fNfiltMCnoiseRej; // MC noise hits rejected by filter
+#endif
+
     // Fit statistics cut parameters
     Double_t         fConfLevel;     // Requested confidence level for chi2 cut
     vec_pdbl_t       fChisqLimits;   // lo/hi onfidence interval limits on Chi2
 
     // Event-by-event results
-    Hitpattern*      fHitpattern;    // Hitpattern of current event
+    Hitpattern*      fHitpattern;    // Hitpattern of current search level
     NodeVec_t        fPatternsFound; // Patterns found by TreeSearch
     TClonesArray*    fRoads;         // Roads found by MakeRoads
     UInt_t           fNgoodRoads;    // Good roads in fRoads
     TClonesArray*    fRoadCorners;   // Road corners, for event display
     ETrackingStatus  fTrkStat;       // Reconstruction status
 
-    // Statistics (only needed for TESTCODE, but kept for binary compatibility)
+    ThreadPool*      fThreadPool;    //! Thread pool for road fits (not owned)
+    Bool_t           fSharedTree;    // fPatternTree owned by prototype tracker
+
+    // Statistics
+    StageStats       fStats;         //! Latencies of the tracking stages
+    // Only needed for TESTCODE, but kept for binary compatibility
     UInt_t n_hits, n_bins, n_binhits, maxhits_bin;
-    UInt_t n_test, n_pat, n_roads, n_dupl, n_badfits;
+    UInt_t n_roads, n_dupl, n_badfits;
+    // Per-event counters and times (us)
+    UInt_t n_test, n_pat, n_filt;
     Double_t t_treesearch, t_roads, t_fit, t_track;
+    // p50/p99/p99.9 of the times (us), refreshed by UpdatePercentiles
+    Double_t p_treesearch[3], p_roads[3], p_fit[3], p_track[3];
 
     Bool_t  FitRoads();
     Bool_t  RemoveDuplicateRoads();
     void    SetAngle( Double_t a );
     UInt_t  GetNallPlanes() const { return (UInt_t)fAllPlanes.size(); }
+    Int_t   GetEvNum() const;
+    Int_t   SetSearchLevel( UInt_t level );
+    void    SelectSearchLevel( UInt_t level );
+    void    DeleteSearchLevels();
 
-    virtual Hitpattern* MakeHitpattern( const PatternTree& ) const;
+    virtual Hitpattern* MakeHitpattern( const PatternTree& pt,
+					UInt_t nlevels ) const;
     virtual void MakePlaneCombos( const vpl_t& planes, TBits*& combos ) const;
 
     // Podd interface
@@ -212,25 +278,20 @@ namespace TreeSearch {
     class ComparePattern : public NodeVisitor {
     public:
       ComparePattern( const Hitpattern* hitpat, const TBits* combos,
-		      NodeVec_t* matches, UInt_t dummypattern = 0 )
+		      NodeVec_t* matches, UInt_t dummypattern = 0,
+		      UInt_t maxpat = kMaxUInt )
 	: fHitpattern(hitpat), fPlaneCombos(combos), fMatches(matches),
-	  fDummyPlanePattern(dummypattern)
-#ifdef TESTCODE
-	, fNtest(0)
-#endif
+	  fDummyPlanePattern(dummypattern), fMaxPat(maxpat), fNtest(0)
       { assert(fHitpattern && fPlaneCombos && fMatches); }
       virtual ETreeOp operator() ( const NodeDescriptor& nd );
-#ifdef TESTCODE
       UInt_t GetNtest() const { return fNtest; }
-#endif
     private:
       const Hitpattern* fHitpattern;   // Hitpattern to compare to
       const TBits*      fPlaneCombos;  // Allowed plane occupancy patterns
       NodeVec_t*        fMatches;      // Set of matching patterns
       UInt_t            fDummyPlanePattern;  // Dummy plane # bitpattern
-#ifdef TESTCODE
-      UInt_t fNtest;  // Number of pattern comparisons
-#endif
+      UInt_t            fMaxPat;       // Stop if more matches than this
+      UInt_t            fNtest;        // Number of pattern comparisons
     };
 
   private:
@@ -264,6 +325,15 @@ namespace TreeSearch {
     return static_cast<UInt_t>( fPatternsFound.size() );
   }
 
+  //___________________________________________________________________________
+  inline
+  UInt_t Projection::GetSearchDepth() const
+  {
+    // Return the tree search depth used in the current event
+
+    return fLevels.empty() ? 0 : fLevels[fLevel].nlevels-1;
+  }
+
   //___________________________________________________________________________
   inline
   UInt_t Projection::GetNroads() const
@@ -13,6 +13,7 @@
 
 #include "ProjectionLR.h"
 #include "HitpatternLR.h"
+#include "PatternTree.h"
 
 using namespace std;
 
@@ -34,11 +35,12 @@ ProjectionLR::~ProjectionLR()
 }
 
 //_____________________________________________________________________________
-Hitpattern* ProjectionLR::MakeHitpattern( const PatternTree& pt ) const
+Hitpattern* ProjectionLR::MakeHitpattern( const PatternTree& pt,
+					  UInt_t nlevels ) const
 {
   // Instantiate a HitpatternLR that interprets hits as L/R-ambiguous wire hits.
 
-  return new HitpatternLR( pt );
+  return new HitpatternLR( nlevels, pt.GetNplanes(), pt.GetWidth() );
 }
 
 //_____________________________________________________________________________
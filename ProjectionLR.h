@@ -20,7 +20,8 @@ namespace TreeSearch {
 		  THaDetectorBase* parent );
     virtual ~ProjectionLR();
 
-    virtual Hitpattern* MakeHitpattern( const PatternTree& ) const;
+    virtual Hitpattern* MakeHitpattern( const PatternTree& pt,
+					UInt_t nlevels ) const;
 
   private:
     // Prevent default copying, assignment
@@ -877,18 +877,16 @@ TVector2 Road::Intersect( const Road* other, Double_t z ) const
   assert(fGood && other->fGood);
   assert(fProjection->GetType() != other->fProjection->GetType());
 
-  Double_t su = fProjection->GetSinAngle();
-  Double_t cu = fProjection->GetCosAngle();
-  Double_t sv = other->fProjection->GetSinAngle();
-  Double_t cv = other->fProjection->GetCosAngle();
-  // FIXME: this should be calculated only once
-  Double_t inv_denom = 1.0/(sv*cu-su*cv);
+  // Time-critical code should use the version of this function that takes
+  // precomputed coefficients (see Tracker::GetProjPairCoef)
 
   // Standard formulae for the intersection of non-orthogonal coordinates
   // (cf. THaVDCUVTrack.C)
-  Double_t x = (GetPos(z) * sv - other->GetPos(z) * su) * inv_denom;
-  Double_t y = (other->GetPos(z) * cu - GetPos(z) * cv) * inv_denom;
-  return TVector2(x, y);
+  ProjPairCoef_t coef( fProjection->GetSinAngle(),
+		       fProjection->GetCosAngle(),
+		       other->fProjection->GetSinAngle(),
+		       other->fProjection->GetCosAngle() );
+  return Intersect( other, z, coef );
 }
 
 //_____________________________________________________________________________
@@ -8,6 +8,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "Hit.h"
+#include "Types.h"
 #include "TVector2.h"
 #include <set>
 #include <utility>
@@ -93,6 +94,8 @@ namespace TreeSearch {
     Bool_t         HasGrown()   const { return fGrown; }
     Bool_t         Include( const Road* other );
     TVector2       Intersect( const Road* other, Double_t z ) const;
+    TVector2       Intersect( const Road* other, Double_t z,
+			      const ProjPairCoef_t& coef ) const;
     Bool_t         IsGood()     const { return fGood; }
     Bool_t         IsInFrontRange( const NodeDescriptor& nd ) const;
     virtual Bool_t IsSortable() const { return kTRUE; }
@@ -133,6 +136,7 @@ namespace TreeSearch {
     ETrackingStatus GetTrackingStatus() const { return fTrkStat; }
 
   protected:
+    friend class BenchAccess;  // Benchmarks (tsbench)
 
     NodeList_t     fPatterns;   // Patterns in this road
     Hset_t         fHits;       // All hits linked to the patterns
@@ -208,6 +212,20 @@ namespace TreeSearch {
     return fV[0] + 2.0*fV[1]*z + fV[2]*z*z;
   }
 
+  //---------------------------------------------------------------------------
+  inline
+  TVector2 Road::Intersect( const Road* other, Double_t z,
+			    const ProjPairCoef_t& coef ) const
+  {
+    // Same as Intersect(other,z), but using precomputed coefficients for
+    // the projection pair (this, other), e.g. from Tracker::GetProjPairCoef
+
+    assert(other);
+    assert(fGood && other->fGood);
+    Double_t u = GetPos(z), v = other->GetPos(z);
+    return TVector2( u * coef.sv - v * coef.su, v * coef.cu - u * coef.cv );
+  }
+
   //---------------------------------------------------------------------------
   inline
   Bool_t Road::IsInRange( const NodeDescriptor& nd ) const
@@ -0,0 +1,287 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::ThreadPool                                                    //
+//                                                                           //
+// Process-wide pool of persistent worker threads.                           //
+//                                                                           //
+// Each worker owns a task queue. Submitted tasks are distributed over the   //
+// queues round-robin. A worker takes tasks from the back of its own queue   //
+// and, when that is empty, steals from the front of the other workers'      //
+// queues, so unbalanced work (e.g. a busy projection next to quiet ones)    //
+// does not leave threads idle. The thread waiting for a task group also     //
+// executes queued tasks until the group is complete, which makes nested     //
+// submission (tasks submitting and waiting for subtasks) safe.              //
+//                                                                           //
+// Task counters are maintained with atomic operations. Idle workers and     //
+// waiting threads spin briefly on these counters before blocking on a       //
+// condition variable, so that short hand-overs do not pay the full wake-up  //
+// latency of the OS.                                                        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ThreadPool.h"
+#include "Instrument.h"   // for TraceScope
+#include "TThread.h"
+#include "TMutex.h"
+#include "TCondition.h"
+#include "TString.h"
+
+#include <cassert>
+
+using namespace std;
+
+namespace TreeSearch {
+
+// Number of polls of a counter before blocking
+static const UInt_t kSpinCount = 2000;
+
+ThreadPool* ThreadPool::fgInstance = 0;
+UInt_t      ThreadPool::fgNusers   = 0;
+
+//_____________________________________________________________________________
+ThreadPool::Worker::Worker( ThreadPool* p, UInt_t i )
+  : pool(p), index(i), lock(new TMutex), thread(0)
+{
+  // Constructor
+}
+
+//_____________________________________________________________________________
+ThreadPool::Worker::~Worker()
+{
+  // Destructor. The thread must have been joined.
+  delete thread;
+  delete lock;
+}
+
+//_____________________________________________________________________________
+ThreadPool::ThreadPool()
+  : fNworkers(0), fNext(0), fNqueued(0), fNidle(0), fNwaiting(0),
+    fTerminate(false),
+    fWorkM(new TMutex), fWork(new TCondition(fWorkM)),
+    fDoneM(new TMutex), fDone(new TCondition(fDoneM))
+{
+  // Constructor. Creates a pool without worker threads.
+  for( UInt_t i = 0; i < kMaxWorkers; ++i )
+    fWorkers[i] = 0;
+}
+
+//_____________________________________________________________________________
+ThreadPool::~ThreadPool()
+{
+  // Destructor. Terminates and joins all worker threads. Any tasks still
+  // queued are executed first.
+
+  fWorkM->Lock();
+  fTerminate = true;
+  fWork->Broadcast();
+  fWorkM->UnLock();
+  for( UInt_t i = 0; i < fNworkers; ++i ) {
+    fWorkers[i]->thread->Join();
+    delete fWorkers[i];
+  }
+  assert( fNqueued == 0 );
+  delete fDone;
+  delete fDoneM;
+  delete fWork;
+  delete fWorkM;
+}
+
+//_____________________________________________________________________________
+ThreadPool* ThreadPool::Acquire( UInt_t nthreads )
+{
+  // Get the process-wide thread pool and make sure it has at least
+  // nthreads-1 worker threads (the caller of Wait() being the nth thread).
+  // Not thread-safe; to be called during initialization only.
+
+  if( !fgInstance )
+    fgInstance = new ThreadPool;
+  ++fgNusers;
+  if( nthreads > GetMaxThreads() )
+    nthreads = GetMaxThreads();
+  if( nthreads > fgInstance->fNworkers+1 )
+    fgInstance->AddWorkers( nthreads-1-fgInstance->fNworkers );
+  return fgInstance;
+}
+
+//_____________________________________________________________________________
+void ThreadPool::Release()
+{
+  // Release the process-wide thread pool. Stops all threads when the last
+  // user releases it.
+
+  assert( fgNusers > 0 );
+  if( fgNusers > 0 and --fgNusers == 0 ) {
+    delete fgInstance;
+    fgInstance = 0;
+  }
+}
+
+//_____________________________________________________________________________
+void ThreadPool::AddWorkers( UInt_t n )
+{
+  // Start n additional worker threads
+
+  while( n-- > 0 and fNworkers < kMaxWorkers ) {
+    UInt_t i = fNworkers;
+    Worker* w = new Worker( this, i );
+    w->thread = new TThread( Form("tspool_%u",i), WorkerLoop, (void*)w );
+    fWorkers[i] = w;
+    // Publish the new worker only once it is fully set up
+    __sync_synchronize();
+    fNworkers = i+1;
+    w->thread->Run();
+  }
+}
+
+//_____________________________________________________________________________
+void ThreadPool::Submit( Task* task, TaskGroup& group )
+{
+  // Queue task for execution as part of the given group.
+  // Completion is awaited with Wait(group).
+
+  assert( task );
+  task->fGroup = &group;
+  TS_ATOMIC_ADD( &group.fPending, 1 );
+  UInt_t nw = fNworkers;
+  if( nw == 0 ) {
+    // No worker threads: execute right away
+    Execute( task );
+    return;
+  }
+  Worker* w = fWorkers[ TS_ATOMIC_ADD(&fNext,1) % nw ];
+  w->lock->Lock();
+  w->queue.push_back( task );
+  w->lock->UnLock();
+  TS_ATOMIC_ADD( &fNqueued, 1 );
+  // Wake up a sleeping worker, if any. Sleepers announce themselves in
+  // fNidle/fNwaiting (with a full barrier) before testing fNqueued, and
+  // the atomic increment of fNqueued above is a full barrier as well,
+  // so either the sleeper sees the new task or we see the sleeper.
+  if( fNidle > 0 ) {
+    fWorkM->Lock();
+    fWork->Signal();
+    fWorkM->UnLock();
+  }
+  // Threads blocked in Wait() may help with the new task, too
+  if( fNwaiting > 0 ) {
+    fDoneM->Lock();
+    fDone->Broadcast();
+    fDoneM->UnLock();
+  }
+}
+
+//_____________________________________________________________________________
+ThreadPool::Task* ThreadPool::Pop( UInt_t first )
+{
+  // Get the next task to run. Try the back of the queue of worker 'first'
+  // (the caller's own queue, if it is a worker), then steal from the front
+  // of the other queues. Returns 0 if no tasks are queued.
+
+  if( fNqueued <= 0 )
+    return 0;
+  UInt_t nw = fNworkers;
+  for( UInt_t k = 0; k < nw; ++k ) {
+    UInt_t i = (first+k) % nw;
+    Worker* w = fWorkers[i];
+    Task* task = 0;
+    w->lock->Lock();
+    if( !w->queue.empty() ) {
+      if( k == 0 ) {
+	task = w->queue.back();
+	w->queue.pop_back();
+      } else {
+	task = w->queue.front();
+	w->queue.pop_front();
+      }
+    }
+    w->lock->UnLock();
+    if( task ) {
+      TS_ATOMIC_SUB( &fNqueued, 1 );
+      return task;
+    }
+  }
+  return 0;
+}
+
+//_____________________________________________________________________________
+void ThreadPool::Execute( Task* task )
+{
+  // Run the given task and update its group's completion state
+
+  TaskGroup* group = task->fGroup;
+  assert( group );
+  if( task->Run() < 0 )
+    TS_ATOMIC_ADD( &group->fNerrors, 1 );
+  if( TS_ATOMIC_SUB( &group->fPending, 1 ) == 0 ) {
+    // Wake up threads waiting for this group. (The waiting thread tests
+    // fPending while holding fDoneM, so the wake-up cannot get lost.)
+    fDoneM->Lock();
+    fDone->Broadcast();
+    fDoneM->UnLock();
+  }
+}
+
+//_____________________________________________________________________________
+void ThreadPool::Wait( TaskGroup& group )
+{
+  // Wait until all tasks of the given group have completed. While waiting,
+  // the calling thread executes queued tasks itself.
+
+  UInt_t spin = 0;
+  while( group.fPending > 0 ) {
+    Task* task = Pop( fNext );
+    if( task ) {
+      Execute( task );
+      spin = 0;
+      continue;
+    }
+    // Nothing left to do for us; the remaining tasks are being run by
+    // the workers. Spin briefly, then block.
+    if( ++spin < kSpinCount )
+      continue;
+    TraceScope trace( "PoolWait" );
+    fDoneM->Lock();
+    TS_ATOMIC_ADD( &fNwaiting, 1 );
+    while( group.fPending > 0 and fNqueued <= 0 )
+      fDone->Wait();
+    TS_ATOMIC_SUB( &fNwaiting, 1 );
+    fDoneM->UnLock();
+    spin = 0;
+  }
+  __sync_synchronize();
+}
+
+//_____________________________________________________________________________
+void ThreadPool::WorkerLoop( void* arg )
+{
+  // Main loop of the worker threads
+
+  Worker* self = static_cast<Worker*>(arg);
+  ThreadPool* pool = self->pool;
+  UInt_t spin = 0;
+  while( true ) {
+    Task* task = pool->Pop( self->index );
+    if( task ) {
+      pool->Execute( task );
+      spin = 0;
+      continue;
+    }
+    if( ++spin < kSpinCount and !pool->fTerminate )
+      continue;
+    spin = 0;
+    TraceScope trace( "PoolIdle" );
+    pool->fWorkM->Lock();
+    TS_ATOMIC_ADD( &pool->fNidle, 1 );
+    while( pool->fNqueued <= 0 and !pool->fTerminate )
+      pool->fWork->Wait();
+    TS_ATOMIC_SUB( &pool->fNidle, 1 );
+    bool quit = pool->fTerminate and pool->fNqueued <= 0;
+    pool->fWorkM->UnLock();
+    if( quit )
+      break;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // end namespace TreeSearch
@@ -0,0 +1,114 @@
+#ifndef ROOT_TreeSearch_ThreadPool
+#define ROOT_TreeSearch_ThreadPool
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TreeSearch::ThreadPool                                                    //
+//                                                                           //
+// Process-wide pool of persistent worker threads with per-worker task       //
+// queues and work stealing.                                                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Rtypes.h"
+#include <deque>
+
+class TThread;
+class TMutex;
+class TCondition;
+
+#ifndef __CINT__
+// Atomic counter updates, returning the new value. These are full memory
+// barriers. Uses the GCC-style builtins (gcc >= 4.1, clang).
+#define TS_ATOMIC_ADD(p,v)  __sync_add_and_fetch((p),(v))
+#define TS_ATOMIC_SUB(p,v)  __sync_sub_and_fetch((p),(v))
+#endif
+
+namespace TreeSearch {
+
+  class ThreadPool {
+  public:
+    // Completion tracking for a batch of tasks
+    class TaskGroup {
+    public:
+      TaskGroup() : fPending(0), fNerrors(0) {}
+      UInt_t GetNerrors() const { return fNerrors; }
+      Bool_t IsDone()     const { return fPending == 0; }
+    private:
+      friend class ThreadPool;
+      volatile Int_t fPending;  // Number of submitted, unfinished tasks
+      volatile Int_t fNerrors;  // Number of tasks that returned < 0
+    };
+
+    // Unit of work. Run() returns a negative value to indicate an error.
+    // Tasks are owned by the caller and must stay alive until the
+    // corresponding TaskGroup has been waited for.
+    class Task {
+    public:
+      Task() : fGroup(0) {}
+      virtual ~Task() {}
+      virtual Int_t Run() = 0;
+    private:
+      friend class ThreadPool;
+      TaskGroup* fGroup;  // Group this task belongs to
+    };
+
+    // Get the process-wide pool, with at least nthreads threads in total
+    // (including the calling thread, which executes tasks while waiting).
+    // Each call must be balanced by a call to Release().
+    static ThreadPool* Acquire( UInt_t nthreads );
+    static void        Release();
+
+    void   Submit( Task* task, TaskGroup& group );
+    void   Wait( TaskGroup& group );
+
+    UInt_t GetNworkers() const { return fNworkers; }
+
+    static UInt_t GetMaxThreads() { return kMaxWorkers+1; }
+
+  private:
+    enum { kMaxWorkers = 63 };
+
+    struct Worker {
+      ThreadPool*        pool;    // Owning pool
+      UInt_t             index;   // Index of this worker in fWorkers
+      TMutex*            lock;    // Protects queue
+      std::deque<Task*>  queue;   // Tasks waiting to be run
+      TThread*           thread;  // Thread executing WorkerLoop
+      Worker( ThreadPool* p, UInt_t i );
+      ~Worker();
+    };
+
+    ThreadPool();
+    ~ThreadPool();
+
+    void   AddWorkers( UInt_t n );
+    Task*  Pop( UInt_t first );
+    void   Execute( Task* task );
+
+    static void WorkerLoop( void* arg );
+
+    Worker*         fWorkers[kMaxWorkers]; // Worker threads
+    volatile UInt_t fNworkers;     // Number of active workers
+    volatile UInt_t fNext;         // Round-robin counter for Submit()
+    volatile Int_t  fNqueued;      // Total number of queued tasks
+    volatile Int_t  fNidle;        // Number of workers sleeping in fWork
+    volatile Int_t  fNwaiting;     // Number of threads sleeping in fDone
+    volatile bool   fTerminate;    // Workers should exit
+    TMutex*         fWorkM;        // Mutex for fWork
+    TCondition*     fWork;         // Signalled when tasks are queued
+    TMutex*         fDoneM;        // Mutex for fDone
+    TCondition*     fDone;         // Signalled when a task group completes
+                                   // or tasks are queued for waiters
+
+    static ThreadPool* fgInstance; // The process-wide pool
+    static UInt_t      fgNusers;   // Number of Acquire() calls outstanding
+
+    // Copying is not supported
+    ThreadPool( const ThreadPool& );
+    ThreadPool& operator=( const ThreadPool& );
+  };
+
+} // end namespace TreeSearch
+
+#endif
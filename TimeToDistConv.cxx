@@ -6,13 +6,52 @@
 
 #include "TimeToDistConv.h"
 #include "TMath.h"
+#include <cassert>
 
 ClassImp(TreeSearch::TimeToDistConv)
 ClassImp(TreeSearch::LinearTTD)
 ClassImp(TreeSearch::TanhFitTTD)
+ClassImp(TreeSearch::TableTTD)
 
 namespace TreeSearch {
 
+//_____________________________________________________________________________
+void TimeToDistConv::ConvertTimesToDist( UInt_t n, const Double_t* time,
+					 Double_t slope, Double_t* dist ) const
+{
+  // Convert n drift times (s) to distances (m) for the given track slope.
+  // Derived classes may override this with a more efficient version.
+
+  for( UInt_t i = 0; i < n; ++i )
+    dist[i] = ConvertTimeToDist( time[i], slope );
+}
+
+//_____________________________________________________________________________
+Double_t TimeToDistConv::ConvertDistToTime( Double_t dist, Double_t slope,
+					    Double_t tmax ) const
+{
+  // Inverse conversion: drift time (s) in [0,tmax] corresponding to the
+  // drift distance dist (m) for the given track slope. The distance is
+  // assumed to increase monotonically with time. Returns tmax if dist
+  // is not reached within tmax. For event simulation, not time-critical.
+
+  static const Double_t kTimeTol = 1e-12;
+
+  Double_t lo = 0, hi = tmax;
+  if( dist <= ConvertTimeToDist(lo, slope) )
+    return lo;
+  if( dist >= ConvertTimeToDist(hi, slope) )
+    return hi;
+  while( hi-lo > kTimeTol ) {
+    Double_t t = 0.5*(lo+hi);
+    if( ConvertTimeToDist(t, slope) < dist )
+      lo = t;
+    else
+      hi = t;
+  }
+  return 0.5*(lo+hi);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // LinearTTD                                                                 //
@@ -136,6 +175,216 @@ Double_t TanhFitTTD::ConvertTimeToDist( Double_t time, Double_t slope ) const
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// TableTTD                                                                  //
+//                                                                           //
+// Lookup table for another converter, filled by Tabulate() on a regular     //
+// grid of drift times and track slopes. Distances are obtained by bilinear  //
+// or bicubic (Catmull-Rom) interpolation in the grid, avoiding the          //
+// evaluation of the converter's function. Tabulate() reports the maximum    //
+// deviation of the interpolation from the exact converter. Times and slopes //
+// outside of the tabulated range are passed to the exact converter.         //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+//_____________________________________________________________________________
+TableTTD::TableTTD( TimeToDistConv* conv )
+  : TimeToDistConv( conv ? conv->GetNparam() : 0 ), fConv(conv),
+    fInterp(kCubic), fTmin(0), fTmax(0), fDt(0), fInvDt(0), fSmin(0),
+    fSmax(0), fDs(0), fInvDs(0), fNt(0), fNs(0), fStride(0), fMaxError(0)
+{
+  // Constructor. Takes ownership of the converter 'conv'.
+}
+
+//_____________________________________________________________________________
+TableTTD::~TableTTD()
+{
+  // Destructor
+
+  delete fConv;
+}
+
+//_____________________________________________________________________________
+Double_t TableTTD::GetParameter( UInt_t i ) const
+{
+  // Get i-th parameter of the tabulated converter
+
+  return fConv ? fConv->GetParameter(i) : kBig;
+}
+
+//_____________________________________________________________________________
+Int_t TableTTD::SetParameters( const vector<double>& parameters )
+{
+  // Set parameters of the tabulated converter and recompute the table,
+  // if any
+
+  if( !fConv )
+    return -1;
+  Int_t ret = fConv->SetParameters( parameters );
+  if( ret == 0 and IsTabulated() )
+    ret = Tabulate( fTmin, fTmax, fNt, fSmax, fNs, fInterp );
+  return ret;
+}
+
+//_____________________________________________________________________________
+Int_t TableTTD::Tabulate( Double_t tmin, Double_t tmax, UInt_t nt,
+			  Double_t smax, UInt_t ns, EInterpolation interp )
+{
+  // Fill the lookup table with nt x ns grid points covering drift times
+  // tmin-tmax (s) and track slopes -smax to +smax. One extra grid point is
+  // added on each side for cubic interpolation at the edges.
+  // Afterwards, compare the interpolation to the converter at several points
+  // within each grid cell. The largest deviation is available from
+  // GetMaxError(). Returns 0 on success, -1 if parameters are invalid.
+
+  fTable.clear();
+  fMaxError = 0;
+  if( !fConv or nt < 2 or ns < 2 or tmax <= tmin or smax <= 0 or
+      (interp != kLinear and interp != kCubic) )
+    return -1;
+
+  fInterp = interp;
+  fTmin   = tmin;
+  fTmax   = tmax;
+  fNt     = nt;
+  fDt     = (tmax-tmin)/(nt-1);
+  fInvDt  = 1.0/fDt;
+  fSmin   = -smax;
+  fSmax   = smax;
+  fNs     = ns;
+  fDs     = 2.0*smax/(ns-1);
+  fInvDs  = 1.0/fDs;
+  fStride = nt+2;
+
+  fTable.resize( (ns+2)*fStride );
+  for( UInt_t j = 0; j < ns+2; ++j ) {
+    Double_t slope = fSmin + (Int_t(j)-1)*fDs;
+    Double_t* row = &fTable[j*fStride];
+    for( UInt_t i = 0; i < fStride; ++i )
+      row[i] = fConv->ConvertTimeToDist( fTmin + (Int_t(i)-1)*fDt, slope );
+  }
+
+  // Check the interpolation error
+  const Double_t frac[] = { 0.25, 0.5, 0.75 };
+  for( UInt_t j = 0; j+1 < ns; ++j ) {
+    for( UInt_t i = 0; i+1 < nt; ++i ) {
+      for( UInt_t a = 0; a < 3; ++a ) {
+	Double_t slope = fSmin + (j+frac[a])*fDs;
+	for( UInt_t b = 0; b < 3; ++b ) {
+	  Double_t time = fTmin + (i+frac[b])*fDt;
+	  Double_t err = TMath::Abs( Interpolate(time, slope) -
+				     fConv->ConvertTimeToDist(time, slope) );
+	  if( err > fMaxError )
+	    fMaxError = err;
+	}
+      }
+    }
+  }
+  return 0;
+}
+
+//_____________________________________________________________________________
+inline
+void TableTTD::CubicWeights( Double_t f, Double_t* w ) const
+{
+  // Catmull-Rom interpolation weights for the grid points i-1, i, i+1, i+2
+  // at fractional position f between points i and i+1
+
+  Double_t f2 = f*f, f3 = f2*f;
+  w[0] = 0.5*( -f3 + 2.0*f2 - f );
+  w[1] = 0.5*( 3.0*f3 - 5.0*f2 + 2.0 );
+  w[2] = 0.5*( -3.0*f3 + 4.0*f2 + f );
+  w[3] = 0.5*( f3 - f2 );
+}
+
+//_____________________________________________________________________________
+Double_t TableTTD::Interpolate( Double_t time, Double_t slope ) const
+{
+  // Interpolate the table at the given time and slope, which must be
+  // within the tabulated range
+
+  assert( IsTabulated() and InRange(time, slope) );
+
+  Double_t x = (time-fTmin)*fInvDt, y = (slope-fSmin)*fInvDs;
+  UInt_t i = TMath::Min( static_cast<UInt_t>(x), fNt-2 );
+  UInt_t j = TMath::Min( static_cast<UInt_t>(y), fNs-2 );
+  Double_t f = x-i, g = y-j;
+
+  if( fInterp == kLinear ) {
+    // Grid point (i,j) is at index (j+1)*fStride+(i+1)
+    const Double_t* p = &fTable[(j+1)*fStride + i+1];
+    return (1.0-g) * ( (1.0-f)*p[0]       + f*p[1] )
+      +          g * ( (1.0-f)*p[fStride] + f*p[fStride+1] );
+  }
+  Double_t wt[4], ws[4];
+  CubicWeights( f, wt );
+  CubicWeights( g, ws );
+  // Grid point (i-1,j-1) is at index j*fStride+i
+  const Double_t* p = &fTable[j*fStride + i];
+  Double_t d = 0;
+  for( UInt_t b = 0; b < 4; ++b, p += fStride )
+    d += ws[b] * ( wt[0]*p[0] + wt[1]*p[1] + wt[2]*p[2] + wt[3]*p[3] );
+  return d;
+}
+
+//_____________________________________________________________________________
+Double_t TableTTD::ConvertTimeToDist( Double_t time, Double_t slope ) const
+{
+  // Convert time (s) to distance (m) by interpolation in the table.
+  // Falls back to the tabulated converter outside of the table range.
+
+  if( IsTabulated() and InRange(time, slope) )
+    return Interpolate( time, slope );
+
+  assert( fConv );
+  return fConv->ConvertTimeToDist( time, slope );
+}
+
+//_____________________________________________________________________________
+void TableTTD::ConvertTimesToDist( UInt_t n, const Double_t* time,
+				   Double_t slope, Double_t* dist ) const
+{
+  // Convert n drift times (s) to distances (m) for the given track slope.
+  // The slope interpolation weights are computed only once.
+
+  assert( fConv );
+  if( !IsTabulated() or slope < fSmin or slope > fSmax ) {
+    fConv->ConvertTimesToDist( n, time, slope, dist );
+    return;
+  }
+  Double_t y = (slope-fSmin)*fInvDs;
+  UInt_t j = TMath::Min( static_cast<UInt_t>(y), fNs-2 );
+  Double_t g = y-j;
+  Double_t ws[4];
+  if( fInterp == kCubic )
+    CubicWeights( g, ws );
+
+  for( UInt_t k = 0; k < n; ++k ) {
+    Double_t t = time[k];
+    if( t < fTmin or t > fTmax ) {
+      dist[k] = fConv->ConvertTimeToDist( t, slope );
+      continue;
+    }
+    Double_t x = (t-fTmin)*fInvDt;
+    UInt_t i = TMath::Min( static_cast<UInt_t>(x), fNt-2 );
+    Double_t f = x-i;
+    if( fInterp == kLinear ) {
+      const Double_t* p = &fTable[(j+1)*fStride + i+1];
+      dist[k] = (1.0-g) * ( (1.0-f)*p[0]       + f*p[1] )
+	+             g * ( (1.0-f)*p[fStride] + f*p[fStride+1] );
+    } else {
+      Double_t wt[4];
+      CubicWeights( f, wt );
+      const Double_t* p = &fTable[j*fStride + i];
+      Double_t d = 0;
+      for( UInt_t b = 0; b < 4; ++b, p += fStride )
+	d += ws[b] * ( wt[0]*p[0] + wt[1]*p[1] + wt[2]*p[2] + wt[3]*p[3] );
+      dist[k] = d;
+    }
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 }  // end namespace TreeSearch
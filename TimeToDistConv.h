@@ -25,6 +25,10 @@ namespace TreeSearch {
 
     virtual Double_t ConvertTimeToDist( Double_t time,
 					Double_t slope ) const = 0;
+    virtual void     ConvertTimesToDist( UInt_t n, const Double_t* time,
+					 Double_t slope, Double_t* dist ) const;
+            Double_t ConvertDistToTime( Double_t dist, Double_t slope,
+					Double_t tmax ) const;
             UInt_t   GetNparam() const { return fNparam; }
     virtual Double_t GetParameter( UInt_t ) const { return kBig; }
     virtual Int_t    SetParameters( const vector<double>& ) { return 0; }
@@ -97,6 +101,65 @@ protected:
     ClassDef(TanhFitTTD,0)  // TanhFit drift time-to-distance converter
   };
 
+  //___________________________________________________________________________
+  // TableTTD
+  //
+  // Tabulated version of another drift time-to-distance converter, using
+  // linear or cubic interpolation on a (time, slope) grid
+
+  class TableTTD : public TimeToDistConv {
+
+  public:
+    enum EInterpolation { kLinear = 1, kCubic = 3 };
+
+    TableTTD( TimeToDistConv* conv = 0 );
+    virtual ~TableTTD();
+
+    virtual Double_t ConvertTimeToDist( Double_t time, Double_t slope ) const;
+    virtual void     ConvertTimesToDist( UInt_t n, const Double_t* time,
+					 Double_t slope, Double_t* dist ) const;
+    virtual Double_t GetParameter( UInt_t i ) const;
+    virtual Int_t    SetParameters( const vector<double>& param );
+
+            Int_t    Tabulate( Double_t tmin, Double_t tmax, UInt_t nt,
+			       Double_t smax, UInt_t ns,
+			       EInterpolation interp = kCubic );
+            TimeToDistConv* GetConverter() const { return fConv; }
+            Double_t GetMaxError() const { return fMaxError; }
+            Bool_t   IsTabulated() const { return !fTable.empty(); }
+
+protected:
+
+    TimeToDistConv* fConv;  // Tabulated converter (owned)
+    EInterpolation  fInterp; // Interpolation method
+    Double_t fTmin;         // Lower edge of time range (s)
+    Double_t fTmax;         // Upper edge of time range (s)
+    Double_t fDt;           // Time step (s)
+    Double_t fInvDt;        // 1/fDt (1/s)
+    Double_t fSmin;         // Lower edge of slope range
+    Double_t fSmax;         // Upper edge of slope range
+    Double_t fDs;           // Slope step
+    Double_t fInvDs;        // 1/fDs
+    UInt_t   fNt;           // Number of time grid points in range
+    UInt_t   fNs;           // Number of slope grid points in range
+    UInt_t   fStride;       // Row length of fTable (fNt+2)
+    vector<Double_t> fTable;// [(fNs+2)*(fNt+2)] Distances, one row per slope
+    Double_t fMaxError;     // Max interpolation error found in Tabulate (m)
+
+    Bool_t   InRange( Double_t time, Double_t slope ) const
+    { return ( time >= fTmin && time <= fTmax &&
+	       slope >= fSmin && slope <= fSmax ); }
+    Double_t Interpolate( Double_t time, Double_t slope ) const;
+    void     CubicWeights( Double_t f, Double_t* w ) const;
+
+  private:
+    // Copying is not supported
+    TableTTD( const TableTTD& );
+    TableTTD& operator=( const TableTTD& );
+
+    ClassDef(TableTTD,0)  // Tabulated drift time-to-distance converter
+  };
+
 ///////////////////////////////////////////////////////////////////////////////
 
 }  // end namespace TreeSearch
@@ -19,6 +19,8 @@
 #include "Projection.h"
 #include "Road.h"
 #include "Helper.h"
+#include "ThreadPool.h"
+#include "HitSnapshot.h"
 
 #include "THaDetMap.h"
 #include "THaTrack.h"
@@ -27,13 +29,10 @@
 #include "TMath.h"
 #include "THashTable.h"
 #include "TVector2.h"
-#include "TDecompChol.h"
 #include "TSystem.h"
-#include "TThread.h"
-#include "TCondition.h"
-#include "TMutex.h"
 #include "TBits.h"
 #include "TClass.h"
+#include "TError.h"
 
 #include <iostream>
 #include <algorithm>
@@ -43,9 +42,6 @@
 #include <stdexcept>
 #include <cstring>   // for memset
 
-#ifdef TESTCODE
-#include "TStopwatch.h"
-#endif
 #ifdef MCDATA
 #include "Hit.h"
 #endif
@@ -135,6 +131,16 @@ const Double_t kBig = 1e38;
 // Default value for minimum difference between all projection angles
 static const Double_t kMinProjAngleDiff = 5.0 * TMath::DegToRad();
 
+// Timed stages of CoarseTrack and FineTrack
+enum { kStageTrack, kStage3dMatch, kStage3dFit, kStageCoarse,
+       kStageFineConv, kStageFine, kStageDeghost };
+static const char* const kStageNames[] =
+  { "track", "3dmatch", "3dfit", "coarse", "fineconv", "fine", "deghost",
+    0 };
+
+// Number of events between updates of the timing percentile variables
+static const UInt_t kPercentileInterval = 256;
+
 #ifdef MCDATA
 // Reconstruction status bit numbers, for evaluating tracking with MC data
 enum EReconBits {
@@ -167,222 +173,384 @@ struct ProjAngle_t {
 };
 
 //_____________________________________________________________________________
-// Support classes for data-processing threads
+// Tasks for the thread pool
 
-struct TrackThread {
-  Projection*  proj;    // Projection to be processed
-  Int_t*       status;  // Return status (shared)
-  UInt_t*      running; // Bitfield indicating threads to wait for (shared)
-  TMutex*      start_m; // Mutex for start condition
-  TMutex*      done_m;  // Mutex for done condition
-  TCondition*  start;   // Start condition of tracking threads
-  TCondition*  done;    // Condition indicating all tracking threads done
-  TThread*     thread;  // The actual thread running with these arguments
-  TrackThread()
-    : proj(0), status(0), running(0), start(0), done(0), thread(0) {}
-  ~TrackThread() {
-    if( thread ) {
-      TThread::Delete(thread);
-      delete thread;
-    }
-  }
+class ProjTrackTask : public ThreadPool::Task {
+public:
+  ProjTrackTask() : fProj(0) {}
+  void SetProjection( Projection* proj ) { fProj = proj; }
+  virtual Int_t Run() { return fProj->Track(); }
+private:
+  Projection* fProj;
 };
 
 //_____________________________________________________________________________
-class ThreadCtrl {
+// Parallel decoding of the planes of all projections. Each plane is decoded
+// by a separate task. The task that decodes the last plane of a projection
+// also fills that projection's hitpattern, so hitpattern filling overlaps
+// with the decoding of other projections. The event data are only read.
+
+class DecodeCtrl {
 public:
-  ThreadCtrl( const vector<Projection*>& vp )
-    : fTrackStatus(0), fTrackToDo(0),
-      fTrackStartM(new TMutex), fTrackDoneM(new TMutex),
-      fTrackStart(new TCondition(fTrackStartM)),
-      fTrackDone(new TCondition(fTrackDoneM))
-  {
-    if( !vp.empty() ) {
-      fTrack.reserve( vp.size() );
-      fTrackStartM->Lock();
-      for( vpsiz_t k = 0; k < vp.size(); ++k ) {
-	TThread* t = AddTrackThread( vp[k] );
-	t->Run();
-      }
-      fTrackStartM->UnLock();
-    }
-  }
+  DecodeCtrl( const vector<Projection*>& projs );
+  void   Run( ThreadPool* pool, const THaEvData& evdata, bool fill );
+  // Results of last Run(): true if any plane of projection k had
+  // too many hits or failed to decode (in which case its hitpattern
+  // was not filled)
+  bool   Overflow( vpsiz_t k ) const { return fProj[k].overflow != 0; }
 
-  //___________________________________________________________________________
-  ~ThreadCtrl()
-  {
-    // Terminate all running tracking threads
-    if( !fTrack.empty() ) {
-      fTrackDoneM->Lock();
-      fTrackStartM->Lock();
-      fTrackToDo = 0;
-      for( vector<TrackThread>::iterator it = fTrack.begin(); it !=
-	     fTrack.end(); ++it ) {
-	TThread* th = (*it).thread;
-	if( th and th->GetState() == TThread::kRunningState )
-	  SETBIT(fTrackToDo, (*it).proj->GetType());
-      }
-      // MSB is termination flag
-      SETBIT(fTrackToDo, kThreadTerminateBit);
-      fTrackStart->Broadcast();
-      fTrackStartM->UnLock();
-      while( true ) {
-#ifndef NDEBUG
-	Int_t ret =
-#endif
-	  fTrackDone->Wait();
-	assert( ret == 0 );
-	if( fTrackToDo == BIT(kThreadTerminateBit) )
-	  break;
+private:
+  struct ProjState_t {
+    Projection*     proj;
+    Int_t           nplanes;   // Number of planes in projection
+    volatile Int_t  nleft;     // Planes still to be decoded
+    volatile Int_t  overflow;  // Number of planes with too many hits
+  };
+  class PlaneTask : public ThreadPool::Task {
+  public:
+    PlaneTask( Plane* pl, ProjState_t* ps, DecodeCtrl* ctrl )
+      : fPlane(pl), fState(ps), fCtrl(ctrl) {}
+    virtual Int_t Run()
+    {
+      TraceScope trace( fPlane->GetName(), fPlane->GetTracker()->GetEvNum() );
+      // Exceptions must not escape into the thread pool, and the plane
+      // must always be counted as done. A failed plane counts as
+      // overflowing, so its projection is not tracked.
+      Int_t nhits = -1;
+      try {
+	nhits = fPlane->Decode( *fCtrl->fEvdata );
       }
-      fTrackDoneM->UnLock();
-    }
-    // At this point, all threads should have released their condition
-    // waits and mutexes, so clean up is safe
-    delete fTrackDone;
-    delete fTrackStart;
-    delete fTrackDoneM;
-    delete fTrackStartM;
-  }
-
-  //___________________________________________________________________________
-  Int_t Run( UInt_t maxthreads )
-  {
-    // Run our threads, at most maxthreads at a time
-    if( maxthreads == 0 or fTrack.empty() )
-      return 0;
-    if( maxthreads > kThreadTerminateBit )
-      maxthreads = kThreadTerminateBit;
-    fTrackDoneM->Lock();
-    fTrackStatus = 0;
-    vector<TrackThread>::iterator it = fTrack.begin();
-    while( it != fTrack.end() ) {
-      fTrackStartM->Lock();
-      fTrackToDo = 0;
-      UInt_t n = 0;
-      while( n < maxthreads and it != fTrack.end() ) {
-	SETBIT(fTrackToDo, (*it).proj->GetType());
-	++n;
-	++it;
+      catch( exception& e ) {
+	::Error( "Tracker::Decode", "Caught %s while decoding plane \"%s\"",
+		 e.what(), fPlane->GetName() );
       }
-      // Start tracking within the threads
-      fTrackStart->Broadcast();
-      fTrackStartM->UnLock();
-      while( true ) {
-	// Wait for end of processing
-#ifndef NDEBUG
-	Int_t ret =
-#endif
-	  fTrackDone->Wait();
-	assert( ret == 0 );
-	if( fTrackToDo == 0 )
-	  break;
+      catch( ... ) {
+	::Error( "Tracker::Decode", "Caught unknown exception while decoding "
+		 "plane \"%s\"", fPlane->GetName() );
       }
+      if( nhits < 0 )
+	TS_ATOMIC_ADD( &fState->overflow, 1 );
+      // Last plane of the projection done: fill hitpattern
+      if( TS_ATOMIC_SUB( &fState->nleft, 1 ) == 0 and fCtrl->fFill and
+	  fState->overflow == 0 )
+	fState->proj->FillHitpattern();
+      return 0;
     }
-    fTrackDoneM->UnLock();
-    return fTrackStatus;
+  private:
+    Plane*       fPlane;
+    ProjState_t* fState;
+    DecodeCtrl*  fCtrl;
+  };
+  friend class PlaneTask;
+  vector<ProjState_t>  fProj;
+  vector<PlaneTask>    fTasks;
+  const THaEvData*     fEvdata;  // Event being decoded
+  bool                 fFill;    // Fill hitpatterns
+};
+
+//_____________________________________________________________________________
+DecodeCtrl::DecodeCtrl( const vector<Projection*>& projs )
+  : fProj(projs.size()), fEvdata(0), fFill(false)
+{
+  // Set up one task per plane. fProj is never resized, so the tasks can
+  // keep pointers to its elements.
+
+  for( vpsiz_t k = 0; k < projs.size(); ++k ) {
+    const vpl_t& planes = projs[k]->GetListOfAllPlanes();
+    ProjState_t& ps = fProj[k];
+    ps.proj = projs[k];
+    ps.nplanes = planes.size();
+    ps.nleft = ps.overflow = 0;
+    for( vplsiz_t i = 0; i < planes.size(); ++i )
+      fTasks.push_back( PlaneTask(planes[i], &ps, this) );
   }
+}
 
-  //___________________________________________________________________________
-  static void DoTrack( void* ptr )
-  {
-    TrackThread* arg = reinterpret_cast<TrackThread*>(ptr);
+//_____________________________________________________________________________
+void DecodeCtrl::Run( ThreadPool* pool, const THaEvData& evdata, bool fill )
+{
+  // Decode all planes and, if requested, fill the hitpatterns
+
+  fEvdata = &evdata;
+  fFill = fill;
+  for( vector<ProjState_t>::iterator it = fProj.begin(); it != fProj.end();
+       ++it ) {
+    ProjState_t& ps = *it;
+    ps.nleft = ps.nplanes;
+    ps.overflow = 0;
+    // Projections without planes (should not happen) are never touched
+    // by a task
+    if( ps.nplanes == 0 and fill )
+      ps.proj->FillHitpattern();
+  }
+  ThreadPool::TaskGroup group;
+  for( vector<PlaneTask>::iterator it = fTasks.begin(); it != fTasks.end();
+       ++it )
+    pool->Submit( &(*it), group );
+  pool->Wait( group );
+  fEvdata = 0;
+}
 
-    //  TThread::SetCancelOn();
-    bool terminate = false;
-    arg->start_m->Lock();
-    while( !terminate ) {
+//_____________________________________________________________________________
+// Crate/slot dispatch table for raw data decoding. Maps each (crate, slot,
+// channel) of the planes' detector maps to (plane, logical channel). Run()
+// reads the data of each module from THaEvData only once per event and
+// stages the hits in the raw hit buffers of the planes, from where the
+// planes' Decode() picks them up. Without this, each plane loops over all
+// channels with hits of each of its modules and skips those belonging to
+// other planes sharing the module.
+class DecodeDispatch {
+public:
+  DecodeDispatch() {}
+  UInt_t Add( Plane* pl );
+  void   Enable( bool enable = true );
+  void   Run( const THaEvData& evdata );
+  UInt_t GetNplanes() const { return fPlanes.size(); }
+  UInt_t GetNslots()  const { return fSlots.size(); }
 
-      // Wait for start condition
-      while( true ) {
-#ifndef NDEBUG
-	Int_t ret =
-#endif
-	  arg->start->Wait(); // unlocks arg->start_m
-	assert( ret == 0 );
-	terminate = TESTBIT(*arg->running, kThreadTerminateBit);
-	if( TESTBIT(*arg->running, arg->proj->GetType()) or terminate )
-	  break;
-      }
-      arg->start_m->UnLock();
-
-      Int_t nrd = 0;
-      if( !terminate )
-	// Process this event
-	nrd = arg->proj->Track();
-
-      // Ensure we're the only one modifying/testing thread
-      // control data (arg->running)
-      arg->done_m->Lock();
-      // Set error flag, if necessary
-      if( nrd < 0 ) {
-	*arg->status = 1;
+private:
+  struct Chan_t {
+    Plane*  plane;     // Plane this channel belongs to, or 0 if unused
+    Int_t   elem;      // Logical channel (e.g. wire number) in plane
+    Int_t   imod;      // Index of module in plane's detector map
+    Chan_t() : plane(0), elem(-1), imod(-1) {}
+  };
+  struct Slot_t {
+    Int_t   crate;
+    Int_t   slot;
+    UInt_t  nfwd;      // Number of mapped channels in normal order
+    UInt_t  nrev;      // Number of mapped channels in reverse order
+    vector<Chan_t> chan; // Lookup table indexed by physical channel
+  };
+  vector<Slot_t>  fSlots;
+  vector<Plane*>  fPlanes;
+};
+
+//_____________________________________________________________________________
+UInt_t DecodeDispatch::Add( Plane* pl )
+{
+  // Add the channels of the detector map of the given plane to the table.
+  // Returns the number of channels that were already mapped to another
+  // plane or module, which cannot be dispatched.
+
+  THaDetMap* map = pl->GetDetMap();
+  UInt_t nconflict = 0;
+  for( Int_t imod = 0; imod < map->GetSize(); ++imod ) {
+    THaDetMap::Module* d = map->GetModule(imod);
+    vector<Slot_t>::size_type i = 0;
+    while( i < fSlots.size() and
+	   (fSlots[i].crate != d->crate or fSlots[i].slot != d->slot) )
+      ++i;
+    if( i == fSlots.size() ) {
+      Slot_t s;
+      s.crate = d->crate;
+      s.slot  = d->slot;
+      s.nfwd = s.nrev = 0;
+      fSlots.push_back( s );
+    }
+    Slot_t& s = fSlots[i];
+    if( d->hi >= (Int_t)s.chan.size() )
+      s.chan.resize( d->hi+1 );
+    for( Int_t chan = d->lo; chan <= d->hi; ++chan ) {
+      Chan_t& c = s.chan[chan];
+      if( c.plane ) {
+	++nconflict;
+	continue;
       }
-      // Clear the bit for this projection in the status bitfield
-      CLRBIT( *arg->running, arg->proj->GetType() );
-      // If all bits are zero, all threads have finished processing,
-      // in which case we wake up the main thread
-      if( (*arg->running & ~BIT(kThreadTerminateBit)) == 0 )
-	arg->done->Signal();
+      c.plane = pl;
+      c.elem  = d->first + ( (d->reverse) ? d->hi-chan : chan-d->lo );
+      c.imod  = imod;
+      if( d->reverse )
+	++s.nrev;
+      else
+	++s.nfwd;
+    }
+  }
+  fPlanes.push_back( pl );
+  return nconflict;
+}
 
-      if( !terminate )
-	// Ensure that we enter Wait() before the main thread can send the
-	// next Broadcast(). This must come before unlocking arg->done_m,
-	// or else we have a race condition in the main thread.
-	arg->start_m->Lock();
+//_____________________________________________________________________________
+void DecodeDispatch::Enable( bool enable )
+{
+  // Tell the planes in the table to decode from their staged hits
+
+  for( vector<Plane*>::size_type i = 0; i < fPlanes.size(); ++i )
+    fPlanes[i]->SetUseDispatch( enable );
+}
 
-      arg->done_m->UnLock();
+//_____________________________________________________________________________
+void DecodeDispatch::Run( const THaEvData& evdata )
+{
+  // Stage the raw hits of all modules in the table in their planes
+
+  for( vector<Plane*>::size_type i = 0; i < fPlanes.size(); ++i )
+    fPlanes[i]->ClearRawHits();
+
+  for( vector<Slot_t>::iterator it = fSlots.begin(); it != fSlots.end();
+       ++it ) {
+    const Slot_t& s = *it;
+    const Int_t maxchan = s.chan.size();
+    Int_t nchan = evdata.GetNumChan( s.crate, s.slot );
+    // Loop backwards over modules that only have "reversed" channels, so
+    // that the hits come out ordered by logical channel, as the planes
+    // would get them when reading the data themselves
+    bool reverse = ( s.nrev > 0 and s.nfwd == 0 );
+    for( Int_t k = 0; k < nchan; ++k ) {
+      Int_t ichan = reverse ? nchan-1-k : k;
+      Int_t chan = evdata.GetNextChan( s.crate, s.slot, ichan );
+      if( chan < 0 or chan >= maxchan )
+	continue;
+      const Chan_t& c = s.chan[chan];
+      if( !c.plane )
+	continue;
+      Int_t nhits = evdata.GetNumHits( s.crate, s.slot, chan );
+      for( Int_t hit = 0; hit < nhits; ++hit )
+	c.plane->StageRawHit( c.elem, c.imod,
+			      evdata.GetData(s.crate, s.slot, chan, hit) );
     }
   }
+}
+
+//_____________________________________________________________________________
+// Uniform 2D grid of roads, indexed by the roads' positions in the front
+// (z=0) and back reference planes. Used by MatchRoadsFast3D to look up
+// candidate roads of the symmetry-axis projection near a predicted
+// front/back position pair in constant time, instead of scanning all roads
+// whose front position alone is close.
+//
+// The cell size is never smaller than the matching tolerance, so all roads
+// within the tolerance of a query point are found in the 3x3 block of cells
+// centered on it. The grid is stored in compressed form (cell offsets +
+// road array, filled via a counting sort) so that refilling it every event
+// does not allocate memory once the buffers have grown to their working size.
+
+class RoadGrid {
+public:
+  RoadGrid() : fNf(0), fNb(0), fFmin(0), fBmin(0), fInvCell(1) {}
 
-  static UInt_t GetMaxThreads() { return kThreadTerminateBit; }
+  void   Fill( const Rvec_t& roads, Double_t zback, Double_t tolerance );
+  void   Find( Double_t pf, Double_t pb, Rvec_t& found ) const;
+  UInt_t GetNcells() const { return fNf*fNb; }
 
 private:
-  static const UInt_t kThreadTerminateBit = 8*sizeof(UInt_t)-1; // = 31
+  static const UInt_t kMaxBins = 256;  // Max number of bins per dimension
 
-  TThread* AddTrackThread( Projection* proj ) {
-    assert( proj );
-    fTrack.push_back( TrackThread() );
-    TrackThread* t = &fTrack.back();
-    t->proj    = proj;
-    t->status  = &fTrackStatus;
-    t->running = &fTrackToDo;
-    t->start_m = fTrackStartM;
-    t->done_m  = fTrackDoneM;
-    t->start   = fTrackStart;
-    t->done    = fTrackDone;
-    string tn;
-    tn = "trk_"; tn.append( proj->GetName() );
-    t->thread  = new TThread( tn.c_str(), DoTrack, (void*)t );
-    return t->thread;
-  }
-  vector<TrackThread>  fTrack;        // Tracking thread descriptors
-  Int_t                fTrackStatus;  // Common status variable
-  UInt_t               fTrackToDo;    // Bitfield of threads to wait for
-  TMutex*              fTrackStartM;  // Mutex for start condition
-  TMutex*              fTrackDoneM;   // Mutex for done condition
-  TCondition*          fTrackStart;   // Start condition
-  TCondition*          fTrackDone;    // Finish condition
+  UInt_t          fNf;       // Number of bins in front position
+  UInt_t          fNb;       // Number of bins in back position
+  Double_t        fFmin;     // Lower edge of first front bin (m)
+  Double_t        fBmin;     // Lower edge of first back bin (m)
+  Double_t        fInvCell;  // 1/(cell size) (1/m)
+  vec_uint_t      fStart;    // [fNf*fNb+1] Offsets of cells in fRoads
+  vec_uint_t      fCell;     // Cell index of each input road (scratch)
+  Rvec_t          fRoads;    // Roads ordered by cell
+
+  Int_t Bin( Double_t pos, Double_t pmin ) const {
+    return static_cast<Int_t>( TMath::Floor( (pos-pmin) * fInvCell ) );
+  }
 };
 
+//_____________________________________________________________________________
+void RoadGrid::Fill( const Rvec_t& roads, Double_t zback, Double_t tolerance )
+{
+  // Fill grid with given roads. 'tolerance' is the maximum distance of
+  // road positions (in both front and back planes) from a query point
+  // for which Find() is guaranteed to return the road.
+
+  assert( tolerance > 0.0 );
+  Rvec_t::size_type nroads = roads.size();
+  fRoads.resize( nroads );
+  fCell.resize( nroads );
+  if( nroads == 0 ) {
+    fNf = fNb = 0;
+    fStart.assign( 1, 0 );
+    return;
+  }
+
+  // Determine extent of the road positions
+  Double_t fmax = -kBig, bmax = -kBig;
+  fFmin = fBmin = kBig;
+  for( Rvec_t::const_iterator it = roads.begin(); it != roads.end(); ++it ) {
+    Double_t pf = (*it)->GetPos(), pb = (*it)->GetPos(zback);
+    fFmin = TMath::Min( fFmin, pf ); fmax = TMath::Max( fmax, pf );
+    fBmin = TMath::Min( fBmin, pb ); bmax = TMath::Max( bmax, pb );
+  }
+  // Choose the cell size. Limit the number of cells to what is reasonable
+  // for the number of roads so that clearing the grid remains cheap
+  UInt_t maxbins = TMath::Min( kMaxBins, 2*static_cast<UInt_t>(nroads) );
+  Double_t cell = TMath::Max( tolerance, TMath::Max(fmax-fFmin,bmax-fBmin)
+			      / static_cast<Double_t>(maxbins) );
+  fInvCell = 1.0/cell;
+  fNf = Bin( fmax, fFmin ) + 1;
+  fNb = Bin( bmax, fBmin ) + 1;
+  // Roundoff safety
+  fNf = TMath::Min( fNf, maxbins );
+  fNb = TMath::Min( fNb, maxbins );
+
+  // Counting sort of the roads by cell index
+  fStart.assign( fNf*fNb+1, 0 );
+  for( Rvec_t::size_type i = 0; i < nroads; ++i ) {
+    UInt_t jf = TMath::Min( (UInt_t)Bin(roads[i]->GetPos(), fFmin), fNf-1 );
+    UInt_t jb = TMath::Min( (UInt_t)Bin(roads[i]->GetPos(zback), fBmin), fNb-1);
+    fCell[i] = jf*fNb + jb;
+    ++fStart[fCell[i]+1];
+  }
+  partial_sum( ALL(fStart), fStart.begin() );
+  for( Rvec_t::size_type i = 0; i < nroads; ++i ) {
+    // Use the lower offset of each cell as the insertion cursor, then
+    // restore it below
+    fRoads[ fStart[fCell[i]]++ ] = roads[i];
+  }
+  for( UInt_t k = fNf*fNb; k; --k )
+    fStart[k] = fStart[k-1];
+  fStart[0] = 0;
+}
+
+//_____________________________________________________________________________
+void RoadGrid::Find( Double_t pf, Double_t pb, Rvec_t& found ) const
+{
+  // Append to 'found' all roads in the cells adjacent to the cell containing
+  // the front/back positions pf/pb, including that cell itself.
+  // The caller must apply the actual distance cut.
+
+  Int_t jf = Bin( pf, fFmin ), jb = Bin( pb, fBmin );
+  Int_t flo = TMath::Max( jf-1, 0 ), fhi = TMath::Min( jf+1, (Int_t)fNf-1 );
+  Int_t blo = TMath::Max( jb-1, 0 ), bhi = TMath::Min( jb+1, (Int_t)fNb-1 );
+  for( Int_t i = flo; i <= fhi; ++i ) {
+    UInt_t row = i*fNb;
+    if( blo <= bhi ) {
+      found.insert( found.end(), fRoads.begin() + fStart[row+blo],
+		    fRoads.begin() + fStart[row+bhi+1] );
+    }
+  }
+}
+
 //====================== Tracker class ========================================
 
 //_____________________________________________________________________________
 Tracker::Tracker( const char* name, const char* desc, THaApparatus* app )
   : THaTrackingDetector(name,desc,app), fCrateMap(0),
     fMinProjAngleDiff(kMinProjAngleDiff), fIsRotated(false),
-    fAllPartnered(false), fMaxThreads(1), fThreads(0),
+    fAllPartnered(false), fMaxThreads(1), fThreadPool(0),
+    fParallelDecode(false), fDecodeCtrl(0), fDispatchDecode(false),
+    fDispatch(0), fPrototype(0),
     fMinReqProj(3), f3dMatchvalScalefact(1), f3dMatchCut(0),
-    fMinNdof(1), fTrkStat(kTrackOK),
-    fNcombos(0), fN3dFits(0), fEvNum(0),
-    t_track(0), t_3dmatch(0), t_3dfit(0), t_coarse(0)
+    f3dGridMatch(false), fRoadGrid(0), fZback(0),
+    fMaxExactPack(0), fMinNdof(1), fTrkStat(kTrackOK),
+    fStats(kStageNames), fNcombos(0), fN3dFits(0), fEvNum(0),
+    fNfineFlips(0), fNfineRej(0), fFineDchi2(0),
+    t_track(0), t_3dmatch(0), t_3dfit(0), t_coarse(0), t_fineconv(0), t_fine(0)
 #ifdef MCDATA
   , fMCDecoder(0), fMCPointUpdater(0), fChecked(false)
 #endif
-  , fDBmaxmiss(-1), fDBconf_level(1e-9)
+  , fDBmaxmiss(-1), fDBconf_level(1e-9), fSnapshotRead(false),
+    fSnapshotCompr(0), fSnapshot(0)
 {
   // Constructor
 
+  size_t nbytes = (char*)&p_fine[3] - (char*)&p_track[0];
+  memset( p_track, 0, nbytes );
+
   SetBit(kProjTrackToZ0);
 }
 
@@ -393,9 +561,16 @@ Tracker::~Tracker()
   if (fIsSetup)
     RemoveVariables();
 
-  delete fThreads;
+  if( fThreadPool )
+    ThreadPool::Release();
   if( fMaxThreads > 1 )
     gSystem->Unload("libThread");
+  delete fRoadGrid;
+  delete fDecodeCtrl;
+  delete fDispatch;
+  delete fSnapshot;
+  if( !fTraceFile.empty() )
+    Trace::Disable();
 
   DeleteContainer( fPlanes );
   DeleteContainer( fProj );
@@ -408,6 +583,22 @@ Tracker::~Tracker()
 //_____________________________________________________________________________
 Int_t Tracker::Begin( THaRunBase* run )
 {
+  ResetStageStats();
+  if( !fTraceFile.empty() )
+    Trace::Clear();
+  // Snapshot files stay open across runs until re-initialization
+  if( !fSnapshotFile.empty() and !fSnapshot ) {
+    fSnapshot = new HitSnapshot( this );
+    Int_t err = fSnapshotRead ? fSnapshot->OpenRead( fSnapshotFile.c_str() )
+      : fSnapshot->OpenWrite( fSnapshotFile.c_str(), fSnapshotCompr );
+    if( err ) {
+      delete fSnapshot; fSnapshot = 0;
+      return kInitError;
+    }
+    Info( Here("Begin"), "%s decoded hits %s %s",
+	  fSnapshotRead ? "Replaying" : "Recording",
+	  fSnapshotRead ? "from" : "to", fSnapshotFile.c_str() );
+  }
 #ifdef TESTCODE
   for( vrsiz_t iplane = 0; iplane < fPlanes.size(); ++iplane )
     fPlanes[iplane]->Begin(run);
@@ -429,13 +620,15 @@ void Tracker::Clear( Option_t* opt )
     for( vpsiz_t k = 0; k < fProj.size(); ++k )
       fProj[k]->Clear(opt);
   }
-#ifdef TESTCODE
-  size_t nbytes = (char*)&t_coarse - (char*)&fNcombos + sizeof(t_coarse);
+  size_t nbytes = (char*)&t_fine - (char*)&fNcombos + sizeof(t_fine);
   memset( &fNcombos, 0, nbytes );
-#endif
 
   // Clear tracking status
   fTrkStat = kTrackOK;
+  fFineFits.clear();
+  fNfineFlips = 0;
+  fNfineRej = 0;
+  fFineDchi2 = 0;
 
 #ifdef MCDATA
   fMCHitBits.clear();
@@ -471,24 +664,58 @@ Int_t Tracker::Decode( const THaEvData& evdata )
     fChecked = true;
   }
 #endif
-#ifdef TESTCODE
+  // Replaying a snapshot: take the hits and the event number from the next
+  // record. The raw data only pace the replay. A read error stops the
+  // replay, and this and all further events get an error status.
+  if( fSnapshot and fSnapshot->IsReading() ) {
+    Bool_t at_end = fSnapshot->AtEnd(), had_error = fSnapshot->HasError();
+    Int_t ret = fSnapshot->ReadEvent();
+    if( ret < 0 ) {
+      if( !had_error )
+	Error( Here("Decode"), "Error reading snapshot file %s after %llu "
+	       "events. Replay stopped.", fSnapshot->GetFileName(),
+	       fSnapshot->GetNevents() );
+      fEvNum = evdata.GetEvNum();
+      fTrkStat = kSnapshotError;
+      return -1;
+    }
+    if( ret == 0 and !at_end )
+      Warning( Here("Decode"), "End of snapshot file %s after %llu events. "
+	       "Further events will have no hits.", fSnapshot->GetFileName(),
+	       fSnapshot->GetNevents() );
+    return DecodeHits( ret > 0 ? fSnapshot->GetEvNum() : evdata.GetEvNum() );
+  }
+
   // Save current event number for diagnostics
   fEvNum = evdata.GetEvNum();
-#endif
+  TraceScope trace( "Decode", fEvNum );
 
 #ifdef VERBOSE
   if( fDebug > 0 ) {
     cout << "============== Event ";
-#ifdef TESTCODE
     cout << "# " << fEvNum << " ";
-#endif
     cout << "==============" << endl;
   }
 #endif
 
+  // Read the raw data of shared modules once and hand them to the planes
+  if( fDispatch )
+    fDispatch->Run( evdata );
+
   // Decode the planes, then fill the hitpatterns in the projections
-  //TODO: multithread?
-  for( vpiter_t it = fProj.begin(); it != fProj.end(); ++it ) {
+  if( fDecodeCtrl ) {
+    // Parallel decoding: all planes concurrently in the thread pool
+    fDecodeCtrl->Run( fThreadPool, evdata, TestBit(kDoCoarse) );
+    for( vpsiz_t k = 0; k < fProj.size(); ++k ) {
+#ifdef MCDATA
+      if( mcdata )
+	mchitcount[fProj[k]->GetType()].min = fProj[k]->GetMinFitPlanes();
+#endif
+      if( fDecodeCtrl->Overflow(k) )
+	fTrkStat = kTooManyRawHits;
+    }
+  }
+  else for( vpiter_t it = fProj.begin(); it != fProj.end(); ++it ) {
     Projection* theProj = *it;
     Int_t nhits = theProj->Decode( evdata );
 #ifdef MCDATA
@@ -551,6 +778,39 @@ Int_t Tracker::Decode( const THaEvData& evdata )
   }
 #endif
 
+  if( fSnapshot and fSnapshot->IsWriting() )
+    fSnapshot->WriteEvent( fEvNum );
+
+  return 0;
+}
+
+//_____________________________________________________________________________
+Int_t Tracker::DecodeHits( Int_t evnum )
+{
+  // Decode an event whose hits have been put into the planes directly,
+  // without raw data, e.g. from a fast simulation:
+  //
+  //  - enable external input in all planes once (Plane::SetExtInput)
+  //  - for each event, call Clear(), then Plane::AddHits for each plane
+  //    with hits, then DecodeHits() instead of Decode()
+  //  - continue with CoarseTrack() and FineTrack() as usual
+  //
+  // evnum is the event number to use in diagnostics. The Monte Carlo
+  // track point analysis of Decode() is not done. Returns 0.
+
+  fEvNum = evnum;
+  TraceScope trace( "Decode", fEvNum );
+
+  for( vpiter_t it = fProj.begin(); it != fProj.end(); ++it ) {
+    Projection* theProj = *it;
+    // Sanity cut on overfull planes. nhits < 0 indicates overflow
+    if( theProj->DecodeHits() < 0 ) {
+      fTrkStat = kTooManyRawHits;
+      continue;
+    }
+    if( TestBit(kDoCoarse) )
+      theProj->FillHitpattern();
+  }
   return 0;
 }
 
@@ -702,8 +962,7 @@ Int_t Tracker::FitMCPoints( MCTrack* mctrk ) const
   }
 
   // Mimic the fit procedure used in FitTrack, except for the weighting
-  TMatrixDSym AtA(4);
-  TVectorD Aty(4);
+  NormalEq4 eq;
 
   // Fill fit matrixes
   Int_t npoints = 0;
@@ -721,29 +980,16 @@ Int_t Tracker::FitMCPoints( MCTrack* mctrk ) const
     Double_t x = hitpos.X()*cosa + hitpos.Y()*sina;
     Double_t z = hitpos.Z();
     Double_t Ai[4] = { cosa, cosa*z, sina, sina*z };
-    for( int j = 0; j<4; ++j ) {
-      for( int k = j; k<4; ++k ) {
-	AtA(j,k) += Ai[j] * Ai[k];
-      }
-      Aty(j) += Ai[j] * x;
-    }
+    eq.Add( Ai, x );
     ++npoints;
   }
   assert( npoints > 4 );  // assured by caller
 
-  for( int j = 0; j<4; ++j )
-    for( int k = j+1; k<4; ++k )
-      AtA(k,j) = AtA(j,k);
-
-  // Solve the normal equations
-  TDecompChol chol(AtA);
-  Bool_t ok = chol.Solve(Aty);
+  // Solve the normal equations. Results are in order x, x', y, y'
+  Double_t coef[4];
+  Bool_t ok = eq.Solve(coef);
   if( !ok ) return -1;
 
-  // Results are here, in order x, x', y, y'
-  assert( Aty.GetNrows() == 4 );
-  Double_t* coef = Aty.GetMatrixArray();
-
   // Calculate chi2
   //FIXME: too much code duplication here somehow
   Double_t chi2 = 0;
@@ -797,6 +1043,15 @@ Int_t Tracker::FitMCPoints( MCTrack* mctrk ) const
 //_____________________________________________________________________________
 Int_t Tracker::End( THaRunBase* run )
 {
+  UpdatePercentiles();
+  PrintStageStats();
+  if( !fTraceFile.empty() and Trace::Write(fTraceFile.c_str()) >= 0 )
+    Info( Here("End"), "Wrote stage timeline trace to %s",
+	  fTraceFile.c_str() );
+  if( fSnapshot )
+    Info( Here("End"), "%llu events %s snapshot file %s",
+	  fSnapshot->GetNevents(), fSnapshot->IsReading() ? "read from"
+	  : "written to", fSnapshot->GetFileName() );
 #ifdef TESTCODE
   for( vrsiz_t iplane = 0; iplane < fPlanes.size(); ++iplane )
     fPlanes[iplane]->End(run);
@@ -804,11 +1059,78 @@ Int_t Tracker::End( THaRunBase* run )
   return 0;
 }
 
+//_____________________________________________________________________________
+void Tracker::AddStageStats( const Tracker& rhs )
+{
+  // Add the stage timing statistics of rhs, typically a clone of this
+  // tracker, including those of its projections and the hit statistics
+  // of its planes, to ours
+
+  fStats.Add( rhs.fStats );
+  assert( rhs.fProj.size() == fProj.size() );
+  for( vpsiz_t k = 0; k < fProj.size() and k < rhs.fProj.size(); ++k )
+    fProj[k]->AddStageStats( *rhs.fProj[k] );
+  assert( rhs.fPlanes.size() == fPlanes.size() );
+  for( vrsiz_t k = 0; k < fPlanes.size() and k < rhs.fPlanes.size(); ++k )
+    fPlanes[k]->AddHitStats( *rhs.fPlanes[k] );
+  if( !IsClone() )
+    UpdatePercentiles();
+}
+
+//_____________________________________________________________________________
+void Tracker::ResetStageStats()
+{
+  // Clear the stage timing statistics, including those of the projections,
+  // and the hit statistics of the planes
+
+  fStats.Reset();
+  for( vpsiz_t k = 0; k < fProj.size(); ++k )
+    fProj[k]->ResetStageStats();
+  for( vrsiz_t k = 0; k < fPlanes.size(); ++k )
+    fPlanes[k]->ResetHitStats();
+  UpdatePercentiles();
+}
+
+//_____________________________________________________________________________
+void Tracker::UpdatePercentiles()
+{
+  // Update the timing percentile global variables of this tracker and
+  // its projections
+
+  fStats.GetPercentiles( kStageTrack,    p_track );
+  fStats.GetPercentiles( kStage3dMatch,  p_3dmatch );
+  fStats.GetPercentiles( kStage3dFit,    p_3dfit );
+  fStats.GetPercentiles( kStageCoarse,   p_coarse );
+  fStats.GetPercentiles( kStageFineConv, p_fineconv );
+  fStats.GetPercentiles( kStageFine,     p_fine );
+  for( vpsiz_t k = 0; k < fProj.size(); ++k )
+    fProj[k]->UpdatePercentiles();
+}
+
+//_____________________________________________________________________________
+void Tracker::PrintStageStats() const
+{
+  // Print the stage timing statistics of this tracker and its projections,
+  // followed by the hit statistics of the planes
+
+  if( fStats.GetEntries(kStageCoarse) == 0 )
+    return;
+  fStats.Print( GetPrefix() );
+  for( vpsiz_t k = 0; k < fProj.size(); ++k ) {
+    fProj[k]->GetStageStats().Print( fProj[k]->GetPrefix() );
+    fProj[k]->PrintFilterStats();
+  }
+  for( vrsiz_t k = 0; k < fPlanes.size(); ++k )
+    fPlanes[k]->PrintHitStats();
+}
+
 //_____________________________________________________________________________
 class AddFitCoord
 {
+  // Record the fit coordinates of the track points in their planes.
+  // Optionally, save pointers to the new FitCoords in 'coords'.
 public:
-  AddFitCoord() {}
+  AddFitCoord( vector<FitCoord*>* coords = 0 ) : fCoords(coords) {}
   void operator() ( Road* rd, Road::Point* p, const vector<Double_t>& coef )
   {
     const Projection* proj = rd->GetProjection();
@@ -818,9 +1140,38 @@ public:
     Double_t sina     = proj->GetSinAngle();
     Double_t slope    = coef[1]*cosa + coef[3]*sina;
     Double_t pos      = coef[0]*cosa + coef[2]*sina + slope * p->z;
-    p->hit->GetPlane()->AddFitCoord
+    FitCoord* coord = p->hit->GetPlane()->AddFitCoord
       ( FitCoord( p->hit, rd, p->x, trkpos2d, slope2d, pos, slope ));
+    if( fCoords )
+      fCoords->push_back( coord );
   }
+private:
+  vector<FitCoord*>* fCoords;
+};
+
+//_____________________________________________________________________________
+class UpdateFitCoord
+{
+  // Update the fit coordinates saved by AddFitCoord after a refit.
+  // Must visit the track points in the same order as AddFitCoord.
+public:
+  UpdateFitCoord( const vector<FitCoord*>& coords )
+    : fCoords(coords), fIdx(0) {}
+  void operator() ( Road* rd, Road::Point* p, const vector<Double_t>& coef )
+  {
+    assert( fIdx < fCoords.size() );
+    const Projection* proj = rd->GetProjection();
+    Double_t cosa     = proj->GetCosAngle();
+    Double_t sina     = proj->GetSinAngle();
+    Double_t slope    = coef[1]*cosa + coef[3]*sina;
+    Double_t pos      = coef[0]*cosa + coef[2]*sina + slope * p->z;
+    FitCoord* coord = fCoords[fIdx++];
+    assert( coord->GetHit() == p->hit );
+    coord->Set3DTrack( p->x, pos, slope );
+  }
+private:
+  const vector<FitCoord*>& fCoords;
+  vector<FitCoord*>::size_type fIdx;
 };
 
 //_____________________________________________________________________________
@@ -841,11 +1192,7 @@ public:
 class FillFitMatrix
 {
 public:
-  FillFitMatrix( TMatrixDSym& AtA, TVectorD& Aty )
-    : fAtA(AtA), fAty(Aty), fNpoints(0)
-  {
-    assert( fAtA.GetNrows() == 4 && fAty.GetNrows() == 4 );
-  }
+  FillFitMatrix( NormalEq4& eq ) : fEq(eq) {}
 
   void operator() ( Road* rd, Road::Point* p, const vector<Double_t>& )
   {
@@ -854,19 +1201,11 @@ public:
     Double_t sina = proj->GetSinAngle();
     Double_t Ai[4] = { cosa, cosa * p->z, sina, sina * p->z };
     Double_t s2 = 1.0/(p->res()*p->res());
-    for( int j = 0; j<4; ++j ) {
-      for( int k = j; k<4; ++k ) {
-	fAtA(j,k) += Ai[j] * s2 * Ai[k];
-      }
-      fAty(j) += Ai[j] * s2 * p->x;
-    }
-    ++fNpoints;
+    fEq.Add( Ai, p->x, s2 );
   }
-  Int_t GetNpoints() const { return fNpoints; }
+  Int_t GetNpoints() const { return fEq.GetNpoints(); }
 private:
-  TMatrixDSym& fAtA;
-  TVectorD&    fAty;
-  Int_t        fNpoints;
+  NormalEq4& fEq;
 };
 
 //_____________________________________________________________________________
@@ -964,14 +1303,17 @@ void Tracker::FitErrPrint( Int_t err ) const
 
 //_____________________________________________________________________________
 Int_t Tracker::FitTrack( const Rvec_t& roads, vector<Double_t>& coef,
-			 Double_t& chi2, TMatrixDSym* coef_covar ) const
+			 Double_t& chi2, TMatrixDSym* coef_covar,
+			 NormalEq4* normeq ) const
 {
   // Linear minimization routine to fit a physical straight line track through
   // the hits registered in the different projection planes.
   //
   // This is a much streamlined version of ROOT's TLinearFitter that solves
   // the normal equations with weights, (At W A) b = (At W) y, where AWb = Wy,
-  // using Cholesky decomposition, TDecompChol. The model used is
+  // using Cholesky decomposition. Since there are always exactly four
+  // parameters, the fixed-size solver NormalEq4 is used instead of
+  // TMatrixDSym/TDecompChol to avoid heap allocations. The model used is
   //   y_i = P_i * T_i
   //       = ( x + z_i * mx, y + z_i * my) * ( cos(a_i), sin(a_i) )
   // where
@@ -997,36 +1339,34 @@ Int_t Tracker::FitTrack( const Rvec_t& roads, vector<Double_t>& coef,
   // "coef_covar" is the covariance matrix of the fit results. Since it is
   // expensive to calculate, it is only filled if the argument is supplied.
   //
+  // "normeq", if given, receives the solved normal equations, which allow
+  // FineTrack to refit the track incrementally.
+  //
   // The return value is the number of degrees of freedom of the fit, i.e.
   // npoints-4 > 0, or negative if too few points or matrix inversion error
 
+  TraceScope trace( "FitTrack", fEvNum );
+
   // Fill the (At W A) matrix and (At W y) vector with the measured points
-  TMatrixDSym AtA(4);
-  TVectorD Aty(4);
-  FillFitMatrix f = ForAllTrackPoints(roads, coef, FillFitMatrix(AtA, Aty));
+  NormalEq4 local_eq;
+  NormalEq4& eq = normeq ? *normeq : local_eq;
+  eq.Clear();
+  FillFitMatrix f = ForAllTrackPoints(roads, coef, FillFitMatrix(eq));
 
   Int_t npoints = f.GetNpoints();
   assert( npoints > 4 );
   if( npoints <=4 ) return -1; // Meaningful fit not possible
 
-  // FillFitMatrix only fills the upper triangle for efficiency
-  //TODO: make a function of FillFitMatrix?
-  for( int j = 0; j<4; ++j )
-    for( int k = j+1; k<4; ++k )
-      AtA(k,j) = AtA(j,k);
-
-  // Invert the characteristic matrix and solve the normal equations.
-  // As in ROOT's TLinearFitter, we use a Cholesky decomposition
-  // to do this (since AtA is symmetric and positive-definite).
-  // For more speed but less accuracy, one could use TMatrixDSymCramerInv.
-  TDecompChol chol(AtA);
-  Bool_t ok = chol.Solve(Aty);
+  // Solve the normal equations. As in ROOT's TLinearFitter, we use a
+  // Cholesky decomposition to do this (since AtA is symmetric and
+  // positive-definite).
+  Double_t b[4];
+  Bool_t ok = eq.Solve(b);
   assert(ok);
   if( !ok ) return -2; //Urgh, decomposition failed. Should never happen
 
   // Copy results to output vector in order x, x', y, y'
-  assert( Aty.GetNrows() == 4 );
-  coef.assign( Aty.GetMatrixArray(), Aty.GetMatrixArray()+Aty.GetNrows() );
+  coef.assign( b, b+4 );
 
 #ifdef VERBOSE
   if( fDebug > 2 ) {
@@ -1040,11 +1380,15 @@ Int_t Tracker::FitTrack( const Rvec_t& roads, vector<Double_t>& coef,
 
   // Calculate covariance matrix of the parameters, if requested
   if( coef_covar ) {
-    if( coef_covar->GetNrows() != 4 )
-      coef_covar->ResizeTo(4,4);
-    Bool_t ok = chol.Invert(*coef_covar);
+    Double_t covar[4][4];
+    Bool_t ok = eq.GetCovariance(covar);
     assert(ok);
     if( !ok ) return -3; // Urgh, inversion failed. Should never happen
+    if( coef_covar->GetNrows() != 4 )
+      coef_covar->ResizeTo(4,4);
+    for( int j = 0; j<4; ++j )
+      for( int k = 0; k<4; ++k )
+	(*coef_covar)(j,k) = covar[j][k];
   }
 
 #ifdef VERBOSE
@@ -1058,6 +1402,76 @@ Int_t Tracker::FitTrack( const Rvec_t& roads, vector<Double_t>& coef,
   return npoints-4;
 }
 
+// Number of 3D track fits per thread pool task
+static const UInt_t kFitsPerTask = 16;
+
+//_____________________________________________________________________________
+class Tracker::FitTask : public ThreadPool::Task {
+  // Fit a contiguous range of road combinations
+public:
+  FitTask() : fTracker(0), fBegin(0), fEnd(0) {}
+  void Set( const Tracker* tracker, FitRes_t* begin, FitRes_t* end )
+  { fTracker = tracker; fBegin = begin; fEnd = end; }
+  virtual Int_t Run()
+  {
+    for( FitRes_t* fit_par = fBegin; fit_par != fEnd; ++fit_par )
+      fit_par->ndof = fTracker->FitTrack( *fit_par->roads, fit_par->coef,
+					  fit_par->chi2, 0, &fit_par->normeq );
+    return 0;
+  }
+private:
+  const Tracker* fTracker;
+  FitRes_t*      fBegin;
+  FitRes_t*      fEnd;
+};
+
+//_____________________________________________________________________________
+UInt_t Tracker::FitTracks( list< pair<Double_t,Rvec_t> >& combos,
+			   vector<FitRes_t>& results ) const
+{
+  // Fit all road combinations in 'combos', as found by MatchRoads.
+  // results[i] holds the fit results for the i-th combination. Failed fits
+  // are indicated by results[i].ndof <= 0 (see FitTrack).
+  // Returns the number of successful fits.
+  //
+  // With a thread pool, large numbers of combinations are fit in parallel
+  // in batches of kFitsPerTask.
+
+  results.resize( combos.size() );
+  vector<FitRes_t>::iterator res = results.begin();
+  for( list< pair<Double_t,Rvec_t> >::iterator it = combos.begin();
+       it != combos.end(); ++it, ++res ) {
+    FitRes_t& fit_par = *res;
+    fit_par.matchval = (*it).first;
+    fit_par.roads    = &(*it).second;
+    fit_par.coef.reserve(4);
+  }
+  UInt_t nres = results.size();
+  if( fThreadPool and nres > kFitsPerTask and fDebug <= 1 ) {
+    UInt_t ntasks = (nres+kFitsPerTask-1)/kFitsPerTask;
+    vector<FitTask> tasks(ntasks);
+    ThreadPool::TaskGroup group;
+    for( UInt_t k = 0; k < ntasks; ++k ) {
+      UInt_t begin = k*kFitsPerTask, end = min(begin+kFitsPerTask,nres);
+      tasks[k].Set( this, &results[begin], &results[0]+end );
+      fThreadPool->Submit( &tasks[k], group );
+    }
+    fThreadPool->Wait( group );
+  } else {
+    for( res = results.begin(); res != results.end(); ++res ) {
+      FitRes_t& fit_par = *res;
+      fit_par.ndof = FitTrack( *fit_par.roads, fit_par.coef, fit_par.chi2,
+			       0, &fit_par.normeq );
+    }
+  }
+  UInt_t nfits = 0;
+  for( res = results.begin(); res != results.end(); ++res ) {
+    if( (*res).ndof > 0 )
+      ++nfits;
+  }
+  return nfits;
+}
+
 //_____________________________________________________________________________
 Int_t Tracker::NewTrackCalc( Int_t , THaTrack*, const TVector3&,
 			     const TVector3&, const FitRes_t& )
@@ -1068,20 +1482,22 @@ Int_t Tracker::NewTrackCalc( Int_t , THaTrack*, const TVector3&,
 }
 
 //_____________________________________________________________________________
-THaTrack* Tracker::NewTrack( TClonesArray& tracks, const FitRes_t& fit_par )
+Bool_t Tracker::TrackToGlobal( const vector<Double_t>& coef,
+			       TVector3& pos, TVector3& dir ) const
 {
-  // Make new track with given parameters. Correct for coordinate offset
-  // and rotation of this detector. Used by CoarseTrack to generate all tracks.
+  // Convert the fitted track parameters 'coef' (in the Tracker frame) to the
+  // track origin 'pos' and TRANSPORT direction vector 'dir' (with dir.Z()=1)
+  // in the global frame. Returns false if the track cannot be represented.
 
-  // The following coordinates ("detector" coordinates, e.g. "tr.d_x") are
+  // The fit coordinates ("detector" coordinates, e.g. "tr.d_x") are
   // in the Tracker frame. fOrigin of the planes is already being taken into
   // account when fitting tracks since the hit positions are corrected for it
   // (see Plane::GetStart() and Plane::GetZ())
 
-  Double_t d_x  = fit_par.coef[0];
-  Double_t d_xp = fit_par.coef[1];
-  Double_t d_y  = fit_par.coef[2];
-  Double_t d_yp = fit_par.coef[3];
+  Double_t d_x  = coef[0];
+  Double_t d_xp = coef[1];
+  Double_t d_y  = coef[2];
+  Double_t d_yp = coef[3];
 
   // Correct the track coordinates for the position offset and rotation of the
   // Tracker system, resulting in "global" reference coordinates, e.g. "tr.x".
@@ -1096,20 +1512,19 @@ THaTrack* Tracker::NewTrack( TClonesArray& tracks, const FitRes_t& fit_par )
   // apparatus.
 
   assert( fIsRotated == !fRotation.IsIdentity() );
-  Double_t xp, yp, x, y;
-  TVector3 pos( d_x, d_y, 0.0 );
-  TVector3 dir( d_xp, d_yp, 1.0 );
+  pos.SetXYZ( d_x, d_y, 0.0 );
+  dir.SetXYZ( d_xp, d_yp, 1.0 );
   if( fIsRotated ) {
     // Rotate the TRANSPORT direction vector to global frame
     dir *= fRotation;
     // TODO: use different type of track without this limitation
     if( TMath::Abs(dir.Theta()-TMath::PiOver2()) < 1e-2 ) {
-      Error( Here("NewTrack"), "Limitation: Track (nearly) perpendicular "
+      Error( Here("TrackToGlobal"), "Limitation: Track (nearly) perpendicular "
 	     "to z-axis not supported by TRANSPORT formalism in THaTrack "
 	     "class. Skipping this track." );
       pos.Print();
       dir.Print();
-      return 0;
+      return false;
     }
     // Normalize to z=1 to get new TRANSPORT direction vector
     dir *= 1.0/dir.Z();
@@ -1117,16 +1532,33 @@ THaTrack* Tracker::NewTrack( TClonesArray& tracks, const FitRes_t& fit_par )
     // Rotate track origin to global frame
     pos *= fRotation;
   }
-  xp = dir.X();
-  yp = dir.Y();
   pos += fOrigin;
   if( TestBit(kProjTrackToZ0) ) {
     // If configured, project along the track direction to z=0 in global frame
     pos -= pos.Z() * dir;
     assert( TMath::Abs(pos.Z()) < 1e-6 );
   }
-  x = pos.X();
-  y = pos.Y();
+  return true;
+}
+
+//_____________________________________________________________________________
+THaTrack* Tracker::NewTrack( TClonesArray& tracks, const FitRes_t& fit_par )
+{
+  // Make new track with given parameters. Correct for coordinate offset
+  // and rotation of this detector. Used by CoarseTrack to generate all tracks.
+
+  Double_t d_x  = fit_par.coef[0];
+  Double_t d_xp = fit_par.coef[1];
+  Double_t d_y  = fit_par.coef[2];
+  Double_t d_yp = fit_par.coef[3];
+
+  TVector3 pos, dir;
+  if( !TrackToGlobal( fit_par.coef, pos, dir ) )
+    return 0;
+  Double_t x  = pos.X();
+  Double_t y  = pos.Y();
+  Double_t xp = dir.X();
+  Double_t yp = dir.Y();
 
   THaTrack* newTrack = AddTrack( tracks, x, y, xp, yp );
   assert( newTrack );
@@ -1157,10 +1589,25 @@ THaTrack* Tracker::NewTrack( TClonesArray& tracks, const FitRes_t& fit_par )
   }
 #endif
 
+  // Keep the state of the fit for FineTrack, including the fit coordinates
+  // recorded for this track, which FineTrack updates
+  vector<FitCoord*>* coords = 0;
+  if( TestBit(kDoFine) ) {
+    fFineFits.push_back( FineFit_t() );
+    FineFit_t& ff = fFineFits.back();
+    ff.idx    = idx;
+    ff.roads  = *fit_par.roads;
+    ff.coef   = fit_par.coef;
+    ff.chi2   = fit_par.chi2;
+    ff.ndof   = fit_par.ndof;
+    ff.normeq = fit_par.normeq;
+    coords = &ff.coords;
+  }
+
   // For any planes in calibration mode, save the hits closest to this track.
   // Minimizing the hit residuals is the standard procedure for alignment
   // calibration.
-  ForAllTrackPoints( *fit_par.roads, fit_par.coef, AddFitCoord() );
+  ForAllTrackPoints( *fit_par.roads, fit_par.coef, AddFitCoord(coords) );
   for( Rpvec_t::const_iterator it = fCalibPlanes.begin(); it !=
 	 fCalibPlanes.end(); ++it ) {
     Plane* pl = *it;
@@ -1193,36 +1640,214 @@ private:
 };
 
 //_____________________________________________________________________________
-class AnySharedHits : public unary_function<Road*,bool>
+class HitBits
 {
+  // Compact bitsets of the hits used by a set of roads. Each hit occurring
+  // in any of the roads is assigned a dense per-event index, and each road
+  // is represented by a bitset of its hit indices, so that testing two roads
+  // (or tuples of roads) for shared hits reduces to ANDing a few words.
 public:
-  AnySharedHits() {}
-  bool operator() ( const Road* rd )
+  HitBits() : fNwords(0) {}
+  void Build( const Rset_t& roads );
+  UInt_t GetNwords() const { return fNwords; }
+  const UInt_t* GetBits( const Road* rd ) const
+  {
+    // Get the hit bitset of the given road, which must have been
+    // part of the set given to Build()
+    vector<const Road*>::const_iterator it =
+      lower_bound( ALL(fRoads), rd );
+    assert( it != fRoads.end() and *it == rd );
+    return &fBits[ (it-fRoads.begin())*fNwords ];
+  }
+  static bool Overlap( const UInt_t* a, const UInt_t* b, UInt_t n )
   {
-    const Hset_t& test_hits = rd->GetHits();
-//     cout << "--- testing: " << endl;
-//     PrintHits(test_hits);
-    for( Hset_t::const_iterator it = test_hits.begin(); it != test_hits.end();
+    for( UInt_t i = 0; i < n; ++i )
+      if( a[i] & b[i] ) return true;
+    return false;
+  }
+  static void Or( UInt_t* a, const UInt_t* b, UInt_t n )
+  {
+    for( UInt_t i = 0; i < n; ++i )
+      a[i] |= b[i];
+  }
+private:
+  UInt_t              fNwords;  // Number of 32-bit words per bitset
+  vector<const Road*> fRoads;   // Roads, sorted by pointer value
+  vector<UInt_t>      fBits;    // [fRoads.size()*fNwords] hit bitsets
+};
+
+//_____________________________________________________________________________
+void HitBits::Build( const Rset_t& roads )
+{
+  // Assign dense indices to all hits in the given roads and build the
+  // roads' hit bitsets
+
+  vector<Hit*> hits;
+  fRoads.clear();
+  for( Rset_t::const_iterator it = roads.begin(); it != roads.end(); ++it ) {
+    const Hset_t& road_hits = (*it)->GetHits();
+    hits.insert( hits.end(), ALL(road_hits) );
+    fRoads.push_back( *it );
+  }
+  // Rset_t is ordered by pointer value, so fRoads is already sorted
+  assert( fRoads.empty() or
+	  adjacent_find( ALL(fRoads), greater_equal<const Road*>() )
+	  == fRoads.end() );
+  sort( ALL(hits) );
+  hits.erase( unique(ALL(hits)), hits.end() );
+
+  fNwords = (hits.size()+31)/32;
+  fBits.assign( fRoads.size()*fNwords, 0 );
+  for( vector<const Road*>::size_type i = 0; i < fRoads.size(); ++i ) {
+    const Hset_t& road_hits = fRoads[i]->GetHits();
+    UInt_t* bits = &fBits[i*fNwords];
+    for( Hset_t::const_iterator it = road_hits.begin(); it != road_hits.end();
 	 ++it ) {
-      if( fHits.find(*it) != fHits.end() )
-	return true;
+      UInt_t idx = lower_bound( ALL(hits), *it ) - hits.begin();
+      bits[idx>>5] |= 1U << (idx&31);
     }
-    return false;
+  }
+}
+
+//_____________________________________________________________________________
+class AnySharedHits : public unary_function<Road*,bool>
+{
+public:
+  AnySharedHits( const HitBits& hb )
+    : fHitBits(&hb), fMask(hb.GetNwords(),0) {}
+  bool operator() ( const Road* rd )
+  {
+    if( fMask.empty() )
+      return false;
+    return HitBits::Overlap( fHitBits->GetBits(rd), &fMask[0], fMask.size() );
   }
   const AnySharedHits& use( const Rset_t& tuple )
   {
-    fHits.clear();
-    for( Rset_t::const_iterator it = tuple.begin(); it != tuple.end(); ++it ) {
-      const Road* rd = *it;
-      fHits.insert( ALL(rd->GetHits()) );
+    fMask.assign( fMask.size(), 0 );
+    if( !fMask.empty() ) {
+      for( Rset_t::const_iterator it = tuple.begin(); it != tuple.end(); ++it )
+	HitBits::Or( &fMask[0], fHitBits->GetBits(*it), fMask.size() );
     }
-//     PrintHits(fHits);
     return *this;
   }
 private:
-  Hset_t fHits;
+  const HitBits* fHitBits;  // Hit bitsets of all roads
+  vector<UInt_t> fMask;     // Union of hit bitsets of current tuple
 };
 
+//_____________________________________________________________________________
+class ExactPacking
+{
+  // Exact solution of the track de-ghosting problem for small numbers of
+  // candidates: find the set of pairwise compatible (= no shared hits)
+  // candidate tracks that maximizes, in order of priority, the number of
+  // tracks, the total number of degrees of freedom (hits used) and
+  // the negative sum of the reduced chi2s. This is a maximum-weight set
+  // packing problem, solved here by branch-and-bound over the candidates'
+  // hit bitsets. Candidates should be added in order of decreasing quality
+  // (as in OptimalN) so that good solutions are found early.
+public:
+  ExactPacking( UInt_t nwords ) : fNwords(nwords) {}
+  void Add( const UInt_t* bits, Int_t ndof, Double_t rchi2 )
+  {
+    fBits.insert( fBits.end(), bits, bits+fNwords );
+    fNdof.push_back( ndof );
+    fRchi2.push_back( rchi2 );
+  }
+  void Solve( vector<UInt_t>& picks );
+
+private:
+  struct Score_t {
+    UInt_t   n;      // Number of tracks
+    Int_t    ndof;   // Sum of ndof
+    Double_t rchi2;  // Sum of reduced chi2
+    Score_t() : n(0), ndof(0), rchi2(0) {}
+    bool operator>( const Score_t& rhs ) const {
+      if( n != rhs.n )       return n > rhs.n;
+      if( ndof != rhs.ndof ) return ndof > rhs.ndof;
+      return rchi2 < rhs.rchi2;
+    }
+  };
+  UInt_t           fNwords;  // Number of words per bitset
+  vector<UInt_t>   fBits;    // [ncand*fNwords] Hit bitsets of candidates
+  vector<Int_t>    fNdof;    // [ncand] Degrees of freedom of candidates
+  vector<Double_t> fRchi2;   // [ncand] Reduced chi2 of candidates
+
+  // Working data for Search()
+  Score_t          fBest;
+  vector<UInt_t>   fBestPicks;
+  vector<UInt_t>   fPicks;
+  vector<UInt_t>   fMask;    // [(ncand+1)*fNwords] Hits used before each
+                             // candidate; deeper levels only write above k
+
+  const UInt_t* Bits( UInt_t i ) const { return &fBits[i*fNwords]; }
+  void Search( UInt_t k, const Score_t& cur );
+};
+
+//_____________________________________________________________________________
+void ExactPacking::Solve( vector<UInt_t>& picks )
+{
+  // Find optimal set of candidates. Returns their indices in 'picks',
+  // in ascending order.
+
+  UInt_t ncand = fNdof.size();
+  picks.clear();
+  fBest = Score_t();
+  fBestPicks.clear();
+  fPicks.clear();
+  if( ncand == 0 )
+    return;
+  // One mask level per search depth, plus the empty initial mask
+  fMask.assign( (ncand+1)*fNwords, 0 );
+  Search( 0, Score_t() );
+  picks.swap( fBestPicks );
+}
+
+//_____________________________________________________________________________
+void ExactPacking::Search( UInt_t k, const Score_t& cur )
+{
+  // Branch-and-bound search over candidates k...ncand-1, given the current
+  // partial solution with score 'cur' and hit mask fMask[k*fNwords]
+
+  UInt_t ncand = fNdof.size();
+  const UInt_t* mask = &fMask[k*fNwords];
+
+  // Upper bound on the achievable score: the current partial solution plus
+  // all remaining candidates compatible with it
+  Score_t bound(cur);
+  for( UInt_t i = k; i < ncand; ++i ) {
+    if( fNwords == 0 or !HitBits::Overlap(mask, Bits(i), fNwords) ) {
+      ++bound.n;
+      bound.ndof += fNdof[i];
+    }
+  }
+  if( bound.n < fBest.n or
+      (bound.n == fBest.n and bound.ndof < fBest.ndof) )
+    return;
+  if( cur > fBest ) {
+    fBest = cur;
+    fBestPicks = fPicks;
+  }
+  if( bound.n == cur.n )
+    return;  // Nothing left to add
+
+  for( UInt_t i = k; i < ncand; ++i ) {
+    if( fNwords != 0 and HitBits::Overlap(mask, Bits(i), fNwords) )
+      continue;
+    // Include candidate i, then search the candidates following it
+    UInt_t* next = &fMask[(i+1)*fNwords];
+    copy( mask, mask+fNwords, next );
+    HitBits::Or( next, Bits(i), fNwords );
+    Score_t with(cur);
+    ++with.n;
+    with.ndof  += fNdof[i];
+    with.rchi2 += fRchi2[i];
+    fPicks.push_back(i);
+    Search( i+1, with );
+    fPicks.pop_back();
+  }
+}
+
 //_____________________________________________________________________________
 class Tracker::TrackFitWeight
 {
@@ -1331,6 +1956,24 @@ void Tracker::Add3dMatch( const Rvec_t& selected, Double_t matchval,
 #endif
 };
 
+//_____________________________________________________________________________
+void Tracker::IntersectRoads( const Rvec_t& roads, Double_t z,
+			      vector<TVector2>& points ) const
+{
+  // Intersect the fits of all pairs of the given roads at the given z.
+  // The roads must be from pairwise different projections. The intersection
+  // points are appended to 'points' in the order (0,1),(0,2),...,(1,2),...
+
+  for( Rvec_t::const_iterator it1 = roads.begin(); it1 != roads.end();
+       ++it1 ) {
+    EProjType t1 = (*it1)->GetProjection()->GetType();
+    for( Rvec_t::const_iterator it2 = it1+1; it2 != roads.end(); ++it2 ) {
+      EProjType t2 = (*it2)->GetProjection()->GetType();
+      points.push_back( (*it1)->Intersect(*it2, z, GetProjPairCoef(t1,t2)) );
+    }
+  }
+}
+
 //_____________________________________________________________________________
 UInt_t Tracker::MatchRoadsGeneric( vector<Rvec_t>& roads, const UInt_t ncombos,
 				   list< pair<Double_t,Rvec_t> >& combos_found,
@@ -1355,7 +1998,6 @@ UInt_t Tracker::MatchRoadsGeneric( vector<Rvec_t>& roads, const UInt_t ncombos,
   Rvec_t selected;
 
   UInt_t nfound = 0;
-  Double_t zback = fPlanes.back()->GetZ();
 
   vector<TVector2> fxpts, bxpts;
   fxpts.reserve( nproj*(nproj-1)/2 );
@@ -1369,31 +2011,34 @@ UInt_t Tracker::MatchRoadsGeneric( vector<Rvec_t>& roads, const UInt_t ncombos,
 
     fxpts.clear();
     bxpts.clear();
+    //TODO: weigh with uncertainties of coordinates?
+    IntersectRoads( selected, 0.0, fxpts );
+    IntersectRoads( selected, fZback, bxpts );
+    assert( fxpts.size() == nproj*(nproj-1)/2 );
+    assert( bxpts.size() == fxpts.size() );
     TVector2 fctr, bctr;
-    for( Rvec_t::iterator it1 = selected.begin(); it1 != selected.end();
-	 ++it1 ) {
-      for( Rvec_t::iterator it2 = it1+1; it2 != selected.end(); ++it2 ) {
-	//TODO: weigh with uncertainties of coordinates?
-	fxpts.push_back( (*it1)->Intersect(*it2, 0.0) );
-	bxpts.push_back( (*it1)->Intersect(*it2, zback) );
-	fctr += fxpts.back();
-	bctr += bxpts.back();
 #ifdef VERBOSE
-	if( fDebug > 3 ) {
-	  cout << (*it1)->GetProjection()->GetName()
-	       << (*it2)->GetProjection()->GetName()
-	       << " front(" << fxpts.size() << ") = ";
-	  fxpts.back().Print();
-	  cout << (*it1)->GetProjection()->GetName()
-	       << (*it2)->GetProjection()->GetName()
-	       << " back (" << bxpts.size() << ") = ";
-	  bxpts.back().Print();
-	}
+    // Indices of the road pair of point k, in the order of IntersectRoads
+    Rvec_t::size_type i1 = 0, i2 = 1;
 #endif
+    for( vector<TVector2>::size_type k = 0; k < fxpts.size(); ++k ) {
+      fctr += fxpts[k];
+      bctr += bxpts[k];
+#ifdef VERBOSE
+      if( fDebug > 3 ) {
+	const char* n1 = selected[i1]->GetProjection()->GetName();
+	const char* n2 = selected[i2]->GetProjection()->GetName();
+	cout << n1 << n2 << " front(" << k+1 << ") = ";
+	fxpts[k].Print();
+	cout << n1 << n2 << " back (" << k+1 << ") = ";
+	bxpts[k].Print();
       }
+      if( ++i2 == nproj ) {
+	++i1;
+	i2 = i1+1;
+      }
+#endif
     }
-    assert( fxpts.size() <= nproj*(nproj-1)/2 );
-    assert( bxpts.size() == fxpts.size() );
     fctr /= static_cast<Double_t>( fxpts.size() );
     if( !fPlanes.front()->Contains(fctr) )
       continue;
@@ -1457,6 +2102,8 @@ UInt_t Tracker::MatchRoadsFast3D( vector<Rvec_t>& roads, UInt_t /* ncombos */,
   //  - intersect first two proj in front and back
   //  - calc perp distances to 3rd, add in quadrature -> matchval
   // Requires exactly 3 projections
+  // If enabled in the database (3d_gridmatch), the roads of the 3rd
+  // projection are looked up via a 2D grid of their front/back positions.
   // Note that the elements of the Rvec_t in the output 'combos_found' are not
   // necessarily in order of ascending projection type.
 
@@ -1482,18 +2129,14 @@ UInt_t Tracker::MatchRoadsFast3D( vector<Rvec_t>& roads, UInt_t /* ncombos */,
   if( !f3dIdx.empty() )
     sort( ALL(roads), ByProjTypeMap(f3dIdx) );
 
-  // Fetch coefficients for coordinate transformations
+  // Fetch precomputed coefficients for coordinate transformations
+  // (cf. Road::Intersect)
   const Projection* ip = roads[0].front()->GetProjection();
-  Double_t su = ip->GetSinAngle();
-  Double_t cu = ip->GetCosAngle();
-  assert( ip != roads[1].front()->GetProjection() );
-  ip = roads[1].front()->GetProjection();
-  Double_t sv = ip->GetSinAngle();
-  Double_t cv = ip->GetCosAngle();
-  Double_t inv_denom = 1.0/(sv*cu-su*cv);
-  // Only the scaled coefficients are needed (cf. Road::Intersect)
-  su *= inv_denom; cu *= inv_denom; sv *= inv_denom; cv *= inv_denom;
-  assert( ip != roads[2].front()->GetProjection() );
+  const Projection* jp = roads[1].front()->GetProjection();
+  assert( ip != jp );
+  const ProjPairCoef_t& uv = GetProjPairCoef( ip->GetType(), jp->GetType() );
+  Double_t su = uv.su, cu = uv.cu, sv = uv.sv, cv = uv.cv;
+  assert( jp != roads[2].front()->GetProjection() );
   ip = roads[2].front()->GetProjection();
   assert( ip != roads[0].front()->GetProjection() );
   // Components of the 3rd projection's axis
@@ -1504,13 +2147,20 @@ UInt_t Tracker::MatchRoadsFast3D( vector<Rvec_t>& roads, UInt_t /* ncombos */,
   Road* tuple[3];
   Plane *front_plane = fPlanes.front(), *back_plane = fPlanes.back();
 
-  // For fast access to the relevant position range, sort the 3rd projection
-  // by ascending front position
-  sort( ALL(roads[2]), Road::PosIsLess() );
-  Road::PosIsNear pos_near( TMath::Sqrt(f3dMatchCut) );
-
   UInt_t nfound = 0;
-  Double_t zback = fPlanes.back()->GetZ();
+  Double_t zback = fZback;
+
+  // For fast access to the relevant position range, either sort the 3rd
+  // projection by ascending front position or, if requested, put its roads
+  // into a grid indexed by both front and back position
+  Double_t tolerance = TMath::Sqrt(f3dMatchCut);
+  Road::PosIsNear pos_near( tolerance );
+  Rvec_t near_roads;
+  if( fRoadGrid ) {
+    fRoadGrid->Fill( roads[2], zback, tolerance );
+    near_roads.reserve( roads[2].size() );
+  } else
+    sort( ALL(roads[2]), Road::PosIsLess() );
   Double_t matchval = 0.0;
   // Number of roads in u/v projections
   UInt_t nrd0 = roads[0].size(), nrd1 = roads[1].size();
@@ -1539,8 +2189,14 @@ UInt_t Tracker::MatchRoadsFast3D( vector<Rvec_t>& roads, UInt_t /* ncombos */,
 	  Double_t pf = xf*xax_x + yf*xax_y; // front x from u/v
 	  Double_t pb = xb*xax_x + yb*xax_y; // back x from u/v
 	  // Find range of roads in 3rd projection near this front x
-	  pair<Rvec_t::iterator,Rvec_t::iterator> range =
-	    equal_range( ALL(roads[2]), pf, pos_near );
+	  // (and, with the grid, also near this back x)
+	  pair<Rvec_t::iterator,Rvec_t::iterator> range;
+	  if( fRoadGrid ) {
+	    near_roads.clear();
+	    fRoadGrid->Find( pf, pb, near_roads );
+	    range = make_pair( near_roads.begin(), near_roads.end() );
+	  } else
+	    range = equal_range( ALL(roads[2]), pf, pos_near );
 	  // Test the candidate x-roads for complete matches
 	  for( Rvec_t::iterator it=range.first; it != range.second; ++it ) {
 	    tuple[2] = *it;
@@ -1598,6 +2254,8 @@ UInt_t Tracker::MatchRoads( vector<Rvec_t>& roads,
   // The input vector 'roads' may be altered unpredictably.
   // Output in 'combos_found' and 'unique_found'
 
+  TraceScope trace( "MatchRoads", fEvNum );
+
   // The number of projections that we work with
   vector<Rvec_t>::size_type nproj = roads.size();
 
@@ -1637,9 +2295,7 @@ UInt_t Tracker::MatchRoads( vector<Rvec_t>& roads,
     }
   }
 #endif
-#ifdef TESTCODE
   fNcombos = ncombos;
-#endif
 
   if( ncombos == 0 ) {
     if( inrange )
@@ -1682,6 +2338,105 @@ Bool_t Tracker::PassTrackCuts( const FitRes_t& fit_par ) const
   return true;
 }
 
+//_____________________________________________________________________________
+void Tracker::SelectTracks( const vector<const FitRes_t*>& cands,
+			    const Rset_t& unique_found, UInt_t found_types,
+			    vector<const FitRes_t*>& picks ) const
+{
+  // Second-level de-ghosting: select the set of 3D track candidates
+  // (fits of road combinations) to be made into tracks, using each road
+  // at most once and no hit in more than one track. 'unique_found' must
+  // hold all roads of the candidates, and 'found_types' the bits of the
+  // projection types required in each track.
+  //
+  // Up to fMaxExactPack candidates are packed exactly (see ExactPacking),
+  // ranking solutions by number of tracks, then total ndof, then the sum
+  // of the reduced chi2s. Otherwise, OptimalN picks the candidates
+  // greedily in order of TrackFitWeight (ndof, then chi2). The two differ
+  // when the best candidate shares hits with two or more compatible ones:
+  // greedy keeps the single best track, exact packing the larger set.
+
+  typedef map<Rset_t, const FitRes_t*> FitResMap_t;
+  FitResMap_t fit_results;
+  multimap< TrackFitWeight, Rset_t > fit_chi2;
+  picks.clear();
+  // Sort the candidates by ascending chi2
+  for( vector<const FitRes_t*>::const_iterator it = cands.begin();
+       it != cands.end(); ++it ) {
+    const FitRes_t& fit_par = **it;
+    Rset_t road_tuple( ALL(*fit_par.roads) );
+#ifndef NDEBUG
+    pair<FitResMap_t::iterator,bool> ins =
+#endif
+    fit_results.insert( make_pair(road_tuple, &fit_par) );
+    assert( ins.second );
+    fit_chi2.insert( make_pair( TrackFitWeight(fit_par), road_tuple) );
+  }
+  if( fit_chi2.empty() )
+    return;
+
+#ifdef VERBOSE
+  if( fDebug > 2 ) {
+    cout << "Track candidates:" << endl;
+    for( multimap<TrackFitWeight,Rset_t>::iterator it = fit_chi2.begin();
+	 it != fit_chi2.end(); ++it ) {
+      FitResMap_t::iterator found = fit_results.find((*it).second);
+      const FitRes_t& r = *(*found).second;
+      cout   << "ndof = " << r.ndof
+	     << " rchi2 = " << r.chi2/(double)r.ndof
+	     << " x/y = " << r.coef[0] << "/" << r.coef[2]
+	     << " mx/my = " << r.coef[1] << "/" << r.coef[3]
+	     << endl;
+    }
+  }
+#endif
+  vector<Rset_t> best_roads;
+  HitBits hitbits;
+  hitbits.Build( unique_found );
+  if( fit_chi2.size() <= fMaxExactPack ) {
+    // Few candidates: find the exact optimum
+    TraceScope trace( "ExactPacking", fEvNum );
+    UInt_t nw = hitbits.GetNwords();
+    ExactPacking packing(nw);
+    vector<UInt_t> bits(nw);
+    vector<const Rset_t*> tuples;
+    for( multimap<TrackFitWeight,Rset_t>::iterator it = fit_chi2.begin();
+	 it != fit_chi2.end(); ++it ) {
+      const Rset_t& tuple = (*it).second;
+      // As with OptimalN, only tuples with roads of all required
+      // projection types can become tracks
+      if( !for_each(ALL(tuple), CheckTypes(found_types)) )
+	continue;
+      fill( ALL(bits), 0 );
+      for( Rset_t::const_iterator jt = tuple.begin(); jt != tuple.end();
+	   ++jt )
+	HitBits::Or( &bits[0], hitbits.GetBits(*jt), nw );
+      FitResMap_t::iterator found = fit_results.find(tuple);
+      assert( found != fit_results.end() );
+      const FitRes_t& r = *(*found).second;
+      packing.Add( &bits[0], r.ndof, r.chi2/(double)r.ndof );
+      tuples.push_back( &tuple );
+    }
+    vector<UInt_t> ipicks;
+    packing.Solve( ipicks );
+    for( vector<UInt_t>::iterator it = ipicks.begin(); it != ipicks.end();
+	 ++it )
+      best_roads.push_back( *tuples[*it] );
+  } else {
+    TraceScope trace( "OptimalN", fEvNum );
+    OptimalN( unique_found, fit_chi2, best_roads,
+	      AnySharedHits(hitbits), CheckTypes(found_types) );
+  }
+
+  // Retrieve the fit results for the selected road tuples
+  for( vector<Rset_t>::iterator it = best_roads.begin(); it !=
+	 best_roads.end(); ++it ) {
+    FitResMap_t::iterator found = fit_results.find(*it);
+    assert( found != fit_results.end() );
+    picks.push_back( (*found).second );
+  }
+}
+
 //_____________________________________________________________________________
 Int_t Tracker::CoarseTrack( TClonesArray& tracks )
 {
@@ -1698,13 +2453,21 @@ Int_t Tracker::CoarseTrack( TClonesArray& tracks )
     return 0;
   }
 
-#ifdef TESTCODE
-  TStopwatch timer, timer_tot;
-#endif
+  ULong64_t t_start = ReadClock(), t_stage = t_start, t_now;
 
   Int_t err = 0;
-  if( fMaxThreads > 1 ) {
-    err = fThreads->Run( fMaxThreads );
+  if( fThreadPool ) {
+    // Track the projections as tasks in the thread pool. Idle threads
+    // pick up the road fits of busy projections (see Projection::FitRoads).
+    vector<ProjTrackTask> tasks( fProj.size() );
+    ThreadPool::TaskGroup group;
+    for( vpsiz_t k = 0; k < fProj.size(); ++k ) {
+      tasks[k].SetProjection( fProj[k] );
+      fThreadPool->Submit( &tasks[k], group );
+    }
+    fThreadPool->Wait( group );
+    if( group.GetNerrors() > 0 )
+      err = 1;
   } else {
     // Single-threaded execution: Track() each projection in turn
     for( vpiter_t it = fProj.begin(); it != fProj.end(); ++it ) {
@@ -1748,10 +2511,9 @@ Int_t Tracker::CoarseTrack( TClonesArray& tracks )
     }
   }
   assert( roads.size() == nproj );
-#ifdef TESTCODE
-  t_track = 1e6*timer.RealTime();
-  timer.Start();
-#endif
+  t_now = ReadClock();
+  t_track = fStats.Record( kStageTrack, t_now-t_stage );
+  t_stage = t_now;
 
   // Combine track projections to 3D tracks
   if( nproj >= fMinReqProj ) {
@@ -1763,10 +2525,9 @@ Int_t Tracker::CoarseTrack( TClonesArray& tracks )
     // Find matching combinations of roads
     UInt_t nfits = MatchRoads( roads, road_combos, unique_found );
 
-#ifdef TESTCODE
-    t_3dmatch = 1e6*timer.RealTime();
-    timer.Start();
-#endif
+    t_now = ReadClock();
+    t_3dmatch = fStats.Record( kStage3dMatch, t_now-t_stage );
+    t_stage = t_now;
     // Fit each set of matched roads using linear least squares, yielding
     // the 3D track parameters, x, x'(=mx), y, y'(=my)
     FitRes_t fit_par;
@@ -1776,7 +2537,8 @@ Int_t Tracker::CoarseTrack( TClonesArray& tracks )
       fit_par.matchval    = road_combos.front().first;
       Rvec_t& these_roads = road_combos.front().second;
       fit_par.roads       = &these_roads;
-      fit_par.ndof = FitTrack( these_roads, fit_par.coef, fit_par.chi2 );
+      fit_par.ndof = FitTrack( these_roads, fit_par.coef, fit_par.chi2,
+			       0, &fit_par.normeq );
       if( fit_par.ndof > 0 ) {
 	if( PassTrackCuts(fit_par) )
 	  NewTrack( tracks, fit_par );
@@ -1789,62 +2551,32 @@ Int_t Tracker::CoarseTrack( TClonesArray& tracks )
     else if( nfits > 1 ) {
       // For multiple road combinations, find the set of tracks with the
       // lowest chi2s that uses each road at most once
-      typedef map<Rset_t, FitRes_t> FitResMap_t;
-      FitResMap_t fit_results;
-      multimap< TrackFitWeight, Rset_t > fit_chi2;
-      // Fit all combinations and sort the results by ascending chi2
-      for( list< pair<Double_t,Rvec_t> >::iterator it = road_combos.begin();
-	   it != road_combos.end(); ++it ) {
-	fit_par.matchval    = (*it).first;
-	Rvec_t& these_roads = (*it).second;
-	fit_par.roads       = &these_roads;
-	fit_par.ndof = FitTrack( these_roads, fit_par.coef, fit_par.chi2 );
+      vector<FitRes_t> all_fits;
+      vector<const FitRes_t*> cands, picks;
+      // Fit all combinations and keep the ones passing the track cuts
+      FitTracks( road_combos, all_fits );
+      for( vector<FitRes_t>::iterator it = all_fits.begin();
+	   it != all_fits.end(); ++it ) {
+	const FitRes_t& fit_par = *it;
 	if( fit_par.ndof > 0 ) {
-	  if( PassTrackCuts(fit_par) ) {
-	    Rset_t road_tuple( ALL(these_roads) );
-#ifndef NDEBUG
-	    pair<FitResMap_t::iterator,bool> ins =
-#endif
-	    fit_results.insert( make_pair(road_tuple, fit_par) );
-	    assert( ins.second );
-	    fit_chi2.insert( make_pair( TrackFitWeight(fit_par), road_tuple) );
-	  }
+	  if( PassTrackCuts(fit_par) )
+	    cands.push_back( &fit_par );
 	} else
 	  FitErrPrint( fit_par.ndof );
       }
-
-#ifdef VERBOSE
-      if( fDebug > 2 ) {
-	cout << "Track candidates:" << endl;
-	for( multimap<TrackFitWeight,Rset_t>::iterator it = fit_chi2.begin();
-	     it != fit_chi2.end(); ++it ) {
-	  FitResMap_t::iterator found = fit_results.find((*it).second);
-	  FitRes_t& r = (*found).second;
-	  cout	 << "ndof = " << r.ndof
-		 << " rchi2 = " << r.chi2/(double)r.ndof
-		 << " x/y = " << r.coef[0] << "/" << r.coef[2]
-		 << " mx/my = " << r.coef[1] << "/" << r.coef[3]
-		 << endl;
-	}
-      }
-#endif
-      if( !fit_chi2.empty() ) {
+      if( !cands.empty() ) {
 	// Select "optimal" set of roads, minimizing sum of chi2s
-	vector<Rset_t> best_roads;
-	OptimalN( unique_found, fit_chi2, best_roads,
-		  AnySharedHits(), CheckTypes(found_types) );
+	ULong64_t t_deghost = ReadClock();
+	SelectTracks( cands, unique_found, found_types, picks );
+	fStats.Record( kStageDeghost, ReadClock()-t_deghost );
 
-	if( best_roads.empty() )
+	if( picks.empty() )
 	  fTrkStat = kFailedOptimalN;
 
 	// Now each selected road tuple corresponds to a new track
-	for( vector<Rset_t>::iterator it = best_roads.begin(); it !=
-	       best_roads.end(); ++it ) {
-	  // Retrieve the fit results for this tuple
-	  FitResMap_t::iterator found = fit_results.find(*it);
-	  assert( found != fit_results.end() );
-	  NewTrack( tracks, (*found).second );
-	}
+	for( vector<const FitRes_t*>::iterator it = picks.begin();
+	     it != picks.end(); ++it )
+	  NewTrack( tracks, **it );
       }
       else {
 	fTrkStat = kFailedTrackCuts;
@@ -1854,10 +2586,8 @@ Int_t Tracker::CoarseTrack( TClonesArray& tracks )
       fTrkStat = kFailed3DMatch;
     } //if(nfits)
 
-#ifdef TESTCODE
     fN3dFits = nfits;
-    t_3dfit = 1e6*timer.RealTime();
-#endif
+    t_3dfit = fStats.Record( kStage3dFit, ReadClock()-t_stage );
 #ifdef VERBOSE
     if( fDebug > 0 ) {
       Int_t ntr = tracks.GetLast()+1;
@@ -1902,9 +2632,11 @@ Int_t Tracker::CoarseTrack( TClonesArray& tracks )
 #endif
   } //if(nproj>=fMinReqProj)
 
-#ifdef TESTCODE
-    t_coarse = 1e6*timer_tot.RealTime();
-#endif
+  t_coarse = fStats.Record( kStageCoarse, ReadClock()-t_start );
+  if( !IsClone() and
+      fStats.GetEntries(kStageCoarse) % kPercentileInterval == 0 )
+    UpdatePercentiles();
+
   // Quit here to let detectors CoarseProcess() the approximate tracks,
   // so that they can determine the corrections that we need when we
   // continue in FineTrack
@@ -1912,14 +2644,22 @@ Int_t Tracker::CoarseTrack( TClonesArray& tracks )
 }
 
 //_____________________________________________________________________________
-Int_t Tracker::FineTrack( TClonesArray& /* tracks */ )
+Int_t Tracker::FineTrack( TClonesArray& tracks )
 {
   // Second-level tracking, applying fine corrections.
   //
-  // - Correct the hit drift distances using timing, track slope,
-  //   track momentum, magnet fringe field, etc., as applicable.
-  // - Re-collect hits of roads and re-fit roads
-  // - Re-combine track projections in 3D and re-fit 3D track
+  // For each track found by CoarseTrack, the drift distances of the hits
+  // used in the fit are recomputed for the slope of the 3D track in the
+  // hits' projection, and the L/R ambiguity of each hit is resolved anew
+  // by picking the hit position closest to the 3D track. The track is
+  // then refit. Since only the measured coordinates change, but not the
+  // model or the weights, the normal equations of the coarse fit are
+  // updated incrementally, and the Cholesky factor of the coarse fit is
+  // reused to solve them. If the refit fails the track cuts (minimum ndof
+  // and chi2 limits), it is rejected, and the track keeps its coarse fit.
+  //
+  // Not yet done: timing, momentum and fringe field corrections, and
+  // re-collecting and re-combining roads with the corrected hits.
 
   if( !TestBit(kDoFine) )
     return 0;
@@ -1927,9 +2667,89 @@ Int_t Tracker::FineTrack( TClonesArray& /* tracks */ )
   if( fTrkStat != 0 )
     return -1;
 
-  // TODO
+  ULong64_t t_start = ReadClock(), t_conv = 0;
+
+  for( vector<FineFit_t>::iterator it = fFineFits.begin();
+       it != fFineFits.end(); ++it ) {
+    FineFit_t& ff = *it;
+    assert( ff.idx >= 0 && ff.idx <= tracks.GetLast() );
+    THaTrack* track = static_cast<THaTrack*>( tracks.UncheckedAt(ff.idx) );
+    assert( track );
+    ULong64_t t_stage = ReadClock();
+    // Correct the points of the track and update the normal equations
+    for( Rvec_t::const_iterator jt = ff.roads.begin(); jt != ff.roads.end();
+	 ++jt ) {
+      const Projection* proj = (*jt)->GetProjection();
+      Double_t cosa  = proj->GetCosAngle();
+      Double_t sina  = proj->GetSinAngle();
+      Double_t slope = ff.coef[1]*cosa + ff.coef[3]*sina;
+      Double_t trkx  = ff.coef[0]*cosa + ff.coef[2]*sina;
+      const Road::Pvec_t& points = (*jt)->GetPoints();
+      for( Road::Pvec_t::const_iterator kt = points.begin();
+	   kt != points.end(); ++kt ) {
+	Road::Point* p = *kt;
+	Hit* hit = p->hit;
+	Double_t pos = trkx + slope * p->z;
+	hit->ApplyTrackSlope( slope );
+	Double_t x = hit->GetPosI(0);
+	for( UInt_t i = 1; i < hit->GetNumPos(); ++i ) {
+	  Double_t xi = hit->GetPosI(i);
+	  if( TMath::Abs(xi-pos) < TMath::Abs(x-pos) )
+	    x = xi;
+	}
+	if( x != p->x ) {
+	  if( (x-hit->GetPos())*(p->x-hit->GetPos()) < 0.0 )
+	    ++fNfineFlips;
+	  Double_t Ai[4] = { cosa, cosa * p->z, sina, sina * p->z };
+	  ff.normeq.Update( Ai, x - p->x, 1.0/(p->res()*p->res()) );
+	  p->x = x;
+	}
+      }
+    }
+    t_conv += ReadClock()-t_stage;
+
+    // Refit
+    Double_t b[4];
+    if( !ff.normeq.Resolve(b) ) {
+      FitErrPrint( -2 );
+      continue;
+    }
+    FitRes_t refit;
+    refit.coef.assign( b, b+4 );
+    refit.chi2 = ForAllTrackPoints(ff.roads, refit.coef, CalcChisquare())
+      .GetResult();
+    refit.ndof = ff.ndof;
+    // Keep the coarse fit if the refit no longer passes the track cuts
+    if( !PassTrackCuts(refit) ) {
+      ++fNfineRej;
+      continue;
+    }
+    fFineDchi2 += refit.chi2 - ff.chi2;
+    ff.coef.swap( refit.coef );
+    ff.chi2 = refit.chi2;
+
+    // Update the track and its fit coordinates
+    TVector3 pos, dir;
+    if( !TrackToGlobal( ff.coef, pos, dir ) )
+      continue;
+    track->Set( pos.X(), pos.Y(), dir.X(), dir.Y() );
+    track->SetD( ff.coef[0], ff.coef[2], ff.coef[1], ff.coef[3] );
+    track->SetChi2( ff.chi2, ff.ndof );
+    ForAllTrackPoints( ff.roads, ff.coef, UpdateFitCoord(ff.coords) );
+
+#ifdef VERBOSE
+    if( fDebug > 1 )
+      cout << "Fine 3D fit:  x/y = " << ff.coef[0] << "/" << ff.coef[2] << " "
+	   << "mx/my = " << ff.coef[1] << "/" << ff.coef[3] << " "
+	   << "ndof = " << ff.ndof << " rchi2 = " << ff.chi2/(double)ff.ndof
+	   << endl;
+#endif
+  }
 
-  return 0;;
+  t_fineconv = fStats.Record( kStageFineConv, t_conv );
+  t_fine = fStats.Record( kStageFine, ReadClock()-t_start );
+
+  return 0;
 }
 
 //_____________________________________________________________________________
@@ -1937,6 +2757,10 @@ Int_t Tracker::DefineVariables( EMode mode )
 {
   // Initialize global variables
 
+  // Clones have the same names as their prototype and would redefine its
+  // variables, so they do not export any
+  if( IsClone() ) return kOK;
+
   if( mode == kDefine and fIsSetup ) return kOK;
   fIsSetup = ( mode == kDefine );
 
@@ -1951,18 +2775,33 @@ Int_t Tracker::DefineVariables( EMode mode )
   // Define tracking-related variables only if doing tracking
   if( TestBit(kDoCoarse) ) {
     RVarDef vars_tracking[] = {
-#ifdef TESTCODE
       { "ncombos",    "Number of road combinations",        "fNcombos" },
       { "nfits",      "Number of 3D track fits done",       "fN3dFits" },
       { "t_track",    "Time in 1st stage tracking (us)",    "t_track" },
       { "t_3dmatch",  "Time in MatchRoads (us)",            "t_3dmatch" },
       { "t_3dfit",    "Time fitting/selecting 3D tracks (us)", "t_3dfit" },
       { "t_coarse",   "Total time in CoarseTrack (us)",     "t_coarse" },
-#endif
+      { "p_track",    "p50/p99/p99.9 of t_track (us)",      "p_track" },
+      { "p_3dmatch",  "p50/p99/p99.9 of t_3dmatch (us)",    "p_3dmatch" },
+      { "p_3dfit",    "p50/p99/p99.9 of t_3dfit (us)",      "p_3dfit" },
+      { "p_coarse",   "p50/p99/p99.9 of t_coarse (us)",     "p_coarse" },
       { 0 }
     };
     DefineVarsFromList( vars_tracking, mode );
   }
+  if( TestBit(kDoFine) ) {
+    RVarDef vars_fine[] = {
+      { "fine.nflip", "Hits with L/R side changed by FineTrack", "fNfineFlips" },
+      { "fine.nrej",  "Fine refits rejected by track cuts", "fNfineRej" },
+      { "fine.dchi2", "Change of sum of track chi2 in FineTrack", "fFineDchi2" },
+      { "t_fineconv", "Time correcting hits in FineTrack (us)", "t_fineconv" },
+      { "t_fine",     "Total time in FineTrack (us)",       "t_fine" },
+      { "p_fineconv", "p50/p99/p99.9 of t_fineconv (us)",   "p_fineconv" },
+      { "p_fine",     "p50/p99/p99.9 of t_fine (us)",       "p_fine" },
+      { 0 }
+    };
+    DefineVarsFromList( vars_fine, mode );
+  }
   return 0;
 }
 
@@ -1978,6 +2817,59 @@ Projection* Tracker::MakeProjection( EProjType type, const char* name,
   return new Projection( type, name, angle, parent );
 }
 
+//_____________________________________________________________________________
+Projection* Tracker::GetProjection( EProjType type ) const
+{
+  // Get the projection of the given type, or 0 if not defined
+
+  Prvec_t::const_iterator it =
+    find_if( ALL(fProj), Projection::TypeEquals(type) );
+  return ( it != fProj.end() ) ? *it : 0;
+}
+
+//_____________________________________________________________________________
+Tracker* Tracker::NewClone() const
+{
+  // Create a new, uninitialized tracker of our class with the same name
+  // and apparatus. Specialized Trackers must override this to support
+  // cloning.
+
+  Error( Here("NewClone"), "Cloning not supported by class %s",
+	 ClassName() );
+  return 0;
+}
+
+//_____________________________________________________________________________
+Tracker* Tracker::MakeClone() const
+{
+  // Create a clone of this tracker for processing events concurrently with
+  // it. The clone reads the same database and so has the same
+  // configuration. It shares the largest part of the configuration, the
+  // projections' pattern trees, with this tracker; all per-event working
+  // data (planes, hits, hitpatterns, roads) are the clone's own.
+  //
+  // The caller owns the returned object and must Init() it. This tracker
+  // must be initialized and must outlive the clone.
+
+  if( !IsInit() ) {
+    Error( Here("MakeClone"), "Tracker not initialized. Cannot clone." );
+    return 0;
+  }
+  // Snapshot files are recorded and replayed in event order by this
+  // tracker alone. With clones, each would see only part of the events.
+  if( !fSnapshotFile.empty() ) {
+    Error( Here("MakeClone"), "Cannot clone a tracker that %s snapshot "
+	   "file %s. Remove snapshot_%s from the database or process the "
+	   "events with a single tracker.", fSnapshotRead ? "replays" :
+	   "records", fSnapshotFile.c_str(), fSnapshotRead ? "read" : "write" );
+    return 0;
+  }
+  Tracker* clone = NewClone();
+  if( clone )
+    clone->fPrototype = this;
+  return clone;
+}
+
 //_____________________________________________________________________________
 THaAnalysisObject::EStatus Tracker::Init( const TDatime& date )
 {
@@ -2152,6 +3044,20 @@ THaAnalysisObject::EStatus Tracker::Init( const TDatime& date )
     }
   }
 
+  // Precompute the geometry for intersecting roads of all projection pairs.
+  // The angle checks above guarantee that all pairs are non-degenerate.
+  const UInt_t ntypes = kTypeEnd-kTypeBegin;
+  fProjPairCoef.assign( ntypes*ntypes, ProjPairCoef_t() );
+  for( vpiter_t it = fProj.begin(); it != fProj.end(); ++it ) {
+    for( vpiter_t jt = fProj.begin(); jt != fProj.end(); ++jt ) {
+      if( it == jt ) continue;
+      fProjPairCoef[ (*it)->GetType()*ntypes + (*jt)->GetType() ] =
+	ProjPairCoef_t( (*it)->GetSinAngle(), (*it)->GetCosAngle(),
+			(*jt)->GetSinAngle(), (*jt)->GetCosAngle() );
+    }
+  }
+  fZback = fPlanes.back()->GetZ();
+
   // Check if we can use the simplified 3D matching algorithm
   //TODO: generalize to 4 projections with symmetry?
   vector<ProjAngle_t>::size_type nproj = fProj.size();
@@ -2223,11 +3129,17 @@ THaAnalysisObject::EStatus Tracker::Init( const TDatime& date )
     }
   }
 
-  // If threading requested, load thread library and start up threads
+  // Set up the road grid for fast 3D matching, if requested
+  SetupRoadGrid();
+
+  // If threading requested, load thread library and attach to the
+  // process-wide thread pool, growing it to fMaxThreads threads if necessary
+  if( fThreadPool ) {
+    ThreadPool::Release(); fThreadPool = 0;
+  }
   if( fMaxThreads > 1 ) {
-    delete fThreads; fThreads = 0;
     if( gSystem->Load("libThread") >= 0 ) {
-      fThreads = new ThreadCtrl( fProj );
+      fThreadPool = ThreadPool::Acquire( fMaxThreads );
     } else {
       // Error loading library
       Warning( Here(here), "Error loading thread library. Falling back to "
@@ -2235,6 +3147,42 @@ THaAnalysisObject::EStatus Tracker::Init( const TDatime& date )
       fMaxThreads = 1;
     }
   }
+  for( vpiter_t it = fProj.begin(); it != fProj.end(); ++it )
+    (*it)->SetThreadPool( fThreadPool );
+
+  // Set up parallel decoding, if requested and possible
+  delete fDecodeCtrl; fDecodeCtrl = 0;
+  if( fParallelDecode and fThreadPool ) {
+    fDecodeCtrl = new DecodeCtrl( fProj );
+    if( fDebug > 0 )
+      Info( Here(here), "Enabled parallel decoding of planes" );
+  }
+
+  // Set up the crate/slot dispatch table, if requested
+  delete fDispatch; fDispatch = 0;
+  for( vrsiz_t iplane = 0; iplane < fPlanes.size(); ++iplane )
+    fPlanes[iplane]->SetUseDispatch( false );
+  if( fDispatchDecode ) {
+    fDispatch = new DecodeDispatch;
+    UInt_t nconflict = 0;
+    for( vrsiz_t iplane = 0; iplane < fPlanes.size(); ++iplane ) {
+      if( fPlanes[iplane]->CanUseDispatch() )
+	nconflict += fDispatch->Add( fPlanes[iplane] );
+    }
+    if( nconflict > 0 ) {
+      Warning( Here(here), "%u channel(s) mapped to more than one plane. "
+	       "Dispatch decoding disabled. Check detector maps.", nconflict );
+      delete fDispatch; fDispatch = 0;
+    } else if( fDispatch->GetNplanes() == 0 ) {
+      delete fDispatch; fDispatch = 0;
+    } else {
+      fDispatch->Enable();
+      if( fDebug > 0 )
+	Info( Here(here), "Enabled dispatch decoding of %u planes "
+	      "from %u modules", fDispatch->GetNplanes(),
+	      fDispatch->GetNslots() );
+    }
+  }
 
   // Keep a simple flag for the rotation status for efficiency.
   fIsRotated = !fRotation.IsIdentity();
@@ -2250,6 +3198,27 @@ THaAnalysisObject::EStatus Tracker::Init( const TDatime& date )
   return fStatus = kOK;
 }
 
+//_____________________________________________________________________________
+void Tracker::SetupRoadGrid()
+{
+  // Create the road grid for fast 3D matching if f3dGridMatch is set and
+  // fast 3D matching is available, else delete it. Called by Init.
+
+  static const char* const here = "Init";
+
+  delete fRoadGrid; fRoadGrid = 0;
+  if( f3dGridMatch ) {
+    if( TestBit(k3dFastMatch) ) {
+      fRoadGrid = new RoadGrid;
+      if( fDebug > 0 )
+	Info( Here(here), "Enabled grid lookup for fast 3D matching" );
+    } else {
+      Warning( Here(here), "3d_gridmatch requested, but fast 3D matching is "
+	       "not available for this projection configuration. Ignored." );
+    }
+  }
+}
+
 //_____________________________________________________________________________
 Int_t Tracker::ReadDatabase( const TDatime& date )
 {
@@ -2290,7 +3259,9 @@ Int_t Tracker::ReadDatabase( const TDatime& date )
 #ifdef MCDATA
   Int_t mc_data = 0;
 #endif
-  Int_t maxthreads = -1;
+  Int_t maxthreads = -1, grid_match = 0, exact_maxcand = 0, par_decode = 0,
+    dispatch = 0, trace = 0, trace_maxrec = 262144, snapshot_compress = 0;
+  string trace_file, snapshot_write, snapshot_read;
   fDBmaxmiss = -1;
   fDBconf_level = 1e-9;
   ResetBit( k3dFastMatch ); // Set in Init()
@@ -2311,6 +3282,16 @@ Int_t Tracker::ReadDatabase( const TDatime& date )
     { "3d_chi2_conflevel", &fDBconf_level,     kDouble, 0, 1 },
     { "3d_disable_chi2",   &disable_chi2,      kInt,    0, 1 },
     { "maxthreads",        &maxthreads,        kInt,    0, 1 },
+    { "parallel_decode",   &par_decode,        kInt,    0, 1 },
+    { "dispatch_decode",   &dispatch,          kInt,    0, 1 },
+    { "3d_gridmatch",      &grid_match,        kInt,    0, 1 },
+    { "3d_exact_maxcand",  &exact_maxcand,     kInt,    0, 1 },
+    { "trace",             &trace,             kInt,    0, 1 },
+    { "trace_file",        &trace_file,        kString, 0, 1 },
+    { "trace_maxrec",      &trace_maxrec,      kInt,    0, 1 },
+    { "snapshot_write",    &snapshot_write,    kString, 0, 1 },
+    { "snapshot_read",     &snapshot_read,     kString, 0, 1 },
+    { "snapshot_compress", &snapshot_compress, kInt,    0, 1 },
     { 0 }
   };
 
@@ -2357,6 +3338,57 @@ Int_t Tracker::ReadDatabase( const TDatime& date )
   SetBit( kDoFine,        !(disable_tracking or disable_finetrack) );
   SetBit( kDoChi2,        !disable_chi2 );
   SetBit( kProjTrackToZ0, proj_to_z0 );
+  f3dGridMatch = grid_match;
+  fParallelDecode = par_decode;
+  fDispatchDecode = dispatch;
+
+  // Exact de-ghosting is exponential in the worst case, so limit the number
+  // of candidates for which it may be used
+  const Int_t kMaxExactPack = 64;
+  if( exact_maxcand > kMaxExactPack ) {
+    Warning( Here(here), "3d_exact_maxcand = %d too large, limiting to %d",
+	     exact_maxcand, kMaxExactPack );
+    exact_maxcand = kMaxExactPack;
+  }
+  fMaxExactPack = TMath::Max( exact_maxcand, 0 );
+
+  // Stage timeline tracing is process-wide and configured by prototypes only
+  if( !fTraceFile.empty() ) {
+    Trace::Disable();
+    fTraceFile.clear();
+  }
+  if( trace and !IsClone() ) {
+    if( trace_maxrec <= 0 ) {
+      Error( Here(here), "Illegal trace_maxrec = %d. Must be > 0. "
+	     "Fix database.", trace_maxrec );
+      return kInitError;
+    }
+    fTraceFile = trace_file.empty() ? Form("%strace.json", GetPrefix())
+      : trace_file.c_str();
+    Trace::Enable( trace_maxrec );
+    Info( Here(here), "Tracing enabled, output to %s", fTraceFile.c_str() );
+  }
+
+  // Decoded-hit snapshots. The file is opened in Begin(), when the planes
+  // are set up.
+  delete fSnapshot; fSnapshot = 0;
+  fSnapshotFile.clear();
+  if( !IsClone() and !(snapshot_write.empty() and snapshot_read.empty()) ) {
+    if( !snapshot_write.empty() and !snapshot_read.empty() ) {
+      Error( Here(here), "Cannot both record and replay snapshots. "
+	     "Set only one of snapshot_write and snapshot_read. "
+	     "Fix database." );
+      return kInitError;
+    }
+    if( snapshot_compress < 0 or snapshot_compress > 9 ) {
+      Error( Here(here), "Illegal snapshot_compress = %d. Must be 0-9. "
+	     "Fix database.", snapshot_compress );
+      return kInitError;
+    }
+    fSnapshotRead = !snapshot_read.empty();
+    fSnapshotFile = fSnapshotRead ? snapshot_read : snapshot_write;
+    fSnapshotCompr = snapshot_compress;
+  }
 
   cout << endl;
   if( fDebug > 0 ) {
@@ -2434,9 +3466,9 @@ Int_t Tracker::ReadDatabase( const TDatime& date )
   // has priority. maxthreads = 0 or negative indicates that the number of
   // CPUs/cores of the current host should be used. If not available, use 1.
   // To ensure single-threaded processing, set maxthreads = 1 in the database.
-  // The number of threads is capped by the maximum that the ThreadCtrl class
-  // supports - currently 31 due to the size of UInt_t, which is more than
-  // enough since we never run more threads than the number of projections.
+  // The number of threads is capped by the maximum that the ThreadPool class
+  // supports (currently 64). The threads are shared by all trackers and
+  // process the projections, road fits and 3D track fits of an event.
   bool warn = false;
   if( maxthreads > 0 )
     fMaxThreads = maxthreads;
@@ -2450,8 +3482,8 @@ Int_t Tracker::ReadDatabase( const TDatime& date )
       fMaxThreads = 1;
     }
   }
-  // Limit number of threads to what ThreadCtrl can support (currently = 31)
-  fMaxThreads = min(fMaxThreads, ThreadCtrl::GetMaxThreads());
+  // Limit number of threads to what ThreadPool can support
+  fMaxThreads = min(fMaxThreads, ThreadPool::GetMaxThreads());
   if( warn )
     Warning( Here(here), "Cannot determine number of CPU cores. "
 	     "Falling back to single-threaded processing." );
@@ -12,6 +12,8 @@
 #include "THaTrackingDetector.h"
 #include "THaDetMap.h"
 #include "Types.h"
+#include "Helper.h"   // for NormalEq4
+#include "Instrument.h"
 #include <vector>
 #include <utility>
 #include <set>
@@ -32,6 +34,7 @@ class TClonesArray;
 class THashTable;
 class TClass;
 class TSeqCollection;
+class TVector2;
 
 using std::vector;
 
@@ -40,7 +43,12 @@ namespace TreeSearch {
   class Projection;
   class Road;
   class Hit;
-  class ThreadCtrl;  // Defined in implementation
+  class FitCoord;
+  class ThreadPool;
+  class RoadGrid;    // Defined in implementation
+  class DecodeCtrl;  // Defined in implementation
+  class DecodeDispatch; // Defined in implementation
+  class HitSnapshot;
 
   typedef std::vector<Road*> Rvec_t;
   typedef std::set<Road*>    Rset_t;
@@ -56,6 +64,7 @@ namespace TreeSearch {
 
     virtual void    Clear( Option_t* opt="" );
     virtual Int_t   Decode( const THaEvData& );
+    Int_t           DecodeHits( Int_t evnum = 0 );
     virtual EStatus Init( const TDatime& date );
     virtual Int_t   CoarseTrack( TClonesArray& tracks );
     virtual Int_t   FineTrack( TClonesArray& tracks );
@@ -68,9 +77,28 @@ namespace TreeSearch {
 
     void            EnableEventDisplay( Bool_t enable = true );
     const pdbl_t&   GetChisqLimits( UInt_t i ) const;
+    const ProjPairCoef_t& GetProjPairCoef( EProjType a, EProjType b ) const;
     const TRotation& GetRotation()     const { return fRotation; }
     const TRotation& GetInvRotation()  const { return fInvRot; }
     Bool_t          IsRotated()        const { return fIsRotated; }
+    Projection*     GetProjection( EProjType type ) const;
+    UInt_t          GetNplanes()       const { return fPlanes.size(); }
+    Plane*          GetPlane( UInt_t i ) const { return fPlanes[i]; }
+
+    // Cloning for event-level parallelism. A clone shares this tracker's
+    // immutable configuration and has its own per-event state. The clone
+    // must be Init()ed after this tracker. Clones define no global variables.
+    // Trackers that record or replay a hit snapshot cannot be cloned.
+    Tracker*        MakeClone() const;
+    Bool_t          IsClone()          const { return fPrototype != 0; }
+    const Tracker*  GetPrototype()     const { return fPrototype; }
+
+    // Stage timing statistics, always collected. Clones keep their own,
+    // which can be merged into the prototype's with AddStageStats.
+    const StageStats& GetStageStats()  const { return fStats; }
+    void            AddStageStats( const Tracker& rhs );
+    void            ResetStageStats();
+    void            PrintStageStats() const;
 
     // Analysis control flags. Set via database.
     enum {
@@ -85,8 +113,8 @@ namespace TreeSearch {
       kProjTrackToZ0 = BIT(23)  // Project tracks to global z = 0
     };
 
-#ifdef TESTCODE
     Int_t           GetEvNum() const { return fEvNum; }
+#ifdef TESTCODE
     vector<TreeSearch::Plane*>& GetListOfPlanes() { return fPlanes; }
     vector<TreeSearch::Projection*>& GetListOfProjections() { return fProj; }
 #endif
@@ -104,7 +132,9 @@ namespace TreeSearch {
       kFailedOptimalN      = 7, // Failed 3D de-ghosting algorithm
       // MatchRoads
       kTooManyRoadCombos   = 8, // Overflow in MatchRoads
-      kNoRoadCombos        = 9  // Product of road vector sizes = 0 (bug?)
+      kNoRoadCombos        = 9, // Product of road vector sizes = 0 (bug?)
+      // Decode (snapshot replay)
+      kSnapshotError       = 10 // Error reading decoded-hit snapshot file
     };
     ETrackingStatus GetTrackingStatus() const { return fTrkStat; }
 
@@ -119,15 +149,29 @@ namespace TreeSearch {
 
   protected:
     friend class Plane;
+    friend class BenchAccess;  // Benchmarks (tsbench)
     class TrackFitWeight;
+    class FitTask;     // Defined in implementation
+    friend class FitTask;
     struct FitRes_t {
       vector<Double_t> coef;
       Double_t matchval;
       Double_t chi2;
       Int_t    ndof;
       Rvec_t*  roads;
+      NormalEq4 normeq;  // Normal equations of the fit
       FitRes_t() : roads(0) {}
     };
+    // State of the fit of a track made by CoarseTrack, kept for FineTrack
+    struct FineFit_t {
+      Int_t            idx;    // Index of the track in the tracks array
+      Rvec_t           roads;  // Roads forming the track
+      vector<Double_t> coef;   // Fitted track parameters
+      Double_t         chi2;   // Chi2 of the fit
+      Int_t            ndof;   // Degrees of freedom of the fit
+      NormalEq4        normeq; // Normal equations of the fit
+      vector<FitCoord*> coords;// Fit coordinates of the track's points
+    };
 
     typedef std::vector<Plane*>  Rpvec_t;
     typedef std::vector<Projection*> Prvec_t;
@@ -147,13 +191,35 @@ namespace TreeSearch {
 
     // Multithread support
     UInt_t         fMaxThreads;       // Maximum simultaneously active threads
-    ThreadCtrl*    fThreads;          //! Thread controller
+    ThreadPool*    fThreadPool;       //! Shared worker thread pool
+    Bool_t         fParallelDecode;   // Decode planes concurrently
+    DecodeCtrl*    fDecodeCtrl;       //! Parallel decoding controller
+
+    // Raw data dispatch
+    Bool_t         fDispatchDecode;   // Decode via crate/slot dispatch table
+    DecodeDispatch* fDispatch;        //! Crate/slot -> plane dispatch table
+
+    // Cloning support
+    const Tracker* fPrototype;        //! Tracker we are a clone of
 
     // Parameters for 3D projection matching
     UInt_t         fMinReqProj;  // Minimum # proj required for 3D match
     Double_t       f3dMatchvalScalefact; // Correction for fast 3D matchval
     Double_t       f3dMatchCut;  // Maximum allowed 3D match error
     vec_uint_t     f3dIdx;       // Lookup table proj index -> fast 3d index
+    Bool_t         f3dGridMatch; // Use road grid in fast 3D matching
+    RoadGrid*      fRoadGrid;    //! Grid of roads for fast 3D matching
+
+    // Geometry cache for 3D projection matching, set up in Init.
+    // The front reference plane is always z = 0 (where Road::GetPos() is
+    // evaluated), the back reference plane is the last tracker plane.
+    vector<ProjPairCoef_t> fProjPairCoef; // Road intersection coefficients
+                                          // [type_a*ntypes+type_b]
+    Double_t       fZback;       // z of back reference plane (m)
+
+    // Track de-ghosting
+    UInt_t         fMaxExactPack; // Max # track candidates for exact
+                                  // (instead of greedy) de-ghosting
 
     // Track fit cut parameters
     Int_t          fMinNdof;     // Minimum number of points in fit-4
@@ -161,24 +227,46 @@ namespace TreeSearch {
 
     // Event-by-event data
     ETrackingStatus fTrkStat;    // Reconstruction status
+    vector<FineFit_t> fFineFits; // Fits of the coarse tracks for FineTrack
+    UInt_t         fNfineFlips;  // # of hits whose L/R side FineTrack changed
+    UInt_t         fNfineRej;    // # of fine refits failing the track cuts
+    Double_t       fFineDchi2;   // Change of sum of track chi2s in FineTrack
 
-    // Only needed for TESTCODE, but kept for binary compatibility
+    // Statistics
+    StageStats     fStats;       //! Latencies of the tracking stages
     UInt_t         fNcombos;     // # of road combinations tried
     UInt_t         fN3dFits;     // # of track fits done (=good road combos)
     Int_t          fEvNum;       // Current event number
     Double_t       t_track, t_3dmatch, t_3dfit, t_coarse; // times in us
+    Double_t       t_fineconv, t_fine;                    // times in us
+    // p50/p99/p99.9 of the times (us), refreshed by UpdatePercentiles
+    Double_t       p_track[3], p_3dmatch[3], p_3dfit[3], p_coarse[3];
+    Double_t       p_fineconv[3], p_fine[3];
+
+    void      UpdatePercentiles();
 
     void      Add3dMatch( const Rvec_t& selected, Double_t matchval,
 			  std::list<std::pair<Double_t,Rvec_t> >& combos_found,
 			  Rset_t& unique_found ) const;
     void      FitErrPrint( Int_t err ) const;
+    void      IntersectRoads( const Rvec_t& roads, Double_t z,
+			      vector<TVector2>& points ) const;
     Int_t     FitTrack( const Rvec_t& roads, vector<Double_t>& coef,
-			Double_t& chi2, TMatrixDSym* coef_covar = 0 ) const;
+			Double_t& chi2, TMatrixDSym* coef_covar = 0,
+			NormalEq4* normeq = 0 ) const;
+    UInt_t    FitTracks( std::list<std::pair<Double_t,Rvec_t> >& combos,
+			 vector<FitRes_t>& results ) const;
     template< typename Action > static
     Action    ForAllTrackPoints( const Rvec_t& roads,
 				 const vector<Double_t>& coef, Action action );
     THaTrack* NewTrack( TClonesArray& tracks, const FitRes_t& fit_par );
+    Bool_t    TrackToGlobal( const vector<Double_t>& coef,
+			     TVector3& pos, TVector3& dir ) const;
     Bool_t    PassTrackCuts( const FitRes_t& fit_par ) const;
+    void      SelectTracks( const vector<const FitRes_t*>& cands,
+			    const Rset_t& unique_found, UInt_t found_types,
+			    vector<const FitRes_t*>& picks ) const;
+    void      SetupRoadGrid();
 
     UInt_t    MatchRoadsGeneric( vector<Rvec_t>& roads, UInt_t ncombos,
 		   std::list<std::pair<Double_t,Rvec_t> >& combos_found,
@@ -196,6 +284,7 @@ namespace TreeSearch {
 					Double_t angle,
 					THaDetectorBase* parent ) const;
     virtual UInt_t GetCrateMapDBcols() const = 0;
+    virtual Tracker* NewClone() const;
 
     virtual UInt_t MatchRoads( vector<Rvec_t>& roads,
 	         std::list<std::pair<Double_t,Rvec_t> >& combos_found,
@@ -250,6 +339,16 @@ namespace TreeSearch {
     Int_t    fDBmaxmiss;
     Double_t fDBconf_level;
 
+    // Stage timeline tracing (see Trace). Not used by clones.
+    std::string fTraceFile;     // Trace output file, empty if not tracing
+
+    // Decoded-hit snapshot recording/replay (see HitSnapshot). Not used by
+    // clones, and prevents cloning.
+    std::string fSnapshotFile;  // Snapshot file, empty if none
+    Bool_t      fSnapshotRead;  // Replay fSnapshotFile instead of decoding
+    Int_t       fSnapshotCompr; // gzip level for recording (0-9)
+    HitSnapshot* fSnapshot;     //! Open snapshot file
+
     ClassDef(Tracker,0)   // Tracking system analyzed using TreeSearch reconstruction
   };
 
@@ -260,6 +359,18 @@ namespace TreeSearch {
     return fChisqLimits[i];
   }
 
+  //___________________________________________________________________________
+  inline const ProjPairCoef_t& Tracker::GetProjPairCoef( EProjType a,
+							 EProjType b ) const
+  {
+    // Get coefficients for intersecting roads from projection types a and b
+    // (in this order). Both projections must be defined in this Tracker.
+
+    UInt_t idx = a*(kTypeEnd-kTypeBegin) + b;
+    assert( a != b and idx < fProjPairCoef.size() );
+    return fProjPairCoef[idx];
+  }
+
 }
 
 ///////////////////////////////////////////////////////////////////////////////
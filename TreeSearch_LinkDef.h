@@ -11,7 +11,6 @@
 #pragma link C++ class TreeSearch::Tracker+;
 #pragma link C++ class TreeSearch::Plane+;
 #pragma link C++ class TreeSearch::Hit+;
-#pragma link C++ class TreeSearch::HitPairIter+;
 #pragma link C++ class TreeSearch::HitSet+;
 #pragma link C++ class TreeSearch::Bits+;
 #pragma link C++ class TreeSearch::Hitpattern+;
@@ -26,6 +25,7 @@
 #pragma link C++ class TreeSearch::FitCoord+;
 #pragma link C++ class TreeSearch::Road::Corners+;
 #pragma link C++ class TreeSearch::Road::Point+;
+#pragma link C++ struct TreeSearch::ProjPairCoef_t+;
 
 #pragma link C++ class std::pair<TObject*,TObject*>+;
 #pragma link C++ class std::vector<TreeSearch::Plane*>+;
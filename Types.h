@@ -19,6 +19,21 @@ namespace TreeSearch {
   typedef std::pair<double,double>    pdbl_t;
   typedef std::vector<pdbl_t>         vec_pdbl_t;
 
+  // Coefficients for intersecting coordinates measured along two
+  // non-parallel projection axes u and v, i.e. the sines and cosines of the
+  // axis angles scaled by 1/(sin(v)*cos(u)-sin(u)*cos(v)).
+  // Used by Road::Intersect. The Tracker class keeps a table of these for
+  // all projection pairs so they need not be recomputed for each road pair.
+  struct ProjPairCoef_t {
+    double su, cu, sv, cv;
+    ProjPairCoef_t() : su(0), cu(0), sv(0), cv(0) {}
+    ProjPairCoef_t( double sin_u, double cos_u, double sin_v, double cos_v ) {
+      double inv_denom = 1.0/(sin_v*cos_u-sin_u*cos_v);
+      su = sin_u*inv_denom; cu = cos_u*inv_denom;
+      sv = sin_v*inv_denom; cv = cos_v*inv_denom;
+    }
+  };
+
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -33,8 +33,13 @@ namespace TreeSearch {
 
     virtual UInt_t   GetNumPos()         const;
     virtual Double_t GetPosI( UInt_t i ) const;
+    virtual void     ApplyTrackSlope( Double_t slope )
+    { ConvertTimeToDist( slope ); }
+    virtual Double_t GetInputData()      const { return fTime; }
 
     Double_t ConvertTimeToDist( Double_t slope );
+    void     SetDriftDist( Double_t dist )
+    { fPosL = fPos-dist; fPosR = fPos+dist; }
 
     Int_t    GetWireNum()    const { return fWireNum; }
     Double_t GetWirePos()    const { return GetPos(); }
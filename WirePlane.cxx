@@ -19,6 +19,7 @@
 #include "TError.h"
 #include "TClass.h"
 #include "TString.h"
+#include "TRandom.h"
 #ifndef MCDATA
 #include "THaEvData.h"
 #else
@@ -77,6 +78,7 @@ WirePlane::~WirePlane()
 
   if( fIsSetup )
     RemoveVariables();
+  delete fTTDConv;
 }
 
 //_____________________________________________________________________________
@@ -151,27 +153,66 @@ Int_t WirePlane::WireDecode( const THaEvData& evData )
   UInt_t nHits = 0;
   bool no_time_cut = !fTracker->TestBit(MWDC::kDoTimeCut);
 #ifdef MCDATA
-  bool mc_data     = fTracker->TestBit(Tracker::kMCdata);
-  assert( !mc_data || dynamic_cast<const SimDecoder*>(&evData) != 0 );
+  assert( !fTracker->TestBit(Tracker::kMCdata) ||
+	  dynamic_cast<const SimDecoder*>(&evData) != 0 );
 #endif
 
+  bool sorted = true;
+  WireHit* prevHit = 0;
+  if( UsesDispatch() ) {
+    // The raw hits of this plane have already been read from evData and
+    // staged in fRawHits by the Tracker's dispatch table (see
+    // Tracker::Decode), in the order in which they were read. Hits on the
+    // same wire are adjacent.
+#ifdef TESTCODE
+    UInt_t nmul = 0;
+#endif
+    for( Vraw_t::size_type i = 0; i < fRawHits.size(); ++i ) {
+      const RawHit_t& raw = fRawHits[i];
+      THaDetMap::Module* d = fDetMap->GetModule(raw.imod);
+      Double_t ref_time =
+	(d->refindex >= 0) ? mwdc->GetRefTime(d->refindex) : 0.0;
+#ifdef TESTCODE
+      if( i == 0 || raw.elem != fRawHits[i-1].elem ) {
+	++fNhitwires;
+	nmul = 1;
+      } else if( ++nmul == 2 )
+	++fNmultihit;
+      if( nmul > fNmaxmul )
+	fNmaxmul = nmul;
+#endif
+      // See below for details
+      Double_t time =
+	fTDCOffset[raw.elem] + ref_time - d->resolution*(raw.data+0.5);
+      if( no_time_cut || (fMinTime < time && time < fMaxTime) ) {
+	WireHit* theHit = MakeHit( raw.elem, raw.data, time, nHits );
+	if( sorted && prevHit && theHit->Compare(prevHit) < 0 )
+	  sorted = false;
+	prevHit = theHit;
+      }
+#ifdef TESTCODE
+      else
+	++fNrej;
+#endif
+    }
+  }
   // Decode data. This is done fairly efficiently by looping over only the
   // channels with hits on each module.
-  // FIXME: If a module is shared with another plane (common here), we waste
-  // time skipping hits that don't belong to us.
+  // NB: If a module is shared with another plane (common here), we waste
+  // time skipping hits that don't belong to us. Enable dispatch decoding
+  // in the Tracker to avoid this.
   // NB: certain indices below are guaranteed to be in range by construction
   // in ReadDatabase, so we can avoid unneeded checks.
-  bool sorted = true;
-  WireHit* prevHit = 0;
-  for( Int_t imod = 0; imod < fDetMap->GetSize(); ++imod ) {
+  else for( Int_t imod = 0; imod < fDetMap->GetSize(); ++imod ) {
     THaDetMap::Module * d = fDetMap->GetModule(imod);
     Double_t ref_time =
       (d->refindex >= 0) ? mwdc->GetRefTime(d->refindex) : 0.0;
 
     // Get number of channels with hits and loop over them, skipping channels
     // that are not part of this module
-    // FIXME: this becomes very inefficient if several modules with the
-    // same crate/slot are defined - e.g. one "module" per channel...ouch
+    // NB: this becomes very inefficient if several modules with the
+    // same crate/slot are defined - e.g. one "module" per channel.
+    // Dispatch decoding (see Tracker) handles such maps efficiently.
     Int_t nchan = evData.GetNumChan( d->crate, d->slot );
     // For "reversed" detector map modules, loop backwards over the channels
     // to preserve the ordering of the hits by wire number
@@ -216,32 +257,7 @@ Int_t WirePlane::WireDecode( const THaEvData& evData )
 	// use common-stop TDCs, so t_drift = t_tdc(drift=0)-t_tdc(data).
 	Double_t time = tdc_offset+ref_time - d->resolution*(data+0.5);
 	if( no_time_cut || (fMinTime < time && time < fMaxTime) ) {
-	  WireHit* theHit;
-#ifdef MCDATA
-	  if( mc_data ) {
-	    theHit = new( (*fHits)[nHits++] )
-	      MCWireHit( iw,
-			 GetStart() + iw * GetPitch(),
-			 data,
-			 time,
-			 fResolution,
-			 this,
-			 // TODO: fill MC info here
-			 0, 0.0, 0.0
-			 );
-	  } else
-#endif
-	    theHit = new( (*fHits)[nHits++] )
-	      WireHit( iw,
-		       GetStart() + iw * GetPitch(),
-		       data,
-		       time,
-		       fResolution,
-		       this
-		       );
-	  // Preliminary calculation of drift distance. Once tracks are known,
-	  // the distance can be recomputed using the track slope.
-	  theHit->ConvertTimeToDist( 0.0 );
+	  WireHit* theHit = MakeHit( iw, data, time, nHits );
 
 	  // We can test the ordering of the hits on the fly - they should
 	  // come in sorted if the lowest logical channel corresponds to
@@ -260,8 +276,16 @@ Int_t WirePlane::WireDecode( const THaEvData& evData )
   }     // modules
 
   // If necessary, sort the hits by wire position
-  if( !sorted )
-    fHits->Sort();
+  if( !sorted ) {
+    if( TestBit(kCountingSort) )
+      CountingSortHits();
+    else
+      fHits->Sort();
+  }
+
+  // Preliminary calculation of drift distances. Once tracks are known,
+  // the distances can be recomputed using the track slope.
+  ConvertTimesToDist( 0.0 );
 
 #ifdef TESTCODE
   fWasSorted = sorted;
@@ -275,6 +299,114 @@ Int_t WirePlane::WireDecode( const THaEvData& evData )
   return nHits;
 }
 
+//_____________________________________________________________________________
+void WirePlane::ConvertTimesToDist( Double_t slope )
+{
+  // Convert the drift times of all hits to drift distances, assuming the
+  // given track slope, with a single call to the converter
+
+  Int_t nhits = GetNhits();
+  if( nhits == 0 )
+    return;
+  fTimeBuf.resize( nhits );
+  fDistBuf.resize( nhits );
+  for( Int_t i = 0; i < nhits; ++i )
+    fTimeBuf[i] = static_cast<WireHit*>(GetHit(i))->GetDriftTime();
+  fTTDConv->ConvertTimesToDist( nhits, &fTimeBuf[0], slope, &fDistBuf[0] );
+  for( Int_t i = 0; i < nhits; ++i )
+    static_cast<WireHit*>(GetHit(i))->SetDriftDist( fDistBuf[i] );
+}
+
+//_____________________________________________________________________________
+void WirePlane::CountingSortHits()
+{
+  // Sort the hits in the same order as fHits->Sort(), i.e. by wire position
+  // and, for each wire, by drift time (see WireHit::Compare), but without
+  // comparison-based sorting. The hits are distributed into bins by wire
+  // number with a counting sort, and the few hits in each bin are ordered
+  // by drift time with an insertion sort. The cost is linear in the number
+  // of hits and wires. The hit array is then rebuilt once in sorted order.
+
+  UInt_t nhits = GetNhits();
+  if( nhits < 2 )
+    return;
+  fSortIn.resize( nhits );
+  fSortOut.resize( nhits );
+  fSortCount.assign( fNelem+1, 0 );
+
+  // Wire positions decrease with the wire number if the pitch is negative
+  Bool_t reverse = ( GetPitch() < 0.0 );
+  for( UInt_t i = 0; i < nhits; ++i ) {
+    WireHit* hit = static_cast<WireHit*>( GetHit(i) );
+    SortHit_t& h = fSortIn[i];
+    h.iw   = hit->GetWireNum();
+    h.data = static_cast<Int_t>( hit->GetRawTDC() );
+    h.time = hit->GetDriftTime();
+    assert( h.iw >= 0 && h.iw < fNelem );
+    Int_t key = reverse ? fNelem-1-h.iw : h.iw;
+    ++fSortCount[key+1];
+  }
+  for( Int_t k = 0; k < fNelem; ++k )
+    fSortCount[k+1] += fSortCount[k];
+  for( UInt_t i = 0; i < nhits; ++i ) {
+    const SortHit_t& h = fSortIn[i];
+    Int_t key = reverse ? fNelem-1-h.iw : h.iw;
+    fSortOut[ fSortCount[key]++ ] = h;
+  }
+  // Order multiple hits on the same wire by drift time
+  for( UInt_t i = 1; i < nhits; ++i ) {
+    SortHit_t h = fSortOut[i];
+    UInt_t j = i;
+    while( j > 0 && fSortOut[j-1].iw == h.iw && fSortOut[j-1].time > h.time ) {
+      fSortOut[j] = fSortOut[j-1];
+      --j;
+    }
+    fSortOut[j] = h;
+  }
+
+  fHits->Clear();
+  UInt_t n = 0;
+  for( UInt_t i = 0; i < nhits; ++i ) {
+    const SortHit_t& h = fSortOut[i];
+    MakeHit( h.iw, h.data, h.time, n );
+  }
+  assert( n == nhits );
+}
+
+//_____________________________________________________________________________
+WireHit* WirePlane::MakeHit( Int_t iw, Int_t data, Double_t time,
+			     UInt_t& nHits )
+{
+  // Add a new hit for wire iw with the given raw data and drift time
+  // to fHits and increment nHits. The drift distance is computed later
+  // by ConvertTimesToDist.
+
+  WireHit* theHit;
+#ifdef MCDATA
+  if( fTracker->TestBit(Tracker::kMCdata) ) {
+    theHit = new( (*fHits)[nHits++] )
+      MCWireHit( iw,
+		 GetStart() + iw * GetPitch(),
+		 data,
+		 time,
+		 fResolution,
+		 this,
+		 // TODO: fill MC info here
+		 0, 0.0, 0.0
+		 );
+  } else
+#endif
+    theHit = new( (*fHits)[nHits++] )
+      WireHit( iw,
+	       GetStart() + iw * GetPitch(),
+	       data,
+	       time,
+	       fResolution,
+	       this
+	       );
+  return theHit;
+}
+
 //_____________________________________________________________________________
 Hit* WirePlane::AddHitImpl( Double_t pos )
 {
@@ -318,13 +450,99 @@ Hit* WirePlane::AddHitImpl( Double_t pos )
   return theHit;
 }
 
+//_____________________________________________________________________________
+Hit* WirePlane::AddSimHit( Double_t pos, Double_t slope, TRandom& rnd )
+{
+  // Add a simulated hit for a track crossing this plane at projection
+  // coordinate pos with the given slope. The hit is on the nearest wire.
+  // Its drift time is found by inverting the drift time-to-distance
+  // conversion for the drift distance smeared with the plane's resolution.
+  // Returns 0 if the track misses the wires or if the drift time is
+  // outside of the time window.
+
+  // Upper limit of simulated drift times if there is no drift.max (s)
+  static const Double_t kMaxSimTime = 1e-6;
+
+  if( IsDummy() )
+    return Plane::AddSimHit( pos, slope, rnd );
+
+  assert( HasExtInput() and fTTDConv );
+
+  Int_t iw = TMath::Nint( (pos-GetStart()) / GetPitch() );
+  if( iw < 0 or iw >= fNelem )
+    return 0;
+  Double_t dist = pos - (GetStart() + iw * GetPitch());
+  dist = TMath::Abs( TMath::Abs(dist) + rnd.Gaus(0, fResolution) );
+  Double_t tmax = ( fMaxTime < kBig ) ? fMaxTime : kMaxSimTime;
+  Double_t time = fTTDConv->ConvertDistToTime( dist, slope, tmax );
+  if( time <= fMinTime or time >= tmax )
+    return 0;
+
+  UInt_t nHits = GetNhits();
+  return MakeHit( iw, 0, time, nHits );
+}
+
+//_____________________________________________________________________________
+Hit* WirePlane::AddExtHit( Double_t pos, Double_t res, Double_t time,
+			   const MCHitTruth_t* mc )
+{
+  // Add a hit on the wire at position pos with the given resolution and
+  // drift time, given via AddHits. Returns 0 if there is no wire at pos.
+
+  if( IsDummy() )
+    return Plane::AddExtHit( pos, res, time, mc );
+
+  Int_t iw = TMath::Nint( (pos-GetStart()) / GetPitch() );
+  if( iw < 0 or iw >= fNelem )
+    return 0;
+
+  WireHit* theHit = 0;
+#ifdef MCDATA
+  if( fTracker->TestBit(Tracker::kMCdata) ) {
+    Int_t mctrack = mc ? mc->track : 0;
+    Double_t mcpos = mc ? mc->pos : 0.0, mctime = mc ? mc->time : 0.0;
+    theHit = new( (*fHits)[GetNhits()] ) MCWireHit( iw,
+						    pos,
+						    0,
+						    time,
+						    res,
+						    this,
+						    mctrack,
+						    mcpos,
+						    mctime
+						    );
+  } else
+#endif
+    theHit = new( (*fHits)[GetNhits()] ) WireHit( iw,
+						  pos,
+						  0,
+						  time,
+						  res,
+						  this
+						  );
+  return theHit;
+}
+
+//_____________________________________________________________________________
+Int_t WirePlane::DecodeHits()
+{
+  // Finish decoding of hits added directly. In addition to sorting, as
+  // for any plane, compute the drift distances from the drift times.
+
+  Int_t nHits = Plane::DecodeHits();
+  if( !IsDummy() )
+    ConvertTimesToDist( 0.0 );
+
+  return nHits;
+}
+
 //_____________________________________________________________________________
 Int_t WirePlane::Decode( const THaEvData& evData )
 {
   // Convert evData to hits
 
-  if( IsDummy() )
-    // Special "decoding" for dummy planes
+  if( IsDummy() or HasExtInput() )
+    // Special "decoding" for dummy planes and hits added directly
     return DummyDecode( evData );
 
   return WireDecode( evData );
@@ -336,6 +554,9 @@ Int_t WirePlane::DefineVariables( EMode mode )
   // initialize global variables
 
 
+  // No variables for clones (see Tracker::MakeClone)
+  if( fTracker->IsClone() ) return kOK;
+
   if( mode == kDefine && fIsSetup ) return kOK;
   fIsSetup = ( mode == kDefine );
 
@@ -431,6 +652,10 @@ Int_t WirePlane::ReadDatabase( const TDatime& date )
   // Default values for optional parameters
   fMinTime = -kBig;
   fMaxTime =  kBig;
+  Int_t ttd_table = 0, ttd_table_nt = 1024, ttd_table_ns = 64;
+  Double_t ttd_table_tmax = -kBig, ttd_table_smax = 3.0;
+  Double_t ttd_table_maxerr = 1e-6;
+  Int_t counting_sort = 0;
   try {
     // Putting this container on the stack may cause a stack overflow
     ttd_param = new vector<double>;
@@ -445,6 +670,13 @@ Int_t WirePlane::ReadDatabase( const TDatime& date )
       { "tdc.offsets",   &fTDCOffset,   kFloatV,  0, 0 },
       { "drift.min",     &fMinTime,     kDouble,  0, 1, gbl },
       { "drift.max",     &fMaxTime,     kDouble,  0, 1, gbl },
+      { "ttd.table",     &ttd_table,    kInt,     0, 1, gbl },
+      { "ttd.table.nt",  &ttd_table_nt, kInt,     0, 1, gbl },
+      { "ttd.table.ns",  &ttd_table_ns, kInt,     0, 1, gbl },
+      { "ttd.table.tmax",&ttd_table_tmax, kDouble, 0, 1, gbl },
+      { "ttd.table.smax",&ttd_table_smax, kDouble, 0, 1, gbl },
+      { "ttd.table.maxerr",&ttd_table_maxerr, kDouble, 0, 1, gbl },
+      { "counting_sort", &counting_sort, kInt,    0, 1, gbl },
       { 0 }
     };
     status = LoadDB( file, date, request, fPrefix );
@@ -460,6 +692,8 @@ Int_t WirePlane::ReadDatabase( const TDatime& date )
   if( status != kOK )
     return status;
 
+  SetBit( kCountingSort, counting_sort );
+
   // Dummy planes ignore all of the parameters that are checked below,
   // so we can return right here.
   if( IsDummy() ) {
@@ -485,6 +719,7 @@ Int_t WirePlane::ReadDatabase( const TDatime& date )
       status = kInitError;
       goto ttderr;
     }
+    delete fTTDConv;
     fTTDConv = static_cast<TimeToDistConv*>( cl->New() );
     if( !fTTDConv ) {
       Error( Here(here), "Unexpected error creating drift time-to-distance "
@@ -528,6 +763,49 @@ ttderr:
   if( fMinTime > -kBig )  fMinTime *= kTDCscale;
   if( fMaxTime <  kBig )  fMaxTime *= kTDCscale;
 
+  // Replace the drift time-to-distance converter with a lookup table of
+  // itself, if requested. The table covers drift times from 0 or drift.min
+  // up to ttd.table.tmax or drift.max.
+  if( ttd_table != 0 ) {
+    TableTTD::EInterpolation interp;
+    if( ttd_table == 1 )
+      interp = TableTTD::kLinear;
+    else if( ttd_table == 3 )
+      interp = TableTTD::kCubic;
+    else {
+      Error( Here(here), "Invalid ttd.table = %d. Must be 0 (off), "
+	     "1 (linear) or 3 (cubic interpolation). Fix database.",
+	     ttd_table );
+      return kInitError;
+    }
+    Double_t tmin = ( fMinTime > -kBig ) ? fMinTime : 0.0;
+    Double_t tmax = ( ttd_table_tmax > -kBig ) ?
+      ttd_table_tmax*kTDCscale : fMaxTime;
+    if( tmax >= kBig ) {
+      Error( Here(here), "Drift time-to-distance table requires ttd.table.tmax"
+	     " or drift.max. Fix database." );
+      return kInitError;
+    }
+    TableTTD* table = new TableTTD( fTTDConv );
+    fTTDConv = table;
+    if( ttd_table_nt < 2 or ttd_table_ns < 2 or
+	table->Tabulate( tmin, tmax, ttd_table_nt, ttd_table_smax,
+			 ttd_table_ns, interp ) != 0 ) {
+      Error( Here(here), "Invalid drift time-to-distance table parameters: "
+	     "nt = %d, ns = %d, t = %lf-%lf ns, smax = %lf. Fix database.",
+	     ttd_table_nt, ttd_table_ns, tmin/kTDCscale, tmax/kTDCscale,
+	     ttd_table_smax );
+      return kInitError;
+    }
+    if( table->GetMaxError() > ttd_table_maxerr )
+      Warning( Here(here), "Drift time-to-distance table interpolation error "
+	       "up to %lg m, exceeds ttd.table.maxerr = %lg m. Consider more "
+	       "grid points.", table->GetMaxError(), ttd_table_maxerr );
+    else if( fDebug > 0 )
+      Info( Here(here), "Drift time-to-distance table max interpolation "
+	    "error = %lg m", table->GetMaxError() );
+  }
+
   fIsInit = true;
   return kOK;
 }
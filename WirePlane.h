@@ -15,6 +15,7 @@
 namespace TreeSearch {
 
   class TimeToDistConv;
+  class WireHit;
 
   class WirePlane : public Plane {
 
@@ -30,7 +31,9 @@ namespace TreeSearch {
 
     virtual Double_t GetMaxLRdist() const { return GetPitch(); }
     virtual Hit*     FindNearestHitAndPos( Double_t x, Double_t& pos ) const;
-
+    virtual Hit*     AddSimHit( Double_t pos, Double_t slope, TRandom& rnd );
+    virtual Int_t    DecodeHits();
+    virtual Bool_t   CanUseDispatch() const { return !IsDummy(); }
 
     TimeToDistConv*  GetTTDConv()   const { return fTTDConv; }
 
@@ -39,6 +42,7 @@ namespace TreeSearch {
 #endif
 
   protected:
+    friend class BenchAccess;  // Benchmarks (tsbench)
 
     // Parameters, calibration, flags
 
@@ -47,6 +51,18 @@ namespace TreeSearch {
 
     TimeToDistConv* fTTDConv;   // Drift time->distance converter
     Vflt_t          fTDCOffset; // [fNelem] TDC offsets for each wire
+    std::vector<Double_t> fTimeBuf; //! Drift times for batch conversion
+    std::vector<Double_t> fDistBuf; //! Drift distances from batch conversion
+
+    // Working storage for CountingSortHits
+    struct SortHit_t {
+      Int_t    iw;    // Wire number
+      Int_t    data;  // Raw TDC data
+      Double_t time;  // Drift time (s)
+    };
+    std::vector<SortHit_t> fSortIn;    //! Hit data in decoding order
+    std::vector<SortHit_t> fSortOut;   //! Hit data in sorted order
+    std::vector<UInt_t>    fSortCount; //! [fNelem+1] Bin offsets per wire
 
     // Only needed for TESTCODE, but kept for binary compatibility
     UInt_t          fNmiss;     // Statistics: Decoder channel misses
@@ -61,12 +77,23 @@ namespace TreeSearch {
 
     // Support functions for dummy planes
     virtual Hit*  AddHitImpl( Double_t x );
+    virtual Hit*  AddExtHit( Double_t pos, Double_t res, Double_t time,
+			     const MCHitTruth_t* mc );
     virtual Int_t WireDecode( const THaEvData& );
+    void          ConvertTimesToDist( Double_t slope );
+    void          CountingSortHits();
+    WireHit*      MakeHit( Int_t iw, Int_t data, Double_t time,
+			   UInt_t& nHits );
 
     // Podd interface
     virtual Int_t ReadDatabase( const TDatime& date );
     virtual Int_t DefineVariables( EMode mode = kDefine );
 
+    // Bits for WirePlanes
+    enum {
+      kCountingSort = BIT(16)  // Sort unordered hits with CountingSortHits
+    };
+
     ClassDef(WirePlane,0)      // One MWDC wire plane
   };
 
@@ -0,0 +1,1362 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// tsbench                                                                   //
+//                                                                           //
+// Benchmarks for the TreeSearch tracking core. Built with "make bench".     //
+//                                                                           //
+// Each benchmark runs a kernel of the tracking chain on pre-generated       //
+// random input at several occupancies (hits per plane) and tree depths,     //
+// and times every iteration with the ReadClock() cycle counter. Results     //
+// are written as one JSON object per line, e.g.                             //
+//                                                                           //
+//  {"bench":"treewalk","depth":10,"occ":4,"iter":2000,"mean_ns":...,        //
+//   "p50_ns":...,"p99_ns":...,"max_ns":...,"work":...}                      //
+//                                                                           //
+// "work" is a benchmark-specific average amount of work per iteration       //
+// (e.g. patterns found), to check that the benchmarks do what they should.  //
+//                                                                           //
+// With -e type:name, the full tracking chain (DecodeHits, CoarseTrack,      //
+// FineTrack) of a tracker of the given type (mwdc or gem) is run on events  //
+// from the EventGenerator at several noise levels. The database of the      //
+// tracker (e.g. db_B.mwdc.dat for mwdc:B.mwdc) must be found in the current //
+// directory or DB_DIR. Per-stage percentiles from the tracker's stage       //
+// statistics are written as well. As a consistency check, each projection   //
+// must find patterns in most of the events without noise.                   //
+//                                                                           //
+// The same tracker is used to time the steps of coarse tracking separately  //
+// (Road::Fit, MatchRoads with each matching algorithm, MakeRoads, and       //
+// OptimalN de-ghosting), the scaling of fast 3D matching with and without   //
+// the road grid from 10 to 1000 roads per projection, and the counting sort //
+// of wire hits against TClonesArray::Sort. These benchmarks access library  //
+// internals via the BenchAccess friend class. They check that the grid and  //
+// the sorted road lookup, and both hit sorts, give the same results.        //
+// De-ghosting by exact packing is checked against OptimalN on small sets    //
+// of track candidates.                                                      //
+//                                                                           //
+// For GEM trackers, the strip analysis and clustering of GEM decoding is    //
+// run on synthetic CR-RC strip pulses. It checks that exactly the clusters  //
+// within each plane's time window become hits, at the right positions and   //
+// times. db_B.gem.dat is a sample GEM database for this (gem:B.gem).        //
+//                                                                           //
+// The APV25 deconvolution benchmark checks the recovered pulse amplitudes   //
+// and peak times against the analytic CR-RC pulses it deconvolutes. The     //
+// hit pairing benchmark checks the exact pairs found for runs of hits that  //
+// match more than one hit in the partner plane.                             //
+//                                                                           //
+// Failed checks are reported on stderr and make tsbench exit with status 3. //
+// "make check" runs the checks with few iterations.                         //
+//                                                                           //
+// Usage: tsbench [-o file] [-n niter] [-s seed] [-b name] [-e type:name]    //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Instrument.h"
+#include "Helper.h"
+#include "Hit.h"
+#include "Hitpattern.h"
+#include "PatternGenerator.h"
+#include "PatternTree.h"
+#include "TreeWalk.h"
+#include "Node.h"
+#include "TimeToDistConv.h"
+#include "APVDeconv.h"
+#include "EventGenerator.h"
+#include "Tracker.h"
+#include "Projection.h"
+#include "Road.h"
+#include "WirePlane.h"
+#include "WireHit.h"
+#include "MWDC.h"
+#include "GEMTracker.h"
+#include "GEMPlane.h"
+#include "GEMHit.h"
+
+#include "THaGlobals.h"
+#include "THaVarList.h"
+#include "TClonesArray.h"
+#include "TDatime.h"
+
+#include "TRandom3.h"
+#include "TMath.h"
+#include "TString.h"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <list>
+#include <set>
+#include <algorithm>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+using namespace std;
+using namespace TreeSearch;
+
+// Test geometry, loosely modeled after one projection of the BigBite MWDC:
+// six planes over 0.8 m in z, 1.4 m wide
+static const UInt_t   kNplanes  = 6;
+static const Double_t kZpos[kNplanes] = { 0.0, 0.01, 0.35, 0.36, 0.79, 0.80 };
+static const Double_t kWidth    = 1.4;
+static const Double_t kMaxSlope = 2.5;
+static const Double_t kRes      = 385e-6;
+
+// Number of distinct random events generated per configuration
+static const UInt_t kNevents = 256;
+
+static const UInt_t kOccupancies[] = { 1, 4, 16, 64 };
+static const UInt_t kNocc = sizeof(kOccupancies)/sizeof(kOccupancies[0]);
+
+// Number of failed consistency checks
+static UInt_t gNfail = 0;
+
+//_____________________________________________________________________________
+static void Check( bool ok, const char* what )
+{
+  // Report a failed consistency check
+
+  if( !ok ) {
+    cerr << "Check failed: " << what << endl;
+    ++gNfail;
+  }
+}
+
+//_____________________________________________________________________________
+class Bench {
+  // Timing harness. Collects the iteration times of one benchmark
+  // configuration and writes the summary as one line of JSON.
+public:
+  Bench( ostream& os, const char* name )
+    : fOs(os), fName(name), fWork(0)
+  { fStats.AddStage(name); }
+  void Begin() { fStart = ReadClock(); }
+  void End()   { fStats.Record( 0, ReadClock()-fStart ); }
+  void AddWork( Double_t w ) { fWork += w; }
+  void Write( const char* params );
+private:
+  ostream&    fOs;
+  string      fName;
+  StageStats  fStats;
+  ULong64_t   fStart;
+  Double_t    fWork;
+};
+
+//_____________________________________________________________________________
+void Bench::Write( const char* params )
+{
+  // Write results. 'params' is a list of additional JSON fields.
+
+  const LatencyHist& h = fStats.GetHist(0);
+  ULong64_t n = h.GetEntries();
+  fOs << "{\"bench\":\"" << fName << "\"," << params
+      << ",\"iter\":" << n << fixed << setprecision(1)
+      << ",\"mean_ns\":" << 1e3*ClockToUs(h.GetMean())
+      << ",\"p50_ns\":"  << 1e3*fStats.GetQuantile(0,0.5)
+      << ",\"p99_ns\":"  << 1e3*fStats.GetQuantile(0,0.99)
+      << ",\"max_ns\":"
+      << 1e3*ClockToUs(static_cast<Double_t>(h.GetMax()))
+      << setprecision(3)
+      << ",\"work\":" << (n ? fWork/n : 0) << "}" << endl;
+  fOs.unsetf( ios::floatfield );
+}
+
+//_____________________________________________________________________________
+struct BenchEvent_t {
+  // Hit positions per plane, sorted, each from a straight track or noise
+  vector<Double_t> pos[kNplanes];
+};
+
+//_____________________________________________________________________________
+static void MakeEvents( TRandom3& rnd, UInt_t occ, vector<BenchEvent_t>& evts )
+{
+  // Generate events with one track within the acceptance plus
+  // uniformly distributed noise hits, occ hits per plane in total.
+  // Positions are relative to the center of the planes.
+
+  evts.assign( kNevents, BenchEvent_t() );
+  Double_t dz = kZpos[kNplanes-1]-kZpos[0];
+  for( UInt_t i = 0; i < kNevents; ++i ) {
+    Double_t x0 = rnd.Uniform( -0.4*kWidth, 0.4*kWidth );
+    Double_t x1 = rnd.Uniform( -0.4*kWidth, 0.4*kWidth );
+    Double_t slope = TMath::Max( -kMaxSlope,
+				 TMath::Min( kMaxSlope, (x1-x0)/dz ));
+    for( UInt_t k = 0; k < kNplanes; ++k ) {
+      vector<Double_t>& pos = evts[i].pos[k];
+      pos.push_back( x0 + slope*(kZpos[k]-kZpos[0]) + rnd.Gaus(0,kRes) );
+      while( pos.size() < occ )
+	pos.push_back( rnd.Uniform(-0.5*kWidth,0.5*kWidth) );
+      sort( pos.begin(), pos.end() );
+    }
+  }
+}
+
+//_____________________________________________________________________________
+static PatternTree* MakeTree( UInt_t depth )
+{
+  // Build the pattern tree for the test geometry
+
+  vector<Double_t> zpos( kZpos, kZpos+kNplanes );
+  TreeParam_t param( depth, kWidth, kMaxSlope, zpos );
+  PatternGenerator gen;
+  return gen.Generate( param );
+}
+
+//_____________________________________________________________________________
+static void FillHitpattern( Hitpattern& hp, const BenchEvent_t& evt, Hit* hit )
+{
+  // Set the hitpattern bins for all hits in evt, as Hitpattern::Fill does
+
+  hp.Clear();
+  for( UInt_t k = 0; k < kNplanes; ++k ) {
+    const vector<Double_t>& pos = evt.pos[k];
+    for( vector<Double_t>::size_type j = 0; j < pos.size(); ++j )
+      hp.SetPosition( pos[j]+hp.GetOffset(), kRes, k, hit );
+  }
+}
+
+//_____________________________________________________________________________
+class MatchPattern : public NodeVisitor {
+  // Count patterns contained in the hitpattern with at most one plane
+  // missing, like Projection::ComparePattern with maxmiss = 1
+public:
+  MatchPattern( const Hitpattern* hp ) : fHitpattern(hp), fNmatch(0) {}
+  virtual ETreeOp operator() ( const NodeDescriptor& nd )
+  {
+    pair<UInt_t,UInt_t> match = fHitpattern->ContainsPattern(nd);
+    if( match.second+1 < fHitpattern->GetNplanes() )
+      return kSkipChildNodes;
+    if( nd.depth < fHitpattern->GetNlevels()-1 )
+      return kRecurse;
+    ++fNmatch;
+    return kSkipChildNodes;
+  }
+  UInt_t GetNmatch() const { return fNmatch; }
+private:
+  const Hitpattern* fHitpattern;
+  UInt_t            fNmatch;
+};
+
+//_____________________________________________________________________________
+static void BenchHitpattern( ostream& os, TRandom3& rnd, UInt_t niter )
+{
+  // Hitpattern filling, including recording the hits of each bin
+
+  static const UInt_t depths[] = { 8, 10, 12, 14 };
+  Hit hit;
+  vector<BenchEvent_t> evts;
+  for( UInt_t id = 0; id < sizeof(depths)/sizeof(depths[0]); ++id ) {
+    Hitpattern hp( depths[id]+1, kNplanes, kWidth );
+    for( UInt_t io = 0; io < kNocc; ++io ) {
+      MakeEvents( rnd, kOccupancies[io], evts );
+      Bench b( os, "hitpattern_fill" );
+      for( UInt_t i = 0; i < niter; ++i ) {
+	b.Begin();
+	FillHitpattern( hp, evts[i%kNevents], &hit );
+	b.End();
+	b.AddWork( hp.GetNhits() );
+      }
+      b.Write( Form("\"depth\":%u,\"occ\":%u", depths[id], kOccupancies[io]) );
+    }
+  }
+}
+
+//_____________________________________________________________________________
+static void BenchTreeWalk( ostream& os, TRandom3& rnd, UInt_t niter )
+{
+  // Tree search: walk the pattern tree and compare with the hitpattern
+
+  static const UInt_t depths[] = { 6, 8, 10 };
+  Hit hit;
+  vector<BenchEvent_t> evts;
+  for( UInt_t id = 0; id < sizeof(depths)/sizeof(depths[0]); ++id ) {
+    PatternTree* tree = MakeTree( depths[id] );
+    if( !tree ) {
+      cerr << "Error building pattern tree of depth " << depths[id] << endl;
+      continue;
+    }
+    Hitpattern hp( *tree );
+    TreeWalk walk( tree->GetNlevels() );
+    for( UInt_t io = 0; io < kNocc; ++io ) {
+      MakeEvents( rnd, kOccupancies[io], evts );
+      Bench b( os, "treewalk" );
+      for( UInt_t i = 0; i < niter; ++i ) {
+	FillHitpattern( hp, evts[i%kNevents], &hit );
+	MatchPattern match( &hp );
+	b.Begin();
+	walk( tree->GetRoot(), match );
+	b.End();
+	b.AddWork( match.GetNmatch() );
+      }
+      b.Write( Form("\"depth\":%u,\"occ\":%u", depths[id], kOccupancies[io]) );
+    }
+    delete tree;
+  }
+}
+
+//_____________________________________________________________________________
+static void BenchFit4( ostream& os, TRandom3& rnd, UInt_t niter )
+{
+  // Straight-line 3D track fit, as done in Tracker::FitTrack: fill and
+  // solve the normal equations for npoints points in planes with four
+  // different projection angles
+
+  static const UInt_t npts[] = { 8, 12, 24 };
+  static const Double_t angles[] = { 0.0, 60.0, -60.0, 90.0 };
+  for( UInt_t ip = 0; ip < sizeof(npts)/sizeof(npts[0]); ++ip ) {
+    UInt_t n = npts[ip];
+    vector<Double_t> A(4*n), y(n*kNevents);
+    for( UInt_t j = 0; j < n; ++j ) {
+      Double_t a = angles[j%4]*TMath::DegToRad(), z = 0.1*j;
+      Double_t Aj[4] = { TMath::Cos(a), z*TMath::Cos(a),
+			 TMath::Sin(a), z*TMath::Sin(a) };
+      copy( Aj, Aj+4, &A[4*j] );
+    }
+    for( UInt_t i = 0; i < kNevents; ++i ) {
+      Double_t b[4] = { rnd.Uniform(-0.5,0.5), rnd.Uniform(-1,1),
+			rnd.Uniform(-0.2,0.2), rnd.Uniform(-0.2,0.2) };
+      for( UInt_t j = 0; j < n; ++j )
+	y[n*i+j] = A[4*j]*b[0] + A[4*j+1]*b[1] + A[4*j+2]*b[2] +
+	  A[4*j+3]*b[3] + rnd.Gaus(0,kRes);
+    }
+    Bench b( os, "fit4" );
+    Double_t w = 1.0/(kRes*kRes);
+    for( UInt_t i = 0; i < niter; ++i ) {
+      const Double_t* yi = &y[n*(i%kNevents)];
+      Double_t coef[4];
+      b.Begin();
+      NormalEq4 eq;
+      for( UInt_t j = 0; j < n; ++j )
+	eq.Add( &A[4*j], yi[j], w );
+      bool ok = eq.Solve( coef );
+      b.End();
+      b.AddWork( ok ? 1 : 0 );
+    }
+    b.Write( Form("\"npoints\":%u", n) );
+  }
+}
+
+//_____________________________________________________________________________
+static void BenchTimeToDist( ostream& os, TRandom3& rnd, UInt_t niter )
+{
+  // Drift time to distance conversion of the hits of one wire plane,
+  // exact (TanhFitTTD) and with lookup tables
+
+  static const Double_t par[] = { 5.02e4, 5e-3, 1.95e11, 6.1e-9 };
+  const Double_t tmax = 200e-9;
+  vector<Double_t> param( par, par+4 );
+  for( UInt_t itype = 0; itype < 3; ++itype ) {
+    TimeToDistConv* conv = new TanhFitTTD;
+    conv->SetParameters( param );
+    const char* name = "ttd_exact";
+    if( itype > 0 ) {
+      TableTTD* table = new TableTTD( conv );
+      TableTTD::EInterpolation interp =
+	(itype == 1) ? TableTTD::kLinear : TableTTD::kCubic;
+      if( table->Tabulate( 0, tmax, 1024, 3.0, 64, interp ) != 0 ) {
+	cerr << "Error tabulating time-to-distance conversion" << endl;
+	delete table;
+	continue;
+      }
+      conv = table;
+      name = (itype == 1) ? "ttd_table_linear" : "ttd_table_cubic";
+    }
+    for( UInt_t io = 0; io < kNocc; ++io ) {
+      UInt_t n = kOccupancies[io];
+      vector<Double_t> time(n*kNevents), slope(kNevents), dist(n);
+      for( UInt_t i = 0; i < n*kNevents; ++i )
+	time[i] = rnd.Uniform( 0, tmax );
+      for( UInt_t i = 0; i < kNevents; ++i )
+	slope[i] = rnd.Uniform( -kMaxSlope, kMaxSlope );
+      Bench b( os, name );
+      for( UInt_t i = 0; i < niter; ++i ) {
+	UInt_t ie = i%kNevents;
+	b.Begin();
+	conv->ConvertTimesToDist( n, &time[n*ie], slope[ie], &dist[0] );
+	b.End();
+	b.AddWork( n );
+      }
+      b.Write( Form("\"occ\":%u", n) );
+    }
+    delete conv;
+  }
+}
+
+//_____________________________________________________________________________
+static void CheckHitPairs()
+{
+  // Check the exact pair sequence of HitPairIter for two runs of hits in
+  // plane B that each match two hits in A. After the scan of a run with
+  // the first A hit, B must be rewound to the start of the run, so that
+  // the second A hit is paired with all hits of the run, too. (A rewind
+  // to one past the start would lose the pairs (1,1) and (3,4).) Unpaired
+  // hits in either plane come with index -1 for the other plane.
+
+  static const Double_t posA[] = { 0.0, 0.3, 3.0, 3.2, 6.0 };
+  static const Double_t posB[] = { -2.0, 0.1, 0.2, 0.34, 3.05, 3.1, 3.3,
+				   9.0 };
+  static const Int_t expect[][2] = {
+    {-1,0}, {0,1}, {0,2}, {0,3}, {1,1}, {1,2}, {1,3}, {2,4}, {2,5}, {2,6},
+    {3,4}, {3,5}, {3,6}, {4,-1}, {-1,7}
+  };
+  const UInt_t nA = sizeof(posA)/sizeof(posA[0]);
+  const UInt_t nB = sizeof(posB)/sizeof(posB[0]);
+  const UInt_t nexp = sizeof(expect)/sizeof(expect[0]);
+
+  HitPairIter it( nA, posA, posA, nB, posB, posB, 0.35 );
+  UInt_t n = 0;
+  bool good = true;
+  Int_t ia, ib;
+  while( it.Next(ia,ib) ) {
+    if( n >= nexp or ia != expect[n][0] or ib != expect[n][1] )
+      good = false;
+    ++n;
+  }
+  Check( good and n == nexp, "hitpairs: wrong pair sequence for runs of "
+	 "multiply matched hits" );
+}
+
+//_____________________________________________________________________________
+static void BenchHitPairs( ostream& os, TRandom3& rnd, UInt_t niter )
+{
+  // Pairing of the hits of partner planes, as in HitpatternLR::ScanHits
+
+  CheckHitPairs();
+
+  vector<BenchEvent_t> evts;
+  for( UInt_t io = 0; io < kNocc; ++io ) {
+    UInt_t n = kOccupancies[io];
+    MakeEvents( rnd, n, evts );
+    vector<Double_t> range[4];
+    for( UInt_t j = 0; j < 4; ++j )
+      range[j].resize( n*kNevents );
+    for( UInt_t i = 0; i < kNevents; ++i ) {
+      for( UInt_t j = 0; j < n; ++j ) {
+	// Planes 0 and 1 are partners; L/R ranges of the drift distances
+	range[0][n*i+j] = evts[i].pos[0][j] - 0.01;
+	range[1][n*i+j] = evts[i].pos[0][j] + 0.01;
+	range[2][n*i+j] = evts[i].pos[1][j] - 0.01;
+	range[3][n*i+j] = evts[i].pos[1][j] + 0.01;
+      }
+    }
+    Bench b( os, "hitpairs" );
+    for( UInt_t i = 0; i < niter; ++i ) {
+      UInt_t k = n*(i%kNevents), npairs = 0;
+      Int_t ia, ib;
+      b.Begin();
+      HitPairIter it( n, &range[0][k], &range[1][k],
+		      n, &range[2][k], &range[3][k], 0.02 );
+      while( it.Next(ia,ib) )
+	++npairs;
+      b.End();
+      b.AddWork( npairs );
+    }
+    b.Write( Form("\"occ\":%u", n) );
+  }
+}
+
+//_____________________________________________________________________________
+static void BenchDeconv( ostream& os, TRandom3& rnd, UInt_t niter )
+{
+  // APV25 deconvolution of a batch of strips with sampled CR-RC pulses
+  // A*(t-t0)/Tp*exp(1-(t-t0)/Tp). Checks the recovered amplitudes and peak
+  // times against the true ones for start times t0 across the range that
+  // can be resolved, -delta_t < t0 <= (nsamp-2)*delta_t, including pulses
+  // starting exactly at a sample.
+
+  static const UInt_t nsamps[] = { 3, 6 };
+  const Float_t dt = 25.0, tp = 50.0;
+  const UInt_t n = 512;  // Strips per batch
+  for( UInt_t is = 0; is < sizeof(nsamps)/sizeof(nsamps[0]); ++is ) {
+    UInt_t ns = nsamps[is];
+    APVDeconv deconv;
+    deconv.Init( ns, dt, tp );
+    vector<Float_t> samp(ns*n), dec(ns*n), A(n), t0(n), integral(n),
+      ampl(n), peak(n);
+    vector<Int_t> ipk(n);
+    vector<Float_t*> row(ns), drow(ns);
+    for( UInt_t i = 0; i < ns; ++i ) {
+      row[i]  = &samp[i*n];
+      drow[i] = &dec[i*n];
+    }
+    for( UInt_t k = 0; k < n; ++k ) {
+      A[k]  = rnd.Uniform( 50, 2000 );
+      t0[k] = ( k+1 < ns ) ? k*dt : (ns-1)*dt*(k+0.5)/n - dt;
+      for( UInt_t i = 0; i < ns; ++i ) {
+	Double_t t = (i*dt - t0[k])/tp;
+	samp[i*n+k] = ( t > 0 ) ? A[k]*t*TMath::Exp(1-t) : 0;
+      }
+    }
+    Bench b( os, "apv_deconv" );
+    for( UInt_t i = 0; i < niter; ++i ) {
+      b.Begin();
+      deconv.Process( n, &row[0], &drow[0], &ipk[0], &integral[0],
+		      &ampl[0], &peak[0] );
+      b.End();
+      b.AddWork( n );
+    }
+    b.Write( Form("\"nsamp\":%u,\"strips\":%u", ns, n) );
+
+    Double_t max_da = 0, max_dt = 0;
+    for( UInt_t k = 0; k < n; ++k ) {
+      max_da = TMath::Max( max_da, TMath::Abs(ampl[k]-A[k])/A[k] );
+      max_dt = TMath::Max( max_dt, TMath::Abs(peak[k]-(t0[k]+tp)) );
+    }
+    Check( max_da < 1e-3, Form("apv_deconv nsamp=%u: amplitude off by %g%%",
+			       ns, 100*max_da) );
+    Check( max_dt < 0.1, Form("apv_deconv nsamp=%u: peak time off by %g ns",
+			      ns, max_dt) );
+  }
+}
+
+// Noise levels (mean noise hits per plane) of the tracker benchmarks
+static const Double_t kNoise[] = { 0, 1, 4, 16 };
+static const UInt_t kNnoise = sizeof(kNoise)/sizeof(kNoise[0]);
+
+typedef list< pair<Double_t,Rvec_t> > Combos_t;
+
+// Raw data of a decoded wire hit
+struct WireHitData_t {
+  Int_t    iw;    // Wire number
+  Int_t    data;  // Raw TDC data
+  Double_t time;  // Drift time (s)
+};
+
+//_____________________________________________________________________________
+namespace TreeSearch {
+class BenchAccess {
+  // Access to library internals for benchmarking individual steps of the
+  // tracking chain. Friend of Tracker, Projection, Road, WirePlane and
+  // GEMPlane.
+public:
+  static void ResetRoads( Projection* proj )
+  {
+    // Delete the roads of proj and mark all its patterns as unused, so that
+    // MakeRoads can be run again on the patterns found
+    proj->fRoads->Delete();
+    if( proj->TestBit(Projection::kEventDisplay) )
+      proj->fRoadCorners->Clear();
+    Projection::NodeVec_t& pats = proj->fPatternsFound;
+    for( Projection::NodeVec_t::iterator it = pats.begin(); it != pats.end();
+	 ++it )
+      (*it)->second.used = 0;
+  }
+  static UInt_t MatchRoads( Tracker* tracker, vector<Rvec_t>& roads,
+			    Bool_t grid, Combos_t& combos, Rset_t& unique )
+  {
+    // Tracker::MatchRoads, with or without the tracker's road grid
+    RoadGrid* saved = tracker->fRoadGrid;
+    if( !grid )
+      tracker->fRoadGrid = 0;
+    UInt_t nfound = tracker->MatchRoads( roads, combos, unique );
+    tracker->fRoadGrid = saved;
+    return nfound;
+  }
+  static UInt_t MatchGeneric( Tracker* tracker, vector<Rvec_t>& roads,
+			      UInt_t ncombos, Combos_t& combos, Rset_t& unique )
+  {
+    // Generic 3D matching, testing all ncombos road combinations
+    combos.clear();
+    unique.clear();
+    return tracker->MatchRoadsGeneric( roads, ncombos, combos, unique );
+  }
+  static UInt_t MatchFast3D( Tracker* tracker, vector<Rvec_t>& roads,
+			     Bool_t grid, Combos_t& combos, Rset_t& unique )
+  {
+    // Fast 3D matching, with or without the tracker's road grid
+    combos.clear();
+    unique.clear();
+    RoadGrid* saved = tracker->fRoadGrid;
+    if( !grid )
+      tracker->fRoadGrid = 0;
+    UInt_t nfound = tracker->MatchRoadsFast3D( roads, 0, combos, unique );
+    tracker->fRoadGrid = saved;
+    return nfound;
+  }
+  static Bool_t SetGridMatch( Tracker* tracker, Bool_t enable )
+  {
+    // Set up the road grid as with 3d_gridmatch = enable. Returns the
+    // previous setting.
+    Bool_t was = tracker->f3dGridMatch;
+    tracker->f3dGridMatch = enable;
+    tracker->SetupRoadGrid();
+    return was;
+  }
+  static UInt_t SetMaxExactPack( Tracker* tracker, UInt_t n )
+  {
+    // Set the maximum number of track candidates for exact de-ghosting
+    // (0 = always OptimalN). Returns the previous setting.
+    swap( tracker->fMaxExactPack, n );
+    return n;
+  }
+  static void SelectTracks( Tracker* tracker, vector<Rvec_t>& tuples,
+			    const vector<Int_t>& ndof,
+			    const vector<Double_t>& chi2, Bool_t exact,
+			    vector<UInt_t>& picks )
+  {
+    // De-ghost the 3D track candidates made of the given road tuples,
+    // with the given fit ndof and chi2, either exactly or with OptimalN.
+    // Returns the indices of the selected candidates in ascending order.
+    vector<Tracker::FitRes_t> fits( tuples.size() );
+    vector<const Tracker::FitRes_t*> cands, sel;
+    Rset_t unique;
+    UInt_t types = 0;
+    for( vector<Rvec_t>::size_type i = 0; i < tuples.size(); ++i ) {
+      fits[i].coef.assign( 4, 0 );
+      fits[i].matchval = 0;
+      fits[i].chi2  = chi2[i];
+      fits[i].ndof  = ndof[i];
+      fits[i].roads = &tuples[i];
+      cands.push_back( &fits[i] );
+      for( Rvec_t::iterator it = tuples[i].begin(); it != tuples[i].end();
+	   ++it ) {
+	unique.insert( *it );
+	types |= 1U << (*it)->GetProjection()->GetType();
+      }
+    }
+    UInt_t maxexact = SetMaxExactPack( tracker, exact ? tuples.size() : 0 );
+    tracker->SelectTracks( cands, unique, types, sel );
+    SetMaxExactPack( tracker, maxexact );
+    picks.clear();
+    for( vector<const Tracker::FitRes_t*>::iterator it = sel.begin();
+	 it != sel.end(); ++it )
+      picks.push_back( *it - &fits[0] );
+    sort( picks.begin(), picks.end() );
+  }
+  static void AddHit( Road* rd, Hit* hit ) { rd->fHits.insert( hit ); }
+  static void SetRoad( Road* rd, Double_t pos, Double_t slope )
+  {
+    // Make rd a good road with the given fit results
+    rd->fPos   = pos;
+    rd->fSlope = slope;
+    rd->fChi2  = 0;
+    rd->fGood  = true;
+  }
+  static void SetHits( WirePlane* pl, const vector<WireHitData_t>& hits )
+  {
+    // Replace the hits of pl with the given hits, in the given order
+    pl->fHits->Clear();
+    UInt_t n = 0;
+    for( vector<WireHitData_t>::size_type i = 0; i < hits.size(); ++i )
+      pl->MakeHit( hits[i].iw, hits[i].data, hits[i].time, n );
+  }
+  static void CountingSortHits( WirePlane* pl ) { pl->CountingSortHits(); }
+  static void QuickSortHits( WirePlane* pl )    { pl->fHits->Sort(); }
+  static Int_t DecodeStrips( GEMPlane* pl, const vector<Int_t>& strips,
+			     const vector<Float_t>& samp, UInt_t nsamp )
+  {
+    // Clear pl and make its hits from the given strips, with nsamp ADC
+    // samples each (samp[i*nsamp+j] = sample j of strip i), as GEMDecode
+    // does for the strips read from the raw data
+    pl->Clear();
+    for( vector<Int_t>::size_type i = 0; i < strips.size(); ++i )
+      pl->AddStripData( strips[i], strips[i], 0, strips[i], nsamp,
+			&samp[i*nsamp] );
+    return pl->AnalyzeStrips( 0 );
+  }
+  static void GetStripParam( const GEMPlane* pl, UInt_t& nsamp,
+			     Double_t& dt, Double_t& tp, Double_t& amin,
+			     Double_t& tmin, Double_t& tmax )
+  {
+    // Strip analysis parameters of pl: number of samples analyzed,
+    // sampling interval and shaping time (ns), ADC threshold, and time
+    // window for clusters (ns)
+    nsamp = pl->fDeconvNsamp;
+    dt    = pl->fDeconvDt;
+    tp    = pl->fDeconvTp;
+    amin  = pl->fMinAmpl;
+    tmin  = pl->fMinTime;
+    tmax  = pl->fMaxTime;
+  }
+  static UInt_t GetNtimeRej( const GEMPlane* pl ) { return pl->fNtimeRej; }
+  static Bool_t SetCheckPulseShape( GEMPlane* pl, Bool_t enable )
+  {
+    // Enable or disable the pulse shape test of pl. Returns the previous
+    // setting.
+    Bool_t was = pl->TestBit(GEMPlane::kCheckPulseShape);
+    pl->SetBit( GEMPlane::kCheckPulseShape, enable );
+    return was;
+  }
+};
+}
+
+//_____________________________________________________________________________
+static Tracker* MakeTracker( const string& spec )
+{
+  // Create and initialize the tracker given by spec ("type:name")
+
+  string::size_type colon = spec.find(':');
+  string type = spec.substr( 0, colon );
+  string name = ( colon != string::npos ) ? spec.substr(colon+1) : "";
+  Tracker* tracker = 0;
+  if( type == "mwdc" )
+    tracker = new MWDC( name.c_str(), "Benchmark MWDC" );
+  else if( type == "gem" )
+    tracker = new GEMTracker( name.c_str(), "Benchmark GEM tracker" );
+  if( !tracker or name.empty() ) {
+    cerr << "Invalid tracker specification \"" << spec << "\". "
+	 << "Must be mwdc:name or gem:name" << endl;
+    delete tracker;
+    return 0;
+  }
+  // Podd objects define global variables during Init
+  if( !gHaVars )
+    gHaVars = new THaVarList;
+  if( tracker->Init(TDatime()) != THaAnalysisObject::kOK ) {
+    cerr << "Error initializing tracker " << name << endl;
+    delete tracker;
+    return 0;
+  }
+  return tracker;
+}
+
+//_____________________________________________________________________________
+static void WriteStage( ostream& os, const char* bench, const TString& params,
+			const StageStats& stats, UInt_t k )
+{
+  // Write the percentiles of stage k of the given stage statistics
+
+  Double_t pct[3];
+  stats.GetPercentiles( k, pct );
+  os << "{\"bench\":\"" << bench << "\"," << params
+     << ",\"stage\":\"" << stats.GetStageName(k) << "\""
+     << ",\"calls\":" << stats.GetEntries(k) << fixed << setprecision(1)
+     << ",\"p50_ns\":" << 1e3*pct[0] << ",\"p99_ns\":" << 1e3*pct[1]
+     << ",\"p999_ns\":" << 1e3*pct[2] << "}" << endl;
+  os.unsetf( ios::floatfield );
+}
+
+//_____________________________________________________________________________
+static void BenchTracking( ostream& os, Tracker* tracker, const string& spec,
+			   UInt_t niter, UInt_t seed )
+{
+  // Full tracking of synthetic events with the given tracker
+
+  TClonesArray tracks( "THaTrack", 10 );
+  EventGenerator gen( tracker, seed );
+  if( gen.Init() != 0 )
+    return;
+  for( UInt_t in = 0; in < kNnoise; ++in ) {
+    gen.SetNoise( kNoise[in] );
+    tracker->ResetStageStats();
+    Bench b( os, "tracking" );
+    // Events with patterns found, per projection type
+    UInt_t nwithpat[kTypeEnd] = { 0 };
+    for( UInt_t i = 0; i < niter; ++i ) {
+      tracker->Clear();
+      tracks.Clear("C");
+      gen.Generate();
+      b.Begin();
+      tracker->DecodeHits( i );
+      tracker->CoarseTrack( tracks );
+      tracker->FineTrack( tracks );
+      b.End();
+      b.AddWork( tracks.GetLast()+1 );
+      for( EProjType t = kTypeBegin; t < kTypeEnd; ++t ) {
+	Projection* proj = tracker->GetProjection(t);
+	if( proj and proj->GetNpatterns() > 0 )
+	  ++nwithpat[t];
+      }
+    }
+    TString params = Form( "\"tracker\":\"%s\",\"noise\":%g",
+			   spec.c_str(), kNoise[in] );
+    b.Write( params );
+    // Each generated track crosses all planes, so without noise, the
+    // tree search must find patterns in nearly every event
+    if( kNoise[in] == 0 ) {
+      for( EProjType t = kTypeBegin; t < kTypeEnd; ++t ) {
+	Projection* proj = tracker->GetProjection(t);
+	if( proj )
+	  Check( 2*nwithpat[t] > niter,
+		 Form("%s: patterns found in only %u of %u events",
+		      proj->GetPrefix(), nwithpat[t], niter) );
+      }
+    }
+    const StageStats& stats = tracker->GetStageStats();
+    for( UInt_t k = 0; k < stats.GetNstages(); ++k )
+      WriteStage( os, "tracking_stage", params, stats, k );
+  }
+}
+
+//_____________________________________________________________________________
+static void CheckDeghost( Tracker* tracker )
+{
+  // Check the selection of 3D tracks by exact packing against the greedy
+  // OptimalN on small sets of track candidates. Each candidate is made of
+  // road a of the first projection and road b of all others, where the
+  // roads have no hits in common, so candidates conflict only if they
+  // share roads. In the first three cases, the greedy choice is optimal
+  // and both must pick the same candidates. In the last one, the best
+  // candidate conflicts with two compatible ones, so that OptimalN keeps
+  // the single best track and exact packing the other two.
+
+  struct Case_t {
+    UInt_t   ncand;
+    UInt_t   a[4], b[4];  // Roads of first and other projections
+    Int_t    ndof[4];
+    Double_t chi2[4];
+    bool     agree;       // Exact and greedy must agree
+    UInt_t   nexact;      // Number of tracks expected from exact packing
+  };
+  static const Case_t cases[] = {
+    // Three independent tracks
+    { 3, {0,1,2}, {0,1,2}, {12,12,10}, {1,2,1}, true, 3 },
+    // Two tracks and two ghosts with fewer hits
+    { 4, {0,1,0,1}, {0,1,1,0}, {12,12,8,8}, {1,2,1,1}, true, 2 },
+    // Two conflicting candidates with equal ndof: lower chi2 wins
+    { 2, {0,0}, {0,1}, {12,12}, {5,1}, true, 1 },
+    // Best candidate conflicting with two compatible ones
+    { 3, {0,0,1}, {1,0,1}, {12,10,10}, {1,1,1}, false, 2 }
+  };
+  const UInt_t ncases = sizeof(cases)/sizeof(cases[0]);
+  const UInt_t kNroads = 3;
+
+  vector<Projection*> projs;
+  for( EProjType t = kTypeBegin; t < kTypeEnd; ++t ) {
+    Projection* proj = tracker->GetProjection(t);
+    if( proj )
+      projs.push_back( proj );
+  }
+  if( projs.size() < 2 )
+    return;
+  // kNroads roads per projection, each with a hit of its own
+  vector<Road*> roads;
+  vector<Hit*> hits;
+  for( vector<Projection*>::size_type p = 0; p < projs.size(); ++p ) {
+    for( UInt_t k = 0; k < kNroads; ++k ) {
+      Road* rd = new Road( projs[p] );
+      Hit* hit = new Hit( 0.1*k, kRes, projs[p]->GetPlane(0) );
+      BenchAccess::AddHit( rd, hit );
+      roads.push_back( rd );
+      hits.push_back( hit );
+    }
+  }
+
+  for( UInt_t ic = 0; ic < ncases; ++ic ) {
+    const Case_t& c = cases[ic];
+    vector<Rvec_t> tuples( c.ncand );
+    for( UInt_t i = 0; i < c.ncand; ++i ) {
+      tuples[i].push_back( roads[c.a[i]] );
+      for( vector<Projection*>::size_type p = 1; p < projs.size(); ++p )
+	tuples[i].push_back( roads[p*kNroads+c.b[i]] );
+    }
+    vector<Int_t> ndof( c.ndof, c.ndof+c.ncand );
+    vector<Double_t> chi2( c.chi2, c.chi2+c.ncand );
+    vector<UInt_t> exact, greedy;
+    BenchAccess::SelectTracks( tracker, tuples, ndof, chi2, true, exact );
+    BenchAccess::SelectTracks( tracker, tuples, ndof, chi2, false, greedy );
+    Check( exact.size() == c.nexact,
+	   Form("deghost case %u: exact packing found %u tracks, "
+		"expected %u", ic, (UInt_t)exact.size(), c.nexact) );
+    if( c.agree )
+      Check( exact == greedy, Form("deghost case %u: exact packing and "
+				   "OptimalN disagree", ic) );
+    else
+      Check( greedy.size() == 1 and greedy[0] == 0,
+	     Form("deghost case %u: OptimalN did not pick the best "
+		  "candidate only", ic) );
+  }
+
+  for( vector<Road*>::size_type i = 0; i < roads.size(); ++i ) {
+    delete roads[i];
+    delete hits[i];
+  }
+}
+
+//_____________________________________________________________________________
+static void BenchStages( ostream& os, Tracker* tracker, const string& spec,
+			 UInt_t niter, UInt_t seed )
+{
+  // Individual steps of coarse tracking of synthetic events, each rerun on
+  // the results of a full CoarseTrack: 2D road fits (Road::Fit), matching
+  // of the good roads in 3D with each available algorithm, and building
+  // the roads from the patterns found (Projection::MakeRoads). De-ghosting
+  // of the 3D track candidates is timed in CoarseTrack (stage "deghost"),
+  // forced to use OptimalN.
+
+  CheckDeghost( tracker );
+
+  // Skip generic matching of events with more road combinations than this
+  const Double_t kMaxGenericCombos = 1e5;
+
+  TClonesArray tracks( "THaTrack", 10 );
+  EventGenerator gen( tracker, seed );
+  if( gen.Init() != 0 )
+    return;
+  Bool_t fast3d = tracker->TestBit(Tracker::k3dFastMatch);
+  Bool_t gridmatch = BenchAccess::SetGridMatch( tracker, fast3d );
+  UInt_t maxexact = BenchAccess::SetMaxExactPack( tracker, 0 );
+  Combos_t combos;
+  Rset_t unique;
+  for( UInt_t in = 0; in < kNnoise; ++in ) {
+    gen.SetNoise( kNoise[in] );
+    tracker->ResetStageStats();
+    Bench bfit( os, "road_fit" ), bmatch( os, "matchroads" ),
+      bgeneric( os, "matchroads_generic" ),
+      bsorted( os, "matchroads_fast3d" ), bgrid( os, "matchroads_grid" ),
+      bmake( os, "makeroads" );
+    for( UInt_t i = 0; i < niter; ++i ) {
+      tracker->Clear();
+      tracks.Clear("C");
+      gen.Generate();
+      tracker->DecodeHits( i );
+      tracker->CoarseTrack( tracks );
+
+      // Refit the roads. Collect the good ones in order of ascending
+      // projection type, as CoarseTrack does
+      vector<Rvec_t> roads;
+      UInt_t nproj = 0;
+      Double_t ncombos = 1;
+      for( EProjType t = kTypeBegin; t < kTypeEnd; ++t ) {
+	Projection* proj = tracker->GetProjection(t);
+	if( !proj )
+	  continue;
+	++nproj;
+	Rvec_t good;
+	for( UInt_t k = 0; k < proj->GetNroads(); ++k ) {
+	  Road* rd = proj->GetRoad(k);
+	  bfit.Begin();
+	  rd->Fit();
+	  bfit.End();
+	  if( rd->IsGood() ) {
+	    bfit.AddWork( 1 );
+	    good.push_back( rd );
+	  }
+	}
+	if( !good.empty() ) {
+	  roads.push_back( good );
+	  ncombos *= good.size();
+	}
+      }
+
+      // Match the roads in 3D if all projections have some. The matching
+      // functions may reorder the road vectors, so each gets a copy.
+      if( roads.size() == nproj ) {
+	vector<Rvec_t> work( roads );
+	bmatch.Begin();
+	UInt_t nfound = BenchAccess::MatchRoads( tracker, work, gridmatch,
+						 combos, unique );
+	bmatch.End();
+	bmatch.AddWork( nfound );
+	if( nproj >= 3 and ncombos <= kMaxGenericCombos ) {
+	  work = roads;
+	  bgeneric.Begin();
+	  nfound = BenchAccess::MatchGeneric( tracker, work, (UInt_t)ncombos,
+					      combos, unique );
+	  bgeneric.End();
+	  bgeneric.AddWork( nfound );
+	}
+	if( fast3d ) {
+	  work = roads;
+	  bsorted.Begin();
+	  nfound = BenchAccess::MatchFast3D( tracker, work, false,
+					     combos, unique );
+	  bsorted.End();
+	  bsorted.AddWork( nfound );
+	  work = roads;
+	  bgrid.Begin();
+	  nfound = BenchAccess::MatchFast3D( tracker, work, true,
+					     combos, unique );
+	  bgrid.End();
+	  bgrid.AddWork( nfound );
+	}
+      }
+
+      // Rebuild the roads from the patterns found. This invalidates 'roads'.
+      for( EProjType t = kTypeBegin; t < kTypeEnd; ++t ) {
+	Projection* proj = tracker->GetProjection(t);
+	if( !proj or proj->GetNpatterns() == 0 or
+	    proj->GetTrackingStatus() == Projection::kTooManyPatterns )
+	  continue;
+	BenchAccess::ResetRoads( proj );
+	bmake.Begin();
+	proj->MakeRoads();
+	bmake.End();
+	bmake.AddWork( proj->GetNroads() );
+      }
+    }
+    TString params = Form( "\"tracker\":\"%s\",\"noise\":%g",
+			   spec.c_str(), kNoise[in] );
+    bfit.Write( params );
+    bmatch.Write( params );
+    bgeneric.Write( params );
+    if( fast3d ) {
+      bsorted.Write( params );
+      bgrid.Write( params );
+    }
+    bmake.Write( params );
+    const StageStats& stats = tracker->GetStageStats();
+    for( UInt_t k = 0; k < stats.GetNstages(); ++k ) {
+      if( !strcmp(stats.GetStageName(k), "deghost") )
+	WriteStage( os, "optimaln", params, stats, k );
+    }
+  }
+  BenchAccess::SetMaxExactPack( tracker, maxexact );
+  BenchAccess::SetGridMatch( tracker, gridmatch );
+}
+
+//_____________________________________________________________________________
+static void BenchRoadGrid( ostream& os, Tracker* tracker, const string& spec,
+			   UInt_t niter, UInt_t seed )
+{
+  // Scaling of fast 3D matching with the number of roads per projection,
+  // looking up the roads of the third projection by sorted front position
+  // (3d_gridmatch = 0) or in the road grid (3d_gridmatch = 1). The roads
+  // are those of n random tracks. The number of iterations is reduced for
+  // large n. Checks that both lookups find the same number of matches.
+
+  static const UInt_t nroads[] = { 10, 30, 100, 300, 1000 };
+  const UInt_t nsets = 8;  // Random sets of roads per configuration
+
+  if( !tracker->TestBit(Tracker::k3dFastMatch) ) {
+    cerr << "Skipping road grid benchmark: " << spec
+	 << " does not support fast 3D matching" << endl;
+    return;
+  }
+  vector<Projection*> proj;
+  for( EProjType t = kTypeBegin; t < kTypeEnd; ++t ) {
+    if( tracker->GetProjection(t) )
+      proj.push_back( tracker->GetProjection(t) );
+  }
+  EventGenerator gen( tracker, seed );
+  if( gen.Init() != 0 )
+    return;
+  Bool_t gridmatch = BenchAccess::SetGridMatch( tracker, true );
+  Combos_t combos;
+  Rset_t unique;
+  for( UInt_t ir = 0; ir < sizeof(nroads)/sizeof(nroads[0]); ++ir ) {
+    UInt_t n = nroads[ir];
+    Rvec_t allroads;
+    vector< vector<Rvec_t> > sets( nsets, vector<Rvec_t>(proj.size()) );
+    gen.SetNtracks( n );
+    for( UInt_t is = 0; is < nsets; ++is ) {
+      tracker->Clear();
+      gen.Generate();
+      const vector<EventGenerator::Track_t>& trk = gen.GetTracks();
+      for( vector<Projection*>::size_type ip = 0; ip < proj.size(); ++ip ) {
+	Double_t c = proj[ip]->GetCosAngle(), s = proj[ip]->GetSinAngle();
+	for( vector<EventGenerator::Track_t>::size_type it = 0;
+	     it < trk.size(); ++it ) {
+	  Road* rd = new Road( proj[ip] );
+	  BenchAccess::SetRoad( rd, trk[it].x*c + trk[it].y*s,
+				trk[it].xp*c + trk[it].yp*s );
+	  sets[is][ip].push_back( rd );
+	  allroads.push_back( rd );
+	}
+      }
+    }
+    UInt_t nit = TMath::Max( 1U, TMath::Min(niter, 10*niter/n) ), nbad = 0;
+    Bench bsorted( os, "match3d_sorted" ), bgrid( os, "match3d_grid" );
+    for( UInt_t i = 0; i < nit; ++i ) {
+      const vector<Rvec_t>& roads = sets[i%nsets];
+      vector<Rvec_t> work( roads );
+      bsorted.Begin();
+      UInt_t nsorted = BenchAccess::MatchFast3D( tracker, work, false,
+						 combos, unique );
+      bsorted.End();
+      bsorted.AddWork( nsorted );
+      work = roads;
+      bgrid.Begin();
+      UInt_t ngrid = BenchAccess::MatchFast3D( tracker, work, true,
+					       combos, unique );
+      bgrid.End();
+      bgrid.AddWork( ngrid );
+      if( ngrid != nsorted )
+	++nbad;
+    }
+    TString params = Form( "\"tracker\":\"%s\",\"roads\":%u",
+			   spec.c_str(), n );
+    bsorted.Write( params );
+    bgrid.Write( params );
+    Check( nbad == 0, Form("match3d roads=%u: grid and sorted lookup differ "
+			   "in %u of %u iterations", n, nbad, nit) );
+    DeleteContainer( allroads );
+  }
+  tracker->Clear();
+  BenchAccess::SetGridMatch( tracker, gridmatch );
+}
+
+//_____________________________________________________________________________
+static void BenchHitSort( ostream& os, TRandom3& rnd, Tracker* tracker,
+			  const string& spec, UInt_t niter, UInt_t seed )
+{
+  // Sorting of the decoded hits of each wire plane by wire number and drift
+  // time with WirePlane::CountingSortHits and with TClonesArray::Sort, as
+  // done for hits decoded out of order. The hits of synthetic events are
+  // shuffled before sorting. Checks that both sorts give the same order.
+
+  vector<WirePlane*> planes;
+  for( UInt_t k = 0; k < tracker->GetNplanes(); ++k ) {
+    WirePlane* pl = dynamic_cast<WirePlane*>( tracker->GetPlane(k) );
+    if( pl )
+      planes.push_back( pl );
+  }
+  if( planes.empty() ) {
+    cerr << "Skipping hit sort benchmark: " << spec
+	 << " has no wire planes" << endl;
+    return;
+  }
+  EventGenerator gen( tracker, seed );
+  if( gen.Init() != 0 )
+    return;
+  vector<WireHitData_t> hits;
+  vector< pair<Int_t,Double_t> > order;
+  for( UInt_t in = 0; in < kNnoise; ++in ) {
+    gen.SetNoise( kNoise[in] );
+    Bench bcount( os, "hitsort_counting" ), bquick( os, "hitsort_quick" );
+    UInt_t nbad = 0;
+    for( UInt_t i = 0; i < niter; ++i ) {
+      tracker->Clear();
+      gen.Generate();
+      tracker->DecodeHits( i );
+      for( vector<WirePlane*>::size_type k = 0; k < planes.size(); ++k ) {
+	WirePlane* pl = planes[k];
+	UInt_t nhits = pl->GetNhits();
+	if( nhits < 2 )
+	  continue;
+	hits.resize( nhits );
+	for( UInt_t j = 0; j < nhits; ++j ) {
+	  WireHit* hit = static_cast<WireHit*>( pl->GetHit(j) );
+	  hits[j].iw   = hit->GetWireNum();
+	  hits[j].data = static_cast<Int_t>( hit->GetRawTDC() );
+	  hits[j].time = hit->GetDriftTime();
+	}
+	for( UInt_t j = nhits-1; j > 0; --j )
+	  swap( hits[j], hits[rnd.Integer(j+1)] );
+
+	BenchAccess::SetHits( pl, hits );
+	bcount.Begin();
+	BenchAccess::CountingSortHits( pl );
+	bcount.End();
+	bcount.AddWork( nhits );
+	order.clear();
+	for( UInt_t j = 0; j < nhits; ++j ) {
+	  WireHit* hit = static_cast<WireHit*>( pl->GetHit(j) );
+	  order.push_back( make_pair(hit->GetWireNum(), hit->GetDriftTime()) );
+	}
+
+	BenchAccess::SetHits( pl, hits );
+	bquick.Begin();
+	BenchAccess::QuickSortHits( pl );
+	bquick.End();
+	bquick.AddWork( nhits );
+	for( UInt_t j = 0; j < nhits; ++j ) {
+	  WireHit* hit = static_cast<WireHit*>( pl->GetHit(j) );
+	  if( hit->GetWireNum() != order[j].first or
+	      hit->GetDriftTime() != order[j].second ) {
+	    ++nbad;
+	    break;
+	  }
+	}
+      }
+    }
+    TString params = Form( "\"tracker\":\"%s\",\"noise\":%g",
+			   spec.c_str(), kNoise[in] );
+    bcount.Write( params );
+    bquick.Write( params );
+    Check( nbad == 0, Form("hitsort noise=%g: counting sort and quicksort "
+			   "differ in %u planes", kNoise[in], nbad) );
+  }
+  tracker->Clear();
+}
+
+//_____________________________________________________________________________
+static void BenchGEMDecode( ostream& os, TRandom3& rnd, Tracker* tracker,
+			    const string& spec, UInt_t niter )
+{
+  // Strip analysis and clustering of GEMPlane::GEMDecode (deconvolution,
+  // pedestal and common-mode correction, cluster finding, time window) on
+  // synthetic strip data: each cluster is three adjacent strips with
+  // CR-RC pulses of amplitudes A/2, A, A/2 starting at a random time t0
+  // across the range that can be resolved. Checks that exactly the
+  // clusters within the plane's time window become hits, at the position
+  // of the center strip and with leading-edge time t0, and that the others
+  // are counted as rejected. The pulse shape test is disabled, since it
+  // would also reject pulses starting before or well after the first
+  // sample.
+
+  // Strips per cluster slot. Clusters are at least 5 strips apart.
+  const Int_t kSlot = 8;
+
+  vector<GEMPlane*> planes;
+  for( UInt_t k = 0; k < tracker->GetNplanes(); ++k ) {
+    GEMPlane* pl = dynamic_cast<GEMPlane*>( tracker->GetPlane(k) );
+    if( pl and !pl->IsDummy() and pl->GetNelem() >= kSlot )
+      planes.push_back( pl );
+  }
+  if( planes.empty() ) {
+    cerr << "Skipping GEM decoding benchmark: " << spec
+	 << " has no GEM planes" << endl;
+    return;
+  }
+  tracker->Clear();
+  vector<Int_t> strips, slots;
+  vector<Float_t> samp;
+  vector< pair<Int_t,Double_t> > clust;  // Center strip and t0 of clusters
+  for( UInt_t io = 0; io < kNocc; ++io ) {
+    Bench b( os, "gemdecode" );
+    UInt_t nbad = 0;
+    for( vector<GEMPlane*>::size_type k = 0; k < planes.size(); ++k ) {
+      GEMPlane* pl = planes[k];
+      Bool_t shape = BenchAccess::SetCheckPulseShape( pl, false );
+      UInt_t ns;
+      Double_t dt, tp, amin, tmin, tmax;
+      BenchAccess::GetStripParam( pl, ns, dt, tp, amin, tmin, tmax );
+      if( amin <= 0 )
+	amin = 10;
+      // Leading-edge times that can be measured. Single samples carry no
+      // timing, so they are taken at the peak of the pulse.
+      Double_t tlo = ( ns > 1 ) ? 1.0-dt : -tp;
+      Double_t thi = ( ns > 1 ) ? (ns-2)*dt : -tp;
+      UInt_t nslot = pl->GetNelem()/kSlot;
+      UInt_t nclust = TMath::Min( kOccupancies[io], nslot );
+      slots.resize( nslot );
+      for( UInt_t j = 0; j < nslot; ++j )
+	slots[j] = j;
+      for( UInt_t i = 0; i < niter; ++i ) {
+	// Draw nclust distinct slots and cluster times, avoiding the edges
+	// of the time window, where rounding decides
+	clust.clear();
+	strips.clear();
+	samp.clear();
+	UInt_t nin = 0;
+	for( UInt_t j = 0; j < nclust; ++j ) {
+	  swap( slots[j], slots[j+rnd.Integer(nslot-j)] );
+	  Double_t t0;
+	  do {
+	    t0 = rnd.Uniform( tlo, thi );
+	  } while( ns > 1 and
+		   (TMath::Abs(t0-tmin) < 1 or TMath::Abs(t0-tmax) < 1) );
+	  Int_t center = slots[j]*kSlot + kSlot/2;
+	  if( ns < 2 or (t0 >= tmin and t0 <= tmax) ) {
+	    clust.push_back( make_pair(center, t0) );
+	    ++nin;
+	  }
+	  Double_t A = rnd.Uniform( 20, 100 )*amin;
+	  for( Int_t is = -1; is <= 1; ++is ) {
+	    strips.push_back( center+is );
+	    Double_t a = ( is == 0 ) ? A : 0.5*A;
+	    for( UInt_t js = 0; js < ns; ++js ) {
+	      Double_t t = (js*dt - t0)/tp;
+	      samp.push_back( ( t > 0 ) ? a*t*TMath::Exp(1-t) : 0 );
+	    }
+	  }
+	}
+	sort( clust.begin(), clust.end() );
+
+	b.Begin();
+	Int_t nhits = BenchAccess::DecodeStrips( pl, strips, samp, ns );
+	b.End();
+	b.AddWork( nhits );
+
+	bool good = ( nhits == static_cast<Int_t>(nin) and
+		      BenchAccess::GetNtimeRej(pl) == nclust-nin );
+	for( Int_t j = 0; good and j < nhits; ++j ) {
+	  GEMHit* hit = static_cast<GEMHit*>( pl->GetHit(j) );
+	  Double_t pos = pl->GetStart() + clust[j].first*pl->GetPitch();
+	  Double_t t0 = clust[j].second;
+	  good = ( TMath::Abs(hit->GetPos()-pos) < 0.01*pl->GetPitch() and
+		   (ns < 2 or TMath::Abs(hit->GetTime()-t0) < 0.5) );
+	}
+	if( !good )
+	  ++nbad;
+      }
+      pl->Clear();
+      BenchAccess::SetCheckPulseShape( pl, shape );
+    }
+    b.Write( Form("\"tracker\":\"%s\",\"clusters\":%u", spec.c_str(),
+		  kOccupancies[io]) );
+    Check( nbad == 0, Form("gemdecode clusters=%u: wrong hits in %u "
+			   "events", kOccupancies[io], nbad) );
+  }
+  tracker->Clear();
+}
+
+//_____________________________________________________________________________
+static void Usage()
+{
+  cerr << "Usage: tsbench [-o file] [-n niter] [-s seed] [-b name] "
+       << "[-e type:name]" << endl
+       << "  -o file   write results to file instead of stdout" << endl
+       << "  -n niter  iterations per configuration (default 2000)" << endl
+       << "  -s seed   random seed (default 4357)" << endl
+       << "  -b name   run only the named benchmark group: hitpattern, "
+       << "treewalk," << endl
+       << "            fit4, ttd, hitpairs, deconv, tracking, stages, "
+       << "roadgrid, hitsort," << endl
+       << "            gemdecode" << endl
+       << "  -e type:name  tracker for the tracking, stages, roadgrid, "
+       << "hitsort and" << endl
+       << "            gemdecode benchmarks, type = mwdc or gem" << endl;
+}
+
+//_____________________________________________________________________________
+int main( int argc, char** argv )
+{
+  UInt_t niter = 2000, seed = 4357;
+  const char* outfile = 0;
+  string only, spec;
+  int opt;
+  while( (opt = getopt(argc, argv, "o:n:s:b:e:h")) != -1 ) {
+    switch( opt ) {
+    case 'o': outfile = optarg; break;
+    case 'n': niter = atoi(optarg); break;
+    case 's': seed  = atoi(optarg); break;
+    case 'b': only  = optarg; break;
+    case 'e': spec  = optarg; break;
+    default:  Usage(); return 1;
+    }
+  }
+  if( niter == 0 ) {
+    Usage();
+    return 1;
+  }
+  ofstream ofs;
+  if( outfile ) {
+    ofs.open( outfile );
+    if( !ofs ) {
+      cerr << "Cannot open output file " << outfile << endl;
+      return 2;
+    }
+  }
+  ostream& os = outfile ? ofs : cout;
+
+  TRandom3 rnd( seed );
+  if( only.empty() or only == "hitpattern" )
+    BenchHitpattern( os, rnd, niter );
+  if( only.empty() or only == "treewalk" )
+    BenchTreeWalk( os, rnd, niter );
+  if( only.empty() or only == "fit4" )
+    BenchFit4( os, rnd, niter );
+  if( only.empty() or only == "ttd" )
+    BenchTimeToDist( os, rnd, niter );
+  if( only.empty() or only == "hitpairs" )
+    BenchHitPairs( os, rnd, niter );
+  if( only.empty() or only == "deconv" )
+    BenchDeconv( os, rnd, niter );
+  if( !spec.empty() and
+      (only.empty() or only == "tracking" or only == "stages" or
+       only == "roadgrid" or only == "hitsort" or only == "gemdecode") ) {
+    Tracker* tracker = MakeTracker( spec );
+    if( !tracker )
+      return 2;
+    if( only.empty() or only == "tracking" )
+      BenchTracking( os, tracker, spec, niter, seed );
+    if( only.empty() or only == "stages" )
+      BenchStages( os, tracker, spec, niter, seed );
+    if( only.empty() or only == "roadgrid" )
+      BenchRoadGrid( os, tracker, spec, niter, seed );
+    if( only.empty() or only == "hitsort" )
+      BenchHitSort( os, rnd, tracker, spec, niter, seed );
+    if( only.empty() or only == "gemdecode" )
+      BenchGEMDecode( os, rnd, tracker, spec, niter );
+    delete tracker;
+  }
+
+  if( gNfail > 0 ) {
+    cerr << gNfail << " check(s) failed" << endl;
+    return 3;
+  }
+  return 0;
+}